@@ -101,7 +101,6 @@ static void parse_mb2(void* info, int from_uefi) {
         for (const mb2_tag* t = tag; (const uint8_t*)t < base + total_size && t->type != MB2_TAG_END; t = mb2_next_tag(t)) {
             if (t->type == MB2_TAG_BASIC_MEMINFO) {
                 const mb2_tag_basic_meminfo* bi = (const mb2_tag_basic_meminfo*)t;
-                uint64_t lower = (uint64_t)bi->mem_lower * 1024ULL;
                 uint64_t upper = (uint64_t)bi->mem_upper * 1024ULL;
                 // Treat only upper memory (above 1MiB) as usable; cap via add_region
                 if (upper > 0) {
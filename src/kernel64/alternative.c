@@ -0,0 +1,46 @@
+// Boot-time instruction patching: alternatives and static keys
+#include <stdint.h>
+#include "alternative.h"
+#include "cpuid.h"
+
+extern const alt_entry_t __alt_table_start[];
+extern const alt_entry_t __alt_table_end[];
+
+static const uint8_t k_nop5[5] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+
+void text_poke(void* site, const void* bytes, uint32_t len) {
+    // Byte loop rather than memcpy: memcpy itself is a patch site.
+    volatile uint8_t* d = (volatile uint8_t*)site;
+    const uint8_t* s = (const uint8_t*)bytes;
+    for (uint32_t i = 0; i < len; ++i) d[i] = s[i];
+    // Kernel text is mapped RW; cpuid serializes so the new bytes are fetched
+    (void)cpuid(0, 0);
+}
+
+static int alt_wanted(uint16_t feature) {
+    int has = cpu_has(feature & ~ALT_NOT);
+    return (feature & ALT_NOT) ? !has : has;
+}
+
+int alternatives_apply(void) {
+    int applied = 0;
+    for (const alt_entry_t* a = __alt_table_start; a < __alt_table_end; ++a) {
+        if (a->len != 5 || !alt_wanted(a->feature)) continue;
+        uint8_t* site = (uint8_t*)&a->site + a->site;
+        uint8_t* target = (uint8_t*)&a->target + a->target;
+        uint8_t insn[5];
+        if (a->kind == ALT_KIND_NOP) {
+            for (int i = 0; i < 5; ++i) insn[i] = k_nop5[i];
+        } else if (a->kind == ALT_KIND_JMP || a->kind == ALT_KIND_CALL) {
+            int32_t rel = (int32_t)(target - (site + 5));
+            insn[0] = (a->kind == ALT_KIND_JMP) ? 0xE9 : 0xE8;
+            insn[1] = (uint8_t)rel; insn[2] = (uint8_t)(rel >> 8);
+            insn[3] = (uint8_t)(rel >> 16); insn[4] = (uint8_t)(rel >> 24);
+        } else {
+            continue;
+        }
+        text_poke(site, insn, 5);
+        ++applied;
+    }
+    return applied;
+}
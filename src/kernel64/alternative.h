@@ -0,0 +1,51 @@
+#pragma once
+
+// Boot-time code patching keyed on CPU features ("alternatives").
+// Each .altinstructions entry names a 5-byte patch site and, when its
+// feature test passes, retargets the rel32 jmp/call there or overwrites it
+// with a NOP. Offsets are PC-relative so the flat image needs no relocation.
+// Entries are applied in link order: for one site, list the generic choice
+// first and the most preferred last.
+
+#include "cpufeature.h"
+
+#define ALT_KIND_JMP  1
+#define ALT_KIND_CALL 2
+#define ALT_KIND_NOP  3
+#define ALT_NOT       0x8000   // feature flag: apply when the feature is absent
+
+#ifdef __ASSEMBLER__
+
+// jmp rel32 that the assembler cannot relax into a short jump
+.macro JMP32 target
+    .byte 0xE9
+    .long \target - . - 4
+.endm
+
+.macro ALTERNATIVE site, feature, kind, target
+    .pushsection .altinstructions, "a"
+    .balign 4
+    .long \site - .
+    .long \target - .
+    .word \feature
+    .byte 5, \kind
+    .popsection
+.endm
+
+#else
+#include <stdint.h>
+
+typedef struct {
+    int32_t site;      // patch site, relative to this field
+    int32_t target;    // new jmp/call target, relative to this field
+    uint16_t feature;  // X86_FEATURE_* | ALT_NOT
+    uint8_t len;       // bytes at the site (5)
+    uint8_t kind;      // ALT_KIND_*
+} alt_entry_t;
+
+// Apply every entry whose feature test passes; returns the number applied.
+// Call once after cpu_features_init().
+int alternatives_apply(void);
+// Overwrite code bytes and serialize instruction fetch
+void text_poke(void* site, const void* bytes, uint32_t len);
+#endif
@@ -0,0 +1,499 @@
+// In-kernel benchmark suite: TSC-timed memory, allocator, scheduler, block,
+// filesystem, disk and RAID measurements in a stable key=value format (shell 'bench')
+#include <stdint.h>
+#include <stddef.h>
+#include "bench.h"
+#include "tsc.h"
+#include "console.h"
+#include "lib/mem.h"
+#include "sched/sched.h"
+#include "sched/async.h"
+#include "block/block.h"
+#include "block/raid.h"
+#include "block/tier.h"
+#include "block/crypt.h"
+#include "block/integ.h"
+#include "lib/crc32c.h"
+#include "lib/aes.h"
+#include "vfs/vfs.h"
+#include "fs/exfat.h"
+#include "../kernel/mm/pmm.h"
+#include "../kernel/mm/kmalloc.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec);
+
+#define BENCH_RUNS      3                     // report the best of N runs
+#define BENCH_BUF_BYTES (1024u * 1024u)
+#define BENCH_DISK_BYTES (4u * 1024u * 1024u)
+#define BENCH_FILE_BYTES (1024u * 1024u)
+
+static uint64_t s_khz;
+
+void bench_kv(const char* key, uint64_t value) {
+    console_write(key); console_putc('='); console_write_dec(value); console_putc('\n');
+}
+
+static void key_cat(char* out, const char* a, const char* b) {
+    int n = 0;
+    while (*a && n < 47) out[n++] = *a++;
+    while (*b && n < 47) out[n++] = *b++;
+    out[n] = 0;
+}
+
+void bench_rate(const char* key, uint64_t bytes, uint64_t cycles) {
+    char k[48];
+    if (cycles == 0) cycles = 1;
+    if (s_khz) { key_cat(k, key, "_mbps"); bench_kv(k, bytes * s_khz / cycles / 1000ULL); }
+    else { key_cat(k, key, "_bpkc"); bench_kv(k, bytes * 1000ULL / cycles); }
+}
+
+static uint64_t min_u64(uint64_t a, uint64_t b) { return a < b ? a : b; }
+
+// ---- mem: active memcpy/memset variant at small, medium and bulk sizes ----
+
+static void bench_mem(void) {
+    uint64_t pages = BENCH_BUF_BYTES / PMM_FRAME_SIZE;
+    uint64_t src = pmm_alloc_frames_below((size_t)pages, 1ULL<<32);
+    uint64_t dst = pmm_alloc_frames_below((size_t)pages, 1ULL<<32);
+    if (!src || !dst) {
+        if (src) pmm_free_frames(src, (size_t)pages);
+        bench_kv("mem_error", 1);
+        return;
+    }
+    uint8_t* s = (uint8_t*)(uintptr_t)src;
+    uint8_t* d = (uint8_t*)(uintptr_t)dst;
+    memset(s, 0x5A, BENCH_BUF_BYTES);
+    static const uint32_t sizes[3] = { 64, 4096, BENCH_BUF_BYTES };
+    static const char* const names[2][3] = {
+        { "memcpy_64", "memcpy_4k", "memcpy_1m" },
+        { "memset_64", "memset_4k", "memset_1m" },
+    };
+    for (int op = 0; op < 2; ++op) {
+        for (int i = 0; i < 3; ++i) {
+            uint32_t size = sizes[i];
+            uint32_t reps = (8u * 1024u * 1024u) / size;
+            uint64_t best = ~0ULL;
+            for (int r = 0; r < BENCH_RUNS; ++r) {
+                uint64_t t0 = rdtsc_ordered();
+                if (op == 0) { for (uint32_t k = 0; k < reps; ++k) memcpy(d, s, size); }
+                else { for (uint32_t k = 0; k < reps; ++k) memset(d, (int)k, size); }
+                best = min_u64(best, rdtsc_ordered() - t0);
+            }
+            bench_rate(names[op][i], (uint64_t)reps * size, best);
+        }
+    }
+    pmm_free_frames(src, (size_t)pages);
+    pmm_free_frames(dst, (size_t)pages);
+}
+
+// ---- alloc: kmalloc/kfree and PMM frame alloc/free round trips ----
+
+static void bench_alloc(void) {
+    const uint32_t iters = 10000;
+    static const uint32_t ksizes[2] = { 32, 512 };
+    static const char* const knames[2] = { "kmalloc_free_32_cyc", "kmalloc_free_512_cyc" };
+    for (int i = 0; i < 2; ++i) {
+        uint64_t best = ~0ULL;
+        for (int r = 0; r < BENCH_RUNS; ++r) {
+            uint64_t t0 = rdtsc_ordered();
+            for (uint32_t k = 0; k < iters; ++k) kfree(kmalloc(ksizes[i]));
+            best = min_u64(best, rdtsc_ordered() - t0);
+        }
+        bench_kv(knames[i], best / iters);
+    }
+    static const uint32_t frames[2] = { 1, 16 };
+    static const char* const pnames[2] = { "pmm_alloc_free_1_cyc", "pmm_alloc_free_16_cyc" };
+    for (int i = 0; i < 2; ++i) {
+        uint64_t best = ~0ULL;
+        for (int r = 0; r < BENCH_RUNS; ++r) {
+            uint64_t t0 = rdtsc_ordered();
+            for (uint32_t k = 0; k < iters / 10; ++k) {
+                uint64_t p = pmm_alloc_frames(frames[i]);
+                pmm_free_frames(p, frames[i]);
+            }
+            best = min_u64(best, rdtsc_ordered() - t0);
+        }
+        bench_kv(pnames[i], best / (iters / 10));
+    }
+}
+
+// ---- sched: cost of one sched_yield() switch between kernel threads ----
+
+static volatile int s_spin_stop;
+
+static void spin_thread(void* arg) {
+    (void)arg;
+    while (!s_spin_stop) sched_yield();
+}
+
+static void bench_sched(void) {
+    const uint32_t iters = 20000;
+    s_spin_stop = 0;
+    if (sched_create(spin_thread, NULL) != 0) { bench_kv("sched_error", 1); return; }
+    sched_yield();  // let the partner start
+    uint64_t sw0 = sched_switch_count();
+    uint64_t t0 = rdtsc_ordered();
+    for (uint32_t k = 0; k < iters; ++k) sched_yield();
+    uint64_t t1 = rdtsc_ordered();
+    uint64_t switches = sched_switch_count() - sw0;
+    s_spin_stop = 1;
+    sched_yield();
+    bench_kv("ctxsw_cyc", (t1 - t0) / (switches ? switches : 1));
+}
+
+// ---- block: sequential ramdisk reads/writes through the ops table, 512-byte
+// and 4 KiB sectors ----
+
+static block_device_t* bench_disk(const char* name) {
+    block_device_t* d = block_find(name);
+    if (!d && ramdisk_create(name, BENCH_DISK_BYTES) == 0) d = block_find(name);
+    return d;
+}
+
+// Whole-device passes of 4 KiB and 64 KiB requests straight to the driver
+static void bench_block_dev(block_device_t* d, const char* key, uint8_t* b) {
+    static const uint32_t sizes[2] = { 4096, 65536 };
+    char k[48];
+    for (int w = 0; w < 2; ++w) {
+        for (int i = 0; i < 2; ++i) {
+            uint32_t secs = sizes[i] / d->sector_size;
+            uint64_t total = d->sector_count / secs;
+            uint64_t best = ~0ULL;
+            for (int r = 0; r < BENCH_RUNS; ++r) {
+                uint64_t t0 = rdtsc_ordered();
+                for (uint64_t n = 0; n < total; ++n) {
+                    if (w) d->ops->write(d, n * secs, b, secs); else d->ops->read(d, n * secs, b, secs);
+                }
+                best = min_u64(best, rdtsc_ordered() - t0);
+            }
+            key_cat(k, key, w ? (i ? "_write_64k" : "_write_4k") : (i ? "_read_64k" : "_read_4k"));
+            bench_rate(k, total * sizes[i], best);
+        }
+    }
+}
+
+// The same on a 512-byte-sector ramdisk and on a 4Kn one (8x fewer sectors
+// per request)
+static void bench_block(void) {
+    block_device_t* d = bench_disk("bench0");
+    uint64_t buf = pmm_alloc_frames_below(16, 1ULL<<32);
+    if (!d || !buf) { if (buf) pmm_free_frames(buf, 16); bench_kv("block_error", 1); return; }
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    bench_block_dev(d, "blk", b);
+    block_device_t* d4 = block_find("bench4k");
+    if (!d4 && ramdisk_create_sec("bench4k", BENCH_DISK_BYTES, 4096) == 0) d4 = block_find("bench4k");
+    if (d4) bench_block_dev(d4, "blk4kn", b);
+    else bench_kv("blk4kn_error", 1);
+    pmm_free_frames(buf, 16);
+}
+
+// ---- disk: random 4 KiB reads at QD1/QD32 (blocking, and from async tasks)
+// and sequential 128 KiB reads on devices with hardware queues (ops->submit),
+// through the block queue ----
+
+#define BENCH_DISK_IOS 2048
+#define BENCH_QD       32
+
+static uint64_t s_rng = 0x9E3779B97F4A7C15ULL;
+static uint64_t bench_rand(void) { s_rng ^= s_rng << 13; s_rng ^= s_rng >> 7; s_rng ^= s_rng << 17; return s_rng; }
+
+static void bench_iops(const char* key, uint64_t ios, uint64_t cycles) {
+    char k[48];
+    if (cycles == 0) cycles = 1;
+    if (s_khz) { key_cat(k, key, "_iops"); bench_kv(k, ios * s_khz * 1000ULL / cycles); }
+    else { key_cat(k, key, "_cyc"); bench_kv(k, cycles / (ios ? ios : 1)); }
+}
+
+// QD32 again, but as 32 async tasks each awaiting one bio at a time
+static async_bio_t s_abio[BENCH_QD];
+static block_device_t* s_adev;
+static uint64_t s_ablocks;
+static uint8_t* s_abuf;
+static int s_adone, s_aerr;
+
+static async_status_t bench_async_reader(async_task_t* t) {
+    async_bio_t* ab = &s_abio[t->local[0]];
+    uint32_t spb = 4096 / s_adev->sector_size;
+    ASYNC_BEGIN(t);
+    while (t->local[1]) {
+        t->local[1]--;
+        bio_init(&ab->bio, s_adev, BIO_READ, (bench_rand() % s_ablocks) * spb, s_abuf + t->local[0] * 4096, spb);
+        async_bio_submit(ab);
+        ASYNC_AWAIT(t, &ab->fut);
+        if (ab->fut.result != 0) s_aerr = 1;
+    }
+    s_adone++;
+    ASYNC_END(t);
+}
+
+static uint64_t bench_async_qd(block_device_t* d, uint64_t blocks, uint8_t* buf) {
+    s_adev = d; s_ablocks = blocks; s_abuf = buf; s_adone = 0;
+    int n = 0;
+    uint64_t t0 = rdtsc_ordered();
+    for (; n < BENCH_QD; ++n) {
+        async_task_t* t = async_spawn(bench_async_reader, NULL);
+        if (!t) { s_aerr = 1; break; }
+        t->local[0] = (uint64_t)n; t->local[1] = BENCH_DISK_IOS / BENCH_QD;
+    }
+    while (s_adone < n) if (async_run_once() == 0) sched_yield();
+    return rdtsc_ordered() - t0;
+}
+
+static void bench_disk_dev(block_device_t* d, uint8_t* buf) {
+    uint32_t spb = 4096 / d->sector_size;          // sectors per 4 KiB block
+    uint64_t blocks = d->sector_count / spb;
+    if (blocks > 262144) blocks = 262144;          // first GiB keeps it cache-comparable
+    if (blocks < BENCH_QD) return;
+    char k[48];
+    static bio_t bios[BENCH_QD];
+    uint64_t best1 = ~0ULL, best32 = ~0ULL, besta = ~0ULL, bests = ~0ULL;
+    int err = 0;
+    s_aerr = 0;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        for (uint32_t i = 0; i < BENCH_DISK_IOS; ++i)
+            if (block_read(d, (bench_rand() % blocks) * spb, buf, spb) != (int)spb) err = 1;
+        uint64_t t1 = rdtsc_ordered();
+        for (uint32_t i = 0; i < BENCH_DISK_IOS; i += BENCH_QD) {
+            for (int q = 0; q < BENCH_QD; ++q) {
+                bio_init(&bios[q], d, BIO_READ, (bench_rand() % blocks) * spb, buf + q * 4096, spb);
+                block_submit(&bios[q]);
+            }
+            for (int q = 0; q < BENCH_QD; ++q) if (block_wait(&bios[q]) != 0) err = 1;
+        }
+        uint64_t t2 = rdtsc_ordered();
+        uint64_t seq = blocks / 32;                // 128 KiB requests
+        for (uint64_t i = 0; i < seq; ++i)
+            if (block_read(d, i * 32 * spb, buf, 32 * spb) != (int)(32 * spb)) err = 1;
+        uint64_t t3 = rdtsc_ordered();
+        best1 = min_u64(best1, t1 - t0);
+        best32 = min_u64(best32, t2 - t1);
+        besta = min_u64(besta, bench_async_qd(d, blocks, buf));
+        bests = min_u64(bests, t3 - t2);
+    }
+    key_cat(k, d->name, "_rand4k_qd1"); bench_iops(k, BENCH_DISK_IOS, best1);
+    key_cat(k, d->name, "_rand4k_qd32"); bench_iops(k, BENCH_DISK_IOS, best32);
+    key_cat(k, d->name, "_rand4k_async32"); bench_iops(k, BENCH_DISK_IOS, besta);
+    key_cat(k, d->name, "_seq128k"); bench_rate(k, (blocks / 32) * 131072ULL, bests);
+    if (err || s_aerr) { key_cat(k, d->name, "_error"); bench_kv(k, 1); }
+}
+
+static void bench_hw_disks(void) {
+    uint64_t buf = pmm_alloc_frames_below(BENCH_QD, 1ULL<<32);
+    if (!buf) { bench_kv("disk_error", 1); return; }
+    for (block_device_t* d = block_first(); d; d = block_next(d))
+        if (d->ops && d->ops->submit && d->sector_size <= 4096) bench_disk_dev(d, (uint8_t*)(uintptr_t)buf);
+    pmm_free_frames(buf, BENCH_QD);
+}
+
+// ---- raid: sequential 256 KiB requests on a ramdisk, and on RAID0/RAID1
+// arrays of two such ramdisks; arrays the user built (e.g. over virtio
+// disks) are measured read-only ----
+
+#define BENCH_RAID_REQ (256u * 1024u)
+
+static uint64_t bench_seq(block_device_t* d, int write, uint8_t* buf) {
+    uint32_t secs = BENCH_RAID_REQ / d->sector_size;
+    uint64_t total = d->sector_count / secs;
+    if (total > 64) total = 64;                    // 16 MiB per run at most
+    uint64_t best = ~0ULL;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        for (uint64_t k = 0; k < total; ++k) {
+            if (write) block_write(d, k * secs, buf, secs); else block_read(d, k * secs, buf, secs);
+        }
+        best = min_u64(best, rdtsc_ordered() - t0);
+    }
+    return best ? best : 1;
+}
+
+static uint64_t bench_seq_bytes(block_device_t* d) {
+    uint64_t total = d->sector_count / (BENCH_RAID_REQ / d->sector_size);
+    return (total > 64 ? 64 : total) * BENCH_RAID_REQ;
+}
+
+static void bench_raid_dev(block_device_t* d, const char* key, int write, uint8_t* buf) {
+    char k[48];
+    key_cat(k, key, "_read_256k"); bench_rate(k, bench_seq_bytes(d), bench_seq(d, 0, buf));
+    if (write) { key_cat(k, key, "_write_256k"); bench_rate(k, bench_seq_bytes(d), bench_seq(d, 1, buf)); }
+}
+
+static void bench_raid(void) {
+    uint64_t buf = pmm_alloc_frames_below(BENCH_RAID_REQ / PMM_FRAME_SIZE, 1ULL<<32);
+    block_device_t* m0 = bench_disk("benchr0");
+    block_device_t* m1 = bench_disk("benchr1");
+    if (!buf || !m0 || !m1) { if (buf) pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); bench_kv("raid_error", 1); return; }
+    const char* members[2];
+    members[0] = "benchr0"; members[1] = "benchr1";
+    if (!block_find("benchs")) (void)raid_create("benchs", 0, 0, members, 2);
+    if (!block_find("benchm")) (void)raid_create("benchm", 1, 0, members, 2);
+    block_device_t* s0 = block_find("benchs");
+    block_device_t* s1 = block_find("benchm");
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    memset(b, 0x3C, BENCH_RAID_REQ);
+    bench_raid_dev(m0, "raid_member", 1, b);
+    if (s0) bench_raid_dev(s0, "raid0", 1, b); else bench_kv("raid0_error", 1);
+    if (s1) bench_raid_dev(s1, "raid1", 1, b); else bench_kv("raid1_error", 1);
+    raid_stats_t st;
+    for (block_device_t* d = block_first(); d; d = block_next(d))
+        if (d != s0 && d != s1 && raid_get_stats(d->name, &st) == 0) bench_raid_dev(d, d->name, 0, b);
+    pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE);
+}
+
+// ---- tier: 256 KiB reads of a ramdisk directly and through a tier cache
+// on a second ramdisk, once all hits and once bypassed as sequential ----
+
+static void bench_tier(void) {
+    uint64_t buf = pmm_alloc_frames_below(BENCH_RAID_REQ / PMM_FRAME_SIZE, 1ULL<<32);
+    block_device_t* o = bench_disk("benchto");
+    block_device_t* c = bench_disk("benchtc");
+    if (!buf || !o || !c) { if (buf) pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); bench_kv("tier_error", 1); return; }
+    if (!block_find("bencht")) (void)tier_create("bencht", "benchto", "benchtc", TIER_WRITETHROUGH);
+    block_device_t* t = block_find("bencht");
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    if (!t) { pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); bench_kv("tier_error", 1); return; }
+    // The cache holds a little less than the origin; time the part that fits
+    uint64_t bytes = bench_seq_bytes(o) / 2;
+    uint32_t secs = BENCH_RAID_REQ / t->sector_size;
+    (void)tier_set_policy("bencht", TIER_WRITETHROUGH, 0);
+    for (uint64_t k = 0; k < bytes / BENCH_RAID_REQ; ++k) block_read(t, k * secs, b, secs);
+    uint64_t best_o = ~0ULL, best_h = ~0ULL, best_b = ~0ULL;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        for (uint64_t k = 0; k < bytes / BENCH_RAID_REQ; ++k) block_read(o, k * secs, b, secs);
+        uint64_t t1 = rdtsc_ordered();
+        for (uint64_t k = 0; k < bytes / BENCH_RAID_REQ; ++k) block_read(t, k * secs, b, secs);
+        best_o = min_u64(best_o, t1 - t0);
+        best_h = min_u64(best_h, rdtsc_ordered() - t1);
+    }
+    (void)tier_set_policy("bencht", TIER_WRITETHROUGH, 1);
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        for (uint64_t k = 0; k < bytes / BENCH_RAID_REQ; ++k) block_read(t, (bytes / BENCH_RAID_REQ + k) * secs, b, secs);
+        best_b = min_u64(best_b, rdtsc_ordered() - t0);
+    }
+    (void)tier_set_policy("bencht", TIER_WRITETHROUGH, TIER_SEQ_CUTOFF);
+    bench_rate("tier_origin_read_256k", bytes, best_o ? best_o : 1);
+    bench_rate("tier_hit_read_256k", bytes, best_h ? best_h : 1);
+    bench_rate("tier_bypass_read_256k", bytes, best_b ? best_b : 1);
+    tier_stats_t st;
+    if (tier_get_stats("bencht", &st) == 0) bench_kv("tier_read_hits", st.read_hits);
+    pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE);
+}
+
+// ---- crypt: 256 KiB requests on a ramdisk, and through XTS-AES-256 over
+// it with AES-NI (when the CPU has it) and with the portable tables ----
+
+static void bench_crypt(void) {
+    uint64_t buf = pmm_alloc_frames_below(BENCH_RAID_REQ / PMM_FRAME_SIZE, 1ULL<<32);
+    block_device_t* base = bench_disk("benchc0");
+    if (!buf || !base) { if (buf) pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); bench_kv("crypt_error", 1); return; }
+    if (!block_find("benchc")) {
+        uint8_t key[64];
+        for (int i = 0; i < 64; ++i) key[i] = (uint8_t)(i * 37 + 1);
+        (void)crypt_create("benchc", "benchc0", key, sizeof(key));
+    }
+    block_device_t* c = block_find("benchc");
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    memset(b, 0x5A, BENCH_RAID_REQ);
+    bench_raid_dev(base, "crypt_raw", 1, b);
+    if (!c) { bench_kv("crypt_error", 1); pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); return; }
+    int hw = aes_hw();
+    bench_kv("crypt_aesni", (uint64_t)hw);
+    if (hw) bench_raid_dev(c, "crypt_aesni", 1, b);
+    aes_use_hw(0);
+    bench_raid_dev(c, "crypt_soft", 1, b);
+    aes_use_hw(1);
+    pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE);
+}
+
+// ---- integ: CRC32C of 256 KiB with SSE4.2 and with the tables, then
+// 256 KiB requests on a ramdisk and through an integrity device over it ----
+
+static void bench_crc(const uint8_t* b, const char* key) {
+    uint64_t best = ~0ULL;
+    volatile uint32_t sink = 0;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        sink = crc32c(sink, b, BENCH_RAID_REQ);
+        best = min_u64(best, rdtsc_ordered() - t0);
+    }
+    bench_rate(key, BENCH_RAID_REQ, best ? best : 1);
+}
+
+static void bench_integ(void) {
+    uint64_t buf = pmm_alloc_frames_below(BENCH_RAID_REQ / PMM_FRAME_SIZE, 1ULL<<32);
+    block_device_t* base = bench_disk("benchi0");
+    if (!buf || !base) { if (buf) pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE); bench_kv("integ_error", 1); return; }
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    memset(b, 0x5A, BENCH_RAID_REQ);
+    int hw = crc32c_hw();
+    bench_kv("crc32c_sse42", (uint64_t)hw);
+    if (hw) bench_crc(b, "crc32c_sse42_256k");
+    crc32c_use_hw(0);
+    bench_crc(b, "crc32c_soft_256k");
+    crc32c_use_hw(1);
+    if (!block_find("benchi")) (void)integ_create("benchi", "benchi0");
+    block_device_t* d = block_find("benchi");
+    bench_raid_dev(base, "integ_raw", 1, b);
+    if (d) bench_raid_dev(d, "integ", 1, b);
+    else bench_kv("integ_error", 1);
+    pmm_free_frames(buf, BENCH_RAID_REQ / PMM_FRAME_SIZE);
+}
+
+// ---- fs: exFAT file write/read on a dedicated ramdisk ----
+
+static int bench_fs_setup(void) {
+    if (vfs_has_mount("bench")) return 0;
+    if (!bench_disk("bench1")) return -1;
+    if (exfat_format_device("bench1", "BENCH") != 0) return -1;
+    if (vfs_mount("exfat", "bench", "bench1") != 0) return -1;
+    return vfs_create("bench:/data", 0);
+}
+
+static void bench_fs(void) {
+    uint64_t buf = pmm_alloc_frames_below(16, 1ULL<<32);
+    if (!buf || bench_fs_setup() != 0) { if (buf) pmm_free_frames(buf, 16); bench_kv("fs_error", 1); return; }
+    uint8_t* b = (uint8_t*)(uintptr_t)buf;
+    memset(b, 0xA5, 65536);
+    vfs_node_t* n = vfs_open("bench:/data");
+    if (!n) { pmm_free_frames(buf, 16); bench_kv("fs_error", 1); return; }
+    uint64_t best_w = ~0ULL, best_r = ~0ULL;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t t0 = rdtsc_ordered();
+        for (uint32_t off = 0; off < BENCH_FILE_BYTES; off += 65536) vfs_write(n, off, b, 65536);
+        uint64_t t1 = rdtsc_ordered();
+        for (uint32_t off = 0; off < BENCH_FILE_BYTES; off += 65536) vfs_read(n, off, b, 65536);
+        uint64_t t2 = rdtsc_ordered();
+        best_w = min_u64(best_w, t1 - t0);
+        best_r = min_u64(best_r, t2 - t1);
+    }
+    bench_rate("exfat_write_64k", BENCH_FILE_BYTES, best_w);
+    bench_rate("exfat_read_64k", BENCH_FILE_BYTES, best_r);
+    pmm_free_frames(buf, 16);
+}
+
+static int group_is(const char* group, const char* name) {
+    if (!group || !*group) return 1;
+    while (*group && *group == *name) { ++group; ++name; }
+    return *group == 0 && *name == 0;
+}
+
+void bench_run(const char* group) {
+    s_khz = tsc_khz();
+    console_write("bench-begin\n");
+    bench_kv("tsc_khz", s_khz);
+    console_write("mem_variant="); console_write(mem_active_name()); console_putc('\n');
+    if (group_is(group, "mem")) bench_mem();
+    if (group_is(group, "alloc")) bench_alloc();
+    if (group_is(group, "sched")) bench_sched();
+    if (group_is(group, "block")) bench_block();
+    if (group_is(group, "fs")) bench_fs();
+    if (group_is(group, "disk")) bench_hw_disks();
+    if (group_is(group, "raid")) bench_raid();
+    if (group_is(group, "tier")) bench_tier();
+    if (group_is(group, "crypt")) bench_crypt();
+    if (group_is(group, "integ")) bench_integ();
+    console_write("bench-end\n");
+}
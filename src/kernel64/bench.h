@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+// In-kernel benchmark suite (shell 'bench'). Results are printed as one
+// key=value per line between "bench-begin" and "bench-end" markers so
+// tests/bench.sh can diff them against a baseline. Key suffixes give the
+// unit and direction: _mbps and _iops (higher is better), _cyc (lower is
+// better).
+
+// Run every group, or only the named one (mem, alloc, sched, block, fs, disk, raid, tier, crypt, integ)
+void bench_run(const char* group);
+// Emit one result line
+void bench_kv(const char* key, uint64_t value);
+// Throughput line for 'bytes' moved in 'cycles': key_mbps, or key_bpkc
+// (bytes per 1000 cycles) when the TSC is uncalibrated
+void bench_rate(const char* key, uint64_t bytes, uint64_t cycles);
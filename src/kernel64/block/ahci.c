@@ -0,0 +1,468 @@
+// AHCI SATA host controller: ABAR register access, port bring-up, IDENTIFY,
+// NCQ (READ/WRITE FPDMA QUEUED) or DMA EXT commands with PRD scatter lists,
+// completed by polling PxSACT/PxCI from the block queue.
+#include "ahci.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+#include "../console.h"
+#include "../tsc.h"
+#include "../pci/pci.h"
+#include "../lib/mem.h"
+#include "../../kernel/mm/pmm.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+
+// HBA registers (32-bit word index)
+#define HBA_CAP  (0x00 / 4)
+#define HBA_GHC  (0x04 / 4)
+#define HBA_PI   (0x0C / 4)
+#define GHC_HR   (1u << 0)
+#define GHC_IE   (1u << 1)
+#define GHC_AE   (1u << 31)
+#define CAP_SNCQ (1u << 30)
+
+// Port registers (word index from the port base)
+#define PX_CLB   (0x00 / 4)
+#define PX_CLBU  (0x04 / 4)
+#define PX_FB    (0x08 / 4)
+#define PX_FBU   (0x0C / 4)
+#define PX_IS    (0x10 / 4)
+#define PX_IE    (0x14 / 4)
+#define PX_CMD   (0x18 / 4)
+#define PX_TFD   (0x20 / 4)
+#define PX_SIG   (0x24 / 4)
+#define PX_SSTS  (0x28 / 4)
+#define PX_SERR  (0x30 / 4)
+#define PX_SACT  (0x34 / 4)
+#define PX_CI    (0x38 / 4)
+#define CMD_ST   (1u << 0)
+#define CMD_SUD  (1u << 1)
+#define CMD_POD  (1u << 2)
+#define CMD_FRE  (1u << 4)
+#define CMD_FR   (1u << 14)
+#define CMD_CR   (1u << 15)
+#define TFD_ERR  (1u << 0)
+#define TFD_DRQ  (1u << 3)
+#define TFD_BSY  (1u << 7)
+#define IS_ERR   ((1u << 30) | (1u << 29) | (1u << 28) | (1u << 27))  // TFES HBFS HBDS IFS
+#define SIG_ATA  0x00000101u
+
+#define ATA_IDENTIFY       0xEC
+#define ATA_READ_DMA_EXT   0x25
+#define ATA_WRITE_DMA_EXT  0x35
+#define ATA_READ_FPDMA     0x60
+#define ATA_WRITE_FPDMA    0x61
+#define ATA_WRITE_DMA_FUA_EXT 0x3D
+#define ATA_FLUSH_CACHE    0xE7
+#define ATA_FLUSH_CACHE_EXT 0xEA
+#define FIS_DEV_FUA        0x80     // NCQ device register: force unit access
+
+#define AHCI_PRD_MAX_BYTES (4u * 1024u * 1024u)
+#define AHCI_BOUNCE_BYTES  (128u * 1024u)
+
+typedef struct {
+    uint16_t flags;            // CFL in dwords [4:0], W bit 6
+    uint16_t prdtl;            // PRD entries
+    volatile uint32_t prdbc;   // bytes transferred
+    uint64_t ctba;             // command table (128-byte aligned)
+    uint32_t rsv[4];
+} ahci_cmd_hdr_t;
+
+typedef struct {
+    uint64_t dba;
+    uint32_t rsv;
+    uint32_t dbc;              // bytes - 1 (even count), bit 31 = interrupt
+} ahci_prd_t;
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t rsv[48];
+    ahci_prd_t prd[AHCI_MAX_PRD];
+} ahci_cmd_table_t;
+
+typedef struct {
+    bio_t* rq;                 // asynchronous request, NULL when synchronous
+    volatile uint8_t done;
+    int8_t result;
+} ahci_slot_t;
+
+typedef struct {
+    uint64_t commands;
+    uint64_t completions;
+    uint64_t errors;           // port resets after a task-file or bus error
+    uint64_t bounced;          // requests staged through the bounce buffer
+} ahci_stats_t;
+
+typedef struct {
+    block_device_t bdev;
+    volatile uint32_t* regs;
+    ahci_cmd_hdr_t* clist;
+    ahci_cmd_table_t* tables;
+    uint32_t nslots;           // commands in flight: NCQ depth, or 1
+    uint32_t busy;             // issued slots
+    uint8_t ncq;
+    uint8_t port;
+    uint8_t wcache;            // volatile write cache enabled (IDENTIFY word 85)
+    uint8_t flush_ext;         // FLUSH CACHE EXT supported
+    uint8_t fua;               // writes can carry FUA (NCQ, or WRITE DMA FUA EXT)
+    ahci_slot_t slots[32];
+    uint8_t* bounce;           // for segments the PRD rules cannot express
+    int bounce_slot;
+    block_iovec_t bounce_segs[BLOCK_MAX_SEGS];
+    uint32_t bounce_nseg;
+    char model[41];
+    ahci_stats_t stats;
+} ahci_port_t;
+
+static ahci_port_t* g_ports[16];
+static int g_nports;
+static block_ops_t ahci_ops;
+
+static inline uint64_t dma_addr(const volatile void* p) { return (uint64_t)(uintptr_t)p; }
+static inline void barrier(void) { __asm__ volatile("" ::: "memory"); }
+
+// Wait until (*reg & mask) == val, for at most ms milliseconds
+static int wait_reg(volatile uint32_t* reg, uint32_t mask, uint32_t val, uint32_t ms) {
+    uint64_t khz = tsc_khz();
+    uint64_t limit = (khz ? khz : 2000000ULL) * ms, t0 = rdtsc();
+    while ((*reg & mask) != val) {
+        if (rdtsc() - t0 > limit) return -1;
+        __asm__ volatile("pause");
+    }
+    return 0;
+}
+
+static void port_stop(volatile uint32_t* r) {
+    r[PX_CMD] &= ~CMD_ST;
+    wait_reg(&r[PX_CMD], CMD_CR, 0, 500);
+    r[PX_CMD] &= ~CMD_FRE;
+    wait_reg(&r[PX_CMD], CMD_FR, 0, 500);
+}
+
+static void port_start(volatile uint32_t* r) {
+    wait_reg(&r[PX_TFD], TFD_BSY | TFD_DRQ, 0, 1000);
+    r[PX_SERR] = 0xFFFFFFFFu;
+    r[PX_IS] = 0xFFFFFFFFu;
+    r[PX_CMD] |= CMD_FRE;
+    r[PX_CMD] |= CMD_ST;
+}
+
+static void build_fis(uint8_t* f, uint8_t cmd, uint64_t lba, uint32_t count, int tag, int ncq) {
+    memset(f, 0, 20);
+    f[0] = 0x27;                   // register FIS, host to device
+    f[1] = 0x80;                   // command register update
+    f[2] = cmd;
+    f[4] = (uint8_t)lba; f[5] = (uint8_t)(lba >> 8); f[6] = (uint8_t)(lba >> 16);
+    f[7] = cmd == ATA_IDENTIFY ? 0 : 0x40;   // LBA mode
+    f[8] = (uint8_t)(lba >> 24); f[9] = (uint8_t)(lba >> 32); f[10] = (uint8_t)(lba >> 40);
+    if (ncq) { f[3] = (uint8_t)count; f[11] = (uint8_t)(count >> 8); f[12] = (uint8_t)(tag << 3); }
+    else { f[12] = (uint8_t)count; f[13] = (uint8_t)(count >> 8); }
+}
+
+// PRDs need word-aligned, even-length buffers
+static int segs_dmaable(const block_iovec_t* segs, uint32_t nseg) {
+    for (uint32_t i = 0; i < nseg; ++i)
+        if (((uintptr_t)segs[i].base | segs[i].len) & 1) return 0;
+    return 1;
+}
+
+static int slot_get(ahci_port_t* p) {
+    uint32_t free = ~p->busy & (p->nslots == 32 ? 0xFFFFFFFFu : ((1u << p->nslots) - 1));
+    if (!free) return -1;
+    int s = __builtin_ctz(free);
+    p->busy |= 1u << s;
+    p->slots[s].rq = NULL; p->slots[s].done = 0; p->slots[s].result = 0;
+    return s;
+}
+
+// Fill slot s's table and header and set its issue bits
+static int slot_issue(ahci_port_t* p, int s, uint8_t cmd, int write, int fua, uint64_t lba, uint32_t count,
+                      const block_iovec_t* segs, uint32_t nseg) {
+    ahci_cmd_table_t* t = &p->tables[s];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nseg; ++i) {
+        uint8_t* b = (uint8_t*)segs[i].base;
+        for (uint32_t left = segs[i].len; left; ) {
+            uint32_t chunk = left > AHCI_PRD_MAX_BYTES ? AHCI_PRD_MAX_BYTES : left;
+            if (n == AHCI_MAX_PRD) return -1;
+            t->prd[n].dba = dma_addr(b); t->prd[n].rsv = 0; t->prd[n].dbc = chunk - 1;
+            ++n; b += chunk; left -= chunk;
+        }
+    }
+    int ncq = cmd == ATA_READ_FPDMA || cmd == ATA_WRITE_FPDMA;
+    build_fis(t->cfis, cmd, lba, count, s, ncq);
+    if (ncq && fua) t->cfis[7] |= FIS_DEV_FUA;
+    ahci_cmd_hdr_t* h = &p->clist[s];
+    h->flags = (uint16_t)(5 | (write ? 1u << 6 : 0));
+    h->prdtl = (uint16_t)n;
+    h->prdbc = 0;
+    barrier();
+    if (ncq) p->regs[PX_SACT] = 1u << s;
+    p->regs[PX_CI] = 1u << s;
+    p->stats.commands++;
+    return 0;
+}
+
+// Start a read/write; returns the slot, BLOCK_BUSY (as -2) or -1
+static int port_rw(ahci_port_t* p, int write, int fua, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    uint64_t bytes = block_iov_bytes(segs, nseg);
+    if (bytes == 0 || bytes % 512 || bytes / 512 > 65535 || lba + bytes / 512 > p->bdev.sector_count) return -1;
+    int bounce = !segs_dmaable(segs, nseg);
+    if (bounce) {
+        if (bytes > AHCI_BOUNCE_BYTES || nseg > BLOCK_MAX_SEGS) return -1;
+        if (p->bounce_slot >= 0) return -2;
+        if (!p->bounce) {
+            uint64_t f = pmm_alloc_frames_below(AHCI_BOUNCE_BYTES / PMM_FRAME_SIZE, 1ULL << 32);
+            if (!f) return -1;
+            p->bounce = (uint8_t*)(uintptr_t)f;
+        }
+    }
+    int s = slot_get(p);
+    if (s < 0) return -2;
+    block_iovec_t one;
+    if (bounce) {
+        if (write) block_iov_to_buf(segs, nseg, 0, p->bounce, bytes);
+        memcpy(p->bounce_segs, segs, nseg * sizeof(*segs));
+        p->bounce_nseg = nseg;
+        p->bounce_slot = s;
+        p->stats.bounced++;
+        one.base = p->bounce; one.len = (uint32_t)bytes;
+        segs = &one; nseg = 1;
+    }
+    fua = write && fua && p->fua;
+    uint8_t cmd = p->ncq ? (write ? ATA_WRITE_FPDMA : ATA_READ_FPDMA)
+                         : (write ? (fua ? ATA_WRITE_DMA_FUA_EXT : ATA_WRITE_DMA_EXT) : ATA_READ_DMA_EXT);
+    if (slot_issue(p, s, cmd, write, fua, lba, (uint32_t)(bytes / 512), segs, nseg) != 0) {
+        if (bounce) p->bounce_slot = -1;
+        p->busy &= ~(1u << s);
+        return -1;
+    }
+    return s;
+}
+
+static void slot_finish(ahci_port_t* p, int s, int status) {
+    ahci_slot_t* sl = &p->slots[s];
+    if (p->bounce_slot == s) {
+        if (status == 0 && !(p->clist[s].flags & (1u << 6)))
+            block_iov_from_buf(p->bounce_segs, p->bounce_nseg, 0, p->bounce, block_iov_bytes(p->bounce_segs, p->bounce_nseg));
+        p->bounce_slot = -1;
+    }
+    p->busy &= ~(1u << s);
+    p->stats.completions++;
+    if (sl->rq) { bio_t* rq = sl->rq; sl->rq = NULL; block_complete(rq, status); }
+    else { sl->result = (int8_t)status; sl->done = 1; }
+}
+
+// A failed NCQ command aborts the whole queue: fail everything outstanding
+// and restart the port
+static int port_recover(ahci_port_t* p) {
+    p->stats.errors++;
+    console_write("[ahci] "); console_write(p->bdev.name);
+    console_write(": error tfd="); console_write_hex64(p->regs[PX_TFD]);
+    console_write(" serr="); console_write_hex64(p->regs[PX_SERR]); console_putc('\n');
+    port_stop(p->regs);
+    int n = 0;
+    for (uint32_t busy = p->busy; busy; busy &= busy - 1, ++n) slot_finish(p, __builtin_ctz(busy), -1);
+    port_start(p->regs);
+    return n;
+}
+
+static int port_reap(ahci_port_t* p) {
+    if (!p->busy) return 0;
+    volatile uint32_t* r = p->regs;
+    uint32_t is = r[PX_IS];
+    if (is) r[PX_IS] = is;
+    if (is & IS_ERR) return port_recover(p);
+    uint32_t pending = r[PX_CI];
+    if (p->ncq) pending |= r[PX_SACT];
+    uint32_t fin = p->busy & ~pending;
+    int n = 0;
+    for (; fin; fin &= fin - 1, ++n) slot_finish(p, __builtin_ctz(fin), 0);
+    return n;
+}
+
+// ---- block ops ----
+
+static int ahci_poll(block_device_t* dev) { return port_reap((ahci_port_t*)dev->priv); }
+
+static int ahci_submit(block_device_t* dev, bio_t* rq, const block_iovec_t* segs, uint32_t nseg) {
+    ahci_port_t* p = (ahci_port_t*)dev->priv;
+    int s = port_rw(p, rq->op == BIO_WRITE, rq->flags & BIO_FUA, rq->lba, segs, nseg);
+    if (s == -2) return BLOCK_BUSY;
+    if (s < 0) return -1;
+    p->slots[s].rq = rq;
+    return 0;
+}
+
+static int ahci_sync(ahci_port_t* p, int write, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    int s;
+    while ((s = port_rw(p, write, 0, lba, segs, nseg)) == -2) port_reap(p);
+    if (s < 0) return -1;
+    while (!p->slots[s].done) { if (port_reap(p) == 0) __asm__ volatile("pause"); }
+    return p->slots[s].result ? -1 : (int)(block_iov_bytes(segs, nseg) / 512);
+}
+
+static int ahci_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { buf, count * 512u };
+    return ahci_sync((ahci_port_t*)dev->priv, 0, lba, &seg, 1);
+}
+static int ahci_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { (void*)buf, count * 512u };
+    return ahci_sync((ahci_port_t*)dev->priv, 1, lba, &seg, 1);
+}
+static int ahci_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return ahci_sync((ahci_port_t*)dev->priv, 0, lba, iov, iovcnt);
+}
+static int ahci_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return ahci_sync((ahci_port_t*)dev->priv, 1, lba, iov, iovcnt);
+}
+
+// FLUSH CACHE is not queued: let outstanding NCQ commands finish first
+static int ahci_flush(block_device_t* dev) {
+    ahci_port_t* p = (ahci_port_t*)dev->priv;
+    if (!p->wcache) return 0;
+    while (p->busy) { if (port_reap(p) == 0) __asm__ volatile("pause"); }
+    int s = slot_get(p);
+    if (s < 0 || slot_issue(p, s, p->flush_ext ? ATA_FLUSH_CACHE_EXT : ATA_FLUSH_CACHE, 0, 0, 0, 0, NULL, 0) != 0) {
+        if (s >= 0) p->busy &= ~(1u << s);
+        return -1;
+    }
+    while (!p->slots[s].done) { if (port_reap(p) == 0) __asm__ volatile("pause"); }
+    return p->slots[s].result ? -1 : 0;
+}
+
+// ---- probe ----
+
+static int port_identify(ahci_port_t* p, uint16_t* id) {
+    block_iovec_t seg = { id, 512 };
+    int s = slot_get(p);
+    if (s < 0 || slot_issue(p, s, ATA_IDENTIFY, 0, 0, 0, 0, &seg, 1) != 0) return -1;
+    int rc = wait_reg(&p->regs[PX_CI], 1u << s, 0, 1000);
+    p->busy &= ~(1u << s);
+    if (rc != 0 || (p->regs[PX_TFD] & TFD_ERR)) return -1;
+    return 0;
+}
+
+static void port_probe(volatile uint32_t* hba, int port, uint32_t cap) {
+    volatile uint32_t* r = hba + (0x100 + port * 0x80) / 4;
+    if ((r[PX_SSTS] & 0xF) != 3 || ((r[PX_SSTS] >> 8) & 0xF) != 1) return;   // no device / link down
+    if (r[PX_SIG] != SIG_ATA) return;                                         // ATAPI, PM, bridges
+    if (g_nports >= (int)(sizeof(g_ports) / sizeof(g_ports[0]))) return;
+    size_t pages = 1 + (32 * sizeof(ahci_cmd_table_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint64_t mem = pmm_alloc_frames_below(pages, 1ULL << 32);
+    ahci_port_t* p = (ahci_port_t*)kmalloc(sizeof(ahci_port_t));
+    uint64_t idf = pmm_alloc_frames_below(1, 1ULL << 32);
+    if (!mem || !p || !idf) {
+        if (mem) pmm_free_frames(mem, pages);
+        if (idf) pmm_free_frames(idf, 1);
+        if (p) kfree(p);
+        return;
+    }
+    memset(p, 0, sizeof(*p));
+    memset((void*)(uintptr_t)mem, 0, pages * PMM_FRAME_SIZE);
+    p->regs = r;
+    p->port = (uint8_t)port;
+    p->bounce_slot = -1;
+    p->bdev.name[0] = 's'; p->bdev.name[1] = 'd'; p->bdev.name[2] = (char)('a' + g_nports);
+    // Frame 0: command list (1 KiB) and received-FIS area; then the tables
+    p->clist = (ahci_cmd_hdr_t*)(uintptr_t)mem;
+    p->tables = (ahci_cmd_table_t*)(uintptr_t)(mem + PMM_FRAME_SIZE);
+    for (int s = 0; s < 32; ++s) p->clist[s].ctba = dma_addr(&p->tables[s]);
+    port_stop(r);
+    r[PX_CLB] = (uint32_t)mem; r[PX_CLBU] = (uint32_t)(mem >> 32);
+    r[PX_FB] = (uint32_t)(mem + 1024); r[PX_FBU] = (uint32_t)((mem + 1024) >> 32);
+    r[PX_IE] = 0;
+    r[PX_CMD] |= CMD_SUD | CMD_POD;
+    port_start(r);
+    p->nslots = 1;
+    uint16_t* id = (uint16_t*)(uintptr_t)idf;
+    if (port_identify(p, id) != 0) {
+        console_write("[ahci] port identify failed\n");
+        port_stop(r);
+        pmm_free_frames(idf, 1);
+        pmm_free_frames(mem, pages);
+        kfree(p);
+        return;
+    }
+    uint64_t sectors = (id[83] & (1u << 10))
+        ? (uint64_t)id[100] | ((uint64_t)id[101] << 16) | ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48)
+        : (uint64_t)id[60] | ((uint64_t)id[61] << 16);
+    for (int w = 0; w < 20; ++w) { p->model[w * 2] = (char)(id[27 + w] >> 8); p->model[w * 2 + 1] = (char)id[27 + w]; }
+    for (int k = 39; k >= 0 && p->model[k] == ' '; --k) p->model[k] = 0;
+    uint32_t hba_slots = ((cap >> 8) & 0x1F) + 1;
+    if ((cap & CAP_SNCQ) && (id[76] & (1u << 8))) {
+        uint32_t qd = (id[75] & 0x1F) + 1u;
+        p->ncq = 1;
+        p->nslots = qd < hba_slots ? qd : hba_slots;
+    }
+    p->wcache = (id[85] & (1u << 5)) != 0;
+    p->flush_ext = (id[83] & (1u << 13)) != 0;
+    p->fua = p->ncq || (id[84] & (1u << 6));
+    pmm_free_frames(idf, 1);
+
+    ahci_ops.read = ahci_read; ahci_ops.write = ahci_write;
+    ahci_ops.readv = ahci_readv; ahci_ops.writev = ahci_writev;
+    ahci_ops.submit = ahci_submit; ahci_ops.poll = ahci_poll;
+    ahci_ops.flush = ahci_flush;
+    // The table is shared: native FUA only if every port has it
+    ahci_ops.fua = (uint8_t)((g_nports == 0 || ahci_ops.fua) && p->fua);
+    p->bdev.sector_size = 512;
+    p->bdev.sector_count = sectors;
+    p->bdev.ops = &ahci_ops;
+    p->bdev.priv = p;
+    block_register(&p->bdev);
+    g_ports[g_nports++] = p;
+    console_write("[ahci] "); console_write(p->bdev.name);
+    console_write(": port "); console_write_dec(port);
+    console_write(" \""); console_write(p->model); console_write("\" sectors="); console_write_dec(sectors);
+    console_write(p->ncq ? " ncq depth=" : " no-ncq depth="); console_write_dec(p->nslots);
+    if (p->wcache) console_write(" wcache");
+    console_putc('\n');
+}
+
+static void on_pci(const pci_device_t* d, void* user) {
+    (void)user;
+    if (d->class_code != 0x01 || d->subclass != 0x06 || d->prog_if != 0x01) return;
+    pci_enable_device(d);
+    volatile uint32_t* hba = (volatile uint32_t*)pci_map_bar(d, 5, 0x1100);
+    if (!hba) return;
+    // Reset to a known state, then enter AHCI mode with interrupts off (polled)
+    hba[HBA_GHC] |= GHC_AE;
+    hba[HBA_GHC] |= GHC_HR;
+    if (wait_reg(&hba[HBA_GHC], GHC_HR, 0, 1000) != 0) { console_write("[ahci] HBA reset timeout\n"); return; }
+    hba[HBA_GHC] = GHC_AE;
+    uint32_t cap = hba[HBA_CAP], pi = hba[HBA_PI];
+    for (int port = 0; port < 32; ++port) {
+        if (!(pi & (1u << port))) continue;
+        volatile uint32_t* r = hba + (0x100 + port * 0x80) / 4;
+        wait_reg(&r[PX_SSTS], 0xF, 3, 50);   // give the link a moment after reset
+        port_probe(hba, port, cap);
+    }
+}
+
+int ahci_init(void) {
+    pci_enumerate(on_pci, NULL);
+    return g_nports;
+}
+
+void ahci_dump(void) {
+    if (g_nports == 0) { console_write("no AHCI disks\n"); return; }
+    for (int i = 0; i < g_nports; ++i) {
+        ahci_port_t* p = g_ports[i];
+        console_write(p->bdev.name);
+        console_write(": port="); console_write_dec(p->port);
+        console_write(" mib="); console_write_dec(p->bdev.sector_count / 2048);
+        console_write(p->ncq ? " ncq depth=" : " depth="); console_write_dec(p->nslots);
+        console_write(" model=\""); console_write(p->model); console_write("\"\n");
+        console_write("  commands="); console_write_dec(p->stats.commands);
+        console_write(" completions="); console_write_dec(p->stats.completions);
+        console_write(" errors="); console_write_dec(p->stats.errors);
+        console_write(" bounced="); console_write_dec(p->stats.bounced);
+        console_putc('\n');
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// AHCI SATA driver (PCI class 01/06/01). Every port with an ATA disk
+// attached registers as sda, sdb, ... Disks that support NCQ get up to 32
+// READ/WRITE FPDMA QUEUED commands in flight; others fall back to one
+// READ/WRITE DMA EXT at a time. Data moves through per-command PRD lists
+// built straight from the request's segments. Disks with the write cache
+// enabled flush with FLUSH CACHE EXT (FLUSH CACHE without it), and BIO_FUA
+// writes use the NCQ FUA bit or WRITE DMA FUA EXT.
+
+#define AHCI_MAX_PRD 40         // PRD entries per command table
+
+// Probe PCI, start every controller and register its disks; returns disks found
+int ahci_init(void);
+// Print disks with model, capacity, queue depth and counters
+void ahci_dump(void);
@@ -0,0 +1,473 @@
+#include "bcache.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+
+#define BCACHE_HASH_BUCKETS 256
+
+struct bcache_buf {
+    block_device_t* dev;    // whole-disk device (after block_resolve)
+    uint64_t block;         // first LBA is block * sectors-per-block
+    uint8_t* data;          // one PMM frame
+    uint32_t valid;         // per-sector bits: data matches or supersedes disk
+    uint32_t dirty;         // per-sector bits: not yet written back
+    uint32_t refs;          // pins; pinned buffers are never evicted
+    uint32_t busy;          // device I/O in flight on this buffer
+    bcache_buf_t* hnext;    // hash chain
+    bcache_buf_t* io_next;  // bcache_sync batch
+    uint32_t io_mask;       // sectors covered by the batch write
+    bio_t bio;              // batch write-back request
+    bcache_buf_t* prev;     // LRU list, most recently used at the head
+    bcache_buf_t* next;
+};
+
+static bcache_buf_t* g_hash[BCACHE_HASH_BUCKETS];
+static bcache_buf_t* g_lru_head;
+static bcache_buf_t* g_lru_tail;
+static uint32_t g_nbufs;
+static bcache_stats_t g_st = { .budget = BCACHE_DEFAULT_BUDGET };
+
+static inline int cacheable(block_device_t* d){
+    return d && d->ops && d->ops->read && d->sector_size >= 512 &&
+           d->sector_size <= BCACHE_BLOCK_SIZE && (BCACHE_BLOCK_SIZE % d->sector_size) == 0;
+}
+static inline uint32_t spb_of(block_device_t* d){ return BCACHE_BLOCK_SIZE / d->sector_size; }
+static inline uint32_t range_mask(uint32_t first, uint32_t n){ return ((n >= 32) ? ~0u : ((1u << n) - 1u)) << first; }
+
+static inline uint32_t hash_of(block_device_t* d, uint64_t blk){
+    uint64_t h = (((uint64_t)(uintptr_t)d >> 4) + blk) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 56) & (BCACHE_HASH_BUCKETS - 1);
+}
+
+// Sectors of this block that exist on the device (the last block may be short)
+static uint32_t blk_mask(bcache_buf_t* b){
+    uint32_t spb = spb_of(b->dev);
+    uint64_t first = b->block * spb;
+    uint64_t left = b->dev->sector_count - first;
+    return range_mask(0, left < spb ? (uint32_t)left : spb);
+}
+
+static bcache_buf_t* lookup(block_device_t* d, uint64_t blk){
+    for (bcache_buf_t* b = g_hash[hash_of(d, blk)]; b; b = b->hnext)
+        if (b->dev == d && b->block == blk) return b;
+    return NULL;
+}
+
+static void hash_remove(bcache_buf_t* b){
+    bcache_buf_t** pp = &g_hash[hash_of(b->dev, b->block)];
+    while (*pp && *pp != b) pp = &(*pp)->hnext;
+    if (*pp) *pp = b->hnext;
+    b->hnext = NULL;
+}
+
+static void lru_unlink(bcache_buf_t* b){
+    if (b->prev) b->prev->next = b->next; else g_lru_head = b->next;
+    if (b->next) b->next->prev = b->prev; else g_lru_tail = b->prev;
+    b->prev = b->next = NULL;
+}
+
+static void lru_push(bcache_buf_t* b){
+    b->prev = NULL; b->next = g_lru_head;
+    if (g_lru_head) g_lru_head->prev = b; else g_lru_tail = b;
+    g_lru_head = b;
+}
+
+#define BCACHE_MAX_RUNS 4   // alternating sectors of an 8-sector block
+
+// Device I/O for the sectors in mask: one bio per contiguous run, all queued
+// before the first wait so the device sees them together. Other threads wait
+// on busy while a yielding driver services them.
+static int buf_io(bcache_buf_t* b, uint32_t mask, int write){
+    block_device_t* d = b->dev;
+    uint32_t ssz = d->sector_size;
+    uint64_t base = b->block * spb_of(d);
+    bio_t bios[BCACHE_MAX_RUNS];
+    uint32_t nb = 0;
+    int rc = 0;
+    b->busy = 1;
+    for (uint32_t i = 0; i < 32 && (mask >> i); ) {
+        if (!(mask & (1u << i))) { ++i; continue; }
+        uint32_t j = i; while (j < 32 && (mask & (1u << j))) ++j;
+        bio_init(&bios[nb], d, write ? BIO_WRITE : BIO_READ, base + i, b->data + i * ssz, j - i);
+        (void)block_submit(&bios[nb++]);
+        i = j;
+    }
+    for (uint32_t k = 0; k < nb; ++k) if (block_wait(&bios[k]) != 0) rc = -1;
+    b->busy = 0;
+    return rc;
+}
+
+// A batch write-back may still sit in the device queue; dispatch it so a
+// caller nested inside another device's request (e.g. a loop device's
+// filesystem) doesn't wait on I/O nobody will start
+static void wait_idle(bcache_buf_t* b){
+    while (b->busy) {
+        block_unplug(b->dev);
+        if (b->busy) sched_yield();
+    }
+}
+
+// A failed write-back drops the data rather than leaving a buffer that can
+// never be evicted (e.g. a read-only memdisk); the error reaches sync callers.
+static int writeback(bcache_buf_t* b){
+    wait_idle(b);
+    uint32_t mask = b->dirty;
+    if (!mask) return 0;
+    b->dirty = 0;
+    g_st.writebacks++;
+    if (buf_io(b, mask, 1) != 0) { b->valid &= ~mask; return -1; }
+    return 0;
+}
+
+// Sectors in mask become valid; a miss also reads the rest of the block
+static int buf_fill(bcache_buf_t* b, uint32_t mask){
+    if ((b->valid & mask) == mask) { g_st.hits++; return 0; }
+    g_st.misses++;
+    uint32_t want = blk_mask(b) & ~b->valid;
+    if (buf_io(b, want, 0) != 0) return -1;
+    b->valid |= want;
+    return 0;
+}
+
+// Headers are carved from PMM frames rather than kmalloc: hundreds of small
+// blocks in the first-fit early heap would slow every later allocation.
+static bcache_buf_t* g_free_hdrs;
+
+static bcache_buf_t* hdr_alloc(void){
+    if (!g_free_hdrs) {
+        uint64_t frame = pmm_alloc_frames_below(1, 1ULL << 32);
+        if (!frame) return NULL;
+        bcache_buf_t* h = (bcache_buf_t*)(uintptr_t)frame;
+        for (uint32_t i = 0; i < 4096 / sizeof(bcache_buf_t); ++i) { h[i].hnext = g_free_hdrs; g_free_hdrs = &h[i]; }
+    }
+    bcache_buf_t* b = g_free_hdrs;
+    g_free_hdrs = b->hnext;
+    return b;
+}
+
+static bcache_buf_t* buf_alloc(void){
+    if ((uint64_t)(g_nbufs + 1) * BCACHE_BLOCK_SIZE > g_st.budget) return NULL;
+    uint64_t frame = pmm_alloc_frames_below(1, 1ULL << 32);
+    if (!frame) return NULL;
+    bcache_buf_t* b = hdr_alloc();
+    if (!b) { pmm_free_frames(frame, 1); return NULL; }
+    memset(b, 0, sizeof(*b));
+    b->data = (uint8_t*)(uintptr_t)frame;
+    g_nbufs++;
+    return b;
+}
+
+static void buf_free(bcache_buf_t* b){
+    pmm_free_frames((uint64_t)(uintptr_t)b->data, 1);
+    b->hnext = g_free_hdrs; g_free_hdrs = b;
+    g_nbufs--;
+}
+
+// Least recently used idle buffer, written back and unhashed; NULL if all pinned
+static bcache_buf_t* buf_reclaim(void){
+    for (bcache_buf_t* b = g_lru_tail; b; b = b->prev) {
+        if (b->refs || b->busy) continue;
+        b->refs++;
+        (void)writeback(b);
+        b->refs--;
+        if (!b->refs && !b->dirty) {
+            hash_remove(b); lru_unlink(b);
+            g_st.evictions++;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// Pinned buffer for (d, blk), or NULL when the cache is full of pinned buffers
+static bcache_buf_t* buf_get(block_device_t* d, uint64_t blk){
+    bcache_buf_t* b = lookup(d, blk);
+    if (b) {
+        b->refs++;
+        if (b != g_lru_head) { lru_unlink(b); lru_push(b); }
+        wait_idle(b);
+        return b;
+    }
+    b = buf_alloc();
+    if (!b) b = buf_reclaim();
+    if (!b) return NULL;
+    // reclaim may have yielded; another thread could have cached the block
+    bcache_buf_t* raced = lookup(d, blk);
+    if (raced) {
+        lru_push(b);   // idle and unhashed: reclaimed first next time
+        raced->refs++;
+        wait_idle(raced);
+        return raced;
+    }
+    b->dev = d; b->block = blk; b->valid = 0; b->dirty = 0; b->refs = 1; b->busy = 0;
+    uint32_t h = hash_of(d, blk);
+    b->hnext = g_hash[h]; g_hash[h] = b;
+    lru_push(b);
+    return b;
+}
+
+// Write back dirty buffers overlapping [lba, lba+count) of d
+static int range_sync(block_device_t* d, uint64_t lba, uint32_t count){
+    uint32_t spb = spb_of(d);
+    int rc = 0;
+    for (uint64_t blk = lba / spb; blk <= (lba + count - 1) / spb; ++blk) {
+        bcache_buf_t* b = lookup(d, blk);
+        if (b && b->dirty && writeback(b) != 0) rc = -1;
+    }
+    return rc;
+}
+
+// Segments covering bytes [skip, skip+len) of iov; 0 if more than max are needed
+static uint32_t iov_slice(const block_iovec_t* iov, uint32_t iovcnt, uint64_t skip, uint64_t len,
+                          block_iovec_t* out, uint32_t max){
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < iovcnt && len; ++i) {
+        if (skip >= iov[i].len) { skip -= iov[i].len; continue; }
+        uint64_t t = iov[i].len - skip; if (t > len) t = len;
+        if (n == max) return 0;
+        out[n].base = (uint8_t*)iov[i].base + skip; out[n].len = (uint32_t)t; n++;
+        len -= t; skip = 0;
+    }
+    return n;
+}
+
+int bcache_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    if (!dev || !dev->ops || !dev->ops->read || !iov) return -1;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt);
+    if (bytes % dev->sector_size) return -1;
+    uint32_t count = (uint32_t)(bytes / dev->sector_size);
+    if (count == 0) return 0;
+    if (lba + count > dev->sector_count) return -1;
+    uint64_t rl = lba;
+    block_device_t* d = block_resolve(dev, &rl);
+    if (!cacheable(d)) return block_readv(dev, lba, iov, iovcnt);
+    if (count >= BCACHE_BYPASS_SECTORS) {
+        g_st.bypass++;
+        if (range_sync(d, rl, count) != 0) return -1;
+        return block_readv(dev, lba, iov, iovcnt);
+    }
+    uint32_t ssz = d->sector_size, spb = spb_of(d);
+    for (uint32_t done = 0; done < count; ) {
+        uint64_t cur = rl + done;
+        uint32_t first = (uint32_t)(cur % spb);
+        uint32_t n = spb - first; if (n > count - done) n = count - done;
+        uint64_t skip = (uint64_t)done * ssz, len = (uint64_t)n * ssz;
+        bcache_buf_t* b = buf_get(d, cur / spb);
+        if (!b) {
+            block_iovec_t part[BLOCK_MAX_SEGS];
+            uint32_t np = iov_slice(iov, iovcnt, skip, len, part, BLOCK_MAX_SEGS);
+            if (!np || block_readv(dev, lba + done, part, np) != (int)n) return -1;
+        } else {
+            int rc = buf_fill(b, range_mask(first, n));
+            if (rc == 0) block_iov_from_buf(iov, iovcnt, skip, b->data + first * ssz, len);
+            b->refs--;
+            if (rc != 0) return -1;
+        }
+        done += n;
+    }
+    return (int)count;
+}
+
+const void* bcache_map(block_device_t* dev, uint64_t lba, uint32_t count){
+    if (!dev || count == 0 || lba + count > dev->sector_count) return NULL;
+    uint64_t rl = lba;
+    block_device_t* d = block_resolve(dev, &rl);
+    if (!d || !d->ops || !d->ops->map) return NULL;
+    if (cacheable(d) && range_sync(d, rl, count) != 0) return NULL;
+    return block_map(dev, lba, count);
+}
+
+int bcache_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count){
+    if (!dev || !buf) return -1;
+    uint64_t bytes = (uint64_t)count * dev->sector_size;
+    if (bytes > 0xFFFFFFFFu) return -1;
+    block_iovec_t v = { buf, (uint32_t)bytes };
+    return bcache_readv(dev, lba, &v, 1);
+}
+
+int bcache_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count){
+    if (!dev || !dev->ops || !dev->ops->write || !buf) return -1;
+    if (count == 0) return 0;
+    if (lba + count > dev->sector_count) return -1;
+    uint64_t rl = lba;
+    block_device_t* d = block_resolve(dev, &rl);
+    if (!cacheable(d) || !d->ops->write) return block_write(dev, lba, buf, count);
+    uint32_t ssz = d->sector_size, spb = spb_of(d);
+    const uint8_t* in = (const uint8_t*)buf;
+    if (count >= BCACHE_BYPASS_SECTORS) {
+        g_st.bypass++;
+        int r = block_write(dev, lba, buf, count);
+        if (r != (int)count) return r;
+        // Keep cached copies current; the device now holds these sectors
+        for (uint32_t done = 0; done < count; ) {
+            uint64_t cur = rl + done;
+            uint32_t first = (uint32_t)(cur % spb);
+            uint32_t n = spb - first; if (n > count - done) n = count - done;
+            bcache_buf_t* b = lookup(d, cur / spb);
+            if (b) {
+                wait_idle(b);
+                uint32_t m = range_mask(first, n);
+                memcpy(b->data + first * ssz, in + (uint64_t)done * ssz, (uint64_t)n * ssz);
+                b->valid |= m; b->dirty &= ~m;
+            }
+            done += n;
+        }
+        return r;
+    }
+    for (uint32_t done = 0; done < count; ) {
+        uint64_t cur = rl + done;
+        uint32_t first = (uint32_t)(cur % spb);
+        uint32_t n = spb - first; if (n > count - done) n = count - done;
+        const uint8_t* src = in + (uint64_t)done * ssz;
+        bcache_buf_t* b = buf_get(d, cur / spb);
+        if (!b) {
+            if (block_write(dev, lba + done, src, n) != (int)n) return -1;
+        } else {
+            // Whole sectors are overwritten, so no read-fill is needed
+            uint32_t m = range_mask(first, n);
+            memcpy(b->data + first * ssz, src, (uint64_t)n * ssz);
+            b->valid |= m; b->dirty |= m;
+            b->refs--;
+        }
+        done += n;
+    }
+    return (int)count;
+}
+
+void* bcache_get(block_device_t* dev, uint64_t lba, bcache_buf_t** out){
+    if (!out) return NULL;
+    *out = NULL;
+    if (!dev || lba >= dev->sector_count) return NULL;
+    uint64_t rl = lba;
+    block_device_t* d = block_resolve(dev, &rl);
+    if (!cacheable(d)) return NULL;
+    uint32_t spb = spb_of(d), first = (uint32_t)(rl % spb);
+    bcache_buf_t* b = buf_get(d, rl / spb);
+    if (!b) return NULL;
+    if (buf_fill(b, range_mask(first, 1)) != 0) { b->refs--; return NULL; }
+    *out = b;
+    return b->data + first * d->sector_size;
+}
+
+void bcache_put(bcache_buf_t* b, const void* sector, int dirty){
+    if (!b) return;
+    if (dirty && sector) {
+        uint32_t idx = (uint32_t)(((const uint8_t*)sector - b->data) / b->dev->sector_size);
+        b->dirty |= 1u << idx;
+    }
+    if (b->refs) b->refs--;
+}
+
+// Dirty buffers are queued as one bio each (spanning the first to the last
+// dirty sector when the gap is valid) and dispatched together, so the block
+// queue can sort and merge them; the rest fall back to writeback().
+// Batch writes release their buffer on completion, not when the syncing
+// thread gets to them
+static void sync_end_io(bio_t* bio){
+    bcache_buf_t* b = (bcache_buf_t*)bio->priv;
+    if (bio->status) b->valid &= ~b->io_mask;
+    b->busy = 0;
+}
+
+int bcache_sync(block_device_t* dev){
+    block_device_t* d = dev ? block_resolve(dev, NULL) : NULL;
+    bcache_buf_t* batch = NULL;
+    int rc = 0;
+    for (bcache_buf_t* b = g_lru_head; b; b = b->next) {
+        if ((d && b->dev != d) || !b->dirty) continue;
+        b->refs++;
+        wait_idle(b);
+        uint32_t m = b->dirty;
+        if (!m) { b->refs--; continue; }
+        uint32_t lo = (uint32_t)__builtin_ctz(m), hi = 31u - (uint32_t)__builtin_clz(m);
+        uint32_t span = range_mask(lo, hi - lo + 1);
+        if ((b->valid & span) != span) {
+            if (writeback(b) != 0) rc = -1;
+            b->refs--;
+            continue;
+        }
+        b->dirty = 0; b->busy = 1; b->io_mask = m;
+        g_st.writebacks++;
+        bio_init(&b->bio, b->dev, BIO_WRITE, b->block * spb_of(b->dev) + lo,
+                 b->data + lo * b->dev->sector_size, hi - lo + 1);
+        b->bio.end_io = sync_end_io; b->bio.priv = b;
+        (void)block_submit(&b->bio);
+        b->io_next = batch; batch = b;
+    }
+    block_unplug(d);
+    for (bcache_buf_t* b = batch; b; b = b->io_next) {
+        if (block_wait(&b->bio) != 0) rc = -1;
+        b->refs--;
+    }
+    return rc;
+}
+
+int bcache_flush(block_device_t* dev){
+    int rc = bcache_sync(dev);
+    if (block_flush(dev) != 0) rc = -1;
+    return rc;
+}
+
+int bcache_discard(block_device_t* dev, uint64_t lba, uint64_t count){
+    if (!dev || count == 0) return block_discard(dev, lba, count);
+    uint64_t dl = lba;
+    block_device_t* d = block_resolve(dev, &dl);
+    if (!d || lba + count > dev->sector_count) return -1;
+    if (cacheable(d)) {
+        uint32_t spb = spb_of(d);
+        for (bcache_buf_t* b = g_lru_head; b; b = b->next) {
+            uint64_t first = b->block * spb;
+            if (b->dev != d || first >= dl + count || first + spb <= dl) continue;
+            b->refs++;
+            wait_idle(b);
+            uint64_t lo = dl > first ? dl - first : 0;
+            uint64_t hi = dl + count - first; if (hi > spb) hi = spb;
+            uint32_t m = range_mask((uint32_t)lo, (uint32_t)(hi - lo));
+            b->valid &= ~m;
+            b->dirty &= ~m;
+            b->refs--;
+        }
+    }
+    return block_discard(dev, lba, count);
+}
+
+int bcache_invalidate(block_device_t* dev){
+    block_device_t* d = block_resolve(dev, NULL);
+    if (!d) return -1;
+    int rc = bcache_sync(d);
+    for (bcache_buf_t* b = g_lru_head; b; ) {
+        bcache_buf_t* next = b->next;
+        if (b->dev == d && !b->refs) {
+            wait_idle(b);
+            hash_remove(b); lru_unlink(b);
+            buf_free(b);
+        }
+        b = next;
+    }
+    return rc;
+}
+
+void bcache_set_budget(uint64_t bytes){
+    g_st.budget = bytes;
+    for (bcache_buf_t* b = g_lru_tail; b && (uint64_t)g_nbufs * BCACHE_BLOCK_SIZE > bytes; ) {
+        if (b->refs || b->busy) { b = b->prev; continue; }
+        b->refs++;
+        (void)writeback(b);
+        b->refs--;
+        bcache_buf_t* prev = b->prev;   // read after writeback, which may yield
+        if (!b->refs && !b->dirty) {
+            hash_remove(b); lru_unlink(b);
+            buf_free(b);
+        }
+        b = prev;
+    }
+}
+
+void bcache_get_stats(bcache_stats_t* out){
+    if (!out) return;
+    *out = g_st;
+    out->buffers = g_nbufs;
+    out->dirty = 0;
+    for (bcache_buf_t* b = g_lru_head; b; b = b->next) if (b->dirty) out->dirty++;
+}
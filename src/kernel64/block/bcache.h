@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include "block.h"
+
+// Block buffer cache: 4 KiB buffers hashed by (device, block), LRU eviction,
+// per-sector valid/dirty bits and write-back on eviction or bcache_sync().
+// Partition devices are keyed on their parent disk, so p1 and the whole
+// disk share buffers. Requests of BCACHE_BYPASS_SECTORS or more go straight
+// to the device (after writing back any dirty overlap) instead of flushing
+// the cache with streaming data.
+
+#define BCACHE_BLOCK_SIZE     4096u
+#define BCACHE_DEFAULT_BUDGET (1024u * 1024u)
+#define BCACHE_BYPASS_SECTORS 128u
+
+typedef struct bcache_buf bcache_buf_t;
+
+typedef struct {
+    uint64_t hits;          // block lookups served from the cache
+    uint64_t misses;        // lookups that had to read the device
+    uint64_t evictions;     // buffers recycled for another block
+    uint64_t writebacks;    // dirty runs written to a device
+    uint64_t bypass;        // large requests sent straight to the device
+    uint32_t buffers;       // buffers currently allocated
+    uint32_t dirty;         // buffers holding unwritten data
+    uint64_t budget;        // byte budget for buffer memory
+} bcache_stats_t;
+
+// Cached equivalents of dev->ops->read/write: same arguments and returns
+int bcache_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count);
+int bcache_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count);
+// Scatter read: sectors from lba fill the segments in order (any lengths,
+// whole sectors in total), e.g. to drop partial-sector head/tail bytes
+int bcache_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+// Zero-copy read for memory-backed devices: write back dirty cached sectors
+// of the range, then return block_map()'s pointer (NULL if not mappable)
+const void* bcache_map(block_device_t* dev, uint64_t lba, uint32_t count);
+
+// Discard a dead range: cached sectors of it are dropped, dirty ones
+// without being written back, then block_discard() tells the device
+int bcache_discard(block_device_t* dev, uint64_t lba, uint64_t count);
+
+// Pin the buffer holding one sector and return a pointer to its bytes (NULL
+// on I/O error). Release with bcache_put(), passing dirty=1 after modifying it.
+void* bcache_get(block_device_t* dev, uint64_t lba, bcache_buf_t** out);
+void bcache_put(bcache_buf_t* b, const void* sector, int dirty);
+
+// Write back dirty buffers of dev (NULL = every device); returns 0 or -1
+int bcache_sync(block_device_t* dev);
+// bcache_sync, then block_flush: everything written before the call is on
+// stable media. Filesystems use it as a write barrier. 0 or -1.
+int bcache_flush(block_device_t* dev);
+// Write back and drop every buffer of dev's disk (e.g. before reformatting)
+int bcache_invalidate(block_device_t* dev);
+// Change the memory budget; shrinking writes back and frees idle buffers
+void bcache_set_budget(uint64_t bytes);
+void bcache_get_stats(bcache_stats_t* out);
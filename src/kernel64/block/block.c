@@ -1,16 +1,37 @@
 #include "block.h"
 #include <stddef.h>
+#include "../static_key.h"
+#include "../sched/sched.h"
+#include "../lib/mem.h"
+#include "../tsc.h"
+#include "part.h"
 
 static block_device_t* g_head = NULL;
 extern void serial_putc(char);
+extern void* kmalloc(size_t);
+extern void kfree(void*);
 static void slog(const char* s){ while(*s) serial_putc(*s++); serial_putc('\n'); }
 
+// Extra partition-scan diagnostics; toggled with the shell "debug block on"
+static_key_t g_dbg_block = STATIC_KEY_INIT_FALSE("block");
+
 void block_register(block_device_t* dev) {
     if (!dev) return;
+    dev->queue.head = NULL;
+    dev->queue.stats = (block_queue_stats_t){0};
+    memset(dev->io, 0, sizeof(dev->io));
+    dev->ptable = NULL;
     dev->next = g_head;
     g_head = dev;
 }
 
+void block_io_reset(block_device_t* dev) {
+    for (block_device_t* d = dev ? dev : g_head; d; d = dev ? NULL : d->next) {
+        memset(d->io, 0, sizeof(d->io));
+        d->queue.stats.max_inflight = d->queue.stats.inflight;
+    }
+}
+
 block_device_t* block_find(const char* name) {
     for (block_device_t* d = g_head; d; d = d->next) {
         const char* a = name; const char* b = d->name;
@@ -21,6 +42,7 @@ block_device_t* block_find(const char* name) {
 }
 
 uint32_t block_default_sector(void) { return 512; }
+int block_sector_ok(uint32_t ssz) { return ssz >= 512 && ssz <= BLOCK_MAX_SECTOR && (ssz & (ssz - 1)) == 0; }
 
 block_device_t* block_first(void){ return g_head; }
 block_device_t* block_next(block_device_t* dev){ return dev?dev->next:NULL; }
@@ -44,23 +66,450 @@ static int part_write(block_device_t* dev, uint64_t lba, const void* buf, uint32
     return p->parent->ops->write(p->parent, p->lba_base + lba, buf, count);
 }
 
+static int vec_fallback(block_device_t* dev, int write, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+
+static int part_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    part_priv_t* p = (part_priv_t*)dev->priv;
+    if (!p || !p->parent || !p->parent->ops || !p->parent->ops->read) return -1;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt);
+    if (bytes % dev->sector_size || lba + bytes / dev->sector_size > p->lba_count) return -1;
+    if (p->parent->ops->readv) return p->parent->ops->readv(p->parent, p->lba_base + lba, iov, iovcnt);
+    return vec_fallback(p->parent, 0, p->lba_base + lba, iov, iovcnt);
+}
+static int part_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    part_priv_t* p = (part_priv_t*)dev->priv;
+    if (!p || !p->parent || !p->parent->ops || !p->parent->ops->write) return -1;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt);
+    if (bytes % dev->sector_size || lba + bytes / dev->sector_size > p->lba_count) return -1;
+    if (p->parent->ops->writev) return p->parent->ops->writev(p->parent, p->lba_base + lba, iov, iovcnt);
+    return vec_fallback(p->parent, 1, p->lba_base + lba, iov, iovcnt);
+}
+
+static int part_discard(block_device_t* dev, uint64_t lba, uint64_t count){
+    part_priv_t* p = (part_priv_t*)dev->priv;
+    if (!p || !p->parent || !p->parent->ops || !p->parent->ops->discard) return -1;
+    if (lba + count > p->lba_count) return -1;
+    return p->parent->ops->discard(p->parent, p->lba_base + lba, count);
+}
+
+static int part_flush(block_device_t* dev){
+    part_priv_t* p = (part_priv_t*)dev->priv;
+    if (!p || !p->parent || !p->parent->ops) return -1;
+    return p->parent->ops->flush ? p->parent->ops->flush(p->parent) : 0;
+}
+
 static block_ops_t part_ops;
 
-extern void* kmalloc(size_t);
+block_device_t* block_resolve(block_device_t* dev, uint64_t* lba){
+    while (dev && dev->ops == &part_ops) {
+        part_priv_t* p = (part_priv_t*)dev->priv;
+        if (!p || !p->parent) break;
+        if (lba) *lba += p->lba_base;
+        dev = p->parent;
+    }
+    return dev;
+}
+
+// A write over the MBR, the primary GPT header or the backup header makes
+// the cached partition table stale (an entry array change needs a header
+// with its new CRC)
+static void ptable_touch(block_device_t* d, uint64_t lba, uint64_t count){
+    if (d->ptable && (lba < 2 || lba + count >= d->sector_count)) d->ptable->stale = 1;
+}
+
+uint64_t block_iov_bytes(const block_iovec_t* iov, uint32_t iovcnt){
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < iovcnt; ++i) n += iov[i].len;
+    return n;
+}
+
+void block_iov_from_buf(const block_iovec_t* iov, uint32_t iovcnt, uint64_t skip, const void* src, uint64_t len){
+    const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t i = 0; i < iovcnt && len; ++i) {
+        if (skip >= iov[i].len) { skip -= iov[i].len; continue; }
+        uint64_t t = iov[i].len - skip; if (t > len) t = len;
+        memcpy((uint8_t*)iov[i].base + skip, s, t);
+        s += t; len -= t; skip = 0;
+    }
+}
+
+void block_iov_to_buf(const block_iovec_t* iov, uint32_t iovcnt, uint64_t skip, void* dst, uint64_t len){
+    uint8_t* d = (uint8_t*)dst;
+    for (uint32_t i = 0; i < iovcnt && len; ++i) {
+        if (skip >= iov[i].len) { skip -= iov[i].len; continue; }
+        uint64_t t = iov[i].len - skip; if (t > len) t = len;
+        memcpy(d, (const uint8_t*)iov[i].base + skip, t);
+        d += t; len -= t; skip = 0;
+    }
+}
+
+// Vectored transfer for drivers without readv/writev: whole sectors inside a
+// segment go straight to read/write, sectors straddling segments bounce.
+static int vec_fallback(block_device_t* dev, int write, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    uint32_t ssz = dev->sector_size;
+    uint64_t total = block_iov_bytes(iov, iovcnt), pos = 0;
+    uint32_t si = 0, soff = 0;
+    uint8_t* bounce = NULL;
+    int rc = 0;
+    if (total % ssz) return -1;
+    while (pos < total) {
+        while (si < iovcnt && soff == iov[si].len) { si++; soff = 0; }
+        uint32_t avail = iov[si].len - soff;
+        uint64_t sec = lba + pos / ssz;
+        uint32_t n = avail / ssz;
+        int r;
+        if (n) {
+            uint8_t* p = (uint8_t*)iov[si].base + soff;
+            r = write ? dev->ops->write(dev, sec, p, n) : dev->ops->read(dev, sec, p, n);
+        } else {
+            n = 1;
+            if (!bounce && !(bounce = (uint8_t*)kmalloc(ssz))) { rc = -1; break; }
+            if (write) { block_iov_to_buf(iov, iovcnt, pos, bounce, ssz); r = dev->ops->write(dev, sec, bounce, 1); }
+            else { r = dev->ops->read(dev, sec, bounce, 1); if (r == 1) block_iov_from_buf(iov, iovcnt, pos, bounce, ssz); }
+        }
+        if (r != (int)n) { rc = -1; break; }
+        pos += (uint64_t)n * ssz;
+        for (uint64_t adv = (uint64_t)n * ssz; adv; ) {
+            uint32_t t = iov[si].len - soff; if (t > adv) t = (uint32_t)adv;
+            soff += t; adv -= t;
+            if (soff == iov[si].len) { si++; soff = 0; }
+        }
+    }
+    if (bounce) kfree(bounce);
+    return rc ? -1 : (int)(total / ssz);
+}
+
+void bio_init(bio_t* bio, block_device_t* dev, int op, uint64_t lba, void* buf, uint32_t count){
+    bio->dev = dev; bio->lba = lba; bio->buf = buf; bio->count = count;
+    bio->iov = NULL; bio->iovcnt = 0;
+    bio->op = (uint8_t)op; bio->flags = 0; bio->done = 0; bio->status = 0;
+    bio->end_io = NULL; bio->priv = NULL;
+    bio->next = NULL; bio->merged = NULL; bio->rq_count = 0; bio->rq_segs = 0;
+}
+
+void bio_init_vec(bio_t* bio, block_device_t* dev, int op, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    uint32_t ssz = dev && dev->sector_size ? dev->sector_size : 512;
+    bio_init(bio, dev, op, lba, NULL, (uint32_t)(block_iov_bytes(iov, iovcnt) / ssz));
+    bio->iov = iov; bio->iovcnt = iovcnt;
+}
+
+static void bio_finish(bio_t* bio, int status){
+    bio->status = (int16_t)status;
+    bio->done = 1;
+    if (bio->end_io) bio->end_io(bio);
+}
+
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause" ::: "memory");
+#endif
+}
+
+static inline int has_vec(block_device_t* dev, int op){
+    if (dev->ops->submit) return 1;
+    return op == BIO_WRITE ? dev->ops->writev != NULL : dev->ops->readv != NULL;
+}
+static inline uint32_t bio_segs(const bio_t* b){ return b->iov ? b->iovcnt : 1u; }
+
+static int can_merge(block_device_t* dev, const bio_t* rq, const bio_t* nb){
+    if (nb->op != rq->op || nb->flags != rq->flags || nb->lba != rq->lba + rq->rq_count ||
+        rq->rq_count + nb->count > BLOCK_MAX_MERGE_SECTORS) return 0;
+    if (has_vec(dev, rq->op)) return rq->rq_segs + bio_segs(nb) <= BLOCK_MAX_SEGS;
+    return !rq->iov && !nb->iov &&
+           (uint8_t*)nb->buf == (uint8_t*)rq->buf + (uint64_t)rq->rq_count * dev->sector_size;
+}
+
+static void seg_add(block_iovec_t* segs, uint32_t* n, void* base, uint32_t len){
+    if (*n && (uint8_t*)segs[*n - 1].base + segs[*n - 1].len == (uint8_t*)base &&
+        segs[*n - 1].len + (uint64_t)len <= 0xFFFFFFFFu) { segs[*n - 1].len += len; return; }
+    segs[*n].base = base; segs[*n].len = len; (*n)++;
+}
+
+// Gather the data of a merged request into at most BLOCK_MAX_SEGS segments
+static uint32_t rq_segments(block_device_t* dev, const bio_t* rq, block_iovec_t* segs){
+    uint32_t n = 0;
+    for (const bio_t* b = rq; b; b = b->merged) {
+        if (!b->iov) { seg_add(segs, &n, b->buf, b->count * dev->sector_size); continue; }
+        for (uint32_t i = 0; i < b->iovcnt; ++i) if (b->iov[i].len) seg_add(segs, &n, b->iov[i].base, b->iov[i].len);
+    }
+    return n;
+}
+
+// Hand one (possibly merged) request to the driver; returns sectors or -1
+static int rq_dispatch(block_device_t* dev, bio_t* rq){
+    int w = rq->op == BIO_WRITE;
+    if (w && !dev->ops->write) return -1;
+    if (!rq->iov && (!rq->merged || !has_vec(dev, rq->op)))
+        return w ? dev->ops->write(dev, rq->lba, rq->buf, rq->rq_count)
+                 : dev->ops->read(dev, rq->lba, rq->buf, rq->rq_count);
+    if (!has_vec(dev, rq->op)) return vec_fallback(dev, w, rq->lba, rq->iov, rq->iovcnt);
+    block_iovec_t segs[BLOCK_MAX_SEGS];
+    uint32_t n = rq_segments(dev, rq, segs);
+    return w ? dev->ops->writev(dev, rq->lba, segs, n) : dev->ops->readv(dev, rq->lba, segs, n);
+}
+
+// Put a request the driver refused back at the front, unmerged
+static void rq_requeue(block_queue_t* q, bio_t* rq){
+    bio_t* b = rq;
+    for (;;) {
+        q->stats.depth++;
+        if (!b->merged) break;
+        q->stats.merged--;
+        b->next = b->merged; b = b->merged;
+    }
+    b->next = q->head; q->head = rq;
+}
+
+static inline void rq_issue(block_queue_t* q, bio_t* rq){
+    rq->issued = rdtsc();
+    if (++q->stats.inflight > q->stats.max_inflight) q->stats.max_inflight = q->stats.inflight;
+}
+
+// Count a finished request and its dispatch-to-completion latency
+static void rq_account(block_device_t* dev, const bio_t* rq, int status){
+    block_io_stats_t* s = &dev->io[rq->op == BIO_WRITE];
+    uint64_t lat = rdtsc() - rq->issued;
+    uint32_t b = lat ? 63u - (uint32_t)__builtin_clzll(lat) : 0;
+    if (b >= BLOCK_LAT_BUCKETS) b = BLOCK_LAT_BUCKETS - 1;
+    s->ops++;
+    if (status) s->errors++; else s->sectors += rq->rq_count;
+    s->lat_sum += lat;
+    if (lat > s->lat_max) s->lat_max = lat;
+    s->hist[b]++;
+    if (dev->queue.stats.inflight) dev->queue.stats.inflight--;
+    if (status) dev->queue.stats.errors++;
+}
+
+void block_complete(bio_t* rq, int status){
+    rq_account(rq->dev, rq, status);
+    for (bio_t* b = rq; b; ) { bio_t* n = b->merged; bio_finish(b, status); b = n; }
+}
+
+// Pop the front request plus every bio that continues it, hand it to the
+// driver and complete each bio. end_io may queue more bios; they run too.
+// Asynchronous drivers complete later through block_complete(); when they
+// report BLOCK_BUSY the rest stays queued until a completion frees a slot.
+static void queue_run(block_device_t* dev){
+    block_queue_t* q = &dev->queue;
+    while (q->head) {
+        bio_t* rq = q->head; q->head = rq->next; q->stats.depth--;
+        rq->merged = NULL; rq->rq_count = rq->count; rq->rq_segs = bio_segs(rq);
+        bio_t* tail = rq;
+        while (q->head && can_merge(dev, rq, q->head)) {
+            bio_t* b = q->head; q->head = b->next; q->stats.depth--;
+            b->merged = NULL; tail->merged = b; tail = b;
+            rq->rq_count += b->count; rq->rq_segs += bio_segs(b);
+            q->stats.merged++;
+        }
+        // FUA without driver support: synchronous write, then a flush
+        int fua = rq->flags & BIO_FUA;
+        if (dev->ops->submit && (rq->op != BIO_WRITE || dev->ops->write) && (!fua || dev->ops->fua)) {
+            block_iovec_t segs[BLOCK_MAX_SEGS];
+            uint32_t n = rq_segments(dev, rq, segs);
+            rq_issue(q, rq);
+            int r = dev->ops->submit(dev, rq, segs, n);
+            if (r == BLOCK_BUSY) { q->stats.inflight--; rq_requeue(q, rq); return; }
+            q->stats.dispatched++;
+            if (fua) q->stats.fua++;
+            if (r != 0) block_complete(rq, -1);
+            continue;
+        }
+        q->stats.dispatched++;
+        if (fua) q->stats.fua++;
+        rq_issue(q, rq);
+        int status = (rq_dispatch(dev, rq) == (int)rq->rq_count) ? 0 : -1;
+        if (fua && status == 0 && dev->ops->flush) {
+            q->stats.flushes++;
+            if (dev->ops->flush(dev) != 0) status = -1;
+        }
+        rq_account(dev, rq, status);
+        for (bio_t* b = rq; b; ) { bio_t* n = b->merged; bio_finish(b, status); b = n; }
+    }
+}
+
+int block_submit(bio_t* bio){
+    if (!bio) return -1;
+    block_device_t* dev = bio->dev;
+    bio->done = 0; bio->next = NULL; bio->merged = NULL;
+    if (!dev || !dev->ops || (bio->iov ? bio->iovcnt > BLOCK_MAX_SEGS ||
+                                        block_iov_bytes(bio->iov, bio->iovcnt) != (uint64_t)bio->count * dev->sector_size
+                                      : !bio->buf) ||
+        (bio->op == BIO_WRITE ? !dev->ops->write : !dev->ops->read) ||
+        bio->lba + bio->count > dev->sector_count) { bio_finish(bio, -1); return -1; }
+    if (bio->count == 0) { bio_finish(bio, 0); return 0; }
+    dev = block_resolve(dev, &bio->lba);
+    bio->dev = dev;
+    if (!dev || !dev->ops || bio->lba + bio->count > dev->sector_count) { bio_finish(bio, -1); return -1; }
+    if (bio->op == BIO_WRITE) ptable_touch(dev, bio->lba, bio->count);
+    // Elevator insert: after the last bio that starts at or below this LBA or
+    // overlaps it, so a read never overtakes a write to the same sectors
+    block_queue_t* q = &dev->queue;
+    bio_t** ins = &q->head;
+    for (bio_t* b = q->head; b; b = b->next) {
+        int overlap = b->lba < bio->lba + bio->count && bio->lba < b->lba + b->count;
+        if (overlap || b->lba <= bio->lba) ins = &b->next;
+    }
+    bio->next = *ins; *ins = bio;
+    q->stats.submitted++;
+    if (++q->stats.depth > q->stats.max_depth) q->stats.max_depth = q->stats.depth;
+    if (q->stats.depth >= BLOCK_QUEUE_MAX) queue_run(dev);
+    return 0;
+}
+
+void block_unplug(block_device_t* dev){
+    if (dev) { queue_run(dev); return; }
+    for (block_device_t* d = g_head; d; d = d->next) if (d->queue.head) queue_run(d);
+}
+
+int block_wait(bio_t* bio){
+    if (!bio) return -1;
+    block_device_t* dev = bio->dev;
+    if (!bio->done) block_unplug(dev);
+    while (!bio->done) {
+        // Reap hardware completions; they free device slots for queued bios
+        if (dev->ops->poll && dev->ops->poll(dev) > 0) {
+            if (dev->queue.head) queue_run(dev);
+            continue;
+        }
+        if (dev->queue.spin) cpu_relax(); else sched_yield();
+    }
+    return bio->status;
+}
+
+int block_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count){
+    if (count == 0) return 0;
+    bio_t bio; bio_init(&bio, dev, BIO_READ, lba, buf, count);
+    if (block_submit(&bio) != 0) return -1;
+    return block_wait(&bio) == 0 ? (int)count : -1;
+}
+
+int block_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    bio_t bio; bio_init_vec(&bio, dev, BIO_READ, lba, iov, iovcnt);
+    if (bio.count == 0 && block_iov_bytes(iov, iovcnt) == 0) return 0;
+    if (block_submit(&bio) != 0) return -1;
+    return block_wait(&bio) == 0 ? (int)bio.count : -1;
+}
+
+int block_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    bio_t bio; bio_init_vec(&bio, dev, BIO_WRITE, lba, iov, iovcnt);
+    if (bio.count == 0 && block_iov_bytes(iov, iovcnt) == 0) return 0;
+    if (block_submit(&bio) != 0) return -1;
+    return block_wait(&bio) == 0 ? (int)bio.count : -1;
+}
+
+int block_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count){
+    if (count == 0) return 0;
+    bio_t bio; bio_init(&bio, dev, BIO_WRITE, lba, (void*)buf, count);
+    if (block_submit(&bio) != 0) return -1;
+    return block_wait(&bio) == 0 ? (int)count : -1;
+}
+
+int block_write_fua(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count){
+    if (count == 0) return 0;
+    bio_t bio; bio_init(&bio, dev, BIO_WRITE, lba, (void*)buf, count);
+    bio.flags = BIO_FUA;
+    if (block_submit(&bio) != 0) return -1;
+    return block_wait(&bio) == 0 ? (int)count : -1;
+}
+
+const void* block_map(block_device_t* dev, uint64_t lba, uint32_t count){
+    if (!dev || count == 0 || lba + count > dev->sector_count) return NULL;
+    block_device_t* d = block_resolve(dev, &lba);
+    if (!d || !d->ops || !d->ops->map) return NULL;
+    if (d->queue.head) queue_run(d);
+    return d->ops->map(d, lba, count);
+}
+
+// Dispatch everything queued on d and wait until the driver has completed it
+static void queue_drain(block_device_t* d){
+    if (d->queue.head) queue_run(d);
+    while (d->queue.stats.inflight && d->ops->poll) {
+        if (d->ops->poll(d) > 0) { if (d->queue.head) queue_run(d); continue; }
+        if (d->queue.spin) cpu_relax(); else sched_yield();
+    }
+}
+
+int block_discard(block_device_t* dev, uint64_t lba, uint64_t count){
+    if (!dev || lba + count > dev->sector_count || lba + count < lba) return -1;
+    if (count == 0) return 0;
+    block_device_t* d = block_resolve(dev, &lba);
+    if (!d || !d->ops || !d->ops->discard) return -1;
+    ptable_touch(d, lba, count);
+    // Nothing queued or in flight may land on the range afterwards
+    queue_drain(d);
+    if (d->ops->discard(d, lba, count) != 0) return -1;
+    d->queue.stats.discards++;
+    d->queue.stats.discard_sectors += count;
+    return 0;
+}
+
+int block_flush(block_device_t* dev){
+    if (!dev) {
+        int rc = 0;
+        for (block_device_t* d = g_head; d; d = d->next)
+            if (d->ops && d->ops != &part_ops && block_flush(d) != 0) rc = -1;
+        return rc;
+    }
+    block_device_t* d = block_resolve(dev, NULL);
+    if (!d || !d->ops) return -1;
+    queue_drain(d);
+    if (!d->ops->flush) return 0;
+    d->queue.stats.flushes++;
+    return d->ops->flush(d) == 0 ? 0 : -1;
+}
+
 extern void console_write(const char*);
 extern void console_write_hex64(uint64_t);
 
-void block_scan_partitions(void){
-    uint8_t mbr[512];
-    slog("[block] scan_partitions enter");
-    for (block_device_t* d = g_head; d; d = d->next) {
+// Register partition i of d, or retarget the device an earlier scan made
+// for the same number, so names and pointers held elsewhere stay valid
+static void part_attach(block_device_t* d, block_ptable_t* t, int i){
+    const block_part_t* e = &t->part[i];
+    // Name like <parent>pN
+    int idx = 0; char name[16];
+    for (; idx<12 && d->name[idx]; ++idx) name[idx] = d->name[idx];
+    name[idx++] = 'p';
+    if (e->num >= 10) name[idx++] = (char)('0' + e->num / 10);
+    name[idx++] = (char)('0' + e->num % 10);
+    name[idx] = 0;
+    block_device_t* pd = block_find(name);
+    if (pd && (pd->ops != &part_ops || ((part_priv_t*)pd->priv)->parent != d)) pd = NULL;
+    part_priv_t* pp = pd ? (part_priv_t*)pd->priv : NULL;
+    int fresh = !pd;
+    if (fresh) {
+        pd = (block_device_t*)kmalloc(sizeof(block_device_t)); if (!pd) return;
+        pp = (part_priv_t*)kmalloc(sizeof(part_priv_t)); if (!pp) { kfree(pd); return; }
+        int j=0; for(; name[j]; ++j) pd->name[j]=name[j]; pd->name[j]=0;
+    }
+    pp->parent = d; pp->lba_base = e->start; pp->lba_count = e->count;
+    pd->sector_size = d->sector_size;
+    pd->sector_count = pp->lba_count;
+    if (fresh) {
+        // Initialize part ops on first use
+        part_ops.read = part_read; part_ops.write = part_write;
+        part_ops.readv = part_readv; part_ops.writev = part_writev;
+        part_ops.discard = part_discard; part_ops.flush = part_flush;
+        pd->ops = &part_ops;
+        pd->priv = pp; pd->next = NULL;
+        block_register(pd);
+    }
+    t->dev[i] = pd;
+    console_write("partition: "); console_write(pd->name); console_write(" base="); console_write_hex64(pp->lba_base); console_write(" count="); console_write_hex64(pp->lba_count); console_write("\n");
+}
+
+// Scan d unless its cached table is still valid. Partitions that vanished
+// keep their device with zero sectors, so every access to them fails.
+static block_ptable_t* scan_device(block_device_t* d){
+    if (d->ops == &part_ops) return NULL;
+    block_ptable_t* t = d->ptable;
+    if (t && !t->stale) return t;
     console_write("[block] probe dev "); console_write(d->name);
     console_write(" sec="); console_write_hex64((uint64_t)d->sector_size);
     console_write(" count="); console_write_hex64((uint64_t)d->sector_count);
     console_write("\n");
     // Proceed to scan all devices (including RAM disks)
-    if (!d->ops || !d->ops->read || d->sector_size != 512) continue;
-#ifdef BLOCK_DEBUG
+    if (!d->ops || !d->ops->read || !block_sector_ok(d->sector_size) || d->sector_count < 2) return NULL;
+    if (static_branch_unlikely(&g_dbg_block)) {
     // Log the function pointer addresses to ensure we're calling what we expect
     console_write("[block] ops@="); console_write_hex64((uint64_t)(uintptr_t)d->ops);
     console_write(" read@="); console_write_hex64((uint64_t)(uintptr_t)d->ops->read);
@@ -73,45 +522,41 @@ void block_scan_partitions(void){
     console_write("[block] ops[0..3] = ");
     for (int oi=0; oi<4; ++oi) { console_write_hex64(op64[oi]); console_write(" "); }
     console_write("\n");
-#endif
-    console_write("[block] reading MBR\n");
-#ifdef BLOCK_DEBUG
-    // Test-call the read op with count=0 and then 1
-    (void)d->ops->read(d, 0, mbr, 0);
-    uint8_t scratch[512];
-    (void)d->ops->read(d, 0, scratch, 1);
-#endif
-    // Now perform the actual read of LBA0
-    if (d->ops->read(d, 0, mbr, 1) != 1) { console_write("[block] read LBA0 fail\n"); continue; }
-        console_write("[block] LBA0 ok\n");
-        if (mbr[510] != 0x55 || mbr[511] != 0xAA) { console_write("[block] no 0x55AA\n"); continue; }
-        console_write("[block] 0x55AA found\n");
-        for (int i=0;i<4;++i){
-            const uint8_t* p = &mbr[446 + i*16];
-            uint8_t type = p[4];
-            uint32_t start = *(const uint32_t*)&p[8];
-            uint32_t count = *(const uint32_t*)&p[12];
-            if (type == 0 || count == 0) continue;
-            console_write("[block] part entry found idx="); console_write_hex64(i); console_write(" type="); console_write_hex64(type); console_write(" start="); console_write_hex64(start); console_write(" count="); console_write_hex64(count); console_write("\n");
-            block_device_t* pd = (block_device_t*)kmalloc(sizeof(block_device_t)); if(!pd) continue;
-            part_priv_t* pp = (part_priv_t*)kmalloc(sizeof(part_priv_t)); if(!pp){ /* leak pd */ continue; }
-            pp->parent = d; pp->lba_base = start; pp->lba_count = count;
-            // Name like <parent>pN
-            int nlen=0; while (d->name[nlen] && nlen<15) nlen++;
-            int idx = 0; char name[16];
-            for (; idx<nlen && idx<12; ++idx) name[idx] = d->name[idx];
-            if (idx<13) { name[idx++]='p'; name[idx++] = '1' + i; }
-            name[idx]=0;
-            int j=0; for(; name[j]; ++j) pd->name[j]=name[j]; pd->name[j]=0;
-            pd->sector_size = d->sector_size;
-            pd->sector_count = pp->lba_count;
-            // Initialize part ops on first use
-            part_ops.read = part_read; part_ops.write = part_write;
-            pd->ops = &part_ops;
-            pd->priv = pp; pd->next = NULL;
-            block_register(pd);
-            console_write("partition: "); console_write(pd->name); console_write(" base="); console_write_hex64(pp->lba_base); console_write(" count="); console_write_hex64(pp->lba_count); console_write("\n");
-        }
     }
+    if (!t) {
+        t = (block_ptable_t*)kmalloc(sizeof(block_ptable_t)); if (!t) return NULL;
+        memset(t, 0, sizeof(*t));
+        d->ptable = t;
+    }
+    block_device_t* old[BLOCK_MAX_PARTS];
+    uint32_t had = t->count;
+    memcpy(old, t->dev, sizeof(old));
+    memset(t->dev, 0, sizeof(t->dev));
+    t->stale = 0;
+    t->scans++;
+    if (part_parse(d, t) != 0) { t->stale = 1; }
+    for (int i = 0; i < t->count; ++i) part_attach(d, t, i);
+    // Devices whose number is gone from the table
+    for (uint32_t i = 0; i < had; ++i) {
+        int kept = 0;
+        for (int k = 0; k < t->count; ++k) if (t->dev[k] == old[i]) kept = 1;
+        if (!old[i] || kept) continue;
+        ((part_priv_t*)old[i]->priv)->lba_count = 0;
+        old[i]->sector_count = 0;
+    }
+    return t;
+}
+
+void block_scan_partitions(void){
+    slog("[block] scan_partitions enter");
+    for (block_device_t* d = g_head; d; d = d->next) (void)scan_device(d);
     slog("[block] scan_partitions exit");
 }
+
+const block_ptable_t* block_partitions(block_device_t* dev){
+    return dev ? scan_device(dev) : NULL;
+}
+
+void block_partitions_invalidate(block_device_t* dev){
+    if (dev && dev->ptable) dev->ptable->stale = 1;
+}
@@ -2,12 +2,141 @@
 #include <stdint.h>
 
 typedef struct block_device block_device_t;
+typedef struct bio bio_t;
+
+// One scatter-gather segment. Segments may be any length; a vector's total
+// must be a whole number of sectors.
+typedef struct {
+    void* base;
+    uint32_t len;           // bytes
+} block_iovec_t;
+
+#define BLOCK_MAX_SEGS 32   // segments per vectored request
+// Sector sizes are powers of two from 512 (legacy) to 4096 (4Kn); a
+// 4Kn device's LBAs, partition offsets and filesystem sectors are all in
+// 4 KiB units
+#define BLOCK_MAX_SECTOR 4096u
 
 typedef struct {
     int (*read)(block_device_t* dev, uint64_t lba, void* buf, uint32_t count);  // count in sectors
     int (*write)(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count); // optional, -1 if RO
+    // Optional vectored forms: return sectors transferred or -1. Without
+    // them the block layer falls back to read/write per segment.
+    int (*readv)(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+    int (*writev)(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+    // Optional asynchronous path for hardware queues. submit starts rq
+    // (rq->rq_count sectors at rq->lba, data in segs, which must be consumed
+    // before returning) and returns 0, BLOCK_BUSY when the device queue is
+    // full, or -1. poll reaps finished requests with block_complete() and
+    // returns how many it completed.
+    int (*submit)(block_device_t* dev, bio_t* rq, const block_iovec_t* segs, uint32_t nseg);
+    int (*poll)(block_device_t* dev);
+    // Optional, memory-backed devices: pointer to `count` sectors at lba in
+    // place, or NULL if they are not directly addressable. The bytes stay
+    // valid until the range is written.
+    const void* (*map)(block_device_t* dev, uint64_t lba, uint32_t count);
+    // Optional: the `count` sectors at lba hold no live data any more. The
+    // device may release their backing; later reads return zeros on
+    // memory-backed devices and zeros or stale data on disks. 0 or -1.
+    int (*discard)(block_device_t* dev, uint64_t lba, uint64_t count);
+    // Optional, devices with a volatile write cache: make every completed
+    // write durable. 0 or -1. Without it writes are durable on completion.
+    int (*flush)(block_device_t* dev);
+    // Set when submit honours BIO_FUA itself; otherwise the block layer
+    // runs FUA requests synchronously and follows them with flush
+    uint8_t fua;
 } block_ops_t;
 
+#define BLOCK_BUSY 1
+
+#define BIO_READ  0
+#define BIO_WRITE 1
+
+#define BIO_FUA   0x01      // write reaches stable media before completing
+
+typedef void (*bio_end_io_t)(bio_t* bio);
+
+// One block request. The submitter owns the memory until it completes.
+// A bio on a partition is remapped onto the parent disk when submitted.
+struct bio {
+    block_device_t* dev;
+    uint64_t lba;
+    void* buf;               // flat buffer, or NULL when iov is used
+    const block_iovec_t* iov;
+    uint32_t iovcnt;
+    uint32_t count;          // sectors
+    uint8_t op;              // BIO_READ / BIO_WRITE
+    uint8_t flags;           // BIO_FUA; requests only merge with equal flags
+    volatile uint8_t done;   // set before end_io runs
+    int16_t status;          // 0 ok, -1 error; valid once done
+    bio_end_io_t end_io;     // optional completion callback
+    void* priv;              // submitter's cookie
+    bio_t* next;             // queue link (block layer)
+    bio_t* merged;           // bios merged behind this one at dispatch
+    uint32_t rq_count;       // sectors in the merged request
+    uint32_t rq_segs;        // segments in the merged request
+    uint64_t issued;         // TSC when handed to the driver (latency stats)
+};
+
+typedef struct {
+    uint64_t submitted;      // bios accepted
+    uint64_t dispatched;     // requests handed to the driver
+    uint64_t merged;         // bios folded into an adjacent request
+    uint64_t errors;         // failed requests
+    uint32_t depth;          // bios queued now
+    uint32_t max_depth;      // high-water mark of depth
+    uint32_t inflight;       // requests handed to the driver, not yet complete
+    uint32_t max_inflight;   // high-water mark of inflight
+    uint64_t discards;       // successful discard calls
+    uint64_t discard_sectors;
+    uint64_t flushes;        // cache flushes sent to the device
+    uint64_t fua;            // FUA requests (native or flush-emulated)
+} block_queue_stats_t;
+
+typedef struct {
+    bio_t* head;             // pending bios in LBA order
+    block_queue_stats_t stats;
+    uint8_t spin;            // block_wait busy-polls ops->poll instead of yielding
+} block_queue_t;
+
+#define BLOCK_LAT_BUCKETS 40  // log2 latency buckets, in TSC cycles
+
+// Per-direction counters kept by the dispatch path, indexed by BIO_READ /
+// BIO_WRITE. Bios on a partition are counted on its disk.
+typedef struct {
+    uint64_t ops;            // requests completed (merged bios count once)
+    uint64_t sectors;        // sectors transferred by successful requests
+    uint64_t errors;         // failed requests
+    uint64_t lat_sum;        // dispatch-to-completion TSC cycles, summed
+    uint64_t lat_max;
+    uint32_t hist[BLOCK_LAT_BUCKETS]; // [i]: latency in [2^i, 2^(i+1)) cycles
+} block_io_stats_t;
+
+// Partition table of a disk as found by the last scan
+#define BLOCK_PT_NONE   0
+#define BLOCK_PT_MBR    1
+#define BLOCK_PT_GPT    2
+#define BLOCK_MAX_PARTS 16   // partitions registered per disk
+
+typedef struct {
+    uint64_t start;          // first sector on the disk
+    uint64_t count;
+    uint32_t align;          // bytes: largest power of two up to 1 MiB dividing the start offset
+    uint8_t num;             // N of "<disk>pN": MBR slot or GPT entry, from 1
+    uint8_t mbr_type;        // MBR system id; 0 on GPT
+    uint8_t type_guid[16];   // GPT partition type; zero on MBR
+} block_part_t;
+
+typedef struct block_ptable {
+    uint8_t scheme;          // BLOCK_PT_*
+    uint8_t count;
+    uint8_t stale;           // LBA 0, LBA 1 or the last sector was written since
+    uint8_t gpt_backup;      // the primary GPT was damaged; the backup was used
+    uint32_t scans;          // times the disk was actually read
+    block_part_t part[BLOCK_MAX_PARTS];
+    block_device_t* dev[BLOCK_MAX_PARTS];  // device of part[i]; rescans reuse it by number
+} block_ptable_t;
+
 struct block_device {
     char name[16];
     uint32_t sector_size;   // bytes per sector
@@ -15,19 +144,86 @@ struct block_device {
     const block_ops_t* ops;
     void* priv;
     block_device_t* next;
+    block_queue_t queue;    // initialized by block_register
+    block_io_stats_t io[2]; // zeroed by block_register
+    block_ptable_t* ptable; // partition scan cache; NULL until scanned
 };
 
+// Requests are queued per device, sorted by LBA (never past an overlapping
+// request) and merged when they continue the LBA range of the request ahead
+// and either the driver has vectored ops or the flat buffers are contiguous.
+// The queue runs on block_unplug()/block_wait(), or once BLOCK_QUEUE_MAX bios
+// are pending.
+#define BLOCK_QUEUE_MAX        32
+#define BLOCK_MAX_MERGE_SECTORS 256
+
+void bio_init(bio_t* bio, block_device_t* dev, int op, uint64_t lba, void* buf, uint32_t count);
+// Vectored bio; count is derived from the segment total (must be whole sectors)
+void bio_init_vec(bio_t* bio, block_device_t* dev, int op, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+// Queue a bio; invalid ones complete at once with status -1 (returned too)
+int block_submit(bio_t* bio);
+// Dispatch queued bios of dev (NULL = every device)
+void block_unplug(block_device_t* dev);
+// Dispatch and wait for completion; returns bio->status
+int block_wait(bio_t* bio);
+// For asynchronous drivers: finish a request started by ops->submit and
+// every bio merged into it
+void block_complete(bio_t* rq, int status);
+// Synchronous wrappers: same contract as ops->read/write
+int block_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count);
+int block_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count);
+int block_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+int block_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt);
+// Direct pointer to sectors of a memory-backed device (partitions resolve to
+// their disk); NULL when out of range or the device has no map op. Queued
+// bios of the device are dispatched first.
+const void* block_map(block_device_t* dev, uint64_t lba, uint32_t count);
+// Tell the device a range is dead (partitions resolve to their disk). Queued
+// and in-flight I/O of the device finishes first. 0, or -1 when out of range
+// or the device cannot discard.
+int block_discard(block_device_t* dev, uint64_t lba, uint64_t count);
+// Write barrier: queued and in-flight I/O of the device finishes, then its
+// volatile cache is flushed (partitions resolve to their disk; NULL = every
+// device). 0, or -1 on a flush error; devices without a cache return 0.
+int block_flush(block_device_t* dev);
+// block_write with BIO_FUA: durable when it returns
+int block_write_fua(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count);
+
+// Segment helpers for drivers: total bytes, and copies between a flat range
+// and the vector starting `skip` bytes into it
+uint64_t block_iov_bytes(const block_iovec_t* iov, uint32_t iovcnt);
+void block_iov_from_buf(const block_iovec_t* iov, uint32_t iovcnt, uint64_t skip, const void* src, uint64_t len);
+void block_iov_to_buf(const block_iovec_t* iov, uint32_t iovcnt, uint64_t skip, void* dst, uint64_t len);
+
 void block_register(block_device_t* dev);
+// Clear the I/O counters of dev (NULL = every device)
+void block_io_reset(block_device_t* dev);
 block_device_t* block_find(const char* name);
 uint32_t block_default_sector(void);
+// 1 if ssz is a sector size the block layer supports
+int block_sector_ok(uint32_t ssz);
 
 // Iteration helpers
 block_device_t* block_first(void);
 block_device_t* block_next(block_device_t* dev);
 
-// Optional: scan all registered block devices for MBR partitions and
-// register child devices named "<parent>pN" with LBA offset applied.
+// Optional: scan all registered block devices for GPT or MBR partitions and
+// register child devices named "<parent>pN" with LBA offset applied. On
+// 4Kn devices the MBR/GPT fields count 4 KiB sectors. A protective MBR
+// (type 0xEE) defers to the GPT, whose header and entry array must pass
+// their CRC32s; a damaged primary falls back to the backup at the last
+// sector. Results are cached per disk: a rescan reads nothing unless a write
+// through the block layer reached LBA 0, LBA 1 or the last sector.
 void block_scan_partitions(void);
+// Cached partition table of a disk, scanning it first if needed. NULL for
+// partitions and devices that cannot be read.
+const block_ptable_t* block_partitions(block_device_t* dev);
+// Drop the cached table; the next scan re-reads the disk
+void block_partitions_invalidate(block_device_t* dev);
+
+// Map a partition device and LBA onto the whole-disk device underneath it;
+// other devices are returned unchanged. Used to key shared caches.
+block_device_t* block_resolve(block_device_t* dev, uint64_t* lba);
 
 // Create a memory-backed block device from an existing memory range
 int memdisk_register(const char* name, void* base, uint64_t bytes, uint32_t sector_size, int writable);
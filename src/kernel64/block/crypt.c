@@ -0,0 +1,122 @@
+#include "crypt.h"
+#include "block.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/aes.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+typedef struct crypt {
+    block_device_t dev;
+    block_device_t* base;
+    aes_xts_t key;
+    uint32_t key_bits;      // 128 or 256
+    uint8_t* bounce;        // CRYPT_BOUNCE bytes of ciphertext for writes
+    uint8_t busy;
+    crypt_stats_t st;
+    struct crypt* next;
+} crypt_t;
+
+static block_ops_t s_ops;
+static crypt_t* g_crypts;
+
+static int cr_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    crypt_t* c = (crypt_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    if (block_read(c->base, lba, buf, count) != (int)count) return -1;
+    uint32_t ssz = dev->sector_size;
+    for (uint32_t i = 0; i < count; ++i)
+        aes_xts_decrypt(&c->key, lba + i, (uint8_t*)buf + (uint64_t)i * ssz, (uint8_t*)buf + (uint64_t)i * ssz, ssz);
+    c->st.reads++;
+    c->st.sectors_dec += count;
+    return (int)count;
+}
+
+// The caller's plaintext stays intact: each chunk is encrypted into the
+// bounce buffer and written from there
+static int cr_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    crypt_t* c = (crypt_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    uint32_t ssz = dev->sector_size, per = CRYPT_BOUNCE / ssz;
+    while (c->busy) sched_yield();
+    c->busy = 1;
+    int rc = (int)count;
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = count - done < per ? count - done : per;
+        for (uint32_t i = 0; i < n; ++i)
+            aes_xts_encrypt(&c->key, lba + done + i, c->bounce + (uint64_t)i * ssz,
+                            (const uint8_t*)buf + (uint64_t)(done + i) * ssz, ssz);
+        c->st.sectors_enc += n;
+        if (block_write(c->base, lba + done, c->bounce, n) != (int)n) { rc = -1; break; }
+        done += n;
+    }
+    c->st.writes++;
+    c->busy = 0;
+    return rc;
+}
+
+static int cr_flush(block_device_t* dev) {
+    return block_flush(((crypt_t*)dev->priv)->base);
+}
+
+static int cr_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    if (lba + count > dev->sector_count) return -1;
+    return block_discard(((crypt_t*)dev->priv)->base, lba, count);
+}
+
+int crypt_create(const char* name, const char* base, const uint8_t* key, uint32_t keylen) {
+    block_device_t* b = base ? block_find(base) : NULL;
+    if (!name || !name[0] || block_find(name) || !b || !b->ops || !b->ops->read || !key) return -1;
+    if (b->sector_size % AES_BLOCK || b->sector_size > CRYPT_BOUNCE) return -1;
+    crypt_t* c = (crypt_t*)kmalloc(sizeof(crypt_t));
+    if (!c) return -1;
+    memset(c, 0, sizeof(*c));
+    uint64_t bounce = pmm_alloc_frames_below(CRYPT_BOUNCE / PMM_FRAME_SIZE, 1ULL << 32);
+    if (!bounce || aes_xts_set_key(&c->key, key, keylen) != 0) {
+        if (bounce) pmm_free_frames(bounce, CRYPT_BOUNCE / PMM_FRAME_SIZE);
+        memset(c, 0, sizeof(*c));
+        kfree(c);
+        return -1;
+    }
+    c->base = b;
+    c->bounce = (uint8_t*)(uintptr_t)bounce;
+    c->key_bits = keylen * 4;
+    s_ops.read = cr_read; s_ops.write = cr_write;
+    s_ops.flush = cr_flush; s_ops.discard = cr_discard;
+    block_device_t* d = &c->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = b->sector_size;
+    d->sector_count = b->sector_count;
+    d->ops = &s_ops; d->priv = c; d->next = NULL;
+    c->next = g_crypts; g_crypts = c;
+    block_register(d);
+    return 0;
+}
+
+int crypt_get_stats(const char* name, crypt_stats_t* out) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((crypt_t*)d->priv)->st;
+    return 0;
+}
+
+void crypt_dump(void) {
+    if (!g_crypts) { console_write("crypt: no devices\n"); return; }
+    for (crypt_t* c = g_crypts; c; c = c->next) {
+        console_write(c->dev.name); console_write(": base="); console_write(c->base->name);
+        console_write(" xts-aes-"); console_write_dec(c->key_bits);
+        console_write(aes_hw() ? " aesni" : " soft");
+        console_write(" reads="); console_write_dec(c->st.reads);
+        console_write(" writes="); console_write_dec(c->st.writes);
+        console_write(" dec="); console_write_dec(c->st.sectors_dec);
+        console_write(" enc="); console_write_dec(c->st.sectors_enc);
+        console_write("\n");
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Encrypted block device: XTS-AES over any registered device, one data unit
+// per sector with the sector number as tweak (the layout of dm-crypt's
+// aes-xts-plain64). Reads decrypt in place in the caller's buffer; writes
+// encrypt into a bounce buffer in CRYPT_BOUNCE chunks. Discards pass
+// through, so discarded sectors read back as garbage, not zeros.
+
+#define CRYPT_BOUNCE (64u * 1024u)
+
+typedef struct {
+    uint64_t reads;         // requests
+    uint64_t writes;
+    uint64_t sectors_dec;
+    uint64_t sectors_enc;
+} crypt_stats_t;
+
+// Create and register `name` over `base`; key is 32 bytes (XTS-AES-128) or
+// 64 bytes (XTS-AES-256) and is copied into the key schedule. 0 or -1.
+int crypt_create(const char* name, const char* base, const uint8_t* key, uint32_t keylen);
+// Stats of the named crypt device; returns 0, or -1 if it is not one
+int crypt_get_stats(const char* name, crypt_stats_t* out);
+// Print every crypt device with its cipher and engine (aesni or soft)
+void crypt_dump(void);
@@ -0,0 +1,260 @@
+#include "integ.h"
+#include "block.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/crc32c.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+#define INTEG_FRAMES (INTEG_SCRUB_CHUNK / PMM_FRAME_SIZE)
+
+// Last sector of the base; crc covers the fields before it
+typedef struct {
+    char magic[8];
+    uint32_t ssz;
+    uint32_t meta;          // table sectors
+    uint64_t data_sectors;
+    uint64_t base_sectors;
+    uint32_t crc;
+} integ_sb_t;
+
+static const char s_magic[8] = { 'D', 'X', 'I', 'N', 'T', 'G', '0', '1' };
+
+typedef struct integ {
+    block_device_t dev;
+    block_device_t* base;
+    uint64_t data;          // data sectors; the table starts here
+    uint32_t eps, meta;     // entries per table sector, table sectors
+    uint32_t* crc;          // the table as on disk, meta sectors
+    uint64_t crc_frames;
+    uint8_t* buf;           // INTEG_SCRUB_CHUNK: superblock, build, scrub
+    uint8_t busy;
+    integ_stats_t st;
+    struct integ* next;
+} integ_t;
+
+static block_ops_t s_ops;
+static integ_t* g_integs;
+
+static void integ_lock(integ_t* g) { while (g->busy) sched_yield(); g->busy = 1; }
+static void integ_unlock(integ_t* g) { g->busy = 0; }
+
+static void report(integ_t* g, uint64_t lba, const char* what) {
+    g->st.last_bad = lba;
+    console_write("integ: "); console_write(g->dev.name); console_write(what);
+    console_write_dec(lba); console_write("\n");
+}
+
+// Number of sectors whose contents do not match the table
+static uint32_t check(integ_t* g, uint64_t lba, const uint8_t* buf, uint32_t count) {
+    uint32_t ssz = g->dev.sector_size, bad = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (crc32c(0, buf + (uint64_t)i * ssz, ssz) == g->crc[lba + i]) continue;
+        report(g, lba + i, ": checksum mismatch at sector ");
+        bad++;
+    }
+    return bad;
+}
+
+static int integ_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    integ_t* g = (integ_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    integ_lock(g);
+    int rc = block_read(g->base, lba, buf, count) == (int)count ? (int)count : -1;
+    g->st.reads++;
+    if (rc > 0 && g->st.verify) {
+        uint32_t bad = check(g, lba, (const uint8_t*)buf, count);
+        g->st.verified += count;
+        g->st.mismatches += bad;
+        if (bad) rc = -1;
+    }
+    integ_unlock(g);
+    return rc;
+}
+
+// Data first, then every table sector the range touches
+static int integ_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    integ_t* g = (integ_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    uint32_t ssz = dev->sector_size;
+    integ_lock(g);
+    int rc = (int)count;
+    if (block_write(g->base, lba, buf, count) != (int)count) rc = -1;
+    else {
+        for (uint32_t i = 0; i < count; ++i)
+            g->crc[lba + i] = crc32c(0, (const uint8_t*)buf + (uint64_t)i * ssz, ssz);
+        uint64_t first = lba / g->eps, n = (lba + count - 1) / g->eps - first + 1;
+        if (block_write(g->base, g->data + first, (uint8_t*)g->crc + first * ssz, (uint32_t)n) != (int)n) rc = -1;
+    }
+    g->st.writes++;
+    integ_unlock(g);
+    return rc;
+}
+
+static int integ_flush(block_device_t* dev) {
+    return block_flush(((integ_t*)dev->priv)->base);
+}
+
+static void scrub_main(void* arg) {
+    integ_t* g = (integ_t*)arg;
+    uint32_t per = INTEG_SCRUB_CHUNK / g->dev.sector_size;
+    for (uint64_t lba = 0; lba < g->data; ) {
+        uint32_t n = g->data - lba < per ? (uint32_t)(g->data - lba) : per;
+        integ_lock(g);
+        if (block_read(g->base, lba, g->buf, n) != (int)n) {
+            report(g, lba, ": scrub read error at sector ");
+            g->st.scrub_errors += n;
+        } else {
+            g->st.scrub_errors += check(g, lba, g->buf, n);
+        }
+        lba += n;
+        g->st.scrub_pos = lba;
+        integ_unlock(g);
+        sched_yield();
+    }
+    g->st.scrubs++;
+    g->st.scrubbing = 0;
+    console_write("integ: "); console_write(g->dev.name);
+    console_write(" scrub done, sectors="); console_write_dec(g->st.scrub_pos);
+    console_write(" bad="); console_write_dec(g->st.scrub_errors); console_write("\n");
+}
+
+// Table sectors in chunks from or to the in-memory copy
+static int table_io(integ_t* g, int write) {
+    uint32_t ssz = g->dev.sector_size, per = INTEG_SCRUB_CHUNK / ssz;
+    for (uint32_t s = 0; s < g->meta; ) {
+        uint32_t n = g->meta - s < per ? g->meta - s : per;
+        uint8_t* p = (uint8_t*)g->crc + (uint64_t)s * ssz;
+        int got = write ? block_write(g->base, g->data + s, p, n) : block_read(g->base, g->data + s, p, n);
+        if (got != (int)n) return -1;
+        s += n;
+    }
+    return 0;
+}
+
+static void sb_fill(integ_t* g, integ_sb_t* sb) {
+    memset(sb, 0, sizeof(*sb));
+    memcpy(sb->magic, s_magic, 8);
+    sb->ssz = g->dev.sector_size; sb->meta = g->meta;
+    sb->data_sectors = g->data; sb->base_sectors = g->base->sector_count;
+    sb->crc = crc32c(0, sb, offsetof(integ_sb_t, crc));
+}
+
+static int load(integ_t* g) {
+    integ_sb_t want;
+    sb_fill(g, &want);
+    if (block_read(g->base, g->base->sector_count - 1, g->buf, 1) != 1) return -1;
+    if (memcmp(g->buf, &want, sizeof(want)) != 0) return -1;
+    return table_io(g, 0);
+}
+
+// Checksum what is on the base now, write the table, then the superblock
+// that makes it valid
+static int build(integ_t* g) {
+    uint32_t ssz = g->dev.sector_size, per = INTEG_SCRUB_CHUNK / ssz;
+    for (uint64_t lba = 0; lba < g->data; ) {
+        uint32_t n = g->data - lba < per ? (uint32_t)(g->data - lba) : per;
+        if (block_read(g->base, lba, g->buf, n) != (int)n) return -1;
+        for (uint32_t i = 0; i < n; ++i) g->crc[lba + i] = crc32c(0, g->buf + (uint64_t)i * ssz, ssz);
+        lba += n;
+    }
+    if (table_io(g, 1) != 0 || block_flush(g->base) != 0) return -1;
+    memset(g->buf, 0, ssz);
+    sb_fill(g, (integ_sb_t*)g->buf);
+    g->st.built = g->data;
+    return block_write_fua(g->base, g->base->sector_count - 1, g->buf, 1) == 1 ? 0 : -1;
+}
+
+static void integ_free(integ_t* g) {
+    if (g->crc) pmm_free_frames((uint64_t)(uintptr_t)g->crc, g->crc_frames);
+    if (g->buf) pmm_free_frames((uint64_t)(uintptr_t)g->buf, INTEG_FRAMES);
+    kfree(g);
+}
+
+int integ_create(const char* name, const char* base) {
+    block_device_t* b = base ? block_find(base) : NULL;
+    if (!name || !name[0] || block_find(name) || !b || !b->ops || !b->ops->read || !b->ops->write) return -1;
+    uint32_t ssz = b->sector_size, eps = ssz / 4;
+    if (ssz % 4 || ssz < sizeof(integ_sb_t) || ssz > INTEG_SCRUB_CHUNK || b->sector_count < 3) return -1;
+    // Largest data area that fits with its table and the superblock
+    uint64_t n = b->sector_count, data = (n - 1) / (eps + 1) * eps;
+    while (data + 1 + (data + eps) / eps + 1 <= n) data++;
+    uint64_t meta = (data + eps - 1) / eps;
+    if (data == 0 || meta > 0xFFFFFFFFu) return -1;
+    integ_t* g = (integ_t*)kmalloc(sizeof(integ_t));
+    if (!g) return -1;
+    memset(g, 0, sizeof(*g));
+    g->base = b;
+    g->data = data; g->eps = eps; g->meta = (uint32_t)meta;
+    g->dev.sector_size = ssz;
+    g->crc_frames = (meta * ssz + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    g->crc = (uint32_t*)(uintptr_t)pmm_alloc_frames_below(g->crc_frames, 1ULL << 32);
+    g->buf = (uint8_t*)(uintptr_t)pmm_alloc_frames_below(INTEG_FRAMES, 1ULL << 32);
+    if (!g->crc || !g->buf) { integ_free(g); return -1; }
+    memset(g->crc, 0, g->crc_frames * PMM_FRAME_SIZE);
+    if (load(g) != 0) {
+        memset(g->crc, 0, g->crc_frames * PMM_FRAME_SIZE);
+        if (build(g) != 0) { integ_free(g); return -1; }
+    }
+    g->st.verify = 1;
+    s_ops.read = integ_read; s_ops.write = integ_write; s_ops.flush = integ_flush;
+    block_device_t* d = &g->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_count = data;
+    d->ops = &s_ops; d->priv = g; d->next = NULL;
+    g->next = g_integs; g_integs = g;
+    block_register(d);
+    return 0;
+}
+
+static integ_t* find(const char* name) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    return d && d->ops == &s_ops ? (integ_t*)d->priv : NULL;
+}
+
+int integ_set_verify(const char* name, int on) {
+    integ_t* g = find(name);
+    if (!g) return -1;
+    g->st.verify = on ? 1 : 0;
+    return 0;
+}
+
+int integ_scrub(const char* name) {
+    integ_t* g = find(name);
+    if (!g || g->st.scrubbing) return -1;
+    g->st.scrubbing = 1;
+    g->st.scrub_pos = 0;
+    g->st.scrub_errors = 0;
+    if (sched_create(scrub_main, g) != 0) { g->st.scrubbing = 0; return -1; }
+    return 0;
+}
+
+int integ_get_stats(const char* name, integ_stats_t* out) {
+    integ_t* g = find(name);
+    if (!g || !out) return -1;
+    *out = g->st;
+    return 0;
+}
+
+void integ_dump(void) {
+    if (!g_integs) { console_write("integ: no devices\n"); return; }
+    for (integ_t* g = g_integs; g; g = g->next) {
+        console_write(g->dev.name); console_write(": base="); console_write(g->base->name);
+        console_write(crc32c_hw() ? " crc32c=sse4.2" : " crc32c=soft");
+        console_write(g->st.verify ? " verify=on" : " verify=off");
+        console_write(" sectors="); console_write_dec(g->data);
+        console_write(" verified="); console_write_dec(g->st.verified);
+        console_write(" mismatches="); console_write_dec(g->st.mismatches);
+        console_write(" scrubs="); console_write_dec(g->st.scrubs);
+        if (g->st.scrubbing) { console_write(" scrubbing="); console_write_dec(g->st.scrub_pos); }
+        console_write(" scrub_bad="); console_write_dec(g->st.scrub_errors);
+        console_write("\n");
+    }
+}
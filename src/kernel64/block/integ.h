@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+// Integrity device: a CRC32C per sector over any registered device. The
+// data keeps its LBAs; the checksum table and a superblock live at the tail
+// of the base (one table sector per sector_size/4 data sectors, superblock
+// in the last sector). The whole table is held in memory. Reads are
+// verified when enabled and fail with -1 on a mismatch, which is logged and
+// counted; writes update the data, then the table sectors they touch, so a
+// crash between the two shows up as a mismatch rather than silently. On a
+// base without a matching superblock the checksums of the current contents
+// are built at create. No discard: discarded sectors would not match.
+
+#define INTEG_SCRUB_CHUNK (64u * 1024u)
+
+typedef struct {
+    uint64_t reads;         // requests
+    uint64_t writes;
+    uint64_t verified;      // sectors checked on read
+    uint64_t mismatches;    // on read
+    uint64_t last_bad;      // sector of the latest mismatch, read or scrub
+    uint64_t built;         // sectors checksummed at create (0 if loaded)
+    uint64_t scrubs;        // completed scrub passes
+    uint64_t scrub_pos;     // sectors checked by the running or last pass
+    uint64_t scrub_errors;  // mismatches in the running or last pass
+    uint8_t scrubbing;
+    uint8_t verify;
+} integ_stats_t;
+
+// Create and register `name` over `base` (verification on). 0 or -1.
+int integ_create(const char* name, const char* base);
+// Turn read verification of the named device on or off; checksums are
+// maintained either way. 0, or -1 if it is not an integrity device.
+int integ_set_verify(const char* name, int on);
+// Start a scrub thread verifying every sector in INTEG_SCRUB_CHUNK steps,
+// yielding between them. -1 if one is running or no thread is free.
+int integ_scrub(const char* name);
+// Stats of the named integrity device; returns 0, or -1 if it is not one
+int integ_get_stats(const char* name, integ_stats_t* out);
+// Print every integrity device with its engine (sse4.2 or soft) and counters
+void integ_dump(void);
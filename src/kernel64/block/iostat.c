@@ -0,0 +1,60 @@
+#include "iostat.h"
+#include <stddef.h>
+#include "../tsc.h"
+
+typedef struct { char* out; uint32_t max; uint32_t len; } sbuf_t;
+
+static void put_c(sbuf_t* s, char c){
+    if (s->len + 1 < s->max) s->out[s->len] = c;
+    s->len++;
+}
+static void put_s(sbuf_t* s, const char* str){ while (*str) put_c(s, *str++); }
+// Decimal, right-aligned to width
+static void put_u(sbuf_t* s, uint64_t v, int width){
+    char t[20]; int n = 0;
+    do { t[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+    for (int i = n; i < width; ++i) put_c(s, ' ');
+    while (n) put_c(s, t[--n]);
+}
+static void put_name(sbuf_t* s, const char* name, int width){
+    int n = 0;
+    while (name[n]) put_c(s, name[n++]);
+    for (; n < width; ++n) put_c(s, ' ');
+}
+
+// TSC cycles to microseconds (cycles when the TSC rate is unknown)
+static uint64_t cyc_us(uint64_t cyc, uint64_t khz){ return khz ? cyc * 1000 / khz : cyc; }
+
+static void dev_report(sbuf_t* s, block_device_t* d, int hist, uint64_t khz){
+    for (int w = 0; w < 2; ++w) {
+        const block_io_stats_t* io = &d->io[w];
+        put_name(s, d->name, 10); put_s(s, w ? "write" : "read ");
+        put_u(s, io->ops, 10); put_u(s, io->sectors, 12); put_u(s, io->errors, 7);
+        put_u(s, io->ops ? cyc_us(io->lat_sum / io->ops, khz) : 0, 9);
+        put_u(s, cyc_us(io->lat_max, khz), 9);
+        if (w == 0) { put_u(s, d->queue.stats.inflight, 5); put_u(s, d->queue.stats.max_inflight, 5); }
+        put_c(s, '\n');
+        if (!hist || !io->ops) continue;
+        for (int b = 0; b < BLOCK_LAT_BUCKETS; ++b) {
+            if (!io->hist[b]) continue;
+            put_s(s, "    < "); put_u(s, cyc_us(2ULL << b, khz), 9); put_s(s, khz ? " us" : " cyc");
+            put_u(s, io->hist[b], 10); put_s(s, "  ");
+            for (uint64_t k = (uint64_t)io->hist[b] * 40 / io->ops; k; --k) put_c(s, '#');
+            put_c(s, '\n');
+        }
+    }
+}
+
+uint32_t iostat_format(block_device_t* dev, int hist, char* out, uint32_t max){
+    sbuf_t s = { out, max, 0 };
+    uint64_t khz = tsc_khz();
+    put_s(&s, khz ? "device    dir         ops     sectors errors   avg_us   max_us  inf  max\n"
+                  : "device    dir         ops     sectors errors  avg_cyc  max_cyc  inf  max\n");
+    for (block_device_t* d = dev ? dev : block_first(); d; d = dev ? NULL : block_next(d)) {
+        // Partition traffic is counted on the parent disk
+        if (!dev && !d->io[0].ops && !d->io[1].ops && block_resolve(d, NULL) != d) continue;
+        dev_report(&s, d, hist, khz);
+    }
+    if (max) out[s.len < max ? s.len : max - 1] = 0;
+    return s.len;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include "block.h"
+
+// Text report of the per-device I/O counters (block_device_t.io): one line
+// per device and direction with ops, sectors, errors, mean/max latency and
+// queue depth; with hist set, the non-empty log2 latency buckets follow.
+// Writes at most max-1 bytes plus a NUL to out (out may be NULL when max is
+// 0) and returns the full report length.
+uint32_t iostat_format(block_device_t* dev, int hist, char* out, uint32_t max);
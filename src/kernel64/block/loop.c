@@ -0,0 +1,128 @@
+#include "loop.h"
+#include "block.h"
+#include <stddef.h>
+#include "../vfs/vfs.h"
+#include "../lib/mem.h"
+
+extern void* kmalloc(size_t);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+typedef struct loop {
+    block_device_t dev;
+    vfs_node_t* node;
+    char path[64];
+    uint8_t readonly;
+    loop_stats_t st;
+    struct loop* next;
+} loop_t;
+
+static block_ops_t s_ops;
+static loop_t* g_loops;
+
+static inline uint64_t loop_off(uint64_t lba) { return lba * LOOP_SECTOR; }
+
+// Memory-backed file: one copy out of the mapping. Otherwise one vfs_read
+// per segment, each a contiguous file range.
+static int lo_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    loop_t* lo = (loop_t*)dev->priv;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt);
+    if (bytes % LOOP_SECTOR || lba + bytes / LOOP_SECTOR > dev->sector_count) return -1;
+    lo->st.reads++;
+    const void* m = vfs_map(lo->node, loop_off(lba), bytes);
+    if (m) {
+        lo->st.mapped++;
+        block_iov_from_buf(iov, iovcnt, 0, m, bytes);
+        return (int)(bytes / LOOP_SECTOR);
+    }
+    uint64_t off = loop_off(lba);
+    for (uint32_t i = 0; i < iovcnt; ++i) {
+        if (iov[i].len && vfs_read(lo->node, off, iov[i].base, iov[i].len) != (int)iov[i].len) return -1;
+        off += iov[i].len;
+    }
+    return (int)(bytes / LOOP_SECTOR);
+}
+
+static int lo_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    loop_t* lo = (loop_t*)dev->priv;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt);
+    if (lo->readonly || bytes % LOOP_SECTOR || lba + bytes / LOOP_SECTOR > dev->sector_count) return -1;
+    lo->st.writes++;
+    uint64_t off = loop_off(lba);
+    for (uint32_t i = 0; i < iovcnt; ++i) {
+        if (iov[i].len && vfs_write(lo->node, off, iov[i].base, iov[i].len) != (int)iov[i].len) return -1;
+        off += iov[i].len;
+    }
+    return (int)(bytes / LOOP_SECTOR);
+}
+
+static int lo_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { buf, count * LOOP_SECTOR };
+    return lo_readv(dev, lba, &seg, 1);
+}
+static int lo_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { (void*)buf, count * LOOP_SECTOR };
+    return lo_writev(dev, lba, &seg, 1);
+}
+
+// Write-back state of the backing filesystem, then its device
+static int lo_flush(block_device_t* dev) {
+    loop_t* lo = (loop_t*)dev->priv;
+    if (lo->readonly) return 0;
+    lo->st.flushes++;
+    return vfs_fsync(lo->node) == 0 ? 0 : -1;
+}
+
+static const void* lo_map(block_device_t* dev, uint64_t lba, uint32_t count) {
+    loop_t* lo = (loop_t*)dev->priv;
+    if (lba + count > dev->sector_count) return NULL;
+    return vfs_map(lo->node, loop_off(lba), (uint64_t)count * LOOP_SECTOR);
+}
+
+int loop_attach(const char* name, const char* path, int readonly) {
+    uint64_t size = 0; int is_dir = 1;
+    if (!name || !name[0] || !path || block_find(name)) return -1;
+    if (vfs_stat(path, &size, &is_dir) != 0 || is_dir || size < LOOP_SECTOR) return -1;
+    vfs_node_t* n = vfs_open(path);
+    if (!n) return -1;
+    loop_t* lo = (loop_t*)kmalloc(sizeof(loop_t));
+    if (!lo) return -1;
+    memset(lo, 0, sizeof(*lo));
+    lo->node = n;
+    lo->readonly = (uint8_t)(readonly || !n->fops->write);
+    int i = 0; for (; i < (int)sizeof(lo->path) - 1 && path[i]; ++i) lo->path[i] = path[i]; lo->path[i] = 0;
+    s_ops.read = lo_read; s_ops.write = lo_write;
+    s_ops.readv = lo_readv; s_ops.writev = lo_writev;
+    s_ops.map = lo_map; s_ops.flush = lo_flush;
+    block_device_t* d = &lo->dev;
+    i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = LOOP_SECTOR;
+    d->sector_count = size / LOOP_SECTOR;
+    d->ops = &s_ops; d->priv = lo; d->next = NULL;
+    lo->next = g_loops; g_loops = lo;
+    block_register(d);
+    return 0;
+}
+
+int loop_get_stats(const char* name, loop_stats_t* out) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((loop_t*)d->priv)->st;
+    return 0;
+}
+
+void loop_dump(void) {
+    if (!g_loops) { console_write("loop: no devices\n"); return; }
+    for (loop_t* lo = g_loops; lo; lo = lo->next) {
+        console_write(lo->dev.name); console_write(": "); console_write(lo->path);
+        console_write(" size="); console_write_dec(lo->dev.sector_count * LOOP_SECTOR >> 10);
+        console_write(lo->readonly ? "K ro" : "K rw");
+        console_write(" reads="); console_write_dec(lo->st.reads);
+        console_write(" mapped="); console_write_dec(lo->st.mapped);
+        console_write(" writes="); console_write_dec(lo->st.writes);
+        console_write(" flushes="); console_write_dec(lo->st.flushes);
+        console_write("\n");
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// Loop devices: a file on a mounted filesystem exposed as a block device
+// (e.g. an image kept on the root exFAT). Sector n is file bytes
+// [n*512, n*512+512); a trailing partial sector is not visible. Requests
+// go through vfs_read/vfs_write as one transfer per segment, so merged
+// queue requests reach the filesystem whole; when the file sits in memory
+// (vfs_map) reads copy straight from it and the device maps in place.
+// A flush is a vfs_fsync of the backing file.
+
+#define LOOP_SECTOR 512u
+
+typedef struct {
+    uint64_t reads;         // read requests
+    uint64_t writes;
+    uint64_t mapped;        // reads served through vfs_map
+    uint64_t flushes;       // flushes passed on as vfs_fsync
+} loop_stats_t;
+
+// Attach `path` (mount:/file) as block device `name`; readonly=1 refuses
+// writes. Returns 0, or -1 if the file is missing, a directory or smaller
+// than one sector.
+int loop_attach(const char* name, const char* path, int readonly);
+int loop_get_stats(const char* name, loop_stats_t* out);
+// Print every loop device with its backing file
+void loop_dump(void);
@@ -1,6 +1,7 @@
 #include "block.h"
 #include <stdint.h>
 #include <stddef.h>
+#include "../lib/mem.h"
 
 typedef struct {
     uint8_t* base;      // identity-mapped virtual address to memory region
@@ -14,8 +15,7 @@ static int mem_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count
     uint64_t off = lba * dev->sector_size;
     uint64_t need = (uint64_t)count * dev->sector_size;
     if (off + need > p->bytes) return -1;
-    const uint8_t* src = p->base + off; uint8_t* dst = (uint8_t*)buf;
-    for (uint64_t i=0;i<need;++i) dst[i] = src[i];
+    memcpy(buf, p->base + off, need);
     return (int)count;
 }
 static int mem_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count){
@@ -24,11 +24,37 @@ static int mem_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_
     uint64_t off = lba * dev->sector_size;
     uint64_t need = (uint64_t)count * dev->sector_size;
     if (off + need > p->bytes) return -1;
-    const uint8_t* src = (const uint8_t*)buf; uint8_t* dst = p->base + off;
-    for (uint64_t i=0;i<need;++i) dst[i] = src[i];
+    memcpy(p->base + off, buf, need);
     return (int)count;
 }
 
+static int mem_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    memdisk_priv_t* p = (memdisk_priv_t*)dev->priv;
+    if (!p) return -1;
+    uint64_t off = lba * dev->sector_size;
+    uint64_t need = block_iov_bytes(iov, iovcnt);
+    if (need % dev->sector_size || off + need > p->bytes) return -1;
+    block_iov_from_buf(iov, iovcnt, 0, p->base + off, need);
+    return (int)(need / dev->sector_size);
+}
+static int mem_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt){
+    memdisk_priv_t* p = (memdisk_priv_t*)dev->priv;
+    if (!p || !p->writable) return -1;
+    uint64_t off = lba * dev->sector_size;
+    uint64_t need = block_iov_bytes(iov, iovcnt);
+    if (need % dev->sector_size || off + need > p->bytes) return -1;
+    block_iov_to_buf(iov, iovcnt, 0, p->base + off, need);
+    return (int)(need / dev->sector_size);
+}
+
+static const void* mem_map(block_device_t* dev, uint64_t lba, uint32_t count){
+    memdisk_priv_t* p = (memdisk_priv_t*)dev->priv;
+    if (!p) return NULL;
+    uint64_t off = lba * dev->sector_size;
+    if (off + (uint64_t)count * dev->sector_size > p->bytes) return NULL;
+    return p->base + off;
+}
+
 static block_ops_t mem_ops;
 
 extern void* kmalloc(size_t);
@@ -45,6 +71,8 @@ int memdisk_register(const char* name, void* base, uint64_t bytes, uint32_t sect
     d->sector_size = sector_size;
     d->sector_count = bytes / sector_size;
     mem_ops.read = mem_read; mem_ops.write = mem_write;
+    mem_ops.readv = mem_readv; mem_ops.writev = mem_writev;
+    mem_ops.map = mem_map;
     d->ops = &mem_ops; d->priv = p; d->next = NULL;
     block_register(d);
     return 0;
@@ -0,0 +1,681 @@
+// NVMe over PCI: controller reset/enable, admin queue, Identify, I/O queue
+// pair creation, PRP construction and completion-queue polling. Requests
+// come from the block queue through the async submit/poll ops.
+#include "nvme.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+#include "../console.h"
+#include "../cpuid.h"
+#include "../tsc.h"
+#include "../pci/pci.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+#include "../../kernel/mm/pmm.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+
+// Controller registers (byte offsets in BAR0)
+#define NVME_CAP   0x00
+#define NVME_INTMS 0x0C
+#define NVME_INTMC 0x10
+#define NVME_CC    0x14
+#define NVME_CSTS  0x1C
+#define NVME_AQA   0x24
+#define NVME_ASQ   0x28
+#define NVME_ACQ   0x30
+#define NVME_DBS   0x1000
+
+#define CC_EN      1u
+#define CC_IOSQES  (6u << 16)     // 64-byte SQ entries
+#define CC_IOCQES  (4u << 20)     // 16-byte CQ entries
+#define CSTS_RDY   1u
+#define CSTS_CFS   2u
+
+#define ADM_CREATE_SQ 0x01
+#define ADM_DELETE_CQ 0x04
+#define ADM_CREATE_CQ 0x05
+#define ADM_IDENTIFY  0x06
+#define ADM_SET_FEAT  0x09
+#define FEAT_NUM_QUEUES 0x07
+#define NVM_FLUSH 0x00
+#define NVM_WRITE 0x01
+#define NVM_READ  0x02
+#define NVM_DSM   0x09                // Dataset Management
+#define DSM_AD    (1u << 2)           // attribute: deallocate
+#define ONCS_DSM  (1u << 2)
+#define RW_FUA    (1u << 30)          // cdw12: force unit access
+#define VWC_PRESENT 1u                // Identify: volatile write cache
+#define DSM_MAX_RANGES 256u
+#define DSM_RANGE_MAX  0xFFFFFFFFull  // blocks per range
+
+#define NVME_ADMIN_DEPTH  16
+#define NVME_MAX_XFER     (1024u * 1024u)   // PRP list page covers this comfortably
+#define NVME_BOUNCE_BYTES (128u * 1024u)
+#define NVME_MAX_CTRL     4
+#define NVME_MAX_NS       8
+#define NVME_PAGE         4096u
+
+typedef struct {
+    uint32_t cdw0;                 // opcode [7:0], command id [31:16]
+    uint32_t nsid;
+    uint64_t rsv;
+    uint64_t mptr;
+    uint64_t prp1, prp2;
+    uint32_t cdw10, cdw11, cdw12, cdw13, cdw14, cdw15;
+} nvme_sqe_t;
+
+typedef struct {
+    uint32_t dw0, dw1;
+    uint16_t sq_head, sq_id;
+    uint16_t cid;
+    uint16_t status;               // phase bit 0, status field [15:1]
+} nvme_cqe_t;
+
+// One block request; split requests own several command ids
+typedef struct {
+    bio_t* rq;                     // asynchronous request, NULL when synchronous
+    uint16_t parts;                // commands still outstanding
+    int8_t status;
+    volatile uint8_t done;
+} nvme_io_t;
+
+typedef struct {
+    uint16_t qid, depth;
+    nvme_sqe_t* sq;
+    volatile nvme_cqe_t* cq;
+    volatile uint32_t* sq_db;
+    volatile uint32_t* cq_db;
+    uint16_t sq_tail, cq_head;
+    uint8_t phase;
+    uint32_t cid_busy;             // command ids in flight (depth - 1 usable)
+    uint8_t cid_io[32];            // command id -> io
+    uint64_t* prp_lists;           // one page per command id
+    nvme_io_t ios[32];
+    uint32_t io_busy;
+    uint8_t* bounce;               // for segments PRPs cannot describe
+    int bounce_io;
+    uint8_t bounce_write;
+    block_iovec_t bounce_segs[BLOCK_MAX_SEGS];
+    uint32_t bounce_nseg;
+} nvme_qp_t;
+
+typedef struct nvme_ctrl nvme_ctrl_t;
+
+typedef struct {
+    block_device_t bdev;
+    nvme_ctrl_t* c;
+    uint32_t nsid;
+} nvme_ns_t;
+
+typedef struct {
+    uint64_t commands;
+    uint64_t completions;
+    uint64_t errors;               // commands completed with a non-zero status
+    uint64_t splits;               // requests larger than max_xfer
+    uint64_t bounced;
+} nvme_stats_t;
+
+struct nvme_ctrl {
+    volatile uint8_t* bar;
+    uint32_t dstrd;                // doorbell stride in bytes
+    uint64_t timeout_ms;
+    nvme_qp_t admin;
+    nvme_qp_t* ioq[NVME_MAX_IOQ];
+    int nioq;
+    nvme_qp_t* ioq_dead[NVME_MAX_IOQ];  // failed creates whose CQ could not be deleted
+    int ndead;
+    uint32_t max_xfer;             // bytes per command
+    uint8_t mode;
+    uint8_t dsm;                   // Dataset Management (deallocate) supported
+    uint8_t vwc;                   // volatile write cache present: Flush needed
+    int index;
+    char model[41];
+    nvme_ns_t* ns[NVME_MAX_NS];
+    int nns;
+    nvme_stats_t stats;
+};
+
+static nvme_ctrl_t* g_ctrl[NVME_MAX_CTRL];
+static int g_nctrl;
+static block_ops_t nvme_ops;
+
+static inline uint64_t dma_addr(const volatile void* p) { return (uint64_t)(uintptr_t)p; }
+static inline void barrier(void) { __asm__ volatile("" ::: "memory"); }
+static inline uint32_t rd32(nvme_ctrl_t* c, uint32_t off) { return *(volatile uint32_t*)(c->bar + off); }
+static inline void wr32(nvme_ctrl_t* c, uint32_t off, uint32_t v) { *(volatile uint32_t*)(c->bar + off) = v; }
+static inline void wr64(nvme_ctrl_t* c, uint32_t off, uint64_t v) { wr32(c, off, (uint32_t)v); wr32(c, off + 4, (uint32_t)(v >> 32)); }
+
+// Kernel threads only run on the boot CPU today; per-CPU queue selection
+// starts here once application processors are brought up
+static inline int nvme_cpu(void) { return 0; }
+
+static uint64_t ms_cycles(uint64_t ms) { uint64_t khz = tsc_khz(); return (khz ? khz : 2000000ULL) * ms; }
+
+static int wait_csts(nvme_ctrl_t* c, uint32_t mask, uint32_t val) {
+    uint64_t limit = ms_cycles(c->timeout_ms), t0 = rdtsc();
+    while ((rd32(c, NVME_CSTS) & mask) != val) {
+        if (rdtsc() - t0 > limit) return -1;
+        __asm__ volatile("pause");
+    }
+    return 0;
+}
+
+static void qp_init(nvme_ctrl_t* c, nvme_qp_t* q, uint16_t qid, uint16_t depth, uint64_t sq, uint64_t cq) {
+    q->qid = qid; q->depth = depth;
+    q->sq = (nvme_sqe_t*)(uintptr_t)sq;
+    q->cq = (volatile nvme_cqe_t*)(uintptr_t)cq;
+    q->sq_db = (volatile uint32_t*)(c->bar + NVME_DBS + (2u * qid) * c->dstrd);
+    q->cq_db = (volatile uint32_t*)(c->bar + NVME_DBS + (2u * qid + 1) * c->dstrd);
+    q->sq_tail = 0; q->cq_head = 0; q->phase = 1;
+    q->bounce_io = -1;
+}
+
+static void qp_push(nvme_qp_t* q, const nvme_sqe_t* e) {
+    q->sq[q->sq_tail] = *e;
+    if (++q->sq_tail == q->depth) q->sq_tail = 0;
+}
+
+// ---- admin commands (synchronous, one at a time) ----
+
+static int admin_cmd(nvme_ctrl_t* c, nvme_sqe_t* e, uint32_t* result) {
+    nvme_qp_t* q = &c->admin;
+    qp_push(q, e);
+    barrier();
+    *q->sq_db = q->sq_tail;
+    uint64_t limit = ms_cycles(c->timeout_ms), t0 = rdtsc();
+    while ((q->cq[q->cq_head].status & 1) != q->phase) {
+        if (rdtsc() - t0 > limit) return -1;
+        __asm__ volatile("pause");
+    }
+    barrier();
+    uint16_t st = q->cq[q->cq_head].status >> 1;
+    if (result) *result = q->cq[q->cq_head].dw0;
+    if (++q->cq_head == q->depth) { q->cq_head = 0; q->phase ^= 1; }
+    *q->cq_db = q->cq_head;
+    return st ? -1 : 0;
+}
+
+static int identify(nvme_ctrl_t* c, uint32_t cns, uint32_t nsid, void* buf) {
+    nvme_sqe_t e = {0};
+    e.cdw0 = ADM_IDENTIFY; e.nsid = nsid; e.prp1 = dma_addr(buf); e.cdw10 = cns;
+    return admin_cmd(c, &e, NULL);
+}
+
+// ---- PRPs ----
+
+// PRPs can describe the segments directly when only the first starts off a
+// page boundary (dword aligned) and every segment but the last ends on one
+static int prp_ok(const block_iovec_t* segs, uint32_t nseg) {
+    int first = 1;
+    for (uint32_t i = 0; i < nseg; ++i) {
+        if (!segs[i].len) continue;
+        uint64_t a = dma_addr(segs[i].base);
+        if (first ? (a & 3) : (a & (NVME_PAGE - 1))) return 0;
+        first = 0;
+        int last = 1;
+        for (uint32_t k = i + 1; k < nseg; ++k) if (segs[k].len) { last = 0; break; }
+        if (!last && ((a + segs[i].len) & (NVME_PAGE - 1))) return 0;
+    }
+    return 1;
+}
+
+// PRP1/PRP2 for bytes [off, off+len) of the segments, listing pages past
+// the first two in `list`
+static void build_prp(const block_iovec_t* segs, uint32_t nseg, uint64_t off, uint64_t len,
+                      uint64_t* list, uint64_t* prp1, uint64_t* prp2) {
+    uint32_t n = 0;
+    int first = 1;
+    for (uint32_t i = 0; i < nseg && len; ++i) {
+        if (off >= segs[i].len) { off -= segs[i].len; continue; }
+        uint64_t a = dma_addr(segs[i].base) + off;
+        uint64_t t = segs[i].len - off; if (t > len) t = len;
+        uint64_t end = a + t;
+        off = 0; len -= t;
+        if (first) { *prp1 = a; first = 0; a = (a & ~(uint64_t)(NVME_PAGE - 1)) + NVME_PAGE; }
+        for (; a < end; a += NVME_PAGE) list[n++] = a;
+    }
+    *prp2 = n == 0 ? 0 : n == 1 ? list[0] : dma_addr(list);
+}
+
+// ---- I/O ----
+
+static void io_finish(nvme_ctrl_t* c, nvme_qp_t* q, int i) {
+    nvme_io_t* io = &q->ios[i];
+    if (q->bounce_io == i) {
+        if (io->status == 0 && !q->bounce_write)
+            block_iov_from_buf(q->bounce_segs, q->bounce_nseg, 0, q->bounce, block_iov_bytes(q->bounce_segs, q->bounce_nseg));
+        q->bounce_io = -1;
+    }
+    q->io_busy &= ~(1u << i);
+    c->stats.completions++;
+    if (io->rq) { bio_t* rq = io->rq; io->rq = NULL; block_complete(rq, io->status); }
+    else io->done = 1;
+}
+
+static int qp_reap(nvme_ctrl_t* c, nvme_qp_t* q) {
+    int n = 0;
+    while ((q->cq[q->cq_head].status & 1) == q->phase) {
+        barrier();
+        uint16_t cid = q->cq[q->cq_head].cid;
+        uint16_t st = q->cq[q->cq_head].status >> 1;
+        if (++q->cq_head == q->depth) { q->cq_head = 0; q->phase ^= 1; }
+        ++n;
+        if (cid >= q->depth - 1 || !(q->cid_busy & (1u << cid))) continue;
+        q->cid_busy &= ~(1u << cid);
+        int i = q->cid_io[cid];
+        nvme_io_t* io = &q->ios[i];
+        if (st) { io->status = -1; c->stats.errors++; }
+        if (--io->parts == 0) io_finish(c, q, i);
+    }
+    if (n) *q->cq_db = q->cq_head;
+    return n;
+}
+
+static int ctrl_reap(nvme_ctrl_t* c) {
+    int n = 0;
+    for (int k = 0; k < c->nioq; ++k) n += qp_reap(c, c->ioq[k]);
+    return n;
+}
+
+// Start a read/write on queue pair q (fua: writes bypass the volatile
+// cache); returns the io index, -2 when the queue is full, or -1
+static int qp_rw(nvme_ns_t* ns, nvme_qp_t* q, int write, int fua, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    nvme_ctrl_t* c = ns->c;
+    uint32_t ssz = ns->bdev.sector_size;
+    uint64_t bytes = block_iov_bytes(segs, nseg);
+    if (bytes == 0 || bytes % ssz || lba + bytes / ssz > ns->bdev.sector_count) return -1;
+    uint32_t parts = (uint32_t)((bytes + c->max_xfer - 1) / c->max_xfer);
+    if (parts > (uint32_t)q->depth - 1) return -1;
+    uint32_t cid_free = ~q->cid_busy & ((1u << (q->depth - 1)) - 1);
+    uint32_t io_free = ~q->io_busy & ((1u << (q->depth - 1)) - 1);
+    uint32_t nfree = 0;
+    for (uint32_t m = cid_free; m && nfree < parts; m &= m - 1) ++nfree;   // no libgcc popcount here
+    if (!io_free || nfree < parts) return -2;
+    int bounce = !prp_ok(segs, nseg);
+    block_iovec_t one;
+    if (bounce) {
+        if (bytes > NVME_BOUNCE_BYTES || nseg > BLOCK_MAX_SEGS) return -1;
+        if (q->bounce_io >= 0) return -2;
+        if (!q->bounce) {
+            uint64_t f = pmm_alloc_frames_below(NVME_BOUNCE_BYTES / PMM_FRAME_SIZE, 1ULL << 32);
+            if (!f) return -1;
+            q->bounce = (uint8_t*)(uintptr_t)f;
+        }
+    }
+    int i = __builtin_ctz(io_free);
+    q->io_busy |= 1u << i;
+    nvme_io_t* io = &q->ios[i];
+    io->rq = NULL; io->parts = (uint16_t)parts; io->status = 0; io->done = 0;
+    if (bounce) {
+        if (write) block_iov_to_buf(segs, nseg, 0, q->bounce, bytes);
+        memcpy(q->bounce_segs, segs, nseg * sizeof(*segs));
+        q->bounce_nseg = nseg;
+        q->bounce_io = i;
+        q->bounce_write = (uint8_t)write;
+        c->stats.bounced++;
+        one.base = q->bounce; one.len = (uint32_t)bytes;
+        segs = &one; nseg = 1;
+    }
+    if (parts > 1) c->stats.splits++;
+    for (uint64_t off = 0; off < bytes; off += c->max_xfer) {
+        uint64_t len = bytes - off; if (len > c->max_xfer) len = c->max_xfer;
+        int cid = __builtin_ctz(cid_free); cid_free &= cid_free - 1;
+        q->cid_busy |= 1u << cid;
+        q->cid_io[cid] = (uint8_t)i;
+        nvme_sqe_t e = {0};
+        e.cdw0 = (write ? NVM_WRITE : NVM_READ) | ((uint32_t)cid << 16);
+        e.nsid = ns->nsid;
+        build_prp(segs, nseg, off, len, q->prp_lists + (uint64_t)cid * (NVME_PAGE / 8), &e.prp1, &e.prp2);
+        uint64_t slba = lba + off / ssz;
+        e.cdw10 = (uint32_t)slba; e.cdw11 = (uint32_t)(slba >> 32);
+        e.cdw12 = (uint32_t)(len / ssz - 1) | (write && fua ? RW_FUA : 0);
+        qp_push(q, &e);
+        c->stats.commands++;
+    }
+    barrier();
+    *q->sq_db = q->sq_tail;   // one doorbell for every part
+    return i;
+}
+
+// Start a data-less command on q: NVM_FLUSH, or NVM_DSM deallocating
+// [lba, lba+count) with the range list in the command's PRP list page.
+// Same returns as qp_rw.
+static int qp_cmd(nvme_ns_t* ns, nvme_qp_t* q, uint32_t opc, uint64_t lba, uint64_t count) {
+    nvme_ctrl_t* c = ns->c;
+    uint32_t cid_free = ~q->cid_busy & ((1u << (q->depth - 1)) - 1);
+    uint32_t io_free = ~q->io_busy & ((1u << (q->depth - 1)) - 1);
+    if (!cid_free || !io_free) return -2;
+    int i = __builtin_ctz(io_free);
+    q->io_busy |= 1u << i;
+    nvme_io_t* io = &q->ios[i];
+    io->rq = NULL; io->parts = 1; io->status = 0; io->done = 0;
+    int cid = __builtin_ctz(cid_free);
+    q->cid_busy |= 1u << cid;
+    q->cid_io[cid] = (uint8_t)i;
+    nvme_sqe_t e = {0};
+    e.cdw0 = opc | ((uint32_t)cid << 16);
+    e.nsid = ns->nsid;
+    if (opc == NVM_DSM) {
+        uint32_t* r = (uint32_t*)(q->prp_lists + (uint64_t)cid * (NVME_PAGE / 8));
+        uint32_t nr = 0;
+        for (; count; ++nr, r += 4) {
+            uint64_t n = count < DSM_RANGE_MAX ? count : DSM_RANGE_MAX;
+            r[0] = 0; r[1] = (uint32_t)n;          // context attributes, length
+            r[2] = (uint32_t)lba; r[3] = (uint32_t)(lba >> 32);
+            lba += n; count -= n;
+        }
+        e.prp1 = dma_addr(q->prp_lists + (uint64_t)cid * (NVME_PAGE / 8));
+        e.cdw10 = nr - 1; e.cdw11 = DSM_AD;
+    }
+    qp_push(q, &e);
+    c->stats.commands++;
+    barrier();
+    *q->sq_db = q->sq_tail;
+    return i;
+}
+
+static int nvme_poll(block_device_t* dev) { return ctrl_reap(((nvme_ns_t*)dev->priv)->c); }
+
+// Queue pair of the submitting CPU first, spilling to the others when full
+static int ns_rw(nvme_ns_t* ns, int write, int fua, uint64_t lba, const block_iovec_t* segs, uint32_t nseg, nvme_qp_t** out) {
+    nvme_ctrl_t* c = ns->c;
+    int r = -2;
+    for (int k = 0; k < c->nioq && r == -2; ++k) {
+        nvme_qp_t* q = c->ioq[(nvme_cpu() + k) % c->nioq];
+        r = qp_rw(ns, q, write, fua, lba, segs, nseg);
+        *out = q;
+    }
+    return r;
+}
+
+static int nvme_submit(block_device_t* dev, bio_t* rq, const block_iovec_t* segs, uint32_t nseg) {
+    nvme_qp_t* q = NULL;
+    int i = ns_rw((nvme_ns_t*)dev->priv, rq->op == BIO_WRITE, rq->flags & BIO_FUA, rq->lba, segs, nseg, &q);
+    if (i == -2) return BLOCK_BUSY;
+    if (i < 0) return -1;
+    q->ios[i].rq = rq;
+    return 0;
+}
+
+static void ctrl_idle(nvme_ctrl_t* c) {
+    if (ctrl_reap(c) > 0) return;
+    if (c->mode == NVME_MODE_POLL) __asm__ volatile("pause"); else sched_yield();
+}
+
+static int nvme_sync(nvme_ns_t* ns, int write, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    nvme_qp_t* q = NULL;
+    int i;
+    while ((i = ns_rw(ns, write, 0, lba, segs, nseg, &q)) == -2) ctrl_idle(ns->c);
+    if (i < 0) return -1;
+    while (!q->ios[i].done) ctrl_idle(ns->c);
+    return q->ios[i].status ? -1 : (int)(block_iov_bytes(segs, nseg) / ns->bdev.sector_size);
+}
+
+// Run a qp_cmd() command on the first queue pair with room and wait for it
+static int ns_cmd_sync(nvme_ns_t* ns, uint32_t opc, uint64_t lba, uint64_t count) {
+    nvme_ctrl_t* c = ns->c;
+    nvme_qp_t* q = NULL;
+    int i = -2;
+    while (i == -2) {
+        for (int k = 0; k < c->nioq && i == -2; ++k) {
+            q = c->ioq[(nvme_cpu() + k) % c->nioq];
+            i = qp_cmd(ns, q, opc, lba, count);
+        }
+        if (i == -2) ctrl_idle(c);
+    }
+    while (!q->ios[i].done) ctrl_idle(c);
+    return q->ios[i].status ? -1 : 0;
+}
+
+static int nvme_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    nvme_ns_t* ns = (nvme_ns_t*)dev->priv;
+    if (!ns->c->dsm || lba + count > dev->sector_count) return -1;
+    if (count > DSM_MAX_RANGES * DSM_RANGE_MAX) return -1;
+    if (count == 0) return 0;
+    return ns_cmd_sync(ns, NVM_DSM, lba, count);
+}
+
+// Without a volatile write cache every completed write is already durable
+static int nvme_flush(block_device_t* dev) {
+    nvme_ns_t* ns = (nvme_ns_t*)dev->priv;
+    return ns->c->vwc ? ns_cmd_sync(ns, NVM_FLUSH, 0, 0) : 0;
+}
+
+static int nvme_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { buf, count * dev->sector_size };
+    return nvme_sync((nvme_ns_t*)dev->priv, 0, lba, &seg, 1);
+}
+static int nvme_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { (void*)buf, count * dev->sector_size };
+    return nvme_sync((nvme_ns_t*)dev->priv, 1, lba, &seg, 1);
+}
+static int nvme_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return nvme_sync((nvme_ns_t*)dev->priv, 0, lba, iov, iovcnt);
+}
+static int nvme_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return nvme_sync((nvme_ns_t*)dev->priv, 1, lba, iov, iovcnt);
+}
+
+// ---- bring-up ----
+
+#define IOQ_PAGES (2 + 31)   // SQ, CQ, one PRP list page per command id
+
+static void ioq_free(nvme_qp_t* q) {
+    if (q->bounce) pmm_free_frames((uint64_t)(uintptr_t)q->bounce, NVME_BOUNCE_BYTES / PMM_FRAME_SIZE);
+    pmm_free_frames((uint64_t)(uintptr_t)q->sq, IOQ_PAGES);
+    kfree(q);
+}
+
+static int create_ioq(nvme_ctrl_t* c, uint16_t qid, uint16_t depth) {
+    size_t pages = IOQ_PAGES;
+    uint64_t mem = pmm_alloc_frames_below(pages, 1ULL << 32);
+    nvme_qp_t* q = (nvme_qp_t*)kmalloc(sizeof(nvme_qp_t));
+    if (!mem || !q) { if (mem) pmm_free_frames(mem, pages); if (q) kfree(q); return -1; }
+    memset(q, 0, sizeof(*q));
+    memset((void*)(uintptr_t)mem, 0, 2 * PMM_FRAME_SIZE);
+    qp_init(c, q, qid, depth, mem, mem + PMM_FRAME_SIZE);
+    q->prp_lists = (uint64_t*)(uintptr_t)(mem + 2 * PMM_FRAME_SIZE);
+    nvme_sqe_t e = {0};
+    e.cdw0 = ADM_CREATE_CQ; e.prp1 = mem + PMM_FRAME_SIZE;
+    e.cdw10 = ((uint32_t)(depth - 1) << 16) | qid;
+    e.cdw11 = 1u | 2u;                                  // physically contiguous, interrupts enabled (vector 0)
+    if (admin_cmd(c, &e, NULL) != 0) { ioq_free(q); return -1; }
+    e = (nvme_sqe_t){0};
+    e.cdw0 = ADM_CREATE_SQ; e.prp1 = mem;
+    e.cdw10 = ((uint32_t)(depth - 1) << 16) | qid;
+    e.cdw11 = ((uint32_t)qid << 16) | 1u;
+    if (admin_cmd(c, &e, NULL) != 0) {
+        // The CQ is live on the controller and points at mem: delete it
+        // first. If that fails too, mem stays allocated until the
+        // controller is disabled (ctrl_teardown), never reused while live.
+        e = (nvme_sqe_t){0};
+        e.cdw0 = ADM_DELETE_CQ; e.cdw10 = qid;
+        if (admin_cmd(c, &e, NULL) == 0) ioq_free(q);
+        else c->ioq_dead[c->ndead++] = q;
+        return -1;
+    }
+    c->ioq[c->nioq++] = q;
+    return 0;
+}
+
+static void set_mode(nvme_ctrl_t* c, int mode) {
+    c->mode = (uint8_t)mode;
+    // Without MSI-X the single pin interrupt is vector 0
+    wr32(c, mode == NVME_MODE_POLL ? NVME_INTMS : NVME_INTMC, 1u);
+    for (int k = 0; k < c->nns; ++k) c->ns[k]->bdev.queue.spin = mode == NVME_MODE_POLL;
+}
+
+static void register_ns(nvme_ctrl_t* c, uint32_t nsid, const uint8_t* idns) {
+    uint64_t nsze = *(const uint64_t*)idns;
+    uint8_t fmt = idns[26] & 0xF;
+    uint32_t lbads = (*(const uint32_t*)(idns + 128 + 4 * fmt) >> 16) & 0xFF;
+    if (nsze == 0 || lbads < 9 || lbads > 12 || c->nns >= NVME_MAX_NS) return;
+    nvme_ns_t* ns = (nvme_ns_t*)kmalloc(sizeof(nvme_ns_t));
+    if (!ns) return;
+    memset(ns, 0, sizeof(*ns));
+    ns->c = c; ns->nsid = nsid;
+    // "nvme<c>n<nsid>"
+    char* nm = ns->bdev.name;
+    int k = 0;
+    const char* pre = "nvme";
+    while (*pre) nm[k++] = *pre++;
+    nm[k++] = (char)('0' + c->index);
+    nm[k++] = 'n';
+    if (nsid >= 10) nm[k++] = (char)('0' + (nsid / 10) % 10);
+    nm[k++] = (char)('0' + nsid % 10);
+    nm[k] = 0;
+    ns->bdev.sector_size = 1u << lbads;
+    ns->bdev.sector_count = nsze;
+    ns->bdev.ops = &nvme_ops;
+    ns->bdev.priv = ns;
+    block_register(&ns->bdev);
+    c->ns[c->nns++] = ns;
+    console_write("[nvme] "); console_write(nm);
+    console_write(": sectors="); console_write_dec(nsze);
+    console_write(" lba="); console_write_dec(ns->bdev.sector_size);
+    console_putc('\n');
+}
+
+static int ctrl_setup(nvme_ctrl_t* c, const pci_device_t* d) {
+    c->bar = (volatile uint8_t*)pci_map_bar(d, 0, NVME_DBS);
+    if (!c->bar) return -1;
+    uint64_t cap = (uint64_t)rd32(c, NVME_CAP) | ((uint64_t)rd32(c, NVME_CAP + 4) << 32);
+    c->dstrd = 4u << ((cap >> 32) & 0xF);
+    c->timeout_ms = ((cap >> 24) & 0xFF) * 500ULL;
+    if (c->timeout_ms == 0) c->timeout_ms = 500;
+    if (!pci_map_bar(d, 0, NVME_DBS + 2u * (NVME_MAX_IOQ + 1) * c->dstrd)) return -1;
+    uint32_t mqes = (uint32_t)(cap & 0xFFFF) + 1;
+
+    // Reset, then program the admin queue and enable
+    wr32(c, NVME_CC, rd32(c, NVME_CC) & ~CC_EN);
+    if (wait_csts(c, CSTS_RDY, 0) != 0) { console_write("[nvme] disable timeout\n"); return -1; }
+    uint64_t amem = pmm_alloc_frames_below(3, 1ULL << 32);
+    if (!amem) return -1;
+    memset((void*)(uintptr_t)amem, 0, 3 * PMM_FRAME_SIZE);
+    uint16_t adepth = mqes < NVME_ADMIN_DEPTH ? (uint16_t)mqes : NVME_ADMIN_DEPTH;
+    qp_init(c, &c->admin, 0, adepth, amem, amem + PMM_FRAME_SIZE);
+    wr32(c, NVME_AQA, ((uint32_t)(adepth - 1) << 16) | (adepth - 1u));
+    wr64(c, NVME_ASQ, amem);
+    wr64(c, NVME_ACQ, amem + PMM_FRAME_SIZE);
+    wr32(c, NVME_CC, CC_IOSQES | CC_IOCQES | CC_EN);
+    if (wait_csts(c, CSTS_RDY | CSTS_CFS, CSTS_RDY) != 0) { console_write("[nvme] enable failed\n"); return -1; }
+
+    uint8_t* idbuf = (uint8_t*)(uintptr_t)(amem + 2 * PMM_FRAME_SIZE);
+    if (identify(c, 1, 0, idbuf) != 0) return -1;
+    memcpy(c->model, idbuf + 24, 40);
+    for (int k = 39; k >= 0 && (c->model[k] == ' ' || c->model[k] == 0); --k) c->model[k] = 0;
+    uint8_t mdts = idbuf[77];
+    c->dsm = (*(const uint16_t*)(idbuf + 520) & ONCS_DSM) != 0;
+    c->vwc = (idbuf[525] & VWC_PRESENT) != 0;
+    c->max_xfer = NVME_MAX_XFER;
+    if (mdts && mdts < 20 && (NVME_PAGE << mdts) < c->max_xfer) c->max_xfer = NVME_PAGE << mdts;
+
+    // One I/O queue pair per CPU, as many as the controller grants
+    uint32_t want = cpuid_logical_processor_count();
+    if (want > NVME_MAX_IOQ) want = NVME_MAX_IOQ;
+    if (want == 0) want = 1;
+    nvme_sqe_t e = {0};
+    uint32_t granted = 0;
+    e.cdw0 = ADM_SET_FEAT; e.cdw10 = FEAT_NUM_QUEUES; e.cdw11 = ((want - 1) << 16) | (want - 1);
+    if (admin_cmd(c, &e, &granted) == 0) {
+        uint32_t nsq = (granted & 0xFFFF) + 1, ncq = (granted >> 16) + 1;
+        if (nsq < want) want = nsq;
+        if (ncq < want) want = ncq;
+    } else want = 1;
+    uint16_t depth = mqes < NVME_IOQ_DEPTH ? (uint16_t)mqes : NVME_IOQ_DEPTH;
+    for (uint32_t q = 1; q <= want; ++q) if (create_ioq(c, (uint16_t)q, depth) != 0) break;
+    if (c->nioq == 0) { console_write("[nvme] no I/O queues\n"); return -1; }
+
+    nvme_ops.read = nvme_read; nvme_ops.write = nvme_write;
+    nvme_ops.readv = nvme_readv; nvme_ops.writev = nvme_writev;
+    nvme_ops.submit = nvme_submit; nvme_ops.poll = nvme_poll;
+    nvme_ops.discard = nvme_discard; nvme_ops.flush = nvme_flush;
+    nvme_ops.fua = 1;
+    // Active namespace list, then Identify Namespace for each
+    uint32_t list[NVME_MAX_NS];
+    if (identify(c, 2, 0, idbuf) != 0) return -1;
+    memcpy(list, idbuf, sizeof(list));
+    for (int k = 0; k < NVME_MAX_NS && list[k]; ++k)
+        if (identify(c, 0, list[k], idbuf) == 0) register_ns(c, list[k], idbuf);
+    set_mode(c, NVME_MODE_IRQ);
+    return 0;
+}
+
+// Undo a failed ctrl_setup: disable the controller, which drops every
+// queue, then give back the queue memory. If it never reports not-ready
+// it may still write those frames, so they are leaked instead.
+static void ctrl_teardown(nvme_ctrl_t* c) {
+    if (c->bar) {
+        wr32(c, NVME_CC, rd32(c, NVME_CC) & ~CC_EN);
+        if (wait_csts(c, CSTS_RDY, 0) != 0) { console_write("[nvme] disable timeout, queue memory leaked\n"); return; }
+    }
+    for (int k = 0; k < c->nioq; ++k) ioq_free(c->ioq[k]);
+    for (int k = 0; k < c->ndead; ++k) ioq_free(c->ioq_dead[k]);
+    if (c->admin.sq) pmm_free_frames((uint64_t)(uintptr_t)c->admin.sq, 3);
+}
+
+static void on_pci(const pci_device_t* d, void* user) {
+    (void)user;
+    if (d->class_code != 0x01 || d->subclass != 0x08 || d->prog_if != 0x02) return;
+    if (g_nctrl >= NVME_MAX_CTRL) return;
+    nvme_ctrl_t* c = (nvme_ctrl_t*)kmalloc(sizeof(nvme_ctrl_t));
+    if (!c) return;
+    memset(c, 0, sizeof(*c));
+    c->index = g_nctrl;
+    pci_enable_device(d);
+    if (ctrl_setup(c, d) != 0) {
+        console_write("[nvme] controller init failed\n");
+        ctrl_teardown(c);
+        kfree(c);
+        return;
+    }
+    g_ctrl[g_nctrl++] = c;
+    console_write("[nvme] nvme"); console_write_dec((uint64_t)c->index);
+    console_write(": \""); console_write(c->model);
+    console_write("\" ioq="); console_write_dec((uint64_t)c->nioq);
+    console_write(" depth="); console_write_dec(c->ioq[0]->depth);
+    console_write(" max_xfer_kib="); console_write_dec(c->max_xfer / 1024);
+    console_putc('\n');
+}
+
+int nvme_init(void) {
+    pci_enumerate(on_pci, NULL);
+    int n = 0;
+    for (int k = 0; k < g_nctrl; ++k) n += g_ctrl[k]->nns;
+    return n;
+}
+
+int nvme_set_mode(int mode) {
+    for (int k = 0; k < g_nctrl; ++k) set_mode(g_ctrl[k], mode);
+    return g_nctrl;
+}
+
+void nvme_dump(void) {
+    if (g_nctrl == 0) { console_write("no NVMe controllers\n"); return; }
+    for (int k = 0; k < g_nctrl; ++k) {
+        nvme_ctrl_t* c = g_ctrl[k];
+        console_write("nvme"); console_write_dec((uint64_t)k);
+        console_write(": \""); console_write(c->model); console_write("\"");
+        console_write(" ioq="); console_write_dec((uint64_t)c->nioq);
+        console_write(" max_xfer_kib="); console_write_dec(c->max_xfer / 1024);
+        if (c->dsm) console_write(" discard");
+        if (c->vwc) console_write(" vwc");
+        console_write(c->mode == NVME_MODE_POLL ? " mode=poll\n" : " mode=irq\n");
+        for (int n = 0; n < c->nns; ++n) {
+            console_write("  "); console_write(c->ns[n]->bdev.name);
+            console_write(" mib="); console_write_dec(c->ns[n]->bdev.sector_count * c->ns[n]->bdev.sector_size / (1024 * 1024));
+            console_write(" lba="); console_write_dec(c->ns[n]->bdev.sector_size);
+            console_putc('\n');
+        }
+        console_write("  commands="); console_write_dec(c->stats.commands);
+        console_write(" completions="); console_write_dec(c->stats.completions);
+        console_write(" errors="); console_write_dec(c->stats.errors);
+        console_write(" splits="); console_write_dec(c->stats.splits);
+        console_write(" bounced="); console_write_dec(c->stats.bounced);
+        console_putc('\n');
+    }
+}
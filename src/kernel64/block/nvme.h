@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// NVMe driver (PCI class 01/08/02). Each controller gets an admin queue
+// pair plus up to NVME_MAX_IOQ I/O queue pairs (one per CPU, as many as the
+// controller grants); every active namespace registers as nvme<c>n<nsid>.
+// Data moves through PRP entries and per-command PRP list pages; requests
+// larger than the controller's transfer limit are split. A controller with
+// a volatile write cache gets the flush op (NVM Flush) and BIO_FUA writes
+// set the FUA bit; discards become Dataset Management deallocate when ONCS
+// reports it.
+
+#define NVME_MAX_IOQ   4        // I/O queue pairs per controller
+#define NVME_IOQ_DEPTH 32       // entries per I/O submission/completion queue
+
+// Completion modes, as for virtio-blk: "irq" unmasks the controller's
+// interrupt and lets waiters yield; "poll" masks it and spins on the
+// completion queue phase bit
+#define NVME_MODE_IRQ  0
+#define NVME_MODE_POLL 1
+
+// Probe PCI, bring up controllers and register namespaces; returns namespaces
+int nvme_init(void);
+// Switch completion mode for every controller; returns controllers changed
+int nvme_set_mode(int mode);
+// Print controllers, queue pairs, namespaces and counters
+void nvme_dump(void);
@@ -0,0 +1,227 @@
+#include "overlay.h"
+#include "block.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/mem.h"
+
+extern void* kmalloc(size_t);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+#define OV_FANOUT 512u
+
+// Tree entries are frame addresses. Leaves also carry the page's sector
+// mask in their low bits (at most 8 sectors per page).
+typedef struct overlay {
+    block_device_t dev;
+    block_device_t* base;
+    uintptr_t root;
+    uint32_t levels;        // node levels above the leaves
+    uint32_t spp;           // sectors per page
+    overlay_stats_t st;
+    struct overlay* next;
+} overlay_t;
+
+static block_ops_t s_ops;
+static overlay_t* g_overlays;
+
+#define OV_ADDR(e) ((e) & ~(uintptr_t)(OVERLAY_PAGE - 1))
+
+static uintptr_t frame_alloc(overlay_t* o) {
+    uint64_t pa = pmm_alloc_frames_below(1, 1ULL << 32);
+    if (pa) o->st.frames++;
+    return (uintptr_t)pa;
+}
+
+// Leaf entry slot of page pg; with alloc set, missing nodes are allocated
+// on the way down. NULL when a node is missing (or out of memory).
+static uintptr_t* ov_slot(overlay_t* o, uint64_t pg, int alloc) {
+    uintptr_t* slot = &o->root;
+    for (uint32_t l = o->levels; l > 0; --l) {
+        if (!*slot) {
+            if (!alloc || !(*slot = frame_alloc(o))) return NULL;
+            memset((void*)*slot, 0, OVERLAY_PAGE);
+        }
+        slot = &((uintptr_t*)*slot)[(pg >> (9 * (l - 1))) & (OV_FANOUT - 1)];
+    }
+    return slot;
+}
+
+static inline uint32_t sec_mask(uint32_t first, uint32_t n) { return ((1u << n) - 1u) << first; }
+
+static uint32_t bits(uint32_t m) { uint32_t n = 0; for (; m; m &= m - 1) ++n; return n; }
+
+// Walk the pages of [lba, lba+count): fn gets each page's slot (NULL when
+// absent), the first sector in the page, the sector count and its offset
+// into the request. Stops early when fn returns non-zero.
+typedef int (*ov_fn_t)(overlay_t* o, uintptr_t* slot, uint32_t first, uint32_t n, uint64_t done, void* arg);
+
+static int ov_walk(overlay_t* o, uint64_t lba, uint64_t count, int alloc, ov_fn_t fn, void* arg) {
+    for (uint64_t done = 0; done < count; ) {
+        uint64_t cur = lba + done;
+        uint32_t first = (uint32_t)(cur % o->spp), n = o->spp - first;
+        if (n > count - done) n = (uint32_t)(count - done);
+        int r = fn(o, ov_slot(o, cur / o->spp, alloc), first, n, done, arg);
+        if (r) return r;
+        done += n;
+    }
+    return 0;
+}
+
+typedef struct { int all, any; } ov_cover_t;
+
+static int cover_fn(overlay_t* o, uintptr_t* slot, uint32_t first, uint32_t n, uint64_t done, void* arg) {
+    (void)o; (void)done;
+    ov_cover_t* c = (ov_cover_t*)arg;
+    uint32_t m = sec_mask(first, n), have = slot ? (uint32_t)*slot & m : 0;
+    if (have) c->any = 1;
+    if (have != m) c->all = 0;
+    return 0;
+}
+
+static int patch_fn(overlay_t* o, uintptr_t* slot, uint32_t first, uint32_t n, uint64_t done, void* arg) {
+    if (!slot || !*slot) return 0;
+    uint32_t ssz = o->dev.sector_size;
+    const uint8_t* page = (const uint8_t*)OV_ADDR(*slot);
+    uint8_t* out = (uint8_t*)arg + done * ssz;
+    for (uint32_t s = 0; s < n; ++s)
+        if (*slot & (1u << (first + s))) memcpy(out + s * ssz, page + (first + s) * ssz, ssz);
+    return 0;
+}
+
+static int ov_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    overlay_t* o = (overlay_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    // One base call for the whole range unless the overlay holds all of it,
+    // then the held sectors on top
+    ov_cover_t c = { 1, 0 };
+    (void)ov_walk(o, lba, count, 0, cover_fn, &c);
+    if (!c.all) {
+        o->st.base_reads++;
+        if (o->base->ops->read(o->base, lba, buf, count) != (int)count) return -1;
+    }
+    if (c.any) (void)ov_walk(o, lba, count, 0, patch_fn, buf);
+    return (int)count;
+}
+
+static int write_fn(overlay_t* o, uintptr_t* slot, uint32_t first, uint32_t n, uint64_t done, void* arg) {
+    if (!slot) return -1;
+    if (!*slot) {
+        if (!(*slot = frame_alloc(o))) return -1;
+        o->st.pages++;
+    }
+    uint32_t ssz = o->dev.sector_size, m = sec_mask(first, n);
+    memcpy((uint8_t*)OV_ADDR(*slot) + first * ssz, (const uint8_t*)arg + done * ssz, (uint64_t)n * ssz);
+    o->st.sectors += bits(m & ~(uint32_t)*slot);
+    *slot |= m;
+    return 0;
+}
+
+// A frame is allocated the first time a page is written; sectors of it
+// that were never written keep coming from the base, so no copy-up
+static int ov_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    overlay_t* o = (overlay_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    return ov_walk(o, lba, count, 1, write_fn, (void*)buf) ? -1 : (int)count;
+}
+
+// Untouched ranges map the base; a range inside one page held entirely by
+// the overlay maps its frame
+static const void* ov_map(block_device_t* dev, uint64_t lba, uint32_t count) {
+    overlay_t* o = (overlay_t*)dev->priv;
+    if (count == 0 || lba + count > dev->sector_count) return NULL;
+    ov_cover_t c = { 1, 0 };
+    (void)ov_walk(o, lba, count, 0, cover_fn, &c);
+    if (!c.any) return o->base->ops->map ? o->base->ops->map(o->base, lba, count) : NULL;
+    uint32_t first = (uint32_t)(lba % o->spp);
+    if (!c.all || first + count > o->spp) return NULL;
+    const uintptr_t* slot = ov_slot(o, lba / o->spp, 0);
+    return (const uint8_t*)OV_ADDR(*slot) + first * dev->sector_size;
+}
+
+// Free the data frame of page pg and every node left empty above it
+static void ov_drop(overlay_t* o, uint64_t pg) {
+    uintptr_t* path[8];
+    uintptr_t* slot = &o->root;
+    for (uint32_t l = o->levels; ; --l) {
+        path[l] = slot;
+        if (l == 0) break;
+        slot = &((uintptr_t*)*slot)[(pg >> (9 * (l - 1))) & (OV_FANOUT - 1)];
+    }
+    for (uint32_t l = 0; l <= o->levels; ++l) {
+        if (l) {
+            const uintptr_t* node = (const uintptr_t*)*path[l];
+            uint32_t k = 0;
+            while (k < OV_FANOUT && !node[k]) ++k;
+            if (k < OV_FANOUT) break;
+        } else o->st.pages--;
+        pmm_free_frames(OV_ADDR(*path[l]), 1);
+        *path[l] = 0;
+        o->st.frames--;
+    }
+}
+
+// Held sectors of the range are forgotten (reads see the base again);
+// pages left with none are freed
+static int ov_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    overlay_t* o = (overlay_t*)dev->priv;
+    if (lba + count > dev->sector_count) return -1;
+    for (uint64_t done = 0; done < count; ) {
+        uint64_t cur = lba + done;
+        uint32_t first = (uint32_t)(cur % o->spp), n = o->spp - first;
+        if (n > count - done) n = (uint32_t)(count - done);
+        uintptr_t* slot = ov_slot(o, cur / o->spp, 0);
+        if (slot && *slot) {
+            uint32_t m = sec_mask(first, n);
+            o->st.sectors -= bits((uint32_t)*slot & m);
+            *slot &= ~(uintptr_t)m;
+            if (!(*slot & (OVERLAY_PAGE - 1))) ov_drop(o, cur / o->spp);
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int overlay_create(const char* name, const char* base_name) {
+    block_device_t* base = base_name ? block_find(base_name) : NULL;
+    if (!name || !name[0] || block_find(name) || !base || !base->ops || !base->ops->read) return -1;
+    uint32_t ssz = base->sector_size;
+    if (ssz < 512 || ssz > OVERLAY_PAGE || OVERLAY_PAGE % ssz) return -1;
+    overlay_t* o = (overlay_t*)kmalloc(sizeof(overlay_t));
+    if (!o) return -1;
+    memset(o, 0, sizeof(*o));
+    o->base = base;
+    o->spp = OVERLAY_PAGE / ssz;
+    uint64_t pages = (base->sector_count + o->spp - 1) / o->spp;
+    for (uint64_t span = 1; span < pages; span *= OV_FANOUT) o->levels++;
+    s_ops.read = ov_read; s_ops.write = ov_write;
+    s_ops.map = ov_map; s_ops.discard = ov_discard;
+    block_device_t* d = &o->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = ssz;
+    d->sector_count = base->sector_count;
+    d->ops = &s_ops; d->priv = o; d->next = NULL;
+    o->next = g_overlays; g_overlays = o;
+    block_register(d);
+    return 0;
+}
+
+int overlay_get_stats(const char* name, overlay_stats_t* out) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((overlay_t*)d->priv)->st;
+    return 0;
+}
+
+void overlay_dump(void) {
+    if (!g_overlays) { console_write("cow: no overlays\n"); return; }
+    for (overlay_t* o = g_overlays; o; o = o->next) {
+        console_write(o->dev.name); console_write(": base="); console_write(o->base->name);
+        console_write(" size="); console_write_dec(o->dev.sector_count * o->dev.sector_size >> 10);
+        console_write("K modified="); console_write_dec(o->st.sectors * o->dev.sector_size >> 10);
+        console_write("K resident="); console_write_dec(o->st.frames * OVERLAY_PAGE >> 10);
+        console_write("K base_reads="); console_write_dec(o->st.base_reads);
+        console_write("\n");
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// Copy-on-write overlay: a writable device the size of a read-only base
+// (e.g. the boot image memdisk iso0). Written sectors go to a sparse RAM
+// store, a radix tree of frame-sized nodes leading to 4 KiB data frames
+// with a per-page mask of the sectors held; every other sector is read
+// from the base, and untouched ranges of a mappable base map in place.
+// Discarded sectors fall back to the base contents.
+
+#define OVERLAY_PAGE 4096u
+
+typedef struct {
+    uint64_t sectors;       // sectors held by the overlay
+    uint64_t pages;         // data frames
+    uint64_t frames;        // data frames plus tree nodes
+    uint64_t base_reads;    // requests (partly) served by the base
+} overlay_stats_t;
+
+// Create and register `name` over the registered device `base`; returns 0 or -1
+int overlay_create(const char* name, const char* base);
+// Stats of the named overlay; returns 0, or -1 if it is not one
+int overlay_get_stats(const char* name, overlay_stats_t* out);
+// Print every overlay with its base and memory use
+void overlay_dump(void);
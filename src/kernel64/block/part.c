@@ -0,0 +1,135 @@
+#include "part.h"
+#include <stddef.h>
+#include "../lib/crc32c.h"
+#include "../lib/mem.h"
+
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+#define GPT_HDR_MIN     92u
+#define GPT_ENTRY_MIN   128u
+#define GPT_MAX_ENTRIES 4096u
+#define MBR_PROTECTIVE  0xEE
+#define PART_ALIGN_MAX  (1u << 20)
+
+// Sector being parsed (LBA0, entry array chunks) and the GPT header; the
+// scan is single-threaded
+static uint8_t s_buf[BLOCK_MAX_SECTOR];
+static uint8_t s_hdr[BLOCK_MAX_SECTOR];
+
+static const char s_gpt_sig[8] = { 'E', 'F', 'I', ' ', 'P', 'A', 'R', 'T' };
+static const uint8_t s_unused[16];
+
+static uint32_t rd32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t rd64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+static void log_dev(block_device_t* d, const char* msg) {
+    console_write("[block] "); console_write(d->name); console_write(": "); console_write(msg); console_write("\n");
+}
+
+// Record a partition and its alignment; NULL once the table is full
+static block_part_t* add(block_device_t* d, block_ptable_t* t, uint32_t num, uint64_t start, uint64_t count) {
+    if (t->count >= BLOCK_MAX_PARTS || num > 99) { log_dev(d, "too many partitions, rest ignored"); return NULL; }
+    block_part_t* p = &t->part[t->count++];
+    memset(p, 0, sizeof(*p));
+    p->start = start; p->count = count; p->num = (uint8_t)num;
+    uint64_t off = start * d->sector_size;
+    p->align = PART_ALIGN_MAX;
+    while (p->align > d->sector_size && off % p->align) p->align >>= 1;
+    return p;
+}
+
+// Only for the table that was accepted, so a rejected primary GPT does not
+// log its partitions twice
+static void warn_misaligned(block_device_t* d, const block_ptable_t* t) {
+    for (int i = 0; i < t->count; ++i) {
+        if (t->part[i].align >= 4096) continue;
+        console_write("[block] "); console_write(d->name); console_write(" partition ");
+        console_write_dec(t->part[i].num); console_write(" is not 4 KiB aligned\n");
+    }
+}
+
+// Header at lba and its entry array; every field and both CRCs must check
+// out. *alt gets the other header's LBA once this one's CRC is good.
+static int gpt_read(block_device_t* d, uint64_t lba, block_ptable_t* t, uint64_t* alt) {
+    uint32_t ssz = d->sector_size;
+    if (lba >= d->sector_count || block_read(d, lba, s_hdr, 1) != 1) return -1;
+    uint32_t hs = rd32(s_hdr + 12), want = rd32(s_hdr + 16);
+    if (memcmp(s_hdr, s_gpt_sig, 8) != 0 || hs < GPT_HDR_MIN || hs > ssz) return -1;
+    memset(s_hdr + 16, 0, 4);
+    if (crc32_ieee(0, s_hdr, hs) != want) { log_dev(d, "GPT header CRC mismatch"); return -1; }
+    if (alt) *alt = rd64(s_hdr + 32);
+    uint64_t first = rd64(s_hdr + 40), last = rd64(s_hdr + 48), ent_lba = rd64(s_hdr + 72);
+    uint32_t num = rd32(s_hdr + 80), esz = rd32(s_hdr + 84), ent_crc = rd32(s_hdr + 88);
+    uint64_t ent_secs = ((uint64_t)num * esz + ssz - 1) / ssz;
+    if (rd64(s_hdr + 24) != lba || first > last || last >= d->sector_count || num > GPT_MAX_ENTRIES ||
+        esz < GPT_ENTRY_MIN || (esz & (esz - 1)) || ssz % esz || ent_lba + ent_secs > d->sector_count ||
+        (ent_lba <= last && ent_lba + ent_secs > first)) { log_dev(d, "GPT header invalid"); return -1; }
+    // Stream the array in BLOCK_MAX_SECTOR chunks, checksumming as it goes
+    uint32_t per = BLOCK_MAX_SECTOR / ssz, crc = 0;
+    uint64_t left = (uint64_t)num * esz;
+    uint32_t idx = 0;
+    t->count = 0;
+    for (uint64_t s = 0; s < ent_secs; ) {
+        uint32_t n = ent_secs - s < per ? (uint32_t)(ent_secs - s) : per;
+        if (block_read(d, ent_lba + s, s_buf, n) != (int)n) { t->count = 0; return -1; }
+        uint32_t bytes = left < (uint64_t)n * ssz ? (uint32_t)left : n * ssz;
+        crc = crc32_ieee(crc, s_buf, bytes);
+        for (uint32_t o = 0; o < bytes; o += esz, ++idx) {
+            const uint8_t* e = s_buf + o;
+            if (memcmp(e, s_unused, 16) == 0) continue;
+            uint64_t a = rd64(e + 32), b = rd64(e + 40);
+            if (a < first || b < a || b > last) {
+                console_write("[block] "); console_write(d->name); console_write(" GPT entry ");
+                console_write_dec(idx + 1); console_write(" outside the usable range, skipped\n");
+                continue;
+            }
+            block_part_t* p = add(d, t, idx + 1, a, b - a + 1);
+            if (p) memcpy(p->type_guid, e, 16);
+        }
+        left -= bytes;
+        s += n;
+    }
+    if (crc != ent_crc) { log_dev(d, "GPT entry array CRC mismatch"); t->count = 0; return -1; }
+    t->scheme = BLOCK_PT_GPT;
+    return 0;
+}
+
+static int gpt_parse(block_device_t* d, block_ptable_t* t) {
+    uint64_t alt = 0;
+    if (gpt_read(d, 1, t, &alt) == 0) return 0;
+    // Backup: where the primary says, else the last sector
+    if (!alt || alt >= d->sector_count) alt = d->sector_count - 1;
+    if (gpt_read(d, alt, t, NULL) != 0) { log_dev(d, "no valid GPT"); return -1; }
+    log_dev(d, "primary GPT damaged, using the backup");
+    t->gpt_backup = 1;
+    return 0;
+}
+
+int part_parse(block_device_t* d, block_ptable_t* t) {
+    t->scheme = BLOCK_PT_NONE; t->count = 0; t->gpt_backup = 0;
+    if (block_read(d, 0, s_buf, 1) != 1) { log_dev(d, "read LBA0 failed"); return -1; }
+    if (s_buf[510] != 0x55 || s_buf[511] != 0xAA) return 0;
+    const uint8_t* mbr = s_buf + 446;
+    for (int i = 0; i < 4; ++i)
+        if (mbr[i * 16 + 4] == MBR_PROTECTIVE) {
+            if (gpt_parse(d, t) == 0) warn_misaligned(d, t);
+            return 0;
+        }
+    for (int i = 0; i < 4; ++i) {
+        const uint8_t* p = &mbr[i * 16];
+        uint8_t type = p[4];
+        uint32_t start = rd32(p + 8), count = rd32(p + 12);
+        if (type == 0 || count == 0) continue;
+        if (start == 0 || (uint64_t)start + count > d->sector_count) {
+            console_write("[block] "); console_write(d->name); console_write(" MBR entry ");
+            console_write_dec((uint64_t)i + 1); console_write(" outside the disk, skipped\n");
+            continue;
+        }
+        block_part_t* pt = add(d, t, (uint32_t)i + 1, start, count);
+        if (pt) pt->mbr_type = type;
+    }
+    t->scheme = BLOCK_PT_MBR;
+    warn_misaligned(d, t);
+    return 0;
+}
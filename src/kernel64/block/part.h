@@ -0,0 +1,10 @@
+#pragma once
+#include "block.h"
+
+// Partition table parsing for block_scan_partitions (block.c): fills t's
+// scheme, count, part[] and gpt_backup from the disk. Partitions outside the
+// disk or the GPT usable range are skipped with a log line. 0, or -1 when
+// LBA0 cannot be read. GPT partitions are numbered by entry, so holes in
+// the array keep later names (ram0p1, ram0p3); partitions not starting on a
+// 4 KiB boundary are logged for the table that is accepted.
+int part_parse(block_device_t* d, block_ptable_t* t);
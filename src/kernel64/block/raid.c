@@ -0,0 +1,297 @@
+#include "raid.h"
+#include "block.h"
+#include <stddef.h>
+#include "../lib/mem.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+// One member bio of a request: a run of member sectors gathered from
+// slices of the request's segments
+typedef struct {
+    bio_t bio;
+    uint32_t member;
+    uint64_t lba;           // on the member
+    uint64_t bytes;
+    uint32_t nseg;
+    block_iovec_t segs[BLOCK_MAX_SEGS];
+} raid_kid_t;
+
+#define RAID_KIDS (2 * RAID_MAX_MEMBERS)   // member bios in flight per request
+
+typedef struct raid {
+    block_device_t dev;
+    block_device_t* m[RAID_MAX_MEMBERS];
+    uint32_t n;
+    uint8_t level;
+    uint8_t pool_busy;
+    uint32_t chunk;         // sectors
+    uint32_t rotor;         // RAID1: first mirror of the next read
+    raid_kid_t* pool;       // kids for one request; a concurrent one allocates its own
+    raid_stats_t st;
+    struct raid* next;
+} raid_t;
+
+typedef struct {
+    raid_t* r;
+    int write;
+    const block_iovec_t* iov;
+    uint32_t iovcnt;
+    raid_kid_t* kids;
+    uint32_t used;                          // kids taken from the pool
+    raid_kid_t* open[RAID_MAX_MEMBERS];     // kid still collecting, per member
+    uint32_t ok_mask;                       // RAID1 writes: mirrors that took the data
+    int rc;
+} raid_req_t;
+
+static block_ops_t s_ops;
+static raid_t* g_raids;
+
+static inline uint32_t live_mask(const raid_t* r) { return ((1u << r->n) - 1u) & ~r->st.failed; }
+
+// Segments of iov overlapping bytes [off, off+len)
+static uint32_t slice_count(const block_iovec_t* iov, uint32_t iovcnt, uint64_t off, uint64_t len) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < iovcnt && len; ++i) {
+        if (off >= iov[i].len) { off -= iov[i].len; continue; }
+        uint64_t t = iov[i].len - off; if (t > len) t = len;
+        ++n; len -= t; off = 0;
+    }
+    return n;
+}
+
+static void slice_add(raid_kid_t* k, const block_iovec_t* iov, uint32_t iovcnt, uint64_t off, uint64_t len) {
+    for (uint32_t i = 0; i < iovcnt && len; ++i) {
+        if (off >= iov[i].len) { off -= iov[i].len; continue; }
+        uint64_t t = iov[i].len - off; if (t > len) t = len;
+        k->segs[k->nseg].base = (uint8_t*)iov[i].base + off;
+        k->segs[k->nseg].len = (uint32_t)t;
+        k->nseg++; len -= t; off = 0;
+    }
+}
+
+static void kid_submit(raid_req_t* q, raid_kid_t* k) {
+    raid_t* r = q->r;
+    bio_init_vec(&k->bio, r->m[k->member], q->write ? BIO_WRITE : BIO_READ, k->lba, k->segs, k->nseg);
+    (void)block_submit(&k->bio);
+    r->st.bios++;
+    q->open[k->member] = NULL;
+}
+
+// A RAID1 read that failed is repeated on each other live mirror in turn
+static int kid_retry(raid_t* r, raid_kid_t* k) {
+    uint32_t live = live_mask(r) & ~(1u << k->member);
+    for (uint32_t j = 0; j < r->n; ++j) {
+        if (!(live & (1u << j))) continue;
+        r->st.retries++;
+        if (block_readv(r->m[j], k->lba, k->segs, k->nseg) == (int)k->bio.count) {
+            r->st.member_sectors[j] += k->bio.count;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Start every open kid and dispatch each member's queue, so the members
+// work in parallel; then wait for all of them and recycle the pool
+static void req_finish(raid_req_t* q) {
+    raid_t* r = q->r;
+    for (uint32_t m = 0; m < r->n; ++m) if (q->open[m]) kid_submit(q, q->open[m]);
+    for (uint32_t m = 0; m < r->n; ++m) block_unplug(r->m[m]);
+    for (uint32_t i = 0; i < q->used; ++i) {
+        raid_kid_t* k = &q->kids[i];
+        if (block_wait(&k->bio) == 0) {
+            r->st.member_sectors[k->member] += k->bio.count;
+            if (q->write) q->ok_mask |= 1u << k->member;
+            continue;
+        }
+        if (r->level == 0) q->rc = -1;
+        else if (!q->write) { if (kid_retry(r, k) != 0) q->rc = -1; }
+        else if (!(r->st.failed & (1u << k->member))) {
+            r->st.failed |= 1u << k->member;
+            console_write("raid: "); console_write(r->dev.name); console_write(": mirror ");
+            console_write(r->m[k->member]->name); console_write(" failed a write, dropped\n");
+        }
+    }
+    q->used = 0;
+}
+
+// Route request bytes [off, off+len) to member sectors from mlba. A run
+// continuing the member's open kid joins it while segments last.
+static void emit(raid_req_t* q, uint32_t member, uint64_t mlba, uint64_t off, uint64_t len) {
+    uint32_t ssz = q->r->dev.sector_size;
+    uint32_t ns = slice_count(q->iov, q->iovcnt, off, len);
+    raid_kid_t* k = q->open[member];
+    if (k && (k->lba + k->bytes / ssz != mlba || k->nseg + ns > BLOCK_MAX_SEGS)) { kid_submit(q, k); k = NULL; }
+    if (!k) {
+        if (q->used == RAID_KIDS) req_finish(q);
+        k = &q->kids[q->used++];
+        k->member = member; k->lba = mlba; k->bytes = 0; k->nseg = 0;
+        q->open[member] = k;
+    }
+    slice_add(k, q->iov, q->iovcnt, off, len);
+    k->bytes += len;
+}
+
+static int raid_io(block_device_t* dev, int write, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    raid_t* r = (raid_t*)dev->priv;
+    uint32_t ssz = dev->sector_size;
+    uint64_t bytes = block_iov_bytes(iov, iovcnt), count = bytes / ssz;
+    if (iovcnt > BLOCK_MAX_SEGS || bytes % ssz || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    uint32_t live = live_mask(r);
+    if (!live) return -1;
+    raid_req_t q;
+    memset(&q, 0, sizeof(q));
+    q.r = r; q.write = write; q.iov = iov; q.iovcnt = iovcnt;
+    int own = !r->pool_busy;
+    q.kids = own ? r->pool : (raid_kid_t*)kmalloc(RAID_KIDS * sizeof(raid_kid_t));
+    if (!q.kids) return -1;
+    if (own) r->pool_busy = 1;
+    if (write) r->st.writes++; else r->st.reads++;
+
+    if (r->level == 0) {
+        for (uint64_t done = 0; done < count; ) {
+            uint64_t cur = lba + done, stripe = cur / r->chunk;
+            uint32_t in = (uint32_t)(cur % r->chunk);
+            uint64_t n = r->chunk - in; if (n > count - done) n = count - done;
+            emit(&q, (uint32_t)(stripe % r->n), (stripe / r->n) * r->chunk + in, done * ssz, n * ssz);
+            done += n;
+        }
+    } else if (write) {
+        for (uint32_t m = 0; m < r->n; ++m) if (live & (1u << m)) emit(&q, m, lba, 0, bytes);
+    } else {
+        // Large reads: one chunk-aligned contiguous part per mirror
+        uint32_t mirrors[RAID_MAX_MEMBERS], nl = 0;
+        for (uint32_t m = 0; m < r->n; ++m) if (live & (1u << m)) mirrors[nl++] = m;
+        uint64_t parts = count / r->chunk;
+        if (parts > nl) parts = nl;
+        if (parts == 0) parts = 1;
+        uint64_t per = (count / parts + r->chunk - 1) / r->chunk * r->chunk;
+        uint32_t first = r->rotor++;
+        for (uint64_t p = 0, done = 0; done < count; ++p) {
+            uint64_t n = count - done < per ? count - done : per;
+            emit(&q, mirrors[(first + p) % nl], lba + done, done * ssz, n * ssz);
+            done += n;
+        }
+    }
+    req_finish(&q);
+    if (write && r->level == 1 && !q.ok_mask) q.rc = -1;
+    if (own) r->pool_busy = 0; else kfree(q.kids);
+    return q.rc ? -1 : (int)count;
+}
+
+static int raid_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return raid_io(dev, 0, lba, iov, iovcnt);
+}
+static int raid_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return raid_io(dev, 1, lba, iov, iovcnt);
+}
+static int raid_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { buf, count * dev->sector_size };
+    return raid_io(dev, 0, lba, &seg, 1);
+}
+static int raid_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { (void*)buf, count * dev->sector_size };
+    return raid_io(dev, 1, lba, &seg, 1);
+}
+
+static int raid_flush(block_device_t* dev) {
+    raid_t* r = (raid_t*)dev->priv;
+    uint32_t live = live_mask(r);
+    int rc = 0;
+    for (uint32_t m = 0; m < r->n; ++m) if ((live & (1u << m)) && block_flush(r->m[m]) != 0) rc = -1;
+    return rc;
+}
+
+// Mirrors discard the range as is; stripes become one contiguous run per member
+static int raid_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    raid_t* r = (raid_t*)dev->priv;
+    if (lba + count > dev->sector_count) return -1;
+    uint32_t live = live_mask(r);
+    int rc = 0;
+    if (r->level == 1) {
+        for (uint32_t m = 0; m < r->n; ++m) if ((live & (1u << m)) && block_discard(r->m[m], lba, count) != 0) rc = -1;
+        return rc;
+    }
+    uint64_t start[RAID_MAX_MEMBERS], len[RAID_MAX_MEMBERS];
+    memset(len, 0, sizeof(len));
+    for (uint64_t done = 0; done < count; ) {
+        uint64_t cur = lba + done, stripe = cur / r->chunk;
+        uint32_t in = (uint32_t)(cur % r->chunk), m = (uint32_t)(stripe % r->n);
+        uint64_t n = r->chunk - in; if (n > count - done) n = count - done;
+        uint64_t mlba = (stripe / r->n) * r->chunk + in;
+        if (len[m] && start[m] + len[m] == mlba) len[m] += n;
+        else {
+            if (len[m] && block_discard(r->m[m], start[m], len[m]) != 0) rc = -1;
+            start[m] = mlba; len[m] = n;
+        }
+        done += n;
+    }
+    for (uint32_t m = 0; m < r->n; ++m) if (len[m] && block_discard(r->m[m], start[m], len[m]) != 0) rc = -1;
+    return rc;
+}
+
+int raid_create(const char* name, int level, uint32_t chunk, const char* const* members, uint32_t n) {
+    if (!name || !name[0] || block_find(name) || (level != 0 && level != 1) ||
+        !members || n < 2 || n > RAID_MAX_MEMBERS) return -1;
+    if (chunk == 0) chunk = RAID_DEFAULT_CHUNK;
+    block_device_t* m[RAID_MAX_MEMBERS];
+    uint64_t min = ~0ULL;
+    for (uint32_t i = 0; i < n; ++i) {
+        m[i] = members[i] ? block_find(members[i]) : NULL;
+        if (!m[i] || !m[i]->ops || !m[i]->ops->read || m[i]->sector_size != m[0]->sector_size) return -1;
+        for (uint32_t j = 0; j < i; ++j) if (m[j] == m[i]) return -1;
+        if (m[i]->sector_count < min) min = m[i]->sector_count;
+    }
+    uint64_t sectors = level == 0 ? min / chunk * chunk * n : min;
+    if (sectors == 0) return -1;
+    raid_t* r = (raid_t*)kmalloc(sizeof(raid_t));
+    raid_kid_t* pool = (raid_kid_t*)kmalloc(RAID_KIDS * sizeof(raid_kid_t));
+    if (!r || !pool) { if (r) kfree(r); if (pool) kfree(pool); return -1; }
+    memset(r, 0, sizeof(*r));
+    for (uint32_t i = 0; i < n; ++i) r->m[i] = m[i];
+    r->n = n; r->level = (uint8_t)level; r->chunk = chunk; r->pool = pool;
+    s_ops.read = raid_read; s_ops.write = raid_write;
+    s_ops.readv = raid_readv; s_ops.writev = raid_writev;
+    s_ops.flush = raid_flush; s_ops.discard = raid_discard;
+    block_device_t* d = &r->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = m[0]->sector_size;
+    d->sector_count = sectors;
+    d->ops = &s_ops; d->priv = r; d->next = NULL;
+    r->next = g_raids; g_raids = r;
+    block_register(d);
+    return 0;
+}
+
+int raid_get_stats(const char* name, raid_stats_t* out) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((raid_t*)d->priv)->st;
+    return 0;
+}
+
+void raid_dump(void) {
+    if (!g_raids) { console_write("raid: no arrays\n"); return; }
+    for (raid_t* r = g_raids; r; r = r->next) {
+        console_write(r->dev.name); console_write(r->level ? ": raid1" : ": raid0");
+        console_write(" chunk="); console_write_dec((uint64_t)r->chunk * r->dev.sector_size >> 10);
+        console_write("K size="); console_write_dec(r->dev.sector_count * r->dev.sector_size >> 10);
+        console_write("K reads="); console_write_dec(r->st.reads);
+        console_write(" writes="); console_write_dec(r->st.writes);
+        console_write(" bios="); console_write_dec(r->st.bios);
+        if (r->level) { console_write(" retries="); console_write_dec(r->st.retries); }
+        console_write("\n");
+        for (uint32_t m = 0; m < r->n; ++m) {
+            console_write("  "); console_write(r->m[m]->name);
+            console_write(" sectors="); console_write_dec(r->st.member_sectors[m]);
+            if (r->st.failed & (1u << m)) console_write(" FAILED");
+            console_write("\n");
+        }
+    }
+}
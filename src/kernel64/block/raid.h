@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+// RAID layouts over registered block devices (same sector size):
+//  RAID0: chunk-sized stripes rotate over the members; capacity is the
+//         smallest member times the member count. A request becomes one
+//         bio per member, all in flight together.
+//  RAID1: every member holds the whole device. Writes go to each mirror;
+//         large reads are split into one contiguous part per mirror and
+//         small ones rotate between mirrors. A mirror that fails a write is
+//         dropped (the array runs degraded); a failed read is retried on
+//         another mirror.
+
+#define RAID_MAX_MEMBERS      8
+#define RAID_DEFAULT_CHUNK    128u    // sectors (64 KiB at 512-byte sectors)
+
+typedef struct {
+    uint64_t reads;         // requests on the array
+    uint64_t writes;
+    uint64_t bios;          // member bios issued
+    uint64_t retries;       // RAID1 reads repeated on another mirror
+    uint64_t member_sectors[RAID_MAX_MEMBERS];  // sectors moved per member
+    uint32_t failed;        // RAID1: mask of dropped mirrors
+} raid_stats_t;
+
+// Create and register `name` as RAID level 0 or 1 over the n named devices;
+// chunk is in sectors (0 = RAID_DEFAULT_CHUNK). Returns 0 or -1.
+int raid_create(const char* name, int level, uint32_t chunk, const char* const* members, uint32_t n);
+// Stats of the named array; returns 0, or -1 if it is not one
+int raid_get_stats(const char* name, raid_stats_t* out);
+// Print every array with its members and per-member traffic
+void raid_dump(void);
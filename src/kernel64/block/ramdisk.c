@@ -3,46 +3,59 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "../../kernel/mm/pmm.h"
+#include "../lib/mem.h"
+#include "../static_key.h"
 
-typedef struct {
-    uint8_t* data;
+extern void console_write(const char*);
+extern void console_write_hex64(uint64_t);
+
+// Per-request tracing; toggled at runtime with the shell "debug ramdisk on"
+static_key_t g_dbg_ramdisk = STATIC_KEY_INIT_FALSE("ramdisk");
+
+// Contiguous RAM disks keep every byte in one run of frames (data). Sparse
+// ones start empty: a radix tree of frame-sized nodes, RD_FANOUT entries
+// each, leads to data frames allocated on first write; holes read as zeros.
+#define RD_PAGE   4096u
+#define RD_FANOUT 512u
+
+typedef struct ramdisk {
+    uint8_t* data;          // contiguous store, NULL when sparse
     uint64_t bytes;
+    void* root;             // sparse: tree root, NULL while nothing is written
+    uint32_t levels;        // sparse: node levels above the data frames
+    uint64_t frames;        // sparse: frames allocated (nodes and data)
+    block_device_t* dev;
+    struct ramdisk* next;
 } ramdisk_t;
 
+static ramdisk_t* g_ramdisks;
+
 static int rd_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
     ramdisk_t* rd = (ramdisk_t*)dev->priv;
-#ifdef RAMDISK_DEBUG
+    if (static_branch_unlikely(&g_dbg_ramdisk)) {
     // Minimal serial breadcrumb to avoid console reentrancy during early boot
     serial_putc('E');
     // Log pointers to help diagnose call target and buffer addresses
-    extern void console_write(const char*);
-    extern void console_write_hex64(uint64_t);
     console_write("[ramdisk] rd_read enter dev="); console_write_hex64((uint64_t)(uintptr_t)dev);
     console_write(" priv="); console_write_hex64((uint64_t)(uintptr_t)dev->priv);
     console_write(" buf="); console_write_hex64((uint64_t)(uintptr_t)buf);
     console_write(" lba="); console_write_hex64(lba);
     console_write(" cnt="); console_write_hex64(count);
     console_write("\n");
-#endif
+    }
     if (count == 0) return 0;
     uint64_t off = lba * dev->sector_size;
     uint64_t len = (uint64_t)count * dev->sector_size;
     if (off + len > rd->bytes) return -1;
     uint8_t* dst = (uint8_t*)buf; const uint8_t* src = rd->data + off;
-    // Quick probe (debug): touch first and last byte of destination
-#ifdef RAMDISK_DEBUG
-    volatile uint8_t tmp_probe = 0; (void)tmp_probe;
-    tmp_probe ^= dst[0];
-    if (len > 0) { tmp_probe ^= dst[len - 1]; }
-#endif
-    for (uint64_t i = 0; i < len; ++i) dst[i] = src[i];
-#ifdef RAMDISK_DEBUG
+    memcpy(dst, src, len);
+    if (static_branch_unlikely(&g_dbg_ramdisk)) {
     serial_putc('X');
     console_write("[ramdisk] rd_read exit len="); console_write_hex64(len);
     console_write(" dst="); console_write_hex64((uint64_t)(uintptr_t)dst);
     console_write(" src="); console_write_hex64((uint64_t)(uintptr_t)src);
     console_write("\n");
-#endif
+    }
     return (int)count;
 }
 static int rd_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
@@ -50,23 +63,175 @@ static int rd_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t
     uint64_t off = lba * dev->sector_size;
     uint64_t len = (uint64_t)count * dev->sector_size;
     if (off + len > rd->bytes) return -1;
-    const uint8_t* src = (const uint8_t*)buf; uint8_t* dst = rd->data + off;
-    for (uint64_t i = 0; i < len; ++i) dst[i] = src[i];
+    memcpy(rd->data + off, buf, len);
+    return (int)count;
+}
+
+static int rd_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size;
+    uint64_t len = block_iov_bytes(iov, iovcnt);
+    if (len % dev->sector_size || off + len > rd->bytes) return -1;
+    block_iov_from_buf(iov, iovcnt, 0, rd->data + off, len);
+    return (int)(len / dev->sector_size);
+}
+static int rd_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size;
+    uint64_t len = block_iov_bytes(iov, iovcnt);
+    if (len % dev->sector_size || off + len > rd->bytes) return -1;
+    block_iov_to_buf(iov, iovcnt, 0, rd->data + off, len);
+    return (int)(len / dev->sector_size);
+}
+
+static const void* rd_map(block_device_t* dev, uint64_t lba, uint32_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size;
+    if (off + (uint64_t)count * dev->sector_size > rd->bytes) return NULL;
+    return rd->data + off;
+}
+
+static int rd_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size, len = count * dev->sector_size;
+    if (off + len > rd->bytes) return -1;
+    memset(rd->data + off, 0, len);
+    return 0;
+}
+
+// ---- sparse mode ----
+
+static const uint8_t s_zero_page[RD_PAGE];
+
+// Data frame of page pg; with alloc set, missing nodes and the frame are
+// allocated (zeroed) on the way down. NULL = hole, or out of memory.
+static uint8_t* sp_page(ramdisk_t* rd, uint64_t pg, int alloc) {
+    void** slot = &rd->root;
+    for (uint32_t l = rd->levels; ; --l) {
+        if (!*slot) {
+            if (!alloc) return NULL;
+            uint64_t pa = pmm_alloc_frames_below(1, 1ULL << 32);
+            if (!pa) return NULL;
+            memset((void*)(uintptr_t)pa, 0, RD_PAGE);
+            *slot = (void*)(uintptr_t)pa;
+            rd->frames++;
+        }
+        if (l == 0) return (uint8_t*)*slot;
+        slot = &((void**)*slot)[(pg >> (9 * (l - 1))) & (RD_FANOUT - 1)];
+    }
+}
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
+
+static int all_zero(const uint8_t* p, uint64_t n) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) if (*(const u64_unaligned*)(p + i)) return 0;
+    for (; i < n; ++i) if (p[i]) return 0;
+    return 1;
+}
+
+static int sp_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size, len = (uint64_t)count * dev->sector_size;
+    if (!buf || off + len > rd->bytes) return -1;
+    uint8_t* out = (uint8_t*)buf;
+    while (len) {
+        uint32_t po = (uint32_t)(off % RD_PAGE);
+        uint64_t n = RD_PAGE - po; if (n > len) n = len;
+        const uint8_t* p = sp_page(rd, off / RD_PAGE, 0);
+        if (p) memcpy(out, p + po, n); else memset(out, 0, n);
+        out += n; off += n; len -= n;
+    }
+    return (int)count;
+}
+
+// Zeros written to a hole leave it a hole (e.g. mkfs clearing the bitmap)
+static int sp_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size, len = (uint64_t)count * dev->sector_size;
+    if (!buf || off + len > rd->bytes) return -1;
+    const uint8_t* in = (const uint8_t*)buf;
+    while (len) {
+        uint32_t po = (uint32_t)(off % RD_PAGE);
+        uint64_t n = RD_PAGE - po; if (n > len) n = len;
+        uint8_t* p = sp_page(rd, off / RD_PAGE, 0);
+        if (!p && !all_zero(in, n) && !(p = sp_page(rd, off / RD_PAGE, 1))) return -1;
+        if (p) memcpy(p + po, in, n);
+        in += n; off += n; len -= n;
+    }
     return (int)count;
 }
 
+// Free the data frame of page pg, then every node left empty above it.
+// Returns the pages to advance: 1, or the rest of a missing subtree.
+static uint64_t sp_drop(ramdisk_t* rd, uint64_t pg) {
+    void** path[8];
+    void** slot = &rd->root;
+    for (uint32_t l = rd->levels; ; --l) {
+        if (!*slot) {
+            uint64_t span = 1ULL << (9 * l);
+            return span - (pg & (span - 1));
+        }
+        path[l] = slot;
+        if (l == 0) break;
+        slot = &((void**)*slot)[(pg >> (9 * (l - 1))) & (RD_FANOUT - 1)];
+    }
+    for (uint32_t l = 0; l <= rd->levels; ++l) {
+        if (l && !all_zero((const uint8_t*)*path[l], RD_PAGE)) break;
+        pmm_free_frames((uint64_t)(uintptr_t)*path[l], 1);
+        *path[l] = NULL;
+        rd->frames--;
+    }
+    return 1;
+}
+
+// Whole pages go back to the PMM; partial ones are zeroed, and freed too
+// once nothing else is left in them
+static int sp_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size, len = count * dev->sector_size;
+    if (off + len > rd->bytes) return -1;
+    while (len) {
+        uint32_t po = (uint32_t)(off % RD_PAGE);
+        uint64_t n = RD_PAGE - po; if (n > len) n = len;
+        if (n == RD_PAGE) {
+            n = sp_drop(rd, off / RD_PAGE) * RD_PAGE;
+            if (n > len) n = len;
+        } else {
+            uint8_t* p = sp_page(rd, off / RD_PAGE, 0);
+            if (p) {
+                memset(p + po, 0, n);
+                if (all_zero(p, RD_PAGE)) (void)sp_drop(rd, off / RD_PAGE);
+            }
+        }
+        off += n; len -= n;
+    }
+    return 0;
+}
+
+// Only ranges inside one page are addressable; holes map the shared zero page
+static const void* sp_map(block_device_t* dev, uint64_t lba, uint32_t count) {
+    ramdisk_t* rd = (ramdisk_t*)dev->priv;
+    uint64_t off = lba * dev->sector_size, len = (uint64_t)count * dev->sector_size;
+    uint32_t po = (uint32_t)(off % RD_PAGE);
+    if (off + len > rd->bytes || po + len > RD_PAGE) return NULL;
+    const uint8_t* p = sp_page(rd, off / RD_PAGE, 0);
+    return (p ? p : s_zero_page) + po;
+}
+
 // Avoid static const init of function pointers (no relocations at runtime).
 static block_ops_t s_ops;
+static block_ops_t s_sparse_ops;
 
 // Factory: create and register a RAM disk backed by the kernel heap buffer.
+// sec is the sector size (block_sector_ok); ramdisk_create uses the default.
 extern void* kmalloc(size_t);
 extern void console_write(const char*);
 extern void console_write_hex64(uint64_t);
 
-int ramdisk_create(const char* name, uint64_t bytes) {
-    if (!name || bytes == 0) return -1;
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec) {
+    if (!name || bytes == 0 || !block_sector_ok(sec)) return -1;
     // Round bytes to sector size
-    uint32_t sec = block_default_sector();
     uint64_t rounded = (bytes + sec - 1) / sec * sec;
     ramdisk_t* rd = (ramdisk_t*)kmalloc(sizeof(ramdisk_t));
     if (!rd) return -1;
@@ -76,10 +241,11 @@ int ramdisk_create(const char* name, uint64_t bytes) {
     extern uint64_t pmm_alloc_frames_below(size_t count, uint64_t max_phys_exclusive);
     uint64_t paddr = pmm_alloc_frames_below((size_t)pages, 1ULL<<30);
     if (!paddr) { return -1; }
+    memset(rd, 0, sizeof(*rd));
     rd->data = (uint8_t*)(uintptr_t)paddr; // identity-mapped
     console_write("ramdisk phys base=0x"); console_write_hex64((uint64_t)paddr); console_write(" size=0x"); console_write_hex64((uint64_t)rounded); console_write("\n");
     // Zero the device
-    for (uint64_t i = 0; i < rounded; ++i) rd->data[i] = 0;
+    memset(rd->data, 0, rounded);
     rd->bytes = rounded;
 
 #ifdef RAMDISK_INIT_MBR
@@ -120,10 +286,14 @@ int ramdisk_create(const char* name, uint64_t bytes) {
     // Initialize ops with runtime addresses
     s_ops.read = rd_read;
     s_ops.write = rd_write;
+    s_ops.readv = rd_readv;
+    s_ops.writev = rd_writev;
+    s_ops.map = rd_map;
+    s_ops.discard = rd_discard;
     bd->ops = &s_ops;
     bd->priv = rd;
     bd->next = NULL;
-#ifdef RAMDISK_DEBUG
+    if (static_branch_unlikely(&g_dbg_ramdisk)) {
     // Log the ops->read/write addresses for cross-checking with block layer
     console_write("[ramdisk] s_ops="); console_write_hex64((uint64_t)(uintptr_t)&s_ops);
     console_write(" read@="); console_write_hex64((uint64_t)(uintptr_t)s_ops.read);
@@ -133,8 +303,63 @@ int ramdisk_create(const char* name, uint64_t bytes) {
     console_write(" bd@="); console_write_hex64((uint64_t)(uintptr_t)bd);
     console_write(" priv@="); console_write_hex64((uint64_t)(uintptr_t)bd->priv);
     console_write("\n");
-#endif
+    }
+    rd->dev = bd; rd->next = g_ramdisks; g_ramdisks = rd;
     block_register(bd);
     console_write("ramdisk created: "); console_write(bd->name); console_write(" bytes=0x"); console_write_hex64(rounded); console_write("\n");
     return 0;
 }
+
+int ramdisk_create(const char* name, uint64_t bytes) {
+    return ramdisk_create_sec(name, bytes, block_default_sector());
+}
+
+// Sparse RAM disk: O(1) to create, frames allocated on first write
+int ramdisk_create_sparse_sec(const char* name, uint64_t bytes, uint32_t sec) {
+    if (!name || bytes == 0 || !block_sector_ok(sec)) return -1;
+    uint64_t rounded = (bytes + sec - 1) / sec * sec;
+    ramdisk_t* rd = (ramdisk_t*)kmalloc(sizeof(ramdisk_t));
+    block_device_t* bd = (block_device_t*)kmalloc(sizeof(block_device_t));
+    if (!rd || !bd) return -1;
+    memset(rd, 0, sizeof(*rd));
+    rd->bytes = rounded;
+    for (uint64_t span = RD_PAGE; span < rounded; span *= RD_FANOUT) rd->levels++;
+    int i = 0; for (; i < 15 && name[i]; ++i) bd->name[i] = name[i]; bd->name[i] = 0;
+    bd->sector_size = sec;
+    bd->sector_count = rounded / sec;
+    s_sparse_ops.read = sp_read;
+    s_sparse_ops.write = sp_write;
+    s_sparse_ops.map = sp_map;
+    s_sparse_ops.discard = sp_discard;
+    bd->ops = &s_sparse_ops;
+    bd->priv = rd;
+    bd->next = NULL;
+    rd->dev = bd; rd->next = g_ramdisks; g_ramdisks = rd;
+    block_register(bd);
+    console_write("sparse ramdisk created: "); console_write(bd->name); console_write(" bytes=0x"); console_write_hex64(rounded); console_write("\n");
+    return 0;
+}
+
+int ramdisk_create_sparse(const char* name, uint64_t bytes) {
+    return ramdisk_create_sparse_sec(name, bytes, block_default_sector());
+}
+
+// Bytes of memory backing a RAM disk (contiguous: all of it); 0 if unknown
+uint64_t ramdisk_resident_bytes(const char* name) {
+    for (ramdisk_t* rd = g_ramdisks; rd; rd = rd->next) {
+        const char* a = name; const char* b = rd->dev->name;
+        while (*a && *a == *b) { ++a; ++b; }
+        if (*a == 0 && *b == 0) return rd->data ? (rd->bytes + RD_PAGE - 1) / RD_PAGE * RD_PAGE : rd->frames * RD_PAGE;
+    }
+    return 0;
+}
+
+void ramdisk_dump(void) {
+    for (ramdisk_t* rd = g_ramdisks; rd; rd = rd->next) {
+        console_write(rd->dev->name); console_write(rd->data ? ": contiguous" : ": sparse");
+        console_write(" size=0x"); console_write_hex64(rd->bytes);
+        console_write(" sector=0x"); console_write_hex64(rd->dev->sector_size);
+        console_write(" resident=0x"); console_write_hex64(ramdisk_resident_bytes(rd->dev->name));
+        console_write("\n");
+    }
+}
@@ -0,0 +1,443 @@
+#include "tier.h"
+#include "block.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+#define TIER_RUN    16u             // blocks promoted per origin read
+#define TIER_NONE   0xFFFFFFFFu
+#define T_DIRTY     (1ULL << 63)
+#define T_BLK(e)    (((e) & ~T_DIRTY) - 1)
+
+// Sector 0 of the cache device; the slot table follows from sector 1, one
+// little-endian uint64 per slot: 0 empty, else block+1 with T_DIRTY
+typedef struct {
+    char magic[8];
+    uint32_t ssz;
+    uint32_t bs;            // sectors per block
+    uint32_t slots;
+    uint32_t meta;          // slot table sectors
+    uint32_t data_off;      // first sector of slot 0
+    uint32_t reserved;
+    uint64_t origin_sectors;
+} tier_sb_t;
+
+static const char s_magic[8] = { 'D', 'X', 'T', 'I', 'E', 'R', '0', '1' };
+
+typedef struct tier {
+    block_device_t dev;
+    block_device_t* origin;
+    block_device_t* cache;
+    uint32_t bs;            // sectors per block
+    uint32_t slots, sets;
+    uint32_t meta, eps;     // table sectors, entries per sector
+    uint32_t data_off;
+    uint64_t nblocks;       // whole origin blocks; a partial tail is never cached
+    uint64_t* map;          // slot table as it should be on disk
+    uint32_t* stamp;        // LRU
+    uint8_t* ondisk;        // the slot's entry on disk is not empty
+    uint8_t* mdirty;        // table sectors to write at flush
+    uint32_t clock;
+    uint8_t mode;
+    uint8_t busy;
+    uint32_t seq_cutoff;
+    uint64_t seq_next, seq_sectors;
+    uint8_t* rbuf;          // TIER_RUN blocks
+    uint8_t* wbuf;          // one block, victim write-back
+    uint8_t* mbuf;          // one sector, table and superblock
+    tier_stats_t st;
+    struct tier* next;
+} tier_t;
+
+static block_ops_t s_ops;
+static tier_t* g_tiers;
+
+static inline uint64_t slot_lba(const tier_t* t, uint32_t s) { return t->data_off + (uint64_t)s * t->bs; }
+
+static void tier_lock(tier_t* t) { while (t->busy) sched_yield(); t->busy = 1; }
+static void tier_unlock(tier_t* t) { t->busy = 0; }
+
+static uint32_t lookup(const tier_t* t, uint64_t b) {
+    if (b >= t->nblocks) return TIER_NONE;
+    uint32_t s = (uint32_t)(b % t->sets) * TIER_WAYS;
+    for (uint32_t w = 0; w < TIER_WAYS; ++w, ++s)
+        if (t->map[s] && T_BLK(t->map[s]) == b) return s;
+    return TIER_NONE;
+}
+
+// Write table sector `sec`; entries in it are on disk afterwards
+static int meta_write(tier_t* t, uint32_t sec) {
+    uint32_t first = sec * t->eps, n = t->slots - first;
+    if (n > t->eps) n = t->eps;
+    memset(t->mbuf, 0, t->cache->sector_size);
+    memcpy(t->mbuf, &t->map[first], (uint64_t)n * 8);
+    t->st.meta_writes++;
+    if (block_write(t->cache, 1 + sec, t->mbuf, 1) != 1) return -1;
+    for (uint32_t i = 0; i < n; ++i) t->ondisk[first + i] = t->map[first + i] != 0;
+    t->mdirty[sec] = 0;
+    return 0;
+}
+
+static int meta_sync(tier_t* t) {
+    int rc = 0;
+    for (uint32_t i = 0; i < t->meta; ++i) if (t->mdirty[i] && meta_write(t, i) != 0) rc = -1;
+    return rc;
+}
+
+static void set_entry(tier_t* t, uint32_t s, uint64_t e) {
+    uint64_t old = t->map[s];
+    if (old) { t->st.cached--; if (old & T_DIRTY) t->st.dirty--; }
+    if (e) { t->st.cached++; if (e & T_DIRTY) t->st.dirty++; }
+    t->map[s] = e;
+    t->mdirty[s / t->eps] = 1;
+}
+
+static int write_back(tier_t* t, uint32_t s) {
+    uint64_t b = T_BLK(t->map[s]);
+    if (block_read(t->cache, slot_lba(t, s), t->wbuf, t->bs) != (int)t->bs) return -1;
+    if (block_write(t->origin, b * t->bs, t->wbuf, t->bs) != (int)t->bs) return -1;
+    t->st.writebacks++;
+    set_entry(t, s, t->map[s] & ~T_DIRTY);
+    return 0;
+}
+
+// Empty the slot; a table entry on disk is cleared at once so the slot's
+// data can be overwritten safely
+static int drop(tier_t* t, uint32_t s) {
+    if (t->map[s]) set_entry(t, s, 0);
+    return t->ondisk[s] ? meta_write(t, s / t->eps) : 0;
+}
+
+// A slot for block b: an empty way of its set, else the least recently
+// used one (written back first when dirty)
+static uint32_t alloc(tier_t* t, uint64_t b) {
+    uint32_t base = (uint32_t)(b % t->sets) * TIER_WAYS, s = base;
+    for (uint32_t w = 0; w < TIER_WAYS; ++w) {
+        if (!t->map[base + w]) { s = base + w; break; }
+        if (t->stamp[base + w] < t->stamp[s]) s = base + w;
+    }
+    if (t->map[s]) {
+        if ((t->map[s] & T_DIRTY) && write_back(t, s) != 0) return TIER_NONE;
+        t->st.evictions++;
+    }
+    return drop(t, s) == 0 ? s : TIER_NONE;
+}
+
+static void install(tier_t* t, uint32_t s, uint64_t b, int dirty) {
+    set_entry(t, s, (b + 1) | (dirty ? T_DIRTY : 0));
+    t->stamp[s] = ++t->clock;
+}
+
+static int seq_bypass(tier_t* t, uint64_t lba, uint32_t count) {
+    t->seq_sectors = lba == t->seq_next ? t->seq_sectors + count : count;
+    t->seq_next = lba + count;
+    return t->seq_cutoff && t->seq_sectors * t->dev.sector_size > t->seq_cutoff;
+}
+
+// Hits copy from the cache. A run of missing blocks is one origin read;
+// unless bypassing, whole blocks are read and copied into the cache.
+static int tier_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    tier_t* t = (tier_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    uint32_t ssz = dev->sector_size;
+    tier_lock(t);
+    int bypass = seq_bypass(t, lba, count), rc = 0;
+    if (bypass) t->st.bypassed++;
+    uint64_t cur = lba, end = lba + count;
+    while (cur < end && rc == 0) {
+        uint64_t b = cur / t->bs, off = cur % t->bs;
+        uint8_t* out = (uint8_t*)buf + (cur - lba) * ssz;
+        uint32_t s = lookup(t, b);
+        if (s != TIER_NONE) {
+            uint64_t n = t->bs - off; if (n > end - cur) n = end - cur;
+            if (block_read(t->cache, slot_lba(t, s) + off, out, (uint32_t)n) != (int)n) { rc = -1; break; }
+            t->stamp[s] = ++t->clock;
+            t->st.read_hits++;
+            cur += n;
+            continue;
+        }
+        uint64_t rb = b + 1;
+        while (rb * t->bs < end && rb - b < TIER_RUN && rb < t->nblocks && lookup(t, rb) == TIER_NONE) ++rb;
+        uint64_t rend = rb * t->bs < end ? rb * t->bs : end;
+        t->st.read_misses += rb - b;
+        if (bypass || b >= t->nblocks) {
+            if (block_read(t->origin, cur, out, (uint32_t)(rend - cur)) != (int)(rend - cur)) rc = -1;
+            cur = rend;
+            continue;
+        }
+        uint32_t n = (uint32_t)((rb - b) * t->bs);
+        if (block_read(t->origin, b * t->bs, t->rbuf, n) != (int)n) { rc = -1; break; }
+        memcpy(out, t->rbuf + off * ssz, (rend - cur) * ssz);
+        for (uint64_t k = b; k < rb; ++k) {
+            uint8_t* data = t->rbuf + (k - b) * t->bs * ssz;
+            if ((s = alloc(t, k)) == TIER_NONE) continue;
+            if (block_write(t->cache, slot_lba(t, s), data, t->bs) != (int)t->bs) continue;
+            install(t, s, k, 0);
+            t->st.promotions++;
+        }
+        cur = rend;
+    }
+    tier_unlock(t);
+    return rc ? -1 : (int)count;
+}
+
+// Write-through and bypassed writes go to the origin first and keep cached
+// copies current. Write-back stores blocks dirty in the cache; a partial
+// block that misses is read from the origin and merged first.
+static int tier_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    tier_t* t = (tier_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    if (count == 0) return 0;
+    uint32_t ssz = dev->sector_size;
+    tier_lock(t);
+    int bypass = seq_bypass(t, lba, count), rc = 0;
+    if (bypass) t->st.bypassed++;
+    int through = bypass || t->mode == TIER_WRITETHROUGH;
+    if (through && block_write(t->origin, lba, buf, count) != (int)count) { tier_unlock(t); return -1; }
+    for (uint64_t cur = lba, end = lba + count; cur < end && rc == 0; ) {
+        uint64_t b = cur / t->bs, off = cur % t->bs;
+        uint32_t n = (uint32_t)(t->bs - off); if (n > end - cur) n = (uint32_t)(end - cur);
+        const uint8_t* src = (const uint8_t*)buf + (cur - lba) * ssz;
+        cur += n;
+        uint32_t s = lookup(t, b);
+        if (s != TIER_NONE) {
+            t->st.write_hits++;
+            if (block_write(t->cache, slot_lba(t, s) + off, src, n) != (int)n) {
+                if (!through || drop(t, s) != 0) rc = -1;   // the origin copy is current
+                continue;
+            }
+            t->stamp[s] = ++t->clock;
+            if (!through && !(t->map[s] & T_DIRTY)) set_entry(t, s, t->map[s] | T_DIRTY);
+            continue;
+        }
+        t->st.write_misses++;
+        if (b >= t->nblocks || (through && (bypass || n != t->bs))) {
+            if (!through && block_write(t->origin, b * t->bs + off, src, n) != (int)n) rc = -1;
+            continue;
+        }
+        if (n != t->bs) {
+            if (block_read(t->origin, b * t->bs, t->rbuf, t->bs) != (int)t->bs) { rc = -1; break; }
+            memcpy(t->rbuf + off * ssz, src, (uint64_t)n * ssz);
+            src = t->rbuf;
+        }
+        s = alloc(t, b);
+        if (s == TIER_NONE || block_write(t->cache, slot_lba(t, s), src, t->bs) != (int)t->bs) {
+            if (!through && block_write(t->origin, b * t->bs, src, t->bs) != (int)t->bs) rc = -1;
+            continue;
+        }
+        install(t, s, b, !through);
+        t->st.promotions++;
+    }
+    tier_unlock(t);
+    return rc ? -1 : (int)count;
+}
+
+// The slot table reaches the cache device, then both devices flush
+static int tier_flush(block_device_t* dev) {
+    tier_t* t = (tier_t*)dev->priv;
+    tier_lock(t);
+    int rc = meta_sync(t);
+    if (block_flush(t->cache) != 0) rc = -1;
+    if (block_flush(t->origin) != 0) rc = -1;
+    tier_unlock(t);
+    return rc;
+}
+
+// Whole cached blocks inside the range are dropped (and discarded on the
+// cache device); the origin gets the range as is
+static int tier_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    tier_t* t = (tier_t*)dev->priv;
+    if (lba + count > dev->sector_count) return -1;
+    tier_lock(t);
+    int rc = 0;
+    for (uint64_t b = (lba + t->bs - 1) / t->bs; (b + 1) * t->bs <= lba + count; ++b) {
+        uint32_t s = lookup(t, b);
+        if (s == TIER_NONE) continue;
+        if (drop(t, s) != 0) rc = -1;
+        (void)block_discard(t->cache, slot_lba(t, s), t->bs);
+    }
+    if (block_discard(t->origin, lba, count) != 0) rc = -1;
+    tier_unlock(t);
+    return rc;
+}
+
+static int writeback_all(tier_t* t) {
+    int rc = 0;
+    for (uint32_t s = 0; s < t->slots; ++s)
+        if ((t->map[s] & T_DIRTY) && write_back(t, s) != 0) rc = -1;
+    if (meta_sync(t) != 0) rc = -1;
+    return rc;
+}
+
+// Reuse a matching superblock and its table; entries that do not fit the
+// geometry are dropped
+static int load(tier_t* t) {
+    const tier_sb_t* sb = (const tier_sb_t*)t->mbuf;
+    if (block_read(t->cache, 0, t->mbuf, 1) != 1) return -1;
+    if (memcmp(sb->magic, s_magic, 8) != 0 || sb->ssz != t->cache->sector_size || sb->bs != t->bs ||
+        sb->slots != t->slots || sb->meta != t->meta || sb->data_off != t->data_off ||
+        sb->origin_sectors != t->origin->sector_count) return -1;
+    for (uint32_t sec = 0; sec < t->meta; ++sec) {
+        if (block_read(t->cache, 1 + sec, t->mbuf, 1) != 1) return -1;
+        uint32_t first = sec * t->eps, n = t->slots - first;
+        if (n > t->eps) n = t->eps;
+        memcpy(&t->map[first], t->mbuf, (uint64_t)n * 8);
+    }
+    for (uint32_t s = 0; s < t->slots; ++s) {
+        uint64_t e = t->map[s];
+        if (!e) continue;
+        t->map[s] = 0;
+        t->ondisk[s] = 1;
+        if (T_BLK(e) >= t->nblocks || T_BLK(e) % t->sets != s / TIER_WAYS) continue;
+        set_entry(t, s, e);
+        t->stamp[s] = 0;
+        t->st.loaded++;
+    }
+    for (uint32_t i = 0; i < t->meta; ++i) t->mdirty[i] = 0;
+    for (uint32_t s = 0; s < t->slots; ++s) if (t->ondisk[s] && !t->map[s]) t->mdirty[s / t->eps] = 1;
+    return 0;
+}
+
+// Empty table first, then the superblock that makes it valid
+static int format(tier_t* t) {
+    memset(t->mbuf, 0, t->cache->sector_size);
+    for (uint32_t sec = 0; sec < t->meta; ++sec)
+        if (block_write(t->cache, 1 + sec, t->mbuf, 1) != 1) return -1;
+    if (block_flush(t->cache) != 0) return -1;
+    tier_sb_t* sb = (tier_sb_t*)t->mbuf;
+    memcpy(sb->magic, s_magic, 8);
+    sb->ssz = t->cache->sector_size; sb->bs = t->bs;
+    sb->slots = t->slots; sb->meta = t->meta; sb->data_off = t->data_off;
+    sb->origin_sectors = t->origin->sector_count;
+    return block_write_fua(t->cache, 0, t->mbuf, 1) == 1 ? 0 : -1;
+}
+
+static void tier_free(tier_t* t) {
+    if (t->map) kfree(t->map);
+    if (t->stamp) kfree(t->stamp);
+    if (t->ondisk) kfree(t->ondisk);
+    if (t->mdirty) kfree(t->mdirty);
+    if (t->rbuf) pmm_free_frames((uint64_t)(uintptr_t)t->rbuf, TIER_RUN + 2);
+    kfree(t);
+}
+
+int tier_create(const char* name, const char* origin, const char* cache, int mode) {
+    block_device_t* o = origin ? block_find(origin) : NULL;
+    block_device_t* c = cache ? block_find(cache) : NULL;
+    if (!name || !name[0] || block_find(name) || !o || !c || o == c || !o->ops || !c->ops ||
+        !c->ops->write || (mode != TIER_WRITETHROUGH && mode != TIER_WRITEBACK)) return -1;
+    uint32_t ssz = c->sector_size;
+    if (ssz != o->sector_size || ssz < sizeof(tier_sb_t) || ssz > TIER_BLOCK || TIER_BLOCK % ssz) return -1;
+    uint32_t bs = TIER_BLOCK / ssz, eps = ssz / 8;
+    if (o->sector_count < bs) return -1;
+    // Largest multiple of TIER_WAYS slots that fits behind the table
+    uint64_t slots = c->sector_count / bs / TIER_WAYS * TIER_WAYS, meta = 0, data_off = 0;
+    for (; slots; slots -= TIER_WAYS) {
+        meta = (slots + eps - 1) / eps;
+        data_off = (1 + meta + bs - 1) / bs * bs;
+        if (data_off + slots * bs <= c->sector_count) break;
+    }
+    if (slots == 0 || slots > 0x10000000u) return -1;
+    tier_t* t = (tier_t*)kmalloc(sizeof(tier_t));
+    if (!t) return -1;
+    memset(t, 0, sizeof(*t));
+    t->origin = o; t->cache = c;
+    t->bs = bs; t->eps = eps;
+    t->slots = (uint32_t)slots; t->sets = t->slots / TIER_WAYS;
+    t->meta = (uint32_t)meta; t->data_off = (uint32_t)data_off;
+    t->nblocks = o->sector_count / bs;
+    t->mode = (uint8_t)mode;
+    t->seq_cutoff = TIER_SEQ_CUTOFF;
+    t->seq_next = ~0ULL;
+    t->st.slots = t->slots;
+    t->map = (uint64_t*)kmalloc(slots * 8);
+    t->stamp = (uint32_t*)kmalloc(slots * 4);
+    t->ondisk = (uint8_t*)kmalloc(slots);
+    t->mdirty = (uint8_t*)kmalloc(meta);
+    uint64_t bufs = pmm_alloc_frames_below(TIER_RUN + 2, 1ULL << 32);
+    if (bufs) {
+        t->rbuf = (uint8_t*)(uintptr_t)bufs;
+        t->wbuf = t->rbuf + TIER_RUN * TIER_BLOCK;
+        t->mbuf = t->wbuf + TIER_BLOCK;
+    }
+    if (!t->map || !t->stamp || !t->ondisk || !t->mdirty || !t->rbuf) { tier_free(t); return -1; }
+    memset(t->map, 0, slots * 8);
+    memset(t->stamp, 0, slots * 4);
+    memset(t->ondisk, 0, slots);
+    memset(t->mdirty, 0, meta);
+    if (load(t) != 0) {
+        memset(t->map, 0, slots * 8);
+        memset(t->ondisk, 0, slots);
+        memset(t->mdirty, 0, meta);
+        memset(&t->st, 0, sizeof(t->st));
+        t->st.slots = t->slots;
+        if (format(t) != 0) { tier_free(t); return -1; }
+    }
+    if (mode == TIER_WRITETHROUGH && t->st.dirty && writeback_all(t) != 0)
+        console_write("tier: write-back of restored dirty blocks failed\n");
+    s_ops.read = tier_read; s_ops.write = tier_write;
+    s_ops.flush = tier_flush; s_ops.discard = tier_discard;
+    block_device_t* d = &t->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = ssz;
+    d->sector_count = o->sector_count;
+    d->ops = &s_ops; d->priv = t; d->next = NULL;
+    t->next = g_tiers; g_tiers = t;
+    block_register(d);
+    return 0;
+}
+
+int tier_set_policy(const char* name, int mode, uint32_t seq_cutoff) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || (mode != TIER_WRITETHROUGH && mode != TIER_WRITEBACK)) return -1;
+    tier_t* t = (tier_t*)d->priv;
+    tier_lock(t);
+    int rc = 0;
+    if (mode == TIER_WRITETHROUGH && t->mode == TIER_WRITEBACK) rc = writeback_all(t);
+    if (rc == 0) t->mode = (uint8_t)mode;
+    t->seq_cutoff = seq_cutoff;
+    tier_unlock(t);
+    return rc;
+}
+
+int tier_get_stats(const char* name, tier_stats_t* out) {
+    block_device_t* d = name ? block_find(name) : NULL;
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((tier_t*)d->priv)->st;
+    return 0;
+}
+
+static void put_pct(uint64_t hits, uint64_t misses) {
+    console_write_dec(hits + misses ? hits * 100 / (hits + misses) : 0);
+    console_write("%");
+}
+
+void tier_dump(void) {
+    if (!g_tiers) { console_write("tier: no devices\n"); return; }
+    for (tier_t* t = g_tiers; t; t = t->next) {
+        const tier_stats_t* s = &t->st;
+        console_write(t->dev.name); console_write(": origin="); console_write(t->origin->name);
+        console_write(" cache="); console_write(t->cache->name);
+        console_write(t->mode == TIER_WRITEBACK ? " writeback" : " writethrough");
+        console_write(" seq_cutoff="); console_write_dec(t->seq_cutoff >> 10);
+        console_write("K\n  slots="); console_write_dec(s->slots);
+        console_write(" cached="); console_write_dec(s->cached);
+        console_write(" dirty="); console_write_dec(s->dirty);
+        console_write(" loaded="); console_write_dec(s->loaded);
+        console_write(" read_hit="); put_pct(s->read_hits, s->read_misses);
+        console_write(" write_hit="); put_pct(s->write_hits, s->write_misses);
+        console_write("\n  promotions="); console_write_dec(s->promotions);
+        console_write(" evictions="); console_write_dec(s->evictions);
+        console_write(" writebacks="); console_write_dec(s->writebacks);
+        console_write(" bypassed="); console_write_dec(s->bypassed);
+        console_write(" meta_writes="); console_write_dec(s->meta_writes);
+        console_write("\n");
+    }
+}
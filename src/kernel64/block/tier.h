@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+// Tiered cache device: a fast device (e.g. a ramdisk) keeps copies of hot
+// 4 KiB blocks of a slow origin device, and the pair is registered as one
+// new device of the origin's size. Blocks live in 8-way sets with LRU
+// replacement.
+//  write-through: writes reach the origin before completing; the cache
+//                 copy is updated (hits) or filled (whole-block misses).
+//  write-back:    writes land in the cache only and are marked dirty; they
+//                 reach the origin when evicted or when the policy is
+//                 switched to write-through.
+// Reads and writes that continue a sequential stream of more than the
+// cutoff bypass the cache (blocks already cached stay coherent).
+// The cache device starts with a superblock and the slot table, so a cache
+// re-attached to the same origin keeps its contents, dirty blocks included.
+// Slot changes reach the cache device on flush; a slot is invalidated on
+// disk before its data is reused for another block.
+
+#define TIER_BLOCK          4096u
+#define TIER_WAYS           8u
+#define TIER_SEQ_CUTOFF     (1024u * 1024u)     // bytes; 0 turns bypass off
+
+#define TIER_WRITETHROUGH   0
+#define TIER_WRITEBACK      1
+
+typedef struct {
+    uint64_t read_hits;     // blocks read from the cache
+    uint64_t read_misses;   // blocks read from the origin
+    uint64_t write_hits;
+    uint64_t write_misses;
+    uint64_t bypassed;      // sequential requests sent straight to the origin
+    uint64_t promotions;    // blocks copied into the cache
+    uint64_t evictions;
+    uint64_t writebacks;    // dirty blocks written to the origin
+    uint64_t meta_writes;   // slot table sectors written
+    uint32_t cached;        // valid slots now
+    uint32_t dirty;         // dirty slots now
+    uint32_t slots;
+    uint32_t loaded;        // slots restored from the cache device at create
+} tier_stats_t;
+
+// Create and register `name`: origin cached by `cache` (same sector size,
+// whole blocks of it are used). An existing tier superblock for an origin
+// of the same size is reused, otherwise the cache is formatted. 0 or -1.
+int tier_create(const char* name, const char* origin, const char* cache, int mode);
+// Change the write policy and sequential cutoff in bytes; switching to
+// write-through writes every dirty block back first. 0 or -1.
+int tier_set_policy(const char* name, int mode, uint32_t seq_cutoff);
+// Stats of the named tier device; returns 0, or -1 if it is not one
+int tier_get_stats(const char* name, tier_stats_t* out);
+// Print every tier device with its policy and hit rates
+void tier_dump(void);
@@ -0,0 +1,520 @@
+// virtio-blk over PCI: feature negotiation, one split virtqueue per device,
+// requests as descriptor chains (header, data segments, status byte), using
+// an indirect table per request when the device offers it.
+#include "virtio_blk.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+#include "../console.h"
+#include "../pci/pci.h"
+#include "../lib/mem.h"
+#include "../sched/sched.h"
+#include "../../kernel/mm/pmm.h"
+
+extern void* kmalloc(size_t);
+
+// Feature bits
+#define VIRTIO_BLK_F_SEG_MAX        2
+#define VIRTIO_BLK_F_RO             5
+#define VIRTIO_BLK_F_BLK_SIZE       6
+#define VIRTIO_BLK_F_FLUSH          9
+#define VIRTIO_BLK_F_DISCARD        13
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_F_VERSION_1          32
+
+// Device status
+#define VS_ACK         1
+#define VS_DRIVER      2
+#define VS_DRIVER_OK   4
+#define VS_FEATURES_OK 8
+#define VS_FAILED      128
+
+// virtio PCI capability types
+#define VPCI_COMMON 1
+#define VPCI_NOTIFY 2
+#define VPCI_ISR    3
+#define VPCI_DEVICE 4
+
+#define VQ_DESC_F_NEXT     1
+#define VQ_DESC_F_WRITE    2
+#define VQ_DESC_F_INDIRECT 4
+#define VQ_AVAIL_F_NO_INTERRUPT 1
+#define VQ_USED_F_NO_NOTIFY     1
+
+#define VBLK_T_IN  0
+#define VBLK_T_OUT 1
+#define VBLK_T_FLUSH 4
+#define VBLK_T_DISCARD 11
+
+#define VBLK_MAX_QSIZE 256
+
+typedef struct __attribute__((packed)) {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t  device_status;
+    uint8_t  config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint32_t queue_desc_lo, queue_desc_hi;
+    uint32_t queue_driver_lo, queue_driver_hi;
+    uint32_t queue_device_lo, queue_device_hi;
+} vcommon_t;
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} vq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} vq_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} vq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    vq_used_elem_t ring[];
+} vq_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} vblk_hdr_t;
+
+// Data of a discard request: one range
+typedef struct {
+    uint64_t sector;
+    uint32_t num_sectors;
+    uint32_t flags;
+} vblk_range_t;
+
+// Per-request DMA state; the indirect table comes first to keep it aligned
+typedef struct {
+    vq_desc_t table[BLOCK_MAX_SEGS + 2];
+    vblk_hdr_t hdr;
+    vblk_range_t range;        // discard requests
+    volatile uint8_t status;
+    volatile uint8_t done;     // synchronous requests: set by the reaper
+    int8_t result;
+    bio_t* rq;                 // asynchronous request, NULL when synchronous
+    uint16_t head, tail;       // ring descriptors holding the chain
+} vblk_slot_t;
+
+typedef struct {
+    block_device_t bdev;
+    volatile vcommon_t* common;
+    volatile uint8_t* isr;
+    volatile uint8_t* devcfg;
+    volatile uint16_t* notify;
+    vq_desc_t* desc;
+    volatile vq_avail_t* avail;
+    volatile vq_used_t* used;
+    uint16_t qsize;
+    uint16_t free_head, num_free;
+    uint16_t avail_idx, last_used;
+    uint8_t desc_slot[VBLK_MAX_QSIZE];  // head descriptor -> slot
+    vblk_slot_t* slots;
+    uint32_t slot_busy;                 // bitmask over slots
+    uint32_t seg_max;
+    uint32_t max_discard;               // device sectors per discard request, 0 = unsupported
+    uint8_t shift;                      // log2(sector_size / 512): requests address 512-byte units
+    uint8_t indirect, readonly, mode;
+    uint8_t wcache;                     // VIRTIO_BLK_F_FLUSH: writes may sit in a volatile cache
+    vblk_stats_t stats;
+} vblk_t;
+
+static vblk_t* g_vblk[8];
+static int g_vblk_count;
+static block_ops_t vblk_ops;
+
+// Kernel memory is identity mapped below 4 GiB, so pointers are DMA addresses
+static inline uint64_t dma_addr(const volatile void* p) { return (uint64_t)(uintptr_t)p; }
+static inline void mb(void) { __asm__ volatile("mfence" ::: "memory"); }
+static inline void barrier(void) { __asm__ volatile("" ::: "memory"); }
+
+static void log_dev(const vblk_t* v, const char* msg) {
+    console_write("[virtio-blk] "); console_write(v ? v->bdev.name : "?");
+    console_write(": "); console_write(msg); console_putc('\n');
+}
+
+// ---- descriptors and slots ----
+
+static int slot_alloc(vblk_t* v, uint32_t nseg) {
+    uint32_t need = v->indirect ? 1 : nseg + 2;
+    if (v->num_free < need || v->slot_busy == 0xFFFFFFFFu) return -1;
+    for (int i = 0; i < VBLK_SLOTS; ++i) {
+        if (v->slot_busy & (1u << i)) continue;
+        v->slot_busy |= 1u << i;
+        vblk_slot_t* s = &v->slots[i];
+        s->head = v->free_head;
+        uint16_t d = s->head;
+        for (uint32_t k = 1; k < need; ++k) d = v->desc[d].next;
+        s->tail = d;
+        v->free_head = v->desc[d].next;
+        v->num_free = (uint16_t)(v->num_free - need);
+        v->desc_slot[s->head] = (uint8_t)i;
+        s->done = 0; s->rq = NULL;
+        return i;
+    }
+    return -1;
+}
+
+static void slot_free(vblk_t* v, int i) {
+    vblk_slot_t* s = &v->slots[i];
+    uint16_t n = 1;
+    for (uint16_t d = s->head; d != s->tail; d = v->desc[d].next) ++n;
+    v->desc[s->tail].next = v->free_head;
+    v->free_head = s->head;
+    v->num_free = (uint16_t)(v->num_free + n);
+    v->slot_busy &= ~(1u << i);
+}
+
+// Fill the chain for slot i and publish it on the avail ring
+static void vblk_start(vblk_t* v, int i, uint32_t type, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    vblk_slot_t* s = &v->slots[i];
+    s->hdr.type = type;
+    s->hdr.reserved = 0;
+    s->hdr.sector = lba << v->shift;
+    s->status = 0xFF;
+    uint16_t dflags = type == VBLK_T_IN ? VQ_DESC_F_WRITE : 0;
+    if (v->indirect) {
+        vq_desc_t* t = s->table;
+        t[0].addr = dma_addr(&s->hdr); t[0].len = sizeof(vblk_hdr_t); t[0].flags = VQ_DESC_F_NEXT; t[0].next = 1;
+        for (uint32_t k = 0; k < nseg; ++k) {
+            t[k + 1].addr = dma_addr(segs[k].base); t[k + 1].len = segs[k].len;
+            t[k + 1].flags = dflags | VQ_DESC_F_NEXT; t[k + 1].next = (uint16_t)(k + 2);
+        }
+        t[nseg + 1].addr = dma_addr(&s->status); t[nseg + 1].len = 1;
+        t[nseg + 1].flags = VQ_DESC_F_WRITE; t[nseg + 1].next = 0;
+        vq_desc_t* d = &v->desc[s->head];
+        d->addr = dma_addr(t); d->len = (nseg + 2) * sizeof(vq_desc_t); d->flags = VQ_DESC_F_INDIRECT;
+    } else {
+        uint16_t d = s->head;
+        v->desc[d].addr = dma_addr(&s->hdr); v->desc[d].len = sizeof(vblk_hdr_t); v->desc[d].flags = VQ_DESC_F_NEXT;
+        for (uint32_t k = 0; k < nseg; ++k) {
+            d = v->desc[d].next;
+            v->desc[d].addr = dma_addr(segs[k].base); v->desc[d].len = segs[k].len;
+            v->desc[d].flags = dflags | VQ_DESC_F_NEXT;
+        }
+        d = v->desc[d].next;
+        v->desc[d].addr = dma_addr(&s->status); v->desc[d].len = 1; v->desc[d].flags = VQ_DESC_F_WRITE;
+    }
+    v->avail->ring[v->avail_idx % v->qsize] = s->head;
+    barrier();
+    v->avail->idx = ++v->avail_idx;
+    v->stats.requests++;
+    mb();   // publish idx before sampling the device's notify suppression
+    if (!(v->used->flags & VQ_USED_F_NO_NOTIFY)) { *v->notify = 0; v->stats.notifies++; }
+}
+
+// Reap the used ring: asynchronous requests complete through the block
+// layer, synchronous ones are flagged for their waiter
+static int vblk_reap(vblk_t* v) {
+    if (v->last_used == v->used->idx) return 0;
+    // Reading ISR acknowledges the interrupt and deasserts INTx
+    if (v->mode == VBLK_MODE_IRQ && (*v->isr & 1)) v->stats.irqs++;
+    int n = 0;
+    while (v->last_used != v->used->idx) {
+        barrier();
+        uint32_t id = v->used->ring[v->last_used % v->qsize].id;
+        v->last_used++;
+        if (id >= v->qsize) continue;
+        int i = v->desc_slot[id];
+        vblk_slot_t* s = &v->slots[i];
+        int status = s->status == 0 ? 0 : -1;
+        if (status) v->stats.errors++;
+        v->stats.completions++;
+        ++n;
+        if (s->rq) { bio_t* rq = s->rq; slot_free(v, i); block_complete(rq, status); }
+        else { s->result = (int8_t)status; s->done = 1; }
+    }
+    return n;
+}
+
+static int vblk_poll(block_device_t* dev) { return vblk_reap((vblk_t*)dev->priv); }
+
+static void vblk_idle(vblk_t* v) {
+    if (vblk_reap(v) > 0) return;
+    if (v->mode == VBLK_MODE_POLL) __asm__ volatile("pause"); else sched_yield();
+}
+
+// ---- block ops ----
+
+static int vblk_submit(block_device_t* dev, bio_t* rq, const block_iovec_t* segs, uint32_t nseg) {
+    vblk_t* v = (vblk_t*)dev->priv;
+    int w = rq->op == BIO_WRITE;
+    if ((w && v->readonly) || nseg == 0 || nseg > v->seg_max) return -1;
+    int i = slot_alloc(v, nseg);
+    if (i < 0) return BLOCK_BUSY;
+    v->slots[i].rq = rq;
+    vblk_start(v, i, w ? VBLK_T_OUT : VBLK_T_IN, rq->lba, segs, nseg);
+    return 0;
+}
+
+// Direct calls (ops->read etc.) bypass the queue and wait for their slot
+static int vblk_sync(vblk_t* v, int write, uint64_t lba, const block_iovec_t* segs, uint32_t nseg) {
+    uint64_t bytes = block_iov_bytes(segs, nseg);
+    uint32_t ssz = v->bdev.sector_size;
+    if ((write && v->readonly) || nseg == 0 || nseg > v->seg_max || bytes % ssz ||
+        lba + bytes / ssz > v->bdev.sector_count) return -1;
+    int i;
+    while ((i = slot_alloc(v, nseg)) < 0) vblk_idle(v);
+    vblk_start(v, i, write ? VBLK_T_OUT : VBLK_T_IN, lba, segs, nseg);
+    while (!v->slots[i].done) vblk_idle(v);
+    int rc = v->slots[i].result;
+    slot_free(v, i);
+    return rc ? -1 : (int)(bytes / ssz);
+}
+
+static int vblk_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { buf, count * dev->sector_size };
+    return vblk_sync((vblk_t*)dev->priv, 0, lba, &seg, 1);
+}
+static int vblk_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count) {
+    if (count == 0) return 0;
+    block_iovec_t seg = { (void*)buf, count * dev->sector_size };
+    return vblk_sync((vblk_t*)dev->priv, 1, lba, &seg, 1);
+}
+static int vblk_readv(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return vblk_sync((vblk_t*)dev->priv, 0, lba, iov, iovcnt);
+}
+static int vblk_writev(block_device_t* dev, uint64_t lba, const block_iovec_t* iov, uint32_t iovcnt) {
+    return vblk_sync((vblk_t*)dev->priv, 1, lba, iov, iovcnt);
+}
+
+// One request per max_discard sectors, each waiting for its slot
+static int vblk_discard(block_device_t* dev, uint64_t lba, uint64_t count) {
+    vblk_t* v = (vblk_t*)dev->priv;
+    if (!v->max_discard || v->readonly || lba + count > v->bdev.sector_count) return -1;
+    while (count) {
+        uint32_t n = count > v->max_discard ? v->max_discard : (uint32_t)count;
+        int i;
+        while ((i = slot_alloc(v, 1)) < 0) vblk_idle(v);
+        vblk_slot_t* s = &v->slots[i];
+        s->range.sector = lba << v->shift; s->range.num_sectors = n << v->shift; s->range.flags = 0;
+        block_iovec_t seg = { &s->range, sizeof(vblk_range_t) };
+        vblk_start(v, i, VBLK_T_DISCARD, 0, &seg, 1);
+        while (!s->done) vblk_idle(v);
+        int rc = s->result;
+        slot_free(v, i);
+        if (rc) return -1;
+        lba += n; count -= n;
+    }
+    return 0;
+}
+
+// Header-only request; a device without F_FLUSH writes through
+static int vblk_flush(block_device_t* dev) {
+    vblk_t* v = (vblk_t*)dev->priv;
+    if (!v->wcache || v->readonly) return 0;
+    int i;
+    while ((i = slot_alloc(v, 0)) < 0) vblk_idle(v);
+    vblk_start(v, i, VBLK_T_FLUSH, 0, NULL, 0);
+    while (!v->slots[i].done) vblk_idle(v);
+    int rc = v->slots[i].result;
+    slot_free(v, i);
+    return rc ? -1 : 0;
+}
+
+// ---- probe ----
+
+static uint32_t cfg_read32(volatile uint8_t* base, uint32_t off) { return *(volatile uint32_t*)(base + off); }
+
+static int vblk_setup(vblk_t* v, const pci_device_t* d) {
+    volatile uint8_t* common = NULL; volatile uint8_t* notify = NULL;
+    uint32_t notify_mult = 0;
+    for (uint8_t c = pci_find_cap(d, PCI_CAP_VENDOR, 0); c; c = pci_find_cap(d, PCI_CAP_VENDOR, c)) {
+        uint8_t type = pci_cfg_read8(d->bus, d->dev, d->func, (uint8_t)(c + 3));
+        uint8_t bar = pci_cfg_read8(d->bus, d->dev, d->func, (uint8_t)(c + 4));
+        uint32_t off = pci_cfg_read32(d->bus, d->dev, d->func, (uint8_t)(c + 8));
+        uint32_t len = pci_cfg_read32(d->bus, d->dev, d->func, (uint8_t)(c + 12));
+        if (type < VPCI_COMMON || type > VPCI_DEVICE || bar > 5) continue;
+        volatile uint8_t* base = (volatile uint8_t*)pci_map_bar(d, bar, (uint64_t)off + len);
+        if (!base) continue;
+        if (type == VPCI_COMMON && !common) common = base + off;
+        else if (type == VPCI_NOTIFY && !notify) {
+            notify = base + off;
+            notify_mult = pci_cfg_read32(d->bus, d->dev, d->func, (uint8_t)(c + 16));
+        }
+        else if (type == VPCI_ISR && !v->isr) v->isr = base + off;
+        else if (type == VPCI_DEVICE && !v->devcfg) v->devcfg = base + off;
+    }
+    if (!common || !notify || !v->isr || !v->devcfg) { log_dev(v, "no virtio 1.0 capabilities (legacy-only device)"); return -1; }
+    volatile vcommon_t* cc = (volatile vcommon_t*)common;
+    v->common = cc;
+
+    cc->device_status = 0;
+    while (cc->device_status != 0) { }
+    cc->device_status = VS_ACK;
+    cc->device_status = VS_ACK | VS_DRIVER;
+    cc->device_feature_select = 0; uint32_t f0 = cc->device_feature;
+    cc->device_feature_select = 1; uint32_t f1 = cc->device_feature;
+    if (!(f1 & (1u << (VIRTIO_F_VERSION_1 - 32)))) { cc->device_status = VS_FAILED; return -1; }
+    uint32_t want0 = f0 & ((1u << VIRTIO_RING_F_INDIRECT_DESC) | (1u << VIRTIO_BLK_F_RO) |
+                           (1u << VIRTIO_BLK_F_SEG_MAX) | (1u << VIRTIO_BLK_F_BLK_SIZE) |
+                           (1u << VIRTIO_BLK_F_DISCARD) | (1u << VIRTIO_BLK_F_FLUSH));
+    cc->driver_feature_select = 0; cc->driver_feature = want0;
+    cc->driver_feature_select = 1; cc->driver_feature = 1u << (VIRTIO_F_VERSION_1 - 32);
+    cc->device_status = VS_ACK | VS_DRIVER | VS_FEATURES_OK;
+    if (!(cc->device_status & VS_FEATURES_OK)) { cc->device_status = VS_FAILED; log_dev(v, "features rejected"); return -1; }
+    v->indirect = (want0 >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+    v->readonly = (want0 >> VIRTIO_BLK_F_RO) & 1;
+    v->wcache = (want0 >> VIRTIO_BLK_F_FLUSH) & 1;
+
+    // Device config: capacity (512-byte sectors), seg_max, blk_size,
+    // max_discard_sectors; re-read on a generation change
+    uint64_t cap; uint32_t seg_max, blk_size, max_discard; uint8_t gen;
+    do {
+        gen = cc->config_generation;
+        cap = cfg_read32(v->devcfg, 0) | ((uint64_t)cfg_read32(v->devcfg, 4) << 32);
+        seg_max = cfg_read32(v->devcfg, 12);
+        blk_size = cfg_read32(v->devcfg, 20);
+        max_discard = cfg_read32(v->devcfg, 36);
+    } while (gen != cc->config_generation);
+    // A 4Kn backing device reports blk_size 4096: use it as the sector size,
+    // so every request stays aligned to it
+    v->shift = 0;
+    if ((want0 >> VIRTIO_BLK_F_BLK_SIZE) & 1)
+        while (v->shift < 3 && (512u << (v->shift + 1)) <= blk_size) v->shift++;
+    if ((want0 >> VIRTIO_BLK_F_DISCARD) & 1) {
+        v->max_discard = max_discard ? max_discard >> v->shift : 0xFFFFFFFFu >> v->shift;
+        if (!v->max_discard) v->max_discard = 1;
+    }
+    v->seg_max = BLOCK_MAX_SEGS;
+    if (((want0 >> VIRTIO_BLK_F_SEG_MAX) & 1) && seg_max && seg_max < v->seg_max) v->seg_max = seg_max;
+
+    // Queue 0: descriptor table, avail ring and used ring in one zeroed block
+    cc->queue_select = 0;
+    uint16_t qs = cc->queue_size;
+    if (qs == 0) { cc->device_status = VS_FAILED; return -1; }
+    if (qs > VBLK_MAX_QSIZE) qs = VBLK_MAX_QSIZE;
+    cc->queue_size = qs;
+    uint64_t avail_off = (uint64_t)qs * sizeof(vq_desc_t);
+    uint64_t used_off = (avail_off + 6 + 2u * qs + 3) & ~3ULL;
+    uint64_t ring_bytes = used_off + 6 + 8u * qs;
+    size_t ring_pages = (size_t)((ring_bytes + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+    size_t slot_pages = (size_t)((VBLK_SLOTS * sizeof(vblk_slot_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+    uint64_t ring = pmm_alloc_frames_below(ring_pages, 1ULL << 32);
+    uint64_t slots = pmm_alloc_frames_below(slot_pages, 1ULL << 32);
+    if (!ring || !slots) {
+        if (ring) pmm_free_frames(ring, ring_pages);
+        if (slots) pmm_free_frames(slots, slot_pages);
+        cc->device_status = VS_FAILED; return -1;
+    }
+    memset((void*)(uintptr_t)ring, 0, ring_pages * PMM_FRAME_SIZE);
+    memset((void*)(uintptr_t)slots, 0, slot_pages * PMM_FRAME_SIZE);
+    v->desc = (vq_desc_t*)(uintptr_t)ring;
+    v->avail = (volatile vq_avail_t*)(uintptr_t)(ring + avail_off);
+    v->used = (volatile vq_used_t*)(uintptr_t)(ring + used_off);
+    v->slots = (vblk_slot_t*)(uintptr_t)slots;
+    v->qsize = qs;
+    for (uint16_t k = 0; k < qs; ++k) v->desc[k].next = (uint16_t)(k + 1);
+    v->free_head = 0; v->num_free = qs;
+    if (!v->indirect && v->seg_max > (uint32_t)qs - 2) v->seg_max = (uint32_t)qs - 2;
+    cc->queue_desc_lo = (uint32_t)ring; cc->queue_desc_hi = (uint32_t)(ring >> 32);
+    cc->queue_driver_lo = (uint32_t)(ring + avail_off); cc->queue_driver_hi = (uint32_t)((ring + avail_off) >> 32);
+    cc->queue_device_lo = (uint32_t)(ring + used_off); cc->queue_device_hi = (uint32_t)((ring + used_off) >> 32);
+    cc->queue_msix_vector = 0xFFFF;
+    v->notify = (volatile uint16_t*)(notify + (uint32_t)cc->queue_notify_off * notify_mult);
+    cc->queue_enable = 1;
+    cc->device_status = VS_ACK | VS_DRIVER | VS_FEATURES_OK | VS_DRIVER_OK;
+
+    v->bdev.sector_size = 512u << v->shift;
+    v->bdev.sector_count = cap >> v->shift;
+    return 0;
+}
+
+static void set_mode(vblk_t* v, int mode) {
+    v->mode = (uint8_t)mode;
+    v->avail->flags = mode == VBLK_MODE_POLL ? VQ_AVAIL_F_NO_INTERRUPT : 0;
+    v->bdev.queue.spin = mode == VBLK_MODE_POLL;
+}
+
+static void on_pci(const pci_device_t* d, void* user) {
+    (void)user;
+    if (d->vendor_id != 0x1AF4 || (d->device_id != 0x1001 && d->device_id != 0x1042)) return;
+    if (g_vblk_count >= (int)(sizeof(g_vblk) / sizeof(g_vblk[0]))) return;
+    vblk_t* v = (vblk_t*)kmalloc(sizeof(vblk_t));
+    if (!v) return;
+    memset(v, 0, sizeof(*v));
+    v->bdev.name[0] = 'v'; v->bdev.name[1] = 'd'; v->bdev.name[2] = (char)('a' + g_vblk_count);
+    pci_enable_device(d);
+    if (vblk_setup(v, d) != 0) { log_dev(v, "init failed"); return; }   // v stays allocated; the heap is small and this is rare
+    vblk_ops.read = vblk_read; vblk_ops.write = vblk_write;
+    vblk_ops.readv = vblk_readv; vblk_ops.writev = vblk_writev;
+    vblk_ops.submit = vblk_submit; vblk_ops.poll = vblk_poll;
+    vblk_ops.discard = vblk_discard; vblk_ops.flush = vblk_flush;
+    v->bdev.ops = &vblk_ops;
+    v->bdev.priv = v;
+    block_register(&v->bdev);
+    set_mode(v, VBLK_MODE_IRQ);
+    g_vblk[g_vblk_count++] = v;
+    console_write("[virtio-blk] "); console_write(v->bdev.name);
+    console_write(": sectors="); console_write_dec(v->bdev.sector_count);
+    console_write(" queue="); console_write_dec(v->qsize);
+    console_write(v->indirect ? " indirect" : " chained");
+    if (v->readonly) console_write(" ro");
+    if (v->max_discard) console_write(" discard");
+    if (v->wcache) console_write(" flush");
+    console_putc('\n');
+}
+
+int virtio_blk_init(void) {
+    pci_enumerate(on_pci, NULL);
+    return g_vblk_count;
+}
+
+static int name_eq(const char* a, const char* b) {
+    while (*a && *a == *b) { ++a; ++b; }
+    return *a == *b;
+}
+
+int virtio_blk_set_mode(const char* name, int mode) {
+    int n = 0;
+    for (int i = 0; i < g_vblk_count; ++i) {
+        if (name && !name_eq(name, g_vblk[i]->bdev.name)) continue;
+        set_mode(g_vblk[i], mode);
+        ++n;
+    }
+    return n;
+}
+
+void virtio_blk_dump(void) {
+    if (g_vblk_count == 0) { console_write("no virtio-blk devices\n"); return; }
+    for (int i = 0; i < g_vblk_count; ++i) {
+        vblk_t* v = g_vblk[i];
+        console_write(v->bdev.name);
+        console_write(": mib="); console_write_dec(v->bdev.sector_count * v->bdev.sector_size >> 20);
+        console_write(" lba="); console_write_dec(v->bdev.sector_size);
+        console_write(" queue="); console_write_dec(v->qsize);
+        console_write(" seg_max="); console_write_dec(v->seg_max);
+        console_write(v->indirect ? " indirect" : " chained");
+        if (v->max_discard) console_write(" discard");
+        if (v->wcache) console_write(" flush");
+        console_write(v->mode == VBLK_MODE_POLL ? " mode=poll" : " mode=irq");
+        console_putc('\n');
+        console_write("  requests="); console_write_dec(v->stats.requests);
+        console_write(" completions="); console_write_dec(v->stats.completions);
+        console_write(" notifies="); console_write_dec(v->stats.notifies);
+        console_write(" irqs="); console_write_dec(v->stats.irqs);
+        console_write(" errors="); console_write_dec(v->stats.errors);
+        console_putc('\n');
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// virtio-blk PCI driver (1AF4:1001 transitional or 1AF4:1042 modern, using
+// the virtio 1.0 capability interface). Each device gets one split
+// virtqueue and registers as vda, vdb, ... with asynchronous submit/poll
+// ops, so the block queue keeps up to VBLK_SLOTS requests in flight.
+// VIRTIO_BLK_F_FLUSH and VIRTIO_BLK_F_DISCARD are taken when offered;
+// without them flush is a no-op (the device writes through) and discard
+// fails.
+
+#define VBLK_SLOTS 32           // requests in flight per device
+
+// Completion modes. There is no IDT yet, so "irq" means the device raises
+// its interrupt and waiters yield until the ISR status register reports it;
+// "poll" suppresses interrupts and spins on the used ring for lowest latency.
+#define VBLK_MODE_IRQ  0
+#define VBLK_MODE_POLL 1
+
+typedef struct {
+    uint64_t requests;      // requests placed on the ring
+    uint64_t completions;   // used-ring entries reaped
+    uint64_t notifies;      // doorbell writes
+    uint64_t irqs;          // ISR status reads that reported a completion
+    uint64_t errors;        // requests with a non-OK status
+} vblk_stats_t;
+
+// Probe PCI and register every virtio-blk function; returns devices found
+int virtio_blk_init(void);
+// Switch completion mode for one device (NULL = all); returns devices changed
+int virtio_blk_set_mode(const char* name, int mode);
+// Print devices, negotiated features, mode and counters
+void virtio_blk_dump(void);
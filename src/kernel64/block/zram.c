@@ -0,0 +1,297 @@
+#include "zram.h"
+#include "block.h"
+#include <stddef.h>
+#include "../../kernel/mm/pmm.h"
+#include "../lib/mem.h"
+#include "../lib/lz4.h"
+
+extern void* kmalloc(size_t);
+extern void kfree(void*);
+extern void console_write(const char*);
+extern void console_write_dec(uint64_t);
+
+#define ZRAM_NCLASS    (ZRAM_PAGE / ZRAM_CLASS_STEP)   // 64, 128, ... 4096 bytes
+#define ZRAM_SLAB_MAX  4                               // frames per slab, at most
+
+// One entry per page. Pool objects are identity-mapped below 4 GiB, so the
+// address fits 32 bits. len 0 is a zero page, ZRAM_PAGE a raw one.
+typedef struct {
+    uint32_t obj;
+    uint16_t len;
+    uint16_t zero;          // written as all zeros (counted in zero_pages)
+} zram_slot_t;
+
+typedef struct zobj { struct zobj* next; } zobj_t;
+
+// One run of 1..ZRAM_SLAB_MAX frames carved into objects of one class. A
+// slab whose last object is freed goes back to the PMM.
+typedef struct zslab {
+    uint32_t base;              // physical address of the first frame
+    uint16_t frames;
+    uint16_t live;              // objects handed out
+    zobj_t* free;               // this slab's free objects
+    struct zslab* prev;         // partial list of the class: slabs with free objects
+    struct zslab* next;
+} zslab_t;
+
+typedef struct zram {
+    block_device_t dev;
+    zram_slot_t* slots;
+    uint64_t npages;
+    zslab_t* partial[ZRAM_NCLASS];  // slabs with free objects per size class
+    zslab_t** slabs;            // every slab, sorted by base (object -> slab)
+    uint32_t nslabs, slab_cap;
+    zram_stats_t st;
+    struct zram* next;
+} zram_t;
+
+static block_ops_t s_ops;
+static zram_t* g_zrams;
+static uint8_t s_page[ZRAM_PAGE];      // partial-page read-modify-write
+static uint8_t s_cbuf[ZRAM_HUGE];      // compression output
+
+// Slab size for a class: the frame count (1..ZRAM_SLAB_MAX) wasting the
+// smallest fraction of the slab on the tail that fits no object
+static uint32_t slab_frames(uint32_t sz){
+    uint32_t best = 1; uint64_t best_waste = ZRAM_PAGE % sz;
+    for (uint32_t k = 2; k <= ZRAM_SLAB_MAX; ++k) {
+        uint64_t w = ((uint64_t)k * ZRAM_PAGE) % sz;
+        if (w * best < best_waste * k) { best = k; best_waste = w; }
+    }
+    return best;
+}
+
+static void partial_link(zram_t* z, uint32_t c, zslab_t* sl){
+    sl->prev = NULL; sl->next = z->partial[c];
+    if (sl->next) sl->next->prev = sl;
+    z->partial[c] = sl;
+}
+
+static void partial_unlink(zram_t* z, uint32_t c, zslab_t* sl){
+    if (sl->prev) sl->prev->next = sl->next; else z->partial[c] = sl->next;
+    if (sl->next) sl->next->prev = sl->prev;
+}
+
+// Index of the first slab whose base is above addr
+static uint32_t slab_upper(zram_t* z, uint32_t addr){
+    uint32_t lo = 0, hi = z->nslabs;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (z->slabs[mid]->base <= addr) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static zslab_t* slab_new(zram_t* z, uint32_t c){
+    uint32_t sz = (c + 1) * ZRAM_CLASS_STEP, k = slab_frames(sz);
+    if (z->nslabs == z->slab_cap) {
+        uint32_t cap = z->slab_cap ? z->slab_cap * 2 : 16;
+        zslab_t** a = (zslab_t**)kmalloc(cap * sizeof(zslab_t*));
+        if (!a) return NULL;
+        if (z->slabs) { memcpy(a, z->slabs, z->nslabs * sizeof(zslab_t*)); kfree(z->slabs); }
+        z->slabs = a; z->slab_cap = cap;
+    }
+    zslab_t* sl = (zslab_t*)kmalloc(sizeof(zslab_t));
+    if (!sl) return NULL;
+    uint64_t pa = pmm_alloc_frames_below(k, 1ULL << 32);
+    if (!pa) { kfree(sl); return NULL; }
+    sl->base = (uint32_t)pa; sl->frames = (uint16_t)k; sl->live = 0; sl->free = NULL;
+    uint8_t* base = (uint8_t*)(uintptr_t)pa;
+    for (uint32_t off = (k * ZRAM_PAGE / sz - 1) * sz; ; off -= sz) {
+        zobj_t* o = (zobj_t*)(base + off); o->next = sl->free; sl->free = o;
+        if (!off) break;
+    }
+    uint32_t i = slab_upper(z, sl->base);
+    memmove(&z->slabs[i + 1], &z->slabs[i], (z->nslabs - i) * sizeof(zslab_t*));
+    z->slabs[i] = sl; z->nslabs++;
+    partial_link(z, c, sl);
+    z->st.pool_bytes += (uint64_t)k * ZRAM_PAGE;
+    return sl;
+}
+
+static void* pool_alloc(zram_t* z, uint32_t len){
+    uint32_t c = (len + ZRAM_CLASS_STEP - 1) / ZRAM_CLASS_STEP - 1;
+    zslab_t* sl = z->partial[c];
+    if (!sl && !(sl = slab_new(z, c))) return NULL;
+    zobj_t* o = sl->free; sl->free = o->next; sl->live++;
+    if (!sl->free) partial_unlink(z, c, sl);
+    return o;
+}
+
+static void pool_free(zram_t* z, void* obj, uint32_t len){
+    uint32_t c = (len + ZRAM_CLASS_STEP - 1) / ZRAM_CLASS_STEP - 1;
+    uint32_t i = slab_upper(z, (uint32_t)(uintptr_t)obj) - 1;
+    zslab_t* sl = z->slabs[i];
+    int was_full = !sl->free;
+    zobj_t* o = (zobj_t*)obj; o->next = sl->free; sl->free = o;
+    if (--sl->live) { if (was_full) partial_link(z, c, sl); return; }
+    if (!was_full) partial_unlink(z, c, sl);
+    memmove(&z->slabs[i], &z->slabs[i + 1], (z->nslabs - i - 1) * sizeof(zslab_t*));
+    z->nslabs--;
+    pmm_free_frames(sl->base, sl->frames);
+    z->st.pool_bytes -= (uint64_t)sl->frames * ZRAM_PAGE;
+    kfree(sl);
+}
+
+static void slot_clear(zram_t* z, zram_slot_t* s){
+    if (s->len) {
+        pool_free(z, (void*)(uintptr_t)s->obj, s->len);
+        z->st.stored_pages--; z->st.data_bytes -= ZRAM_PAGE; z->st.compr_bytes -= s->len;
+        if (s->len == ZRAM_PAGE) z->st.huge_pages--;
+    } else if (s->zero) z->st.zero_pages--;
+    s->obj = 0; s->len = 0; s->zero = 0;
+}
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
+
+static int is_zero(const uint8_t* p){
+    const u64_unaligned* w = (const u64_unaligned*)p;
+    for (uint32_t i = 0; i < ZRAM_PAGE / 8; ++i) if (w[i]) return 0;
+    return 1;
+}
+
+static int page_store(zram_t* z, uint64_t pg, const uint8_t* data){
+    zram_slot_t* s = &z->slots[pg];
+    if (is_zero(data)) { slot_clear(z, s); s->zero = 1; z->st.zero_pages++; return 0; }
+    uint32_t len = lz4_compress(data, ZRAM_PAGE, s_cbuf, ZRAM_HUGE);
+    const uint8_t* src = len ? s_cbuf : data;
+    if (!len) len = ZRAM_PAGE;
+    void* obj = pool_alloc(z, len);
+    if (!obj) return -1;
+    memcpy(obj, src, len);
+    slot_clear(z, s);
+    s->obj = (uint32_t)(uintptr_t)obj; s->len = (uint16_t)len;
+    z->st.stored_pages++; z->st.data_bytes += ZRAM_PAGE; z->st.compr_bytes += len;
+    if (len == ZRAM_PAGE) z->st.huge_pages++;
+    return 0;
+}
+
+static int page_load(zram_t* z, uint64_t pg, uint8_t* out){
+    const zram_slot_t* s = &z->slots[pg];
+    const void* obj = (const void*)(uintptr_t)s->obj;
+    if (!s->len) { memset(out, 0, ZRAM_PAGE); return 0; }
+    if (s->len == ZRAM_PAGE) { memcpy(out, obj, ZRAM_PAGE); return 0; }
+    return lz4_decompress(obj, s->len, out, ZRAM_PAGE) == (int)ZRAM_PAGE ? 0 : -1;
+}
+
+// Whole pages go straight between the caller's buffer and the pool; partial
+// pages are decompressed into s_page first
+static int zr_read(block_device_t* dev, uint64_t lba, void* buf, uint32_t count){
+    zram_t* z = (zram_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    uint32_t ssz = dev->sector_size, spp = ZRAM_PAGE / ssz;
+    uint8_t* out = (uint8_t*)buf;
+    for (uint32_t done = 0; done < count; ) {
+        uint64_t cur = lba + done;
+        uint32_t first = (uint32_t)(cur % spp), n = spp - first;
+        if (n > count - done) n = count - done;
+        uint8_t* dst = out + (uint64_t)done * ssz;
+        if (n == spp) { if (page_load(z, cur / spp, dst) != 0) return -1; }
+        else {
+            if (page_load(z, cur / spp, s_page) != 0) return -1;
+            memcpy(dst, s_page + first * ssz, (uint64_t)n * ssz);
+        }
+        done += n;
+    }
+    return (int)count;
+}
+
+static int zr_write(block_device_t* dev, uint64_t lba, const void* buf, uint32_t count){
+    zram_t* z = (zram_t*)dev->priv;
+    if (!buf || lba + count > dev->sector_count) return -1;
+    uint32_t ssz = dev->sector_size, spp = ZRAM_PAGE / ssz;
+    const uint8_t* in = (const uint8_t*)buf;
+    for (uint32_t done = 0; done < count; ) {
+        uint64_t cur = lba + done;
+        uint32_t first = (uint32_t)(cur % spp), n = spp - first;
+        if (n > count - done) n = count - done;
+        const uint8_t* src = in + (uint64_t)done * ssz;
+        if (n == spp) { if (page_store(z, cur / spp, src) != 0) return -1; }
+        else {
+            if (page_load(z, cur / spp, s_page) != 0) return -1;
+            memcpy(s_page + first * ssz, src, (uint64_t)n * ssz);
+            if (page_store(z, cur / spp, s_page) != 0) return -1;
+        }
+        done += n;
+    }
+    return (int)count;
+}
+
+// Whole pages drop their object; partial ones are rewritten with the range
+// zeroed (and end up as zero pages when nothing else was in them)
+static int zr_discard(block_device_t* dev, uint64_t lba, uint64_t count){
+    zram_t* z = (zram_t*)dev->priv;
+    if (lba + count > dev->sector_count) return -1;
+    uint32_t ssz = dev->sector_size, spp = ZRAM_PAGE / ssz;
+    for (uint64_t done = 0; done < count; ) {
+        uint64_t cur = lba + done;
+        uint32_t first = (uint32_t)(cur % spp);
+        uint64_t n = spp - first;
+        if (n > count - done) n = count - done;
+        if (n == spp) slot_clear(z, &z->slots[cur / spp]);
+        else {
+            if (page_load(z, cur / spp, s_page) != 0) return -1;
+            memset(s_page + first * ssz, 0, n * ssz);
+            if (page_store(z, cur / spp, s_page) != 0) return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int zram_create(const char* name, uint64_t bytes){
+    uint32_t sec = block_default_sector();
+    if (!name || !name[0] || bytes == 0 || ZRAM_PAGE % sec) return -1;
+    uint64_t npages = (bytes + ZRAM_PAGE - 1) / ZRAM_PAGE;
+    uint64_t tframes = (npages * sizeof(zram_slot_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    zram_t* z = (zram_t*)kmalloc(sizeof(zram_t));
+    if (!z) return -1;
+    memset(z, 0, sizeof(*z));
+    uint64_t pa = pmm_alloc_frames_below((size_t)tframes, 1ULL << 32);
+    if (!pa) { kfree(z); return -1; }
+    z->slots = (zram_slot_t*)(uintptr_t)pa;
+    memset(z->slots, 0, npages * sizeof(zram_slot_t));
+    z->npages = npages;
+    z->st.disk_bytes = npages * ZRAM_PAGE;
+    z->st.meta_bytes = tframes * PMM_FRAME_SIZE;
+    s_ops.read = zr_read; s_ops.write = zr_write;
+    s_ops.discard = zr_discard;
+    block_device_t* d = &z->dev;
+    int i = 0; for (; i < 15 && name[i]; ++i) d->name[i] = name[i]; d->name[i] = 0;
+    d->sector_size = sec;
+    d->sector_count = z->st.disk_bytes / sec;
+    d->ops = &s_ops; d->priv = z; d->next = NULL;
+    z->next = g_zrams; g_zrams = z;
+    block_register(d);
+    return 0;
+}
+
+int zram_get_stats(const char* name, zram_stats_t* out){
+    block_device_t* d = block_find(name);
+    if (!d || d->ops != &s_ops || !out) return -1;
+    *out = ((zram_t*)d->priv)->st;
+    return 0;
+}
+
+void zram_dump(void){
+    if (!g_zrams) { console_write("zram: no devices\n"); return; }
+    for (zram_t* z = g_zrams; z; z = z->next) {
+        const zram_stats_t* s = &z->st;
+        uint64_t used = s->pool_bytes + s->meta_bytes;
+        uint64_t logical = s->data_bytes + s->zero_pages * ZRAM_PAGE;
+        console_write(z->dev.name);
+        console_write(": size="); console_write_dec(s->disk_bytes >> 10);
+        console_write("K pages="); console_write_dec(s->stored_pages);
+        console_write(" zero="); console_write_dec(s->zero_pages);
+        console_write(" huge="); console_write_dec(s->huge_pages);
+        console_write(" data="); console_write_dec(s->data_bytes >> 10);
+        console_write("K compr="); console_write_dec(s->compr_bytes >> 10);
+        console_write("K used="); console_write_dec(used >> 10);
+        console_write("K\n  ratio=");
+        uint64_t r = s->compr_bytes ? s->data_bytes * 100 / s->compr_bytes : 0;
+        console_write_dec(r / 100); console_write("."); if (r % 100 < 10) console_write("0"); console_write_dec(r % 100);
+        console_write(" saved="); console_write_dec(logical > used ? (logical - used) >> 10 : 0);
+        console_write("K (vs ramdisk "); console_write_dec(s->disk_bytes > used ? (s->disk_bytes - used) >> 10 : 0);
+        console_write("K)\n");
+    }
+}
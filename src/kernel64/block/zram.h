@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+// Compressed RAM disk: every 4 KiB page is stored LZ4-compressed in a
+// per-device pool of size-classed slab objects, all-zero pages take no
+// memory, and pages that do not compress below ZRAM_HUGE bytes are stored
+// raw. Memory grows with the data written, not with the disk size, and a
+// slab whose objects are all freed (overwritten or discarded) goes back to
+// the PMM.
+
+#define ZRAM_PAGE       4096u
+#define ZRAM_CLASS_STEP 64u     // object size granularity
+#define ZRAM_HUGE       3072u   // larger compressed pages are kept raw
+
+typedef struct {
+    uint64_t disk_bytes;    // device size
+    uint64_t stored_pages;  // pages holding data (compressed or raw)
+    uint64_t zero_pages;    // pages written as all zeros (no memory)
+    uint64_t huge_pages;    // incompressible pages kept raw
+    uint64_t data_bytes;    // uncompressed bytes of stored pages
+    uint64_t compr_bytes;   // payload bytes in the pool
+    uint64_t pool_bytes;    // frames held by live slabs
+    uint64_t meta_bytes;    // page table
+} zram_stats_t;
+
+// Create and register a compressed RAM disk of `bytes` (rounded up to pages)
+int zram_create(const char* name, uint64_t bytes);
+// Stats of the named zram device; returns 0, or -1 if it is not one
+int zram_get_stats(const char* name, zram_stats_t* out);
+// Print every zram device with compression ratio and memory saved
+void zram_dump(void);
@@ -0,0 +1,84 @@
+// CPU feature probing and SIMD state enablement
+#include <stdint.h>
+#include "cpufeature.h"
+#include "cpuid.h"
+
+uint32_t g_cpu_caps = 0;
+
+static inline uint64_t read_cr0(void) { uint64_t v; __asm__ volatile ("mov %%cr0,%0" : "=r"(v)); return v; }
+static inline void write_cr0(uint64_t v) { __asm__ volatile ("mov %0,%%cr0" :: "r"(v) : "memory"); }
+static inline uint64_t read_cr4(void) { uint64_t v; __asm__ volatile ("mov %%cr4,%0" : "=r"(v)); return v; }
+static inline void write_cr4(uint64_t v) { __asm__ volatile ("mov %0,%%cr4" :: "r"(v) : "memory"); }
+
+static inline uint64_t xgetbv0(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+static inline void xsetbv0(uint64_t v) {
+    __asm__ volatile ("xsetbv" :: "a"((uint32_t)v), "d"((uint32_t)(v >> 32)), "c"(0) : "memory");
+}
+
+#define CR0_MP        (1ULL<<1)
+#define CR0_EM        (1ULL<<2)
+#define CR4_OSFXSR    (1ULL<<9)
+#define CR4_OSXMMEXCPT (1ULL<<10)
+#define CR4_OSXSAVE   (1ULL<<18)
+#define XCR0_X87      (1ULL<<0)
+#define XCR0_SSE      (1ULL<<1)
+#define XCR0_AVX      (1ULL<<2)
+
+static void set_cap(int f, int present) { if (present) g_cpu_caps |= (1u << f); }
+
+void cpu_features_init(void) {
+    g_cpu_caps = 0;
+    cpuid_regs r0 = cpuid(0, 0);
+    cpuid_regs r1 = cpuid(1, 0);
+    cpuid_regs r7 = { 0, 0, 0, 0 };
+    if (r0.eax >= 7) r7 = cpuid(7, 0);
+
+    // SSE/SSE2 are architectural on x86_64; the loader leaves them disabled.
+    // Kernel C code is built with -mno-sse and the scheduler only switches on
+    // explicit yields, so XMM/YMM state is only live inside the mem* variants
+    // and the AES-NI routines (lib/aes_x86_64.S).
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    __asm__ volatile ("fninit");
+    set_cap(X86_FEATURE_SSE2, (r1.edx >> 26) & 1);
+    set_cap(X86_FEATURE_SSE42, (r1.ecx >> 20) & 1);
+
+    int xsave = (r1.ecx >> 26) & 1;
+    set_cap(X86_FEATURE_XSAVE, xsave);
+    if (xsave && ((r1.ecx >> 28) & 1)) {
+        write_cr4(read_cr4() | CR4_OSXSAVE);
+        xsetbv0(XCR0_X87 | XCR0_SSE | XCR0_AVX);
+        if ((xgetbv0() & (XCR0_SSE | XCR0_AVX)) == (XCR0_SSE | XCR0_AVX)) {
+            set_cap(X86_FEATURE_AVX, 1);
+            set_cap(X86_FEATURE_AVX2, (r7.ebx >> 5) & 1);
+        }
+    }
+
+    set_cap(X86_FEATURE_ERMS, (r7.ebx >> 9) & 1);
+    set_cap(X86_FEATURE_FSRM, (r7.edx >> 4) & 1);
+    set_cap(X86_FEATURE_PCLMUL, (r1.ecx >> 1) & 1);
+    set_cap(X86_FEATURE_AES, (r1.ecx >> 25) & 1);
+    set_cap(X86_FEATURE_PCID, (r1.ecx >> 17) & 1);
+    set_cap(X86_FEATURE_INVPCID, (r7.ebx >> 10) & 1);
+}
+
+const char* cpu_feature_name(int feature) {
+    switch (feature) {
+        case X86_FEATURE_SSE2: return "sse2";
+        case X86_FEATURE_SSE42: return "sse4.2";
+        case X86_FEATURE_AVX: return "avx";
+        case X86_FEATURE_AVX2: return "avx2";
+        case X86_FEATURE_ERMS: return "erms";
+        case X86_FEATURE_FSRM: return "fsrm";
+        case X86_FEATURE_XSAVE: return "xsave";
+        case X86_FEATURE_PCLMUL: return "pclmul";
+        case X86_FEATURE_AES: return "aes";
+        case X86_FEATURE_PCID: return "pcid";
+        case X86_FEATURE_INVPCID: return "invpcid";
+        default: return "?";
+    }
+}
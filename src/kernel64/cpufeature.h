@@ -0,0 +1,34 @@
+#pragma once
+
+// Cached CPU feature bits, probed once at boot by cpu_features_init().
+// SIMD bits are only reported when the OS-side state has been enabled
+// (CR4.OSFXSR for SSE, CR4.OSXSAVE + XCR0 for AVX).
+
+// Feature indices (plain defines so .S files can name them in ALTERNATIVE)
+#define X86_FEATURE_SSE2     0
+#define X86_FEATURE_SSE42    1
+#define X86_FEATURE_AVX      2
+#define X86_FEATURE_AVX2     3
+#define X86_FEATURE_ERMS     4   // enhanced rep movsb/stosb
+#define X86_FEATURE_FSRM     5   // fast short rep movsb
+#define X86_FEATURE_XSAVE    6
+#define X86_FEATURE_PCLMUL   7
+#define X86_FEATURE_AES      8
+#define X86_FEATURE_PCID     9
+#define X86_FEATURE_INVPCID  10
+#define X86_FEATURE_COUNT    11
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+extern uint32_t g_cpu_caps;
+
+static inline int cpu_has(int feature) {
+    return (int)((g_cpu_caps >> feature) & 1u);
+}
+
+// Probe CPUID, enable SSE (and AVX when available) and record usable features.
+void cpu_features_init(void);
+// Short lowercase name for diagnostics ("erms", "avx2", ...)
+const char* cpu_feature_name(int feature);
+#endif
@@ -1,13 +1,17 @@
 #include "../vfs/vfs.h"
 #include "../console.h"
 #include "../block/block.h"
+#include "../block/bcache.h"
+#include "../block/iostat.h"
 #include <stdint.h>
 #include <stddef.h>
 #include "../../kernel/mm/kmalloc.h"
 #include "../serial.h"
+#include "../lib/mem.h"
 
 // Simple devfs exposing block devices under /dev
 // Path format: "/" lists entries; names are device names (e.g., ram0)
+// plus "iostat", a text snapshot of every disk's I/O counters and histograms
 
 typedef struct {
     int is_dir;
@@ -35,6 +39,9 @@ static int path_is_root(const char* sub){
     return (!sub) || (*sub=='\0') || ((*sub=='/'||*sub=='\0') && sub[1]=='\0');
 }
 
+static int is_iostat(const char* q){ return strcmp(q, "iostat") == 0; }
+static uint32_t iostat_len(void){ return iostat_format(NULL, 1, NULL, 0); }
+
 static vfs_node_t* devfs_open(void* fs_priv, const char* path){
     (void)fs_priv;
     devfs_node_t* dn=(devfs_node_t*)kmalloc(sizeof(devfs_node_t));
@@ -47,6 +54,11 @@ static vfs_node_t* devfs_open(void* fs_priv, const char* path){
         dn->is_dir=1; dn->bdev=NULL; dn->name[0]=0; dn->size=0; return vn;
     }
     const char* q=path; if(*q=='/') ++q; if(!*q){ dn->is_dir=1; dn->bdev=NULL; dn->name[0]=0; dn->size=0; return vn; }
+    if (is_iostat(q)) {
+        dn->is_dir=0; dn->bdev=NULL; dn->size=iostat_len();
+        int i=0; for(; i<15 && q[i]; ++i) dn->name[i]=q[i]; dn->name[i]=0;
+        return vn;
+    }
     // lookup block device by name
     block_device_t* b = block_find(q);
     if(!b){ kfree(dn); kfree(vn); return NULL; }
@@ -62,6 +74,7 @@ static int devfs_stat(void* fs_priv, const char* path, uint64_t* size, int* is_d
     (void)fs_priv;
     if (!path || path_is_root(path)){ if(size)*size=0; if(is_dir)*is_dir=1; return 0; }
     const char* q=path; if(*q=='/') ++q; if(!*q){ if(size)*size=0; if(is_dir)*is_dir=1; return 0; }
+    if (is_iostat(q)) { if(size)*size=iostat_len(); if(is_dir)*is_dir=0; return 0; }
     block_device_t* b=block_find(q); if(!b) return -1;
     if(size) *size = b->sector_count * (uint64_t)b->sector_size;
     if(is_dir)*is_dir=0; return 0;
@@ -81,69 +94,93 @@ static int devfs_readdir(vfs_node_t* n, uint32_t idx, char* name_out, uint32_t m
         }
         i++;
     }
+    if(i==idx){ const char* t="iostat"; uint32_t j=0; while(t[j] && j<maxlen-1){ name_out[j]=t[j]; ++j; } name_out[j]=0; return 1; }
     name_out[0]=0; return 0;
 }
 
-// Read from an underlying block device with support for unaligned head/tail via read-modify-copy
+// Discard target for the partial-sector bytes around an unaligned read
+static uint8_t s_sink[BCACHE_BLOCK_SIZE];
+
+// The iostat file is re-rendered on every read, so sequential reads see
+// the counters as of that call
+static int iostat_read(uint64_t off, void* buf, uint64_t len){
+    uint32_t cap = iostat_len() + 64;   // slack for counters growing meanwhile
+    char* t = (char*)kmalloc(cap); if(!t) return -1;
+    uint32_t n = iostat_format(NULL, 1, t, cap); if (n > cap - 1) n = cap - 1;
+    if (off >= n) { kfree(t); return 0; }
+    if (len > n - off) len = n - off;
+    memcpy(buf, t + off, len);
+    kfree(t);
+    return (int)len;
+}
+
+// Read from an underlying block device: one scatter read whose head and tail
+// segments drop the bytes outside [off, off+len) of the first/last sector
 static int devfs_read(vfs_node_t* n, uint64_t off, void* buf, uint64_t len){
     if(!n||!buf) return -1;
     devfs_node_t* dn=(devfs_node_t*)n->file_priv; if(dn->is_dir) return -1;
+    if(!dn->bdev) return iostat_read(off, buf, len);
     block_device_t* b=dn->bdev; if(!b||!b->ops||!b->ops->read) return -1;
     uint32_t sec=b->sector_size; uint64_t end=off+len; if(end > dn->size) end = dn->size; if(end<=off) return 0; len = end - off;
-    uint64_t first_lba = off / sec; uint32_t head_off = (uint32_t)(off % sec); uint64_t remaining = len; uint8_t* out=(uint8_t*)buf; uint64_t pos=0;
-    // handle head partial
-    if(head_off!=0){
-        uint8_t* tmp=(uint8_t*)kmalloc(sec); if(!tmp) return -1;
-        if (b->ops->read(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        uint32_t take = sec - head_off; if (take > remaining) take = (uint32_t)remaining;
-        for(uint32_t i=0;i<take; ++i) out[pos+i] = tmp[head_off+i];
-        pos+=take; remaining-=take; first_lba++; kfree(tmp);
-    }
-    // handle middle full sectors
-    while(remaining >= sec){
-        uint32_t cnt = (remaining / sec); if (cnt > 128) cnt = 128;
-        if (b->ops->read(b, first_lba, out+pos, cnt) != (int)cnt) return -1;
-        uint64_t adv = (uint64_t)cnt * sec; pos += adv; remaining -= adv; first_lba += cnt;
-    }
-    // handle tail partial
-    if(remaining>0){
-        uint8_t* tmp=(uint8_t*)kmalloc(sec); if(!tmp) return -1;
-        if(b->ops->read(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        for(uint32_t i=0;i<remaining;++i) out[pos+i] = tmp[i];
-        pos += remaining; remaining = 0; kfree(tmp);
+    if (sec > sizeof(s_sink)) return -1;
+    uint64_t pos=0; uint8_t* out=(uint8_t*)buf;
+    while (pos < len) {
+        uint64_t cur = off + pos;
+        uint64_t lba = cur / sec; uint32_t head = (uint32_t)(cur % sec);
+        uint64_t take = len - pos; if (take > 128u * sec - head) take = 128u * sec - head;
+        uint32_t tail = (uint32_t)((sec - (head + take) % sec) % sec);
+        block_iovec_t iov[3]; uint32_t ni = 0;
+        if (head) { iov[ni].base = s_sink; iov[ni].len = head; ni++; }
+        iov[ni].base = out + pos; iov[ni].len = (uint32_t)take; ni++;
+        if (tail) { iov[ni].base = s_sink; iov[ni].len = tail; ni++; }
+        uint32_t cnt = (uint32_t)((head + take + tail) / sec);
+        const uint8_t* m = (const uint8_t*)bcache_map(b, lba, cnt);
+        if (m) memcpy(out + pos, m + head, take);
+        else if (bcache_readv(b, lba, iov, ni) != (int)cnt) return pos ? (int)pos : -1;
+        pos += take;
     }
     return (int)pos;
 }
 
+// Partial head/tail sectors are patched in place in the buffer cache; whole
+// sectors in between are written directly
 static int devfs_write(vfs_node_t* n, uint64_t off, const void* buf, uint64_t len){
     if(!n||!buf) return -1;
     devfs_node_t* dn=(devfs_node_t*)n->file_priv; if(dn->is_dir) return -1;
-    block_device_t* b=dn->bdev; if(!b->ops->write) return -1;
+    block_device_t* b=dn->bdev; if(!b||!b->ops->write) return -1;
     uint32_t sec=b->sector_size; uint64_t end=off+len; if(end > dn->size) end = dn->size; if(end<=off) return 0; len = end - off;
-    const uint8_t* in=(const uint8_t*)buf; uint64_t first_lba = off / sec; uint32_t head_off = (uint32_t)(off % sec); uint64_t remaining=len; uint64_t pos=0;
-    if(head_off!=0){
-        uint8_t* tmp=(uint8_t*)kmalloc(sec); if(!tmp) return -1;
-        if(b->ops->read(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        uint32_t put = sec - head_off; if(put>remaining) put=(uint32_t)remaining;
-        for(uint32_t i=0;i<put;++i) tmp[head_off+i] = in[pos+i];
-        if(b->ops->write(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        pos+=put; remaining-=put; first_lba++; kfree(tmp);
-    }
-    while(remaining >= sec){
-        uint32_t cnt=(remaining/sec); if(cnt>128) cnt=128;
-        if(b->ops->write(b, first_lba, in+pos, cnt) != (int)cnt) return -1;
-        uint64_t adv=(uint64_t)cnt*sec; pos+=adv; remaining-=adv; first_lba+=cnt;
-    }
-    if(remaining>0){
-        uint8_t* tmp=(uint8_t*)kmalloc(sec); if(!tmp) return -1;
-        if(b->ops->read(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        for(uint32_t i=0;i<remaining;++i) tmp[i]=in[pos+i];
-        if(b->ops->write(b, first_lba, tmp, 1) != 1) { kfree(tmp); return -1; }
-        pos+=remaining; remaining=0; kfree(tmp);
+    const uint8_t* in=(const uint8_t*)buf; uint64_t pos=0;
+    while (pos < len) {
+        uint64_t cur = off + pos;
+        uint64_t lba = cur / sec; uint32_t head = (uint32_t)(cur % sec);
+        uint64_t left = len - pos;
+        if (head || left < sec) {
+            uint32_t put = sec - head; if (put > left) put = (uint32_t)left;
+            bcache_buf_t* bb; uint8_t* p = (uint8_t*)bcache_get(b, lba, &bb);
+            if (!p) return pos ? (int)pos : -1;
+            memcpy(p + head, in + pos, put);
+            bcache_put(bb, p, 1);
+            pos += put;
+            continue;
+        }
+        uint32_t cnt = (uint32_t)(left / sec); if (cnt > 128) cnt = 128;
+        if (bcache_write(b, lba, in + pos, cnt) != (int)cnt) return pos ? (int)pos : -1;
+        pos += (uint64_t)cnt * sec;
     }
     return (int)pos;
 }
 
+// Zero-copy read of a memory-backed device's bytes
+static const void* devfs_map(vfs_node_t* n, uint64_t off, uint64_t len){
+    if(!n||len==0) return NULL;
+    devfs_node_t* dn=(devfs_node_t*)n->file_priv; if(dn->is_dir) return NULL;
+    block_device_t* b=dn->bdev; if(!b || off>=dn->size || len>dn->size-off) return NULL;
+    uint32_t sec=b->sector_size; uint32_t head=(uint32_t)(off % sec);
+    uint64_t cnt=(head + len + sec - 1) / sec; if (cnt > 0xFFFFFFFFu) return NULL;
+    const uint8_t* m=(const uint8_t*)bcache_map(b, off / sec, (uint32_t)cnt);
+    return m ? m + head : NULL;
+}
+
 void devfs_register(void){
     // Fill ops at runtime so function addresses are computed with RIP-relative code
     devfs_ops.mount   = devfs_mount;
@@ -151,6 +188,7 @@ void devfs_register(void){
     devfs_ops.open    = devfs_open;
     devfs_ops.stat    = devfs_stat;
     devfs_ops.read    = devfs_read;
+    devfs_ops.map     = devfs_map;
     devfs_ops.readdir = devfs_readdir;
     devfs_ops.write   = devfs_write;
     devfs_ops.create  = NULL;
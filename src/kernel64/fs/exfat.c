@@ -4,10 +4,17 @@
 #include <stddef.h>
 #include "../../kernel/mm/kmalloc.h"
 #include "../block/block.h"
+#include "../block/bcache.h"
+#include "../lib/mem.h"
 #include "exfat.h"
 
 // Minimal exFAT recognizer with basic on-disk directory parsing (root only)
 // This is still a simplification suitable for ramdisk demo purposes.
+// Write ordering uses bcache_flush() as a barrier: file data and FAT links
+// are flushed before a directory entry that points at them, and unlink
+// removes the entry before freeing its clusters, which are then discarded
+// in batched runs. mkfs writes the boot sector last, with FUA. fstrim
+// discards every free cluster per the allocation bitmap.
 
 typedef struct {
     block_device_t* bdev;
@@ -18,66 +25,127 @@ typedef struct {
     uint32_t sectors_per_cluster;
     uint32_t cluster_size;     // bytes per cluster
     uint32_t root_dir_cluster;
+    uint32_t cluster_count;    // clusters in the heap (FAT entries 2..count+1)
+    uint32_t bitmap_cluster;   // allocation bitmap (entry 0x81); 0 when the volume has none
+    int bitmap_bad;            // a bitmap entry exists but is unusable: never trim
 } exfat_fs_t;
 
 typedef struct { exfat_fs_t* fs; uint32_t first_cluster; int is_dir; uint64_t size; } exfat_node_t;
 
-static int bdev_read(block_device_t* b, uint64_t lba, void* buf, uint32_t sectors){ return b->ops->read(b,lba,buf,sectors); }
+// All device access goes through the buffer cache (FAT sectors stay resident)
+static int bdev_read(block_device_t* b, uint64_t lba, void* buf, uint32_t sectors){ return bcache_read(b,lba,buf,sectors); }
 
 // Ops table built at runtime
 static vfs_fs_ops_t exfat_ops;
 
+static void bitmap_find(exfat_fs_t* fs);
+
 static int exfat_mount(block_device_t* bdev, const char* mname, void** out_priv){ 
     (void)mname; 
     console_write("[exfat] mount enter\n");
     if (!out_priv) return -1;
-    if (bdev->sector_size != 512) { console_write("exfat: requires 512B sectors\n"); return -1; }
+    if (!block_sector_ok(bdev->sector_size)) { console_write("exfat: unsupported sector size\n"); return -1; }
     exfat_fs_t* fs = (exfat_fs_t*)kmalloc(sizeof(exfat_fs_t)); if (!fs) return -1; fs->bdev = bdev;
-    // Try to read VBR at LBA0
-    uint8_t vbr[512]; int have_vbr = 0;
-    if (bdev->ops->read(bdev, 0, vbr, 1) == 1) {
+    // Try to read VBR at LBA0: one device sector, 512 bytes or 4 KiB
+    uint8_t* vbr = (uint8_t*)kmalloc(bdev->sector_size); int have_vbr = 0;
+    if (!vbr) { kfree(fs); return -1; }
+    if (bdev_read(bdev, 0, vbr, 1) == 1) {
         // exFAT VBR has "EXFAT   " at offset 3
         if (vbr[3]=='E' && vbr[4]=='X' && vbr[5]=='F' && vbr[6]=='A' && vbr[7]=='T' && vbr[8]==' ' && vbr[9]==' ' && vbr[10]==' ') {
             have_vbr = 1;
             uint8_t bps_shift = vbr[0x6C];
-            uint8_t spc = vbr[0x6D];
-            uint32_t fat_off = *(uint32_t*)&vbr[0x80];
-            uint32_t fat_len = *(uint32_t*)&vbr[0x84];
-            uint32_t heap_off = *(uint32_t*)&vbr[0x88];
-            uint32_t root_cl = *(uint32_t*)&vbr[0xA0];
+            uint8_t spc_shift = vbr[0x6D];
+            // Geometry is in the volume's sectors, which must be the device's
+            if (bps_shift > 12 || (1u << bps_shift) != bdev->sector_size || spc_shift > 25 - bps_shift) {
+                console_write("exfat: VBR sector size does not match the device\n");
+                kfree(vbr); kfree(fs); return -1;
+            }
             fs->bytes_per_sector = 1u << bps_shift;
-            fs->sectors_per_cluster = spc;
-            fs->fat_offset = fat_off;
-            fs->fat_length = fat_len;
-            fs->cluster_heap_off = heap_off;
+            fs->sectors_per_cluster = 1u << spc_shift;
+            fs->fat_offset = *(uint32_t*)&vbr[0x50];
+            fs->fat_length = *(uint32_t*)&vbr[0x54];
+            fs->cluster_heap_off = *(uint32_t*)&vbr[0x58];
+            fs->cluster_count = *(uint32_t*)&vbr[0x5C];
             fs->cluster_size = fs->bytes_per_sector * fs->sectors_per_cluster;
-            fs->root_dir_cluster = root_cl;
+            fs->root_dir_cluster = *(uint32_t*)&vbr[0x60];
         }
     }
+    kfree(vbr);
     if (!have_vbr){
         // Fallback demo defaults
         fs->fat_offset = 128;           // sectors
         fs->fat_length = 1024;          // sectors  
         fs->cluster_heap_off = 1152;    // sectors
-        fs->bytes_per_sector = 512;
+        fs->bytes_per_sector = bdev->sector_size;
         fs->sectors_per_cluster = 1;
-        fs->cluster_size = 512;
+        fs->cluster_size = bdev->sector_size;
         fs->root_dir_cluster = 2;       // first data cluster
+        fs->cluster_count = bdev->sector_count > fs->cluster_heap_off ? (uint32_t)(bdev->sector_count - fs->cluster_heap_off) : 0;
     }
+    fs->bitmap_cluster = 0; fs->bitmap_bad = 0;
+    if (have_vbr) bitmap_find(fs);
     *out_priv = fs; 
     console_write("[exfat] mount exit\n");
     return 0;
 }
 
-static void exfat_umount(void* p){ (void)p; }
+static void exfat_umount(void* p){ exfat_fs_t* fs = (exfat_fs_t*)p; if (fs && fs->bdev) (void)bcache_flush(fs->bdev); }
 
 static inline uint32_t cl_to_lba(exfat_fs_t* fs, uint32_t cl){ return fs->cluster_heap_off + (cl - 2u) * fs->sectors_per_cluster; }
 static int read_cluster(exfat_fs_t* fs, uint32_t cl, void* buf){ return bdev_read(fs->bdev, cl_to_lba(fs, cl), buf, fs->sectors_per_cluster) == (int)fs->sectors_per_cluster ? 0 : -1; }
-static int write_cluster(exfat_fs_t* fs, uint32_t cl, const void* buf){ return fs->bdev->ops->write(fs->bdev, cl_to_lba(fs, cl), (void*)buf, fs->sectors_per_cluster) == (int)fs->sectors_per_cluster ? 0 : -1; }
-static uint32_t fat_get(exfat_fs_t* fs, uint32_t cl){ uint32_t val=0; uint32_t off_bytes = cl * 4u; uint32_t sector = fs->fat_offset + (off_bytes / fs->bytes_per_sector); uint32_t sect_off = off_bytes % fs->bytes_per_sector; uint8_t sec[512]; if (bdev_read(fs->bdev, sector, sec, 1) < 1) return 0; val = *(uint32_t*)&sec[sect_off]; return val; }
-static int fat_set(exfat_fs_t* fs, uint32_t cl, uint32_t val){ uint32_t off_bytes = cl * 4u; uint32_t sector = fs->fat_offset + (off_bytes / fs->bytes_per_sector); uint32_t sect_off = off_bytes % fs->bytes_per_sector; uint8_t sec[512]; if (bdev_read(fs->bdev, sector, sec, 1) < 1) return -1; *(uint32_t*)&sec[sect_off] = val; return fs->bdev->ops->write(fs->bdev, sector, sec, 1) == 1 ? 0 : -1; }
+static int write_cluster(exfat_fs_t* fs, uint32_t cl, const void* buf){ return bcache_write(fs->bdev, cl_to_lba(fs, cl), buf, fs->sectors_per_cluster) == (int)fs->sectors_per_cluster ? 0 : -1; }
+static uint32_t fat_get(exfat_fs_t* fs, uint32_t cl){ uint32_t val=0; uint32_t off_bytes = cl * 4u; uint32_t sector = fs->fat_offset + (off_bytes / fs->bytes_per_sector); uint32_t sect_off = off_bytes % fs->bytes_per_sector; bcache_buf_t* bb; uint8_t* sec = (uint8_t*)bcache_get(fs->bdev, sector, &bb); if (!sec) return 0; val = *(uint32_t*)&sec[sect_off]; bcache_put(bb, sec, 0); return val; }
+static int fat_set(exfat_fs_t* fs, uint32_t cl, uint32_t val){ uint32_t off_bytes = cl * 4u; uint32_t sector = fs->fat_offset + (off_bytes / fs->bytes_per_sector); uint32_t sect_off = off_bytes % fs->bytes_per_sector; bcache_buf_t* bb; uint8_t* sec = (uint8_t*)bcache_get(fs->bdev, sector, &bb); if (!sec) return -1; *(uint32_t*)&sec[sect_off] = val; bcache_put(bb, sec, 1); return 0; }
 static inline int fat_is_eoc(uint32_t v){ return (v==0xFFFFFFFFu); }
 
+// Allocation bitmap: bit (cl-2) set means cluster cl is in use. Files with
+// NoFatChain leave their FAT entries at 0, so on volumes with a bitmap it,
+// not the FAT, says which clusters are free. The bitmap's own clusters are
+// followed through the FAT when chained, else taken as contiguous.
+// Sector of the bitmap holding cl's bit (held until bcache_put) and the byte in it
+static uint8_t* bitmap_sector(exfat_fs_t* fs, uint32_t cl, bcache_buf_t** bb, uint32_t* at){
+    uint32_t byte = (cl - 2u) / 8u, c = fs->bitmap_cluster;
+    for (uint32_t k = byte / fs->cluster_size; k; --k) { uint32_t nx = fat_get(fs, c); c = (nx >= 2 && !fat_is_eoc(nx)) ? nx : c + 1; }
+    uint32_t in = byte % fs->cluster_size;
+    *at = in % fs->bytes_per_sector;
+    return (uint8_t*)bcache_get(fs->bdev, cl_to_lba(fs, c) + in / fs->bytes_per_sector, bb);
+}
+// The first bitmap entry (0x81) of the root directory; mkfs.exfat writes
+// one, exfat_format_device does not
+static void bitmap_find(exfat_fs_t* fs){
+    uint8_t* dir = (uint8_t*)kmalloc(fs->cluster_size);
+    if (!dir) { fs->bitmap_bad = 1; return; }
+    if (read_cluster(fs, fs->root_dir_cluster, dir) != 0) { fs->bitmap_bad = 1; kfree(dir); return; }
+    for (uint32_t i = 0; i + 32 <= fs->cluster_size && dir[i] != 0x00; i += 32) {
+        if (dir[i] != 0x81 || (dir[i+1] & 1)) continue;     // second FAT's bitmap
+        uint32_t first = *(uint32_t*)&dir[i+20];
+        uint64_t len = *(uint64_t*)&dir[i+24];
+        if (first < 2 || first >= fs->cluster_count + 2u || len < (fs->cluster_count + 7u) / 8u) {
+            console_write("exfat: allocation bitmap invalid, fstrim disabled\n");
+            fs->bitmap_bad = 1;
+        } else fs->bitmap_cluster = first;
+        break;
+    }
+    kfree(dir);
+}
+
+// 1 in use, 0 free, -1 unreadable
+static int bitmap_get(exfat_fs_t* fs, uint32_t cl){
+    bcache_buf_t* bb; uint32_t at; uint8_t* sec = bitmap_sector(fs, cl, &bb, &at); if (!sec) return -1;
+    int v = (sec[at] >> ((cl - 2u) % 8u)) & 1;
+    bcache_put(bb, sec, 0);
+    return v;
+}
+static int bitmap_set(exfat_fs_t* fs, uint32_t cl, int used){
+    bcache_buf_t* bb; uint32_t at; uint8_t* sec = bitmap_sector(fs, cl, &bb, &at); if (!sec) return -1;
+    uint8_t m = (uint8_t)(1u << ((cl - 2u) % 8u));
+    if (used) sec[at] |= m; else sec[at] &= (uint8_t)~m;
+    bcache_put(bb, sec, 1);
+    return 0;
+}
+// Discard target for partial-sector bytes around an unaligned file read
+static uint8_t s_sink[4096];
+
 static int path_is_root(const char* sub){ return (sub==NULL)||(*sub=='\0')||((*sub=='/')&&sub[1]=='\0'); }
 
 // Directory parsing: support only root dir and basic file entries (0x85 + 0xC0 + 0xC1*)
@@ -90,7 +158,6 @@ static int dir_scan_root(exfat_fs_t* fs, exfat_dirent* ents, int max_ents){
         uint8_t et = clbuf[i];
         if (et == 0x00) break; // end of directory
         if ((et & 0x7F) == 0x05) { // primary file entry 0x85/0x05
-            uint8_t sec_count = clbuf[i+1];
             uint16_t attr = *(uint16_t*)&clbuf[i+4];
             int is_dir = (attr & 0x10) ? 1 : 0;
             // Stream extension expected next
@@ -151,17 +218,52 @@ static vfs_node_t* exfat_open(void* p, const char* path){ exfat_fs_t* fs=(exfat_
 static int exfat_stat(void* p, const char* path, uint64_t* size, int* is_dir){ exfat_fs_t* fs=(exfat_fs_t*)p; if (!path || path_is_root(path)) { if(size) *size=0; if(is_dir) *is_dir=1; return 0; } const char* q=path; if(*q=='/') ++q; exfat_dirent ents[32]; int num=dir_scan_root(fs, ents, 32); for(int i=0;i<num;++i){ const char* a=q; const char* b=ents[i].name; while(*a&&*b&&*a==*b){++a;++b;} if(*a==0&&*b==0){ if(size)*size=ents[i].size; if(is_dir)*is_dir=ents[i].is_dir; return 0; } } return -1; }
 static int exfat_read(vfs_node_t* n, uint64_t off, void* buf, uint64_t len){ if(!n||!buf) return -1; exfat_node_t* en=(exfat_node_t*)n->file_priv; if(en->is_dir) return -1; if(off>=en->size) return 0; uint64_t remaining = en->size - off; if(len>remaining) len=remaining; uint64_t done=0; uint8_t* out=(uint8_t*)buf; uint32_t cl = en->first_cluster; uint64_t pos = 0; // follow FAT to reach 'off'
     uint64_t skip_clusters = off / en->fs->cluster_size; uint64_t skip_in_cluster = off % en->fs->cluster_size; for(uint64_t k=0;k<skip_clusters;k++){ uint32_t next = fat_get(en->fs, cl); if (next==0xFFFFFFFF || next==0) break; cl = next; pos += en->fs->cluster_size; }
-    // read starting at cl with skip_in_cluster
+    // read starting at cl with skip_in_cluster: each physically contiguous run
+    // of clusters is one scatter read straight into the caller's buffer
+    exfat_fs_t* fs = en->fs; uint32_t ssz = fs->bytes_per_sector;
     while (done < len && cl >= 2) {
-        uint8_t* tmp = (uint8_t*)kmalloc(en->fs->cluster_size); if(!tmp) break;
-        if (read_cluster(en->fs, cl, tmp) != 0) { kfree(tmp); break; }
-        uint64_t avail = en->fs->cluster_size - skip_in_cluster; uint64_t take = (len - done < avail) ? (len - done) : avail;
-        for (uint64_t i=0;i<take;++i) out[done+i] = tmp[skip_in_cluster+i];
-        done += take; kfree(tmp); skip_in_cluster = 0;
+        uint32_t run = 1, last = cl; uint64_t want = skip_in_cluster + (len - done);
+        while ((uint64_t)run * fs->cluster_size < want) { uint32_t nx = fat_get(fs, last); if (nx != last + 1) break; last = nx; run++; }
+        uint64_t take = (uint64_t)run * fs->cluster_size - skip_in_cluster; if (take > len - done) take = len - done;
+        // Only the sectors holding [skip, skip+take) are read; partial-sector bytes go to the sink
+        uint64_t lba = cl_to_lba(fs, cl) + skip_in_cluster / ssz;
+        uint32_t head = (uint32_t)(skip_in_cluster % ssz);
+        uint32_t tail = (uint32_t)((ssz - (head + take) % ssz) % ssz);
+        // Memory-backed volume: one copy straight out of the device
+        const uint8_t* m = (const uint8_t*)bcache_map(fs->bdev, lba, (uint32_t)((head + take + tail) / ssz));
+        if (m) memcpy(out + done, m + head, take);
+        else {
+        block_iovec_t iov[3]; uint32_t ni = 0;
+        if (head) { iov[ni].base = s_sink; iov[ni].len = head; ni++; }
+        iov[ni].base = out + done; iov[ni].len = (uint32_t)take; ni++;
+        if (tail) { iov[ni].base = s_sink; iov[ni].len = tail; ni++; }
+        if (bcache_readv(fs->bdev, lba, iov, ni) != (int)((head + take + tail) / ssz)) break;
+        }
+        done += take; skip_in_cluster = 0;
         if (done >= len) break;
-        uint32_t next = fat_get(en->fs, cl); if (next==0 || next==0xFFFFFFFF) break; cl = next;
+        uint32_t next = fat_get(fs, last); if (next==0 || next==0xFFFFFFFF) break; cl = next;
     }
     return (int)done; }
+// Zero-copy read: [off, off+len) must sit in one physically contiguous
+// cluster run on a memory-backed device
+static const void* exfat_map(vfs_node_t* n, uint64_t off, uint64_t len){
+    if (!n || len == 0) return NULL;
+    exfat_node_t* en = (exfat_node_t*)n->file_priv;
+    if (en->is_dir || off >= en->size || len > en->size - off) return NULL;
+    exfat_fs_t* fs = en->fs; uint32_t ssz = fs->bytes_per_sector;
+    uint32_t cl = en->first_cluster;
+    for (uint64_t k = off / fs->cluster_size; k; --k) { uint32_t nx = fat_get(fs, cl); if (nx == 0 || nx == 0xFFFFFFFF) return NULL; cl = nx; }
+    uint64_t skip = off % fs->cluster_size;
+    uint32_t last = cl;
+    for (uint64_t have = fs->cluster_size - skip; have < len; have += fs->cluster_size) {
+        uint32_t nx = fat_get(fs, last); if (nx != last + 1) return NULL; last = nx;
+    }
+    uint32_t head = (uint32_t)(skip % ssz);
+    uint64_t cnt = (head + len + ssz - 1) / ssz;
+    if (cnt > 0xFFFFFFFFu) return NULL;
+    const uint8_t* m = (const uint8_t*)bcache_map(fs->bdev, cl_to_lba(fs, cl) + skip / ssz, (uint32_t)cnt);
+    return m ? m + head : NULL;
+}
 static int exfat_readdir(vfs_node_t* n, uint32_t idx, char* name_out, uint32_t maxlen){ 
     if(!n||!name_out||maxlen==0) return -1; 
     exfat_node_t* en=(exfat_node_t*)n->file_priv; 
@@ -180,9 +282,11 @@ static int exfat_readdir(vfs_node_t* n, uint32_t idx, char* name_out, uint32_t m
 }
 
 // Write helpers: allocate a free cluster by scanning FAT
-static uint32_t fat_alloc(exfat_fs_t* fs){ uint32_t entries = (fs->fat_length * fs->bytes_per_sector) / 4u; for(uint32_t cl=2; cl<entries; ++cl){ uint32_t v=fat_get(fs,cl); if (v==0){ if (fat_set(fs, cl, 0xFFFFFFFF)!=0) return 0; // EOC
+static uint32_t fat_alloc(exfat_fs_t* fs){ uint32_t entries = (fs->fat_length * fs->bytes_per_sector) / 4u; if (entries > fs->cluster_count + 2u) entries = fs->cluster_count + 2u; for(uint32_t cl=2; cl<entries; ++cl){ if (cl == fs->root_dir_cluster) continue; uint32_t v=fat_get(fs,cl); if (v==0 && fs->bitmap_cluster && bitmap_get(fs,cl)!=0) continue; // NoFatChain data
+        if (v==0){ if (fat_set(fs, cl, 0xFFFFFFFF)!=0) return 0; // EOC
+            if (fs->bitmap_cluster && bitmap_set(fs, cl, 1)!=0) return 0;
             // zero cluster
-            uint8_t* zero=(uint8_t*)kmalloc(fs->cluster_size); if(!zero) return 0; for(uint32_t i=0;i<fs->cluster_size;++i) zero[i]=0; (void)write_cluster(fs, cl, zero); kfree(zero); return cl; } }
+            uint8_t* zero=(uint8_t*)kmalloc(fs->cluster_size); if(!zero) return 0; memset(zero, 0, fs->cluster_size); (void)write_cluster(fs, cl, zero); kfree(zero); return cl; } }
     return 0; }
 
 // Update the stream extension entry (size and optionally first_cluster) by matching first_cluster
@@ -225,7 +329,9 @@ static uint32_t ensure_chain_length(exfat_fs_t* fs, uint32_t* first_inout, uint6
 }
 
 static int exfat_write(vfs_node_t* node, uint64_t off, const void* buf, uint64_t len){
-    if(!node||!buf) return -1; exfat_node_t* en=(exfat_node_t*)node->file_priv; if(en->is_dir) return -1; exfat_fs_t* fs=en->fs;
+    if(!node||!buf) return -1;
+    exfat_node_t* en=(exfat_node_t*)node->file_priv; if(en->is_dir) return -1;
+    exfat_fs_t* fs=en->fs;
     if (len==0) return 0;
     uint64_t end_pos = off + len;
     uint64_t csz = fs->cluster_size;
@@ -245,7 +351,7 @@ static int exfat_write(vfs_node_t* node, uint64_t off, const void* buf, uint64_t
         if (read_cluster(fs, cl, tmp)!=0){ kfree(tmp); return -1; }
         uint64_t avail = csz - skip_in_cluster;
         uint64_t take = (len - done < avail) ? (len - done) : avail;
-        for(uint64_t i=0;i<take;++i) tmp[skip_in_cluster+i] = in[done+i];
+        memcpy(tmp + skip_in_cluster, in + done, take);
         if (write_cluster(fs, cl, tmp)!=0){ kfree(tmp); return -1; }
         kfree(tmp);
         done += take; skip_in_cluster = 0;
@@ -257,7 +363,10 @@ static int exfat_write(vfs_node_t* node, uint64_t off, const void* buf, uint64_t
             cl = nxt;
         }
     }
-    // Update size in-memory and on-disk
+    // Update size in-memory and on-disk. A changed entry must not reach the
+    // media before the clusters and FAT links it points at: barrier first.
+    if (end_pos <= en->size && old_first == en->first_cluster) return (int)len;
+    if (bcache_flush(fs->bdev) != 0) return -1;
     if (end_pos > en->size) en->size = end_pos;
     if (dir_update_stream_by_first_cluster(fs, old_first?old_first:en->first_cluster, en->first_cluster, en->size)!=0){ /* ignore failure for demo */ }
     return (int)len;
@@ -275,16 +384,57 @@ static int exfat_create(void* p, const char* path, uint64_t size_hint){ (void)si
     // Allocate first cluster for file (optional, defer until write; we allocate now)
     uint32_t cl = fat_alloc(fs); if(!cl){ kfree(dir); return -1; }
     // Primary file entry 0x85
-    uint8_t* pfe = &dir[di]; for(int z=0;z<32;++z) pfe[z]=0; pfe[0]=0x85; pfe[1]=(uint8_t)total_secs; uint16_t attr=0x20; *(uint16_t*)&pfe[4]=attr;
+    uint8_t* pfe = &dir[di]; memset(pfe, 0, 32); pfe[0]=0x85; pfe[1]=(uint8_t)total_secs; uint16_t attr=0x20; *(uint16_t*)&pfe[4]=attr;
     // Stream ext 0xC0
-    uint8_t* ste = &dir[di+32]; for(int z=0;z<32;++z) ste[z]=0; ste[0]=0xC0; ste[3]=(uint8_t)name_len; *(uint32_t*)&ste[20]=cl; *(uint64_t*)&ste[24]=0; // size 0
+    uint8_t* ste = &dir[di+32]; memset(ste, 0, 32); ste[0]=0xC0; ste[3]=(uint8_t)name_len; *(uint32_t*)&ste[20]=cl; *(uint64_t*)&ste[24]=0; // size 0
     // File name entries
-    int consumed=0; for(int e=0;e<name_entries;e++){ uint8_t* fne=&dir[di+64+e*32]; for(int z=0;z<32;++z) fne[z]=0; fne[0]=0xC1; for(int k=0;k<15;k++){ uint16_t ch=0; if(consumed<name_len){ ch=(uint8_t)q[consumed++]; } *(uint16_t*)&fne[2+k*2]=ch; } }
+    int consumed=0; for(int e=0;e<name_entries;e++){ uint8_t* fne=&dir[di+64+e*32]; memset(fne, 0, 32); fne[0]=0xC1; for(int k=0;k<15;k++){ uint16_t ch=0; if(consumed<name_len){ ch=(uint8_t)q[consumed++]; } *(uint16_t*)&fne[2+k*2]=ch; } }
     // End marker after
     int endpos = di + (1+total_secs)*32; if (endpos < (int)fs->cluster_size) dir[endpos]=0x00;
+    // The allocated cluster is durable before an entry names it
+    if (bcache_flush(fs->bdev) != 0) { kfree(dir); return -1; }
     int rc = write_cluster(fs, fs->root_dir_cluster, dir); kfree(dir); return rc;
 }
 
+// Freed clusters are discarded as runs of adjacent clusters, batched so a
+// fragmented chain costs a handful of device calls
+#define EXFAT_TRIM_BATCH 16
+typedef struct { uint32_t first, count; } cl_run_t;
+typedef struct { exfat_fs_t* fs; cl_run_t run[EXFAT_TRIM_BATCH]; uint32_t n; uint64_t bytes; int unsupported; } trim_batch_t;
+
+static void trim_flush(trim_batch_t* t){
+    exfat_fs_t* fs = t->fs;
+    for (uint32_t k = 0; k < t->n; ++k) {
+        uint64_t sectors = (uint64_t)t->run[k].count * fs->sectors_per_cluster;
+        if (bcache_discard(fs->bdev, cl_to_lba(fs, t->run[k].first), sectors) == 0) t->bytes += sectors * fs->bytes_per_sector;
+        else t->unsupported = 1;
+    }
+    t->n = 0;
+}
+static void trim_add(trim_batch_t* t, uint32_t cl){
+    cl_run_t* last = t->n ? &t->run[t->n - 1] : NULL;
+    if (last && last->first + last->count == cl) { last->count++; return; }
+    if (t->n == EXFAT_TRIM_BATCH) trim_flush(t);
+    t->run[t->n].first = cl; t->run[t->n].count = 1; t->n++;
+}
+
+// Discard every free cluster; bytes discarded, or -1 if the device can't.
+// Free means clear in the bitmap when the volume has one, else a zero FAT
+// entry (volumes from exfat_format_device, whose files are all chained).
+static int64_t exfat_trim(void* p){
+    exfat_fs_t* fs = (exfat_fs_t*)p;
+    if (fs->bitmap_bad) return -1;
+    trim_batch_t t; t.fs = fs; t.n = 0; t.bytes = 0; t.unsupported = 0;
+    for (uint32_t cl = 2; cl < fs->cluster_count + 2u; ++cl) {
+        if (cl == fs->root_dir_cluster) continue;
+        if (fs->bitmap_cluster ? bitmap_get(fs, cl) != 0 : fat_get(fs, cl) != 0) continue;
+        trim_add(&t, cl);
+        if (t.unsupported) return -1;
+    }
+    trim_flush(&t);
+    return t.unsupported && t.bytes == 0 ? -1 : (int64_t)t.bytes;
+}
+
 static int exfat_unlink(void* p, const char* path){ exfat_fs_t* fs=(exfat_fs_t*)p; const char* q=path; if(*q=='/') ++q; if(!*q) return -1; uint8_t* dir=(uint8_t*)kmalloc(fs->cluster_size); if(!dir) return -1; if(read_cluster(fs,fs->root_dir_cluster,dir)!=0){ kfree(dir); return -1; }
     // scan to find matching entry sequence
     int i=0; while(i+32 <= (int)fs->cluster_size && dir[i]!=0x00){ if ((dir[i]&0x7F)==0x05 && i+64 <= (int)fs->cluster_size && dir[i+32]==0xC0){ // candidate
@@ -292,11 +442,20 @@ static int exfat_unlink(void* p, const char* path){ exfat_fs_t* fs=(exfat_fs_t*)
             int j=i+64; char name[64]; int np=0; while(j+32 <= (int)fs->cluster_size && dir[j]==0xC1){ for(int k=0;k<15 && np<63;k++){ uint16_t ch=*(uint16_t*)&dir[j+2+k*2]; if(ch==0) break; name[np++]=(ch<128)?(char)ch:'?'; } j+=32; }
             name[np]=0; const char* a=q; const char* b=name; while(*a&&*b&&*a==*b){++a;++b;} if(*a==0&&*b==0){ // match -> free FAT and zero entries
                 uint32_t first = *(uint32_t*)&dir[i+32+20]; // stream first cluster
-                // follow FAT and free
-                uint32_t cl=first; while(cl>=2){ uint32_t next=fat_get(fs,cl); fat_set(fs,cl,0); if(next==0||next==0xFFFFFFFF) break; cl=next; }
+                int nochain = (dir[i+32+1] & 0x02) != 0;    // NoFatChain: contiguous, FAT unused
+                uint64_t csz = fs->cluster_size, ncl = (*(uint64_t*)&dir[i+32+24] + csz - 1) / csz;
                 // zero entries
-                for(int k=i; k<j; ++k) dir[k]=0; dir[i]=0; // set end marker at this slot
-                int rc=write_cluster(fs,fs->root_dir_cluster,dir); kfree(dir); return rc;
+                memset(dir + i, 0, (size_t)(j - i)); // zeroed primary entry doubles as end marker
+                int rc=write_cluster(fs,fs->root_dir_cluster,dir); kfree(dir);
+                // The entry is gone from the media before its clusters can be reused
+                if(rc!=0 || bcache_flush(fs->bdev)!=0) return -1;
+                // follow FAT and free
+                trim_batch_t t; t.fs=fs; t.n=0; t.bytes=0; t.unsupported=0;
+                uint32_t cl=first;
+                if (nochain) { for(uint64_t k=0; k<ncl && cl>=2 && cl<fs->cluster_count+2u; ++k, ++cl){ if(fs->bitmap_cluster) bitmap_set(fs,cl,0); if(!t.unsupported) trim_add(&t,cl); } }
+                else while(cl>=2){ uint32_t next=fat_get(fs,cl); fat_set(fs,cl,0); if(fs->bitmap_cluster) bitmap_set(fs,cl,0); if(!t.unsupported) trim_add(&t,cl); if(next==0||next==0xFFFFFFFF) break; cl=next; }
+                if(!t.unsupported) trim_flush(&t);    // the data is dead once the entry is gone
+                return 0;
             }
         }
         i+=32;
@@ -304,26 +463,102 @@ static int exfat_unlink(void* p, const char* path){ exfat_fs_t* fs=(exfat_fs_t*)
     kfree(dir); return -1;
 }
 
+// Whole-volume: the cache does not track which buffers belong to a file
+static int exfat_fsync(vfs_node_t* node){
+    if(!node) return -1;
+    exfat_node_t* en=(exfat_node_t*)node->file_priv;
+    return bcache_flush(en->fs->bdev);
+}
+
 void exfat_register(void){
     exfat_ops.mount   = exfat_mount;
     exfat_ops.umount  = exfat_umount;
     exfat_ops.open    = exfat_open;
     exfat_ops.stat    = exfat_stat;
     exfat_ops.read    = exfat_read;
+    exfat_ops.map     = exfat_map;
     exfat_ops.readdir = exfat_readdir;
     exfat_ops.write   = exfat_write;
     exfat_ops.create  = exfat_create;
     exfat_ops.unlink  = exfat_unlink;
+    exfat_ops.trim    = exfat_trim;
+    exfat_ops.fsync   = exfat_fsync;
     vfs_register_fs("exfat", &exfat_ops);
 }
 
-// Very small exFAT "mkfs": create a plausible VBR to allow mounting.
-// Not fully compliant; intended for demo/ramdisk only.
-static void exfat_memset(void* d, int c, size_t n){ unsigned char* p=d; for(size_t i=0;i<n;++i)p[i]=(unsigned char)c; }
+// Very small exFAT "mkfs": write a VBR with the spec field offsets, an
+// initialized FAT and an empty root directory cluster (with a volume label
+// entry when one is given). Not fully compliant: there is no up-case table
+// or backup boot region, and no allocation bitmap, so free space on these
+// volumes comes from the FAT.
+// The volume uses the device's sector size (bps_shift 9..12) and 4 KiB
+// clusters, with the FAT 64 KiB into the device either way.
 int exfat_format_device(const char* dev_name, const char* label_opt){
-    extern void console_write(const char*);
-    // Simplified mkfs: skip actual writes to avoid hangs
-    console_write("[exfat] mkfs enter\n");
-    console_write("[exfat] mkfs exit\n");
-    return 0;
+    block_device_t* b = block_find(dev_name);
+    if (!b || !b->ops || !b->ops->write || !block_sector_ok(b->sector_size)) return -1;
+    const uint32_t ssz = b->sector_size;
+    uint32_t bps_shift = 9; while ((1u << bps_shift) < ssz) bps_shift++;
+    const uint32_t spc_shift = 12 - bps_shift; // 4 KiB clusters
+    const uint32_t spc = 1u << spc_shift;
+    const uint32_t fat_off = 65536u / ssz;
+    if (b->sector_count < fat_off + 4u * spc) return -1;
+    // Size the FAT for the clusters that fit after it, then align the heap
+    uint32_t total = (uint32_t)(b->sector_count > 0xFFFFFFFFull ? 0xFFFFFFFFull : b->sector_count);
+    uint32_t clusters = (total - fat_off) / spc;
+    uint32_t fat_len = ((clusters + 2u) * 4u + ssz - 1u) / ssz;
+    uint32_t heap_off = (fat_off + fat_len + spc - 1u) & ~(spc - 1u);
+    clusters = (total - heap_off) / spc;
+    const uint32_t root_cl = 2;
+
+    // Drop stale cached blocks of the old filesystem, then write through the cache
+    if (bcache_invalidate(b) != 0) return -1;
+    // One cluster of scratch, then the boot sector written last
+    uint8_t* buf = (uint8_t*)kmalloc(spc * ssz + ssz); if (!buf) return -1;
+    uint8_t* vbr = buf + spc * ssz;
+    int rc = -1;
+    memset(buf, 0, ssz);
+    buf[0] = 0xEB; buf[1] = 0x76; buf[2] = 0x90;
+    memcpy(&buf[3], "EXFAT   ", 8);
+    *(uint64_t*)&buf[0x40] = 0;               // partition offset
+    *(uint64_t*)&buf[0x48] = total;           // volume length
+    *(uint32_t*)&buf[0x50] = fat_off;
+    *(uint32_t*)&buf[0x54] = fat_len;
+    *(uint32_t*)&buf[0x58] = heap_off;
+    *(uint32_t*)&buf[0x5C] = clusters;
+    *(uint32_t*)&buf[0x60] = root_cl;
+    *(uint32_t*)&buf[0x64] = 0x44455830u;     // serial "0XED"
+    *(uint16_t*)&buf[0x68] = 0x0100;          // revision 1.00
+    buf[0x6C] = (uint8_t)bps_shift;           // bytes per sector
+    buf[0x6D] = (uint8_t)spc_shift;
+    buf[0x6E] = 1;                            // one FAT
+    buf[0x6F] = 0x80;
+    buf[0x1FE] = 0x55; buf[0x1FF] = 0xAA;
+    memcpy(vbr, buf, ssz);
+
+    // FAT: media descriptor, reserved entry, root directory end of chain
+    for (uint32_t s = 0; s < fat_len; ++s) {
+        memset(buf, 0, ssz);
+        if (s == 0) {
+            *(uint32_t*)&buf[0] = 0xFFFFFFF8u;
+            *(uint32_t*)&buf[4] = 0xFFFFFFFFu;
+            *(uint32_t*)&buf[root_cl * 4u] = 0xFFFFFFFFu;
+        }
+        if (bcache_write(b, fat_off + s, buf, 1) != 1) goto out;
+    }
+
+    memset(buf, 0, spc * ssz);
+    if (label_opt && label_opt[0]) {
+        uint8_t* le = buf; int n = 0;
+        le[0] = 0x83;
+        while (label_opt[n] && n < 11) { *(uint16_t*)&le[2 + n*2] = (uint8_t)label_opt[n]; ++n; }
+        le[1] = (uint8_t)n;
+    }
+    if (bcache_write(b, heap_off + (root_cl - 2u) * spc, buf, spc) != (int)spc) goto out;
+    // The boot sector makes the volume mountable, so it goes last: after a
+    // barrier and with FUA, bypassing the cache (nothing of LBA 0 is cached)
+    if (bcache_flush(b) != 0) goto out;
+    rc = block_write_fua(b, 0, vbr, 1) == 1 ? 0 : -1;
+out:
+    kfree(buf);
+    return rc;
 }
@@ -2,6 +2,7 @@
  #include "serial.h"
  #include "io.h"
  #include "console.h"
+ #include "sched/sched.h"
 
 // --- PS/2 set 1 scancode handling with modifiers ---
 static uint32_t s_mods = 0;      // MOD_* flags
@@ -116,7 +117,8 @@ int input_try_read_event(key_event_t* ev) {
 }
 
 void input_read_event(key_event_t* ev) {
-    while (!input_try_read_event(ev)) { /* spin */ }
+    // Let other threads (e.g. the async executor) run while waiting for a key
+    while (!input_try_read_event(ev)) { sched_yield(); }
 }
 
 int input_try_getc(void) {
@@ -132,7 +134,7 @@ int input_try_getc(void) {
 
 int input_getc(void) {
     int c;
-    while ((c = input_try_getc()) < 0) { /* spin */ }
+    while ((c = input_try_getc()) < 0) { sched_yield(); }
     return c;
 }
 
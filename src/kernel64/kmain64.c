@@ -8,16 +8,24 @@
 #include "serial.h"
 #include "input.h"
 #include "memtest.h"
+#include "cpufeature.h"
+#include "alternative.h"
+#include "lib/mem.h"
 // New subsystems
 #include "../kernel/mm/pmm.h"
 #include "../kernel/mm/vmm.h"
 #include "../kernel/mm/kmalloc.h"
 #include "sched/sched.h"
+#include "sched/async.h"
 // Devices and shell
 #include "dev/device.h"
 #include "vfs/vfs.h"
 #include "fs/exfat.h"
 #include "usb/usb.h"
+#include "block/virtio_blk.h"
+#include "block/ahci.h"
+#include "block/nvme.h"
+#include "block/overlay.h"
 #include "version.h"
 void exfat_register(void);
 void devfs_register(void);
@@ -70,6 +78,9 @@ static void print_brand(void) {
 static void print_features(void) {
     cpuid_regs r1 = cpuid(1, 0);
     console_write("Features ECX="); console_write_hex64(r1.ecx); console_write(" EDX="); console_write_hex64(r1.edx); console_write("\n");
+    console_write("Usable:");
+    for (int f = 0; f < X86_FEATURE_COUNT; ++f) { if (cpu_has(f)) { console_putc(' '); console_write(cpu_feature_name(f)); } }
+    console_write("  mem*: "); console_write(mem_active_name()); console_write("\n");
     s_puts("[k64] cpuid(1,0) raw:");
     s_put_hex64(((uint64_t)r1.edx<<32)|r1.ecx); serial_putc('\n');
 }
@@ -164,6 +175,11 @@ void kmain64(void* mb_info) {
     // Early serial breadcrumb
     serial_init();
     s_puts("[k64] entry");
+    // Enable SIMD state, then patch feature-specific code paths (mem* stubs)
+    cpu_features_init();
+    int alts = alternatives_apply();
+    mem_init();
+    s_puts("[k64] alternatives applied:"); s_put_hex64((uint64_t)alts); serial_putc('\n');
     console_init_from_mb2((uint64_t)mb_info);
     s_puts("[k64] console_init");
     uint64_t mb_addr = (uint64_t)mb_info;
@@ -224,6 +240,11 @@ void kmain64(void* mb_info) {
     kb_ps2_register();
     // Probe PCI/USB controllers (skeleton)
     usb_init();
+    // Attach virtio-blk (vda, ...), AHCI (sda, ...) and NVMe (nvme0n1, ...)
+    // disks before the partition scan
+    virtio_blk_init();
+    ahci_init();
+    nvme_init();
     // Register filesystems
     exfat_register(); s_puts("[k64] exfat_register");
     devfs_register(); s_puts("[k64] devfs_register");
@@ -266,10 +287,13 @@ void kmain64(void* mb_info) {
                     // Assume 512-byte sectors for ISO/IMG content
                     console_write("[k64] MB2 module root.img start="); console_write_hex64(start); console_write(" end="); console_write_hex64(end); console_write(" bytes="); console_write_hex64(bytes); console_write("\n");
                     if (memdisk_register("iso0", (void*)(uintptr_t)start, bytes, 512, 0)==0) {
-                        // Attempt to mount exFAT directly; if needed, user can run bootroot to mount partition
+                        // Mount through a copy-on-write overlay so the root is writable without
+                        // copying the image; fall back to the read-only memdisk. If neither holds
+                        // exFAT, user can run bootroot to mount a partition
+                        const char* rootdev = overlay_create("cow0", "iso0")==0 ? "cow0" : "iso0";
                         s_puts("[k64] mount exfat root enter (iso0)");
-                        rc = vfs_mount("exfat", "root", "iso0");
-                        if (rc==0) { s_puts("[k64] mounted exfat 'root' on iso0"); mounted_from_module = 1; }
+                        rc = vfs_mount("exfat", "root", rootdev);
+                        if (rc==0) { s_puts(rootdev[0]=='c' ? "[k64] mounted exfat 'root' on cow0" : "[k64] mounted exfat 'root' on iso0"); mounted_from_module = 1; }
                     }
                 }
                 break; // only consider first matching module
@@ -291,6 +315,8 @@ void kmain64(void* mb_info) {
     s_puts("[k64] start shell");
     console_write("Starting shell...\n");
     sched_create(shell_main, NULL);
+    // One executor thread multiplexes all async tasks
+    async_executor_start(1);
     sched_start();
     for(;;){ __asm__ volatile ("hlt"); }
 }
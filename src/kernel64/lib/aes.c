@@ -0,0 +1,191 @@
+#include "aes.h"
+#include <stddef.h>
+#include "mem.h"
+#include "../cpufeature.h"
+
+// lib/aes_x86_64.S: rk is the schedule for the direction, blocks of 16 bytes
+void aesni_encrypt_block(const uint32_t* rk, uint32_t rounds, uint8_t* out, const uint8_t* in);
+void aesni_decrypt_block(const uint32_t* rk, uint32_t rounds, uint8_t* out, const uint8_t* in);
+void aesni_xts_encrypt(const uint32_t* rk, uint32_t rounds, const uint8_t* tweak, uint8_t* dst, const uint8_t* src, uint64_t blocks);
+void aesni_xts_decrypt(const uint32_t* rk, uint32_t rounds, const uint8_t* tweak, uint8_t* dst, const uint8_t* src, uint64_t blocks);
+
+// Portable tables, built on first use: S-box, its inverse, and the first
+// column of the round function (MixColumns of S[x], InvMixColumns of Si[x]);
+// the other columns are byte rotations of it
+static uint8_t s_sbox[256], s_isbox[256];
+static uint32_t s_te[256], s_td[256];
+static int s_ready;
+static int s_hw = -1;       // -1: not decided yet
+
+static inline uint8_t xt(uint8_t x) { return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0)); }
+static inline uint8_t gmul(uint8_t a, uint8_t b) {
+    uint8_t r = 0;
+    for (; b; b >>= 1, a = xt(a)) if (b & 1) r ^= a;
+    return r;
+}
+static inline uint32_t rotl(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+static inline uint8_t rotl8(uint8_t v, int n) { return (uint8_t)((v << n) | (v >> (8 - n))); }
+
+static void build_tables(void) {
+    // Walk the multiplicative group with generator 3 and its inverse
+    uint8_t p = 1, q = 1;
+    do {
+        p = (uint8_t)(p ^ xt(p));
+        q ^= (uint8_t)(q << 1); q ^= (uint8_t)(q << 2); q ^= (uint8_t)(q << 4);
+        if (q & 0x80) q ^= 0x09;
+        uint8_t x = (uint8_t)(q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4));
+        s_sbox[p] = x ^ 0x63;
+    } while (p != 1);
+    s_sbox[0] = 0x63;
+    for (int i = 0; i < 256; ++i) s_isbox[s_sbox[i]] = (uint8_t)i;
+    for (int i = 0; i < 256; ++i) {
+        uint8_t s = s_sbox[i], si = s_isbox[i];
+        s_te[i] = (uint32_t)xt(s) | (uint32_t)s << 8 | (uint32_t)s << 16 | (uint32_t)(xt(s) ^ s) << 24;
+        s_td[i] = (uint32_t)gmul(si, 14) | (uint32_t)gmul(si, 9) << 8 |
+                  (uint32_t)gmul(si, 13) << 16 | (uint32_t)gmul(si, 11) << 24;
+    }
+    s_ready = 1;
+}
+
+static void init(void) {
+    if (!s_ready) build_tables();
+    if (s_hw < 0) s_hw = cpu_has(X86_FEATURE_AES) && cpu_has(X86_FEATURE_SSE2);
+}
+
+int aes_hw(void) { init(); return s_hw; }
+void aes_use_hw(int on) { init(); s_hw = on && cpu_has(X86_FEATURE_AES) && cpu_has(X86_FEATURE_SSE2); }
+
+static inline uint32_t ld32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline void st32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static inline uint32_t sub_word(uint32_t w) {
+    return (uint32_t)s_sbox[w & 0xff] | (uint32_t)s_sbox[(w >> 8) & 0xff] << 8 |
+           (uint32_t)s_sbox[(w >> 16) & 0xff] << 16 | (uint32_t)s_sbox[w >> 24] << 24;
+}
+// InvMixColumns of one word: Td(S[x]) is InvMixColumns of byte x alone
+static inline uint32_t inv_mix(uint32_t w) {
+    return s_td[s_sbox[w & 0xff]] ^ rotl(s_td[s_sbox[(w >> 8) & 0xff]], 8) ^
+           rotl(s_td[s_sbox[(w >> 16) & 0xff]], 16) ^ rotl(s_td[s_sbox[w >> 24]], 24);
+}
+
+int aes_set_key(aes_key_t* k, const uint8_t* key, uint32_t len) {
+    if (!k || !key || (len != 16 && len != 32)) return -1;
+    init();
+    uint32_t nk = len / 4, nr = nk + 6, total = 4 * (nr + 1);
+    uint8_t rcon = 1;
+    for (uint32_t i = 0; i < nk; ++i) k->ek[i] = ld32(key + 4 * i);
+    for (uint32_t i = nk; i < total; ++i) {
+        uint32_t t = k->ek[i - 1];
+        if (i % nk == 0) { t = sub_word(rotl(t, 24)) ^ rcon; rcon = xt(rcon); }
+        else if (nk > 6 && i % nk == 4) t = sub_word(t);
+        k->ek[i] = k->ek[i - nk] ^ t;
+    }
+    // Equivalent inverse cipher: reversed rounds, inner ones InvMixColumns'd
+    for (uint32_t r = 0; r <= nr; ++r)
+        for (uint32_t c = 0; c < 4; ++c) {
+            uint32_t w = k->ek[4 * (nr - r) + c];
+            k->dk[4 * r + c] = (r == 0 || r == nr) ? w : inv_mix(w);
+        }
+    k->rounds = nr;
+    return 0;
+}
+
+#define B(w, n) (((w) >> (8 * (n))) & 0xff)
+
+static void soft_encrypt(const aes_key_t* k, uint8_t* out, const uint8_t* in) {
+    const uint32_t* rk = k->ek;
+    uint32_t s0 = ld32(in) ^ rk[0], s1 = ld32(in + 4) ^ rk[1], s2 = ld32(in + 8) ^ rk[2], s3 = ld32(in + 12) ^ rk[3];
+    for (uint32_t r = 1; r < k->rounds; ++r) {
+        rk += 4;
+        uint32_t t0 = s_te[B(s0, 0)] ^ rotl(s_te[B(s1, 1)], 8) ^ rotl(s_te[B(s2, 2)], 16) ^ rotl(s_te[B(s3, 3)], 24) ^ rk[0];
+        uint32_t t1 = s_te[B(s1, 0)] ^ rotl(s_te[B(s2, 1)], 8) ^ rotl(s_te[B(s3, 2)], 16) ^ rotl(s_te[B(s0, 3)], 24) ^ rk[1];
+        uint32_t t2 = s_te[B(s2, 0)] ^ rotl(s_te[B(s3, 1)], 8) ^ rotl(s_te[B(s0, 2)], 16) ^ rotl(s_te[B(s1, 3)], 24) ^ rk[2];
+        uint32_t t3 = s_te[B(s3, 0)] ^ rotl(s_te[B(s0, 1)], 8) ^ rotl(s_te[B(s1, 2)], 16) ^ rotl(s_te[B(s2, 3)], 24) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    rk += 4;
+#define LAST(a, b, c, d) ((uint32_t)s_sbox[B(a, 0)] | (uint32_t)s_sbox[B(b, 1)] << 8 | \
+                          (uint32_t)s_sbox[B(c, 2)] << 16 | (uint32_t)s_sbox[B(d, 3)] << 24)
+    st32(out, LAST(s0, s1, s2, s3) ^ rk[0]);
+    st32(out + 4, LAST(s1, s2, s3, s0) ^ rk[1]);
+    st32(out + 8, LAST(s2, s3, s0, s1) ^ rk[2]);
+    st32(out + 12, LAST(s3, s0, s1, s2) ^ rk[3]);
+#undef LAST
+}
+
+static void soft_decrypt(const aes_key_t* k, uint8_t* out, const uint8_t* in) {
+    const uint32_t* rk = k->dk;
+    uint32_t s0 = ld32(in) ^ rk[0], s1 = ld32(in + 4) ^ rk[1], s2 = ld32(in + 8) ^ rk[2], s3 = ld32(in + 12) ^ rk[3];
+    for (uint32_t r = 1; r < k->rounds; ++r) {
+        rk += 4;
+        uint32_t t0 = s_td[B(s0, 0)] ^ rotl(s_td[B(s3, 1)], 8) ^ rotl(s_td[B(s2, 2)], 16) ^ rotl(s_td[B(s1, 3)], 24) ^ rk[0];
+        uint32_t t1 = s_td[B(s1, 0)] ^ rotl(s_td[B(s0, 1)], 8) ^ rotl(s_td[B(s3, 2)], 16) ^ rotl(s_td[B(s2, 3)], 24) ^ rk[1];
+        uint32_t t2 = s_td[B(s2, 0)] ^ rotl(s_td[B(s1, 1)], 8) ^ rotl(s_td[B(s0, 2)], 16) ^ rotl(s_td[B(s3, 3)], 24) ^ rk[2];
+        uint32_t t3 = s_td[B(s3, 0)] ^ rotl(s_td[B(s2, 1)], 8) ^ rotl(s_td[B(s1, 2)], 16) ^ rotl(s_td[B(s0, 3)], 24) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    rk += 4;
+#define LAST(a, b, c, d) ((uint32_t)s_isbox[B(a, 0)] | (uint32_t)s_isbox[B(b, 1)] << 8 | \
+                          (uint32_t)s_isbox[B(c, 2)] << 16 | (uint32_t)s_isbox[B(d, 3)] << 24)
+    st32(out, LAST(s0, s3, s2, s1) ^ rk[0]);
+    st32(out + 4, LAST(s1, s0, s3, s2) ^ rk[1]);
+    st32(out + 8, LAST(s2, s1, s0, s3) ^ rk[2]);
+    st32(out + 12, LAST(s3, s2, s1, s0) ^ rk[3]);
+#undef LAST
+}
+
+void aes_encrypt_block(const aes_key_t* k, uint8_t out[16], const uint8_t in[16]) {
+    if (aes_hw()) aesni_encrypt_block(k->ek, k->rounds, out, in); else soft_encrypt(k, out, in);
+}
+void aes_decrypt_block(const aes_key_t* k, uint8_t out[16], const uint8_t in[16]) {
+    if (aes_hw()) aesni_decrypt_block(k->dk, k->rounds, out, in); else soft_decrypt(k, out, in);
+}
+
+int aes_xts_set_key(aes_xts_t* x, const uint8_t* key, uint32_t len) {
+    if (!x || !key || (len != 32 && len != 64)) return -1;
+    if (aes_set_key(&x->data, key, len / 2) != 0) return -1;
+    return aes_set_key(&x->tweak, key + len / 2, len / 2);
+}
+
+// Multiply the tweak by x in GF(2^128), little-endian as XTS specifies
+static inline void xts_double(uint64_t t[2]) {
+    uint64_t carry = t[1] >> 63;
+    t[1] = (t[1] << 1) | (t[0] >> 63);
+    t[0] = (t[0] << 1) ^ (carry ? 0x87 : 0);
+}
+
+static void xts_tweak(const aes_xts_t* x, uint64_t unit, uint64_t t[2]) {
+    uint64_t u[2] = { unit, 0 };
+    aes_encrypt_block(&x->tweak, (uint8_t*)t, (const uint8_t*)u);
+}
+
+void aes_xts_encrypt(const aes_xts_t* x, uint64_t unit, void* dst, const void* src, uint32_t len) {
+    uint64_t t[2];
+    xts_tweak(x, unit, t);
+    if (s_hw) { aesni_xts_encrypt(x->data.ek, x->data.rounds, (const uint8_t*)t, (uint8_t*)dst, (const uint8_t*)src, len / AES_BLOCK); return; }
+    uint8_t* d = (uint8_t*)dst; const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t off = 0; off + AES_BLOCK <= len; off += AES_BLOCK) {
+        uint64_t b[2];
+        memcpy(b, s + off, AES_BLOCK);
+        b[0] ^= t[0]; b[1] ^= t[1];
+        soft_encrypt(&x->data, (uint8_t*)b, (const uint8_t*)b);
+        b[0] ^= t[0]; b[1] ^= t[1];
+        memcpy(d + off, b, AES_BLOCK);
+        xts_double(t);
+    }
+}
+
+void aes_xts_decrypt(const aes_xts_t* x, uint64_t unit, void* dst, const void* src, uint32_t len) {
+    uint64_t t[2];
+    xts_tweak(x, unit, t);
+    if (s_hw) { aesni_xts_decrypt(x->data.dk, x->data.rounds, (const uint8_t*)t, (uint8_t*)dst, (const uint8_t*)src, len / AES_BLOCK); return; }
+    uint8_t* d = (uint8_t*)dst; const uint8_t* s = (const uint8_t*)src;
+    for (uint32_t off = 0; off + AES_BLOCK <= len; off += AES_BLOCK) {
+        uint64_t b[2];
+        memcpy(b, s + off, AES_BLOCK);
+        b[0] ^= t[0]; b[1] ^= t[1];
+        soft_decrypt(&x->data, (uint8_t*)b, (const uint8_t*)b);
+        b[0] ^= t[0]; b[1] ^= t[1];
+        memcpy(d + off, b, AES_BLOCK);
+        xts_double(t);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+
+// AES-128/256 and XTS-AES (IEEE 1619). Blocks go through AES-NI when the
+// CPU has it (lib/aes_x86_64.S, four blocks interleaved per loop), else
+// through a portable table implementation built on first use. Round keys
+// are kept in the layout both paths share: little-endian words, the
+// decryption schedule in equivalent inverse cipher form.
+
+#define AES_BLOCK 16u
+
+typedef struct {
+    uint32_t ek[60];        // encryption round keys
+    uint32_t dk[60];        // decryption round keys
+    uint32_t rounds;        // 10 or 14
+} aes_key_t;
+
+typedef struct {
+    aes_key_t data;         // key 1: encrypts the data
+    aes_key_t tweak;        // key 2: encrypts the data unit number
+} aes_xts_t;
+
+// key is 16 or 32 bytes; 0 or -1
+int aes_set_key(aes_key_t* k, const uint8_t* key, uint32_t len);
+void aes_encrypt_block(const aes_key_t* k, uint8_t out[16], const uint8_t in[16]);
+void aes_decrypt_block(const aes_key_t* k, uint8_t out[16], const uint8_t in[16]);
+
+// key is 32 (XTS-AES-128) or 64 (XTS-AES-256) bytes; 0 or -1
+int aes_xts_set_key(aes_xts_t* x, const uint8_t* key, uint32_t len);
+// Process one data unit (e.g. a sector) numbered `unit`; len is a multiple
+// of AES_BLOCK. dst may equal src.
+void aes_xts_encrypt(const aes_xts_t* x, uint64_t unit, void* dst, const void* src, uint32_t len);
+void aes_xts_decrypt(const aes_xts_t* x, uint64_t unit, void* dst, const void* src, uint32_t len);
+
+// 1 when blocks go through AES-NI. aes_use_hw(0) forces the portable path
+// (benchmarks, tests); aes_use_hw(1) restores AES-NI if the CPU has it.
+int aes_hw(void);
+void aes_use_hw(int on);
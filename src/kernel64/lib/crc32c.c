@@ -0,0 +1,79 @@
+#include "crc32c.h"
+#include <stddef.h>
+#include "mem.h"
+#include "../cpufeature.h"
+
+#define CRC32C_POLY 0x82F63B78u     // reflected
+#define CRC32_POLY  0xEDB88320u
+
+static uint32_t s_tab[8][256];
+static int s_ready;
+static int s_hw = -1;       // -1: not decided yet
+
+static void build_tables(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? CRC32C_POLY : 0);
+        s_tab[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+        for (int t = 1; t < 8; ++t) s_tab[t][i] = (s_tab[t - 1][i] >> 8) ^ s_tab[0][s_tab[t - 1][i] & 0xff];
+    s_ready = 1;
+}
+
+static void init(void) {
+    if (s_hw < 0) s_hw = cpu_has(X86_FEATURE_SSE42);
+    if (!s_hw && !s_ready) build_tables();
+}
+
+int crc32c_hw(void) { init(); return s_hw; }
+void crc32c_use_hw(int on) { s_hw = on && cpu_has(X86_FEATURE_SSE42); init(); }
+
+static uint32_t crc_soft(uint32_t c, const uint8_t* p, uint64_t n) {
+    while (n && ((uintptr_t)p & 7)) { c = (c >> 8) ^ s_tab[0][(c ^ *p++) & 0xff]; --n; }
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= c;
+        c = s_tab[7][v & 0xff] ^ s_tab[6][(v >> 8) & 0xff] ^ s_tab[5][(v >> 16) & 0xff] ^ s_tab[4][(v >> 24) & 0xff] ^
+            s_tab[3][(v >> 32) & 0xff] ^ s_tab[2][(v >> 40) & 0xff] ^ s_tab[1][(v >> 48) & 0xff] ^ s_tab[0][v >> 56];
+    }
+    while (n--) c = (c >> 8) ^ s_tab[0][(c ^ *p++) & 0xff];
+    return c;
+}
+
+// One crc32q per 8 bytes once the pointer is aligned
+static uint32_t crc_hw(uint32_t c, const uint8_t* p, uint64_t n) {
+    while (n && ((uintptr_t)p & 7)) { __asm__("crc32b %1, %0" : "+r"(c) : "rm"(*p)); ++p; --n; }
+    uint64_t c64 = c;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        __asm__("crc32q %1, %0" : "+r"(c64) : "rm"(v));
+    }
+    c = (uint32_t)c64;
+    while (n--) { __asm__("crc32b %1, %0" : "+r"(c) : "rm"(*p)); ++p; }
+    return c;
+}
+
+uint32_t crc32c(uint32_t crc, const void* buf, uint64_t len) {
+    init();
+    const uint8_t* p = (const uint8_t*)buf;
+    return ~(s_hw ? crc_hw(~crc, p, len) : crc_soft(~crc, p, len));
+}
+
+static uint32_t s_ieee[256];
+
+uint32_t crc32_ieee(uint32_t crc, const void* buf, uint64_t len) {
+    if (!s_ieee[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ ((c & 1) ? CRC32_POLY : 0);
+            s_ieee[i] = c;
+        }
+    }
+    const uint8_t* p = (const uint8_t*)buf;
+    uint32_t c = ~crc;
+    while (len--) c = (c >> 8) ^ s_ieee[(c ^ *p++) & 0xff];
+    return ~c;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// CRC32C (Castagnoli, as in iSCSI/ext4/btrfs). Uses the SSE4.2 crc32
+// instruction when CPUID reports it (general registers only, so no SIMD
+// state), else slicing-by-8 tables built on first use.
+
+// Continue a CRC over len bytes; start with crc = 0. The pre/post
+// inversion is done inside, so crc32c(crc32c(0, a), b) == crc32c(0, ab).
+uint32_t crc32c(uint32_t crc, const void* buf, uint64_t len);
+
+// 1 when the crc32 instruction is used; crc32c_use_hw(0) forces the tables
+int crc32c_hw(void);
+void crc32c_use_hw(int on);
+
+// CRC-32 of IEEE 802.3 / zlib / GPT (reflected 0xEDB88320), same calling
+// convention; byte-wise table only, for small metadata such as GPT headers
+uint32_t crc32_ieee(uint32_t crc, const void* buf, uint64_t len);
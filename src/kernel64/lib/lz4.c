@@ -0,0 +1,93 @@
+#include "lz4.h"
+#include <stddef.h>
+#include "mem.h"
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MF_LIMIT  12    // the last match starts at least this far from the end
+#define LAST_LITS 5     // the block ends with at least this many literals
+
+static inline uint32_t rd32(const uint8_t* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint32_t hash4(uint32_t v){ return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+// Append one sequence: literals, then a match unless mlen is 0 (last one)
+static uint8_t* put_seq(uint8_t* op, uint8_t* oend, const uint8_t* lit, uint32_t nlit, uint32_t off, uint32_t mlen){
+    if ((uint64_t)(oend - op) < 1u + nlit / 255u + 1u + nlit + 2u + mlen / 255u + 1u) return NULL;
+    uint8_t* token = op++;
+    if (nlit >= 15) {
+        *token = 15 << 4;
+        uint32_t l = nlit - 15;
+        for (; l >= 255; l -= 255) *op++ = 255;
+        *op++ = (uint8_t)l;
+    } else *token = (uint8_t)(nlit << 4);
+    memcpy(op, lit, nlit); op += nlit;
+    if (!mlen) return op;
+    *op++ = (uint8_t)off; *op++ = (uint8_t)(off >> 8);
+    uint32_t m = mlen - MIN_MATCH;
+    if (m >= 15) {
+        *token |= 15;
+        for (m -= 15; m >= 255; m -= 255) *op++ = 255;
+        *op++ = (uint8_t)m;
+    } else *token |= (uint8_t)m;
+    return op;
+}
+
+uint32_t lz4_compress(const void* src, uint32_t n, void* dst, uint32_t cap){
+    if (!n || n > LZ4_MAX_INPUT) return 0;
+    const uint8_t* base = (const uint8_t*)src;
+    const uint8_t* ip = base, *anchor = base;
+    uint8_t* op = (uint8_t*)dst, *oend = op + cap;
+    static uint16_t table[1u << HASH_BITS];   // kernel stacks are small
+    memset(table, 0, sizeof(table));
+    if (n > MF_LIMIT) {
+        const uint8_t* mflimit = base + n - MF_LIMIT;
+        const uint8_t* mlimit = base + n - LAST_LITS;
+        while (ip <= mflimit) {
+            uint32_t seq = rd32(ip), h = hash4(seq);
+            const uint8_t* ref = base + table[h];
+            table[h] = (uint16_t)(ip - base);
+            if (ref >= ip || rd32(ref) != seq) { ip++; continue; }
+            const uint8_t* mp = ip + MIN_MATCH, *rp = ref + MIN_MATCH;
+            while (mp < mlimit && *mp == *rp) { mp++; rp++; }
+            op = put_seq(op, oend, anchor, (uint32_t)(ip - anchor), (uint32_t)(ip - ref), (uint32_t)(mp - ip));
+            if (!op) return 0;
+            ip = anchor = mp;
+        }
+    }
+    op = put_seq(op, oend, anchor, (uint32_t)(base + n - anchor), 0, 0);
+    return op ? (uint32_t)(op - (uint8_t*)dst) : 0;
+}
+
+// Length continuation bytes: 255 means another byte follows
+static int get_len(const uint8_t** ip, const uint8_t* iend, uint32_t* len){
+    uint8_t b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++; *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const void* src, uint32_t n, void* dst, uint32_t cap){
+    const uint8_t* ip = (const uint8_t*)src, *iend = ip + n;
+    uint8_t* out = (uint8_t*)dst, *op = out, *oend = out + cap;
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        uint32_t len = token >> 4;
+        if (len == 15 && get_len(&ip, iend, &len) != 0) return -1;
+        if (len > (uint64_t)(iend - ip) || len > (uint64_t)(oend - op)) return -1;
+        memcpy(op, ip, len); op += len; ip += len;
+        if (ip == iend) break;              // last sequence carries no match
+        if (iend - ip < 2) return -1;
+        uint32_t off = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8); ip += 2;
+        if (off == 0 || off > (uint64_t)(op - out)) return -1;
+        len = token & 15;
+        if (len == 15 && get_len(&ip, iend, &len) != 0) return -1;
+        len += MIN_MATCH;
+        if (len > (uint64_t)(oend - op)) return -1;
+        // Byte copy: the match may overlap the bytes it produces
+        const uint8_t* m = op - off;
+        while (len--) *op++ = *m++;
+    }
+    return (int)(op - out);
+}
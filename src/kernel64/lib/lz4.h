@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// LZ4 block format (no frame header): greedy single-pass compressor with a
+// 4K-entry hash table, and a bounds-checked decompressor. Inputs are limited
+// to LZ4_MAX_INPUT bytes so match offsets always fit the 16-bit field.
+
+#define LZ4_MAX_INPUT 65536u
+// Worst-case compressed size of n input bytes
+#define LZ4_BOUND(n) ((n) + (n) / 255u + 16u)
+
+// Compress n bytes into at most cap bytes; returns the compressed length,
+// or 0 when the output would not fit (or n is 0 / too large)
+uint32_t lz4_compress(const void* src, uint32_t n, void* dst, uint32_t cap);
+// Decompress n bytes into at most cap bytes; returns the decoded length,
+// or -1 on malformed input or overflow
+int lz4_decompress(const void* src, uint32_t n, void* dst, uint32_t cap);
@@ -1,42 +1,71 @@
 #include <stddef.h>
+#include <stdint.h>
+#include "mem.h"
+#include "../cpufeature.h"
 
 // Minimal freestanding implementations used by the kernel.
+// memcpy/memset/memcmp live in mem_x86_64.S as jmp stubs patched at boot by
+// alternatives_apply(); before that (SSE not yet enabled) they use word loops.
 
-void* memset(void* dst, int c, size_t n) {
-    unsigned char* d = (unsigned char*)dst;
-    unsigned char v = (unsigned char)c;
-    for (size_t i = 0; i < n; ++i) d[i] = v;
-    return dst;
-}
+// Filled at runtime: no function-pointer relocations in the flat image
+static mem_variant_t g_variants[4];
+static int g_variant_count = 0;
 
-void* memcpy(void* dst, const void* src, size_t n) {
-    unsigned char* d = (unsigned char*)dst;
-    const unsigned char* s = (const unsigned char*)src;
-    for (size_t i = 0; i < n; ++i) d[i] = s[i];
-    return dst;
-}
-
-void* memmove(void* dst, const void* src, size_t n) {
-    unsigned char* d = (unsigned char*)dst;
-    const unsigned char* s = (const unsigned char*)src;
-    if (d == s || n == 0) return dst;
-    if (d < s) {
-        for (size_t i = 0; i < n; ++i) d[i] = s[i];
-    } else {
-        for (size_t i = n; i != 0; --i) d[i - 1] = s[i - 1];
-    }
-    return dst;
-}
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_unaligned;
 
-int memcmp(const void* a, const void* b, size_t n) {
+int mem_cmp_words(const void* a, const void* b, size_t n) {
     const unsigned char* x = (const unsigned char*)a;
     const unsigned char* y = (const unsigned char*)b;
+    while (n >= 8 && *(const u64_unaligned*)x == *(const u64_unaligned*)y) {
+        x += 8; y += 8; n -= 8;
+    }
     for (size_t i = 0; i < n; ++i) {
         if (x[i] != y[i]) return (int)x[i] - (int)y[i];
     }
     return 0;
 }
 
+static const mem_variant_t* add_variant(const char* name, mem_copy_fn copy, mem_set_fn set) {
+    mem_variant_t* v = &g_variants[g_variant_count++];
+    v->name = name; v->copy = copy; v->set = set;
+    return v;
+}
+
+void mem_init(void) {
+    g_variant_count = 0;
+    add_variant("words", mem_copy_words, mem_set_words);
+    if (cpu_has(X86_FEATURE_SSE2)) add_variant("sse2", mem_copy_sse2, mem_set_sse2);
+    if (cpu_has(X86_FEATURE_AVX)) add_variant("avx", mem_copy_avx, mem_set_avx);
+    if (cpu_has(X86_FEATURE_ERMS) || cpu_has(X86_FEATURE_FSRM)) add_variant("erms", mem_copy_erms, mem_set_erms);
+}
+
+int mem_variants(const mem_variant_t** out) {
+    if (out) *out = g_variants;
+    return g_variant_count;
+}
+
+const char* mem_active_name(void) {
+    // Decode the patched memcpy stub: jmp rel32
+    const uint8_t* p = (const uint8_t*)(uintptr_t)&memcpy;
+    if (p[0] != 0xE9) return "?";
+    int32_t rel = (int32_t)((uint32_t)p[1] | ((uint32_t)p[2] << 8) | ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24));
+    const uint8_t* target = p + 5 + rel;
+    for (int i = 0; i < g_variant_count; ++i) {
+        if ((const uint8_t*)(uintptr_t)g_variants[i].copy == target) return g_variants[i].name;
+    }
+    return "words";
+}
+
+void* memmove(void* dst, const void* src, size_t n) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (d == s || n == 0) return dst;
+    // Forward block copies load each block before storing it, so they are
+    // safe whenever dst is below src or the ranges do not overlap.
+    if (d < s || d >= s + n) return memcpy(dst, src, n);
+    return mem_move_back(dst, src, n);
+}
+
 size_t strlen(const char* s) {
     size_t n = 0;
     while (s && *s) { ++n; ++s; }
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Freestanding string/memory routines (lib/mem.c, lib/mem_x86_64.S)
+void* memset(void* dst, int c, size_t n);
+void* memcpy(void* dst, const void* src, size_t n);
+void* memmove(void* dst, const void* src, size_t n);
+int memcmp(const void* a, const void* b, size_t n);
+size_t strlen(const char* s);
+int strcmp(const char* a, const char* b);
+
+typedef void* (*mem_copy_fn)(void* dst, const void* src, size_t n);
+typedef void* (*mem_set_fn)(void* dst, int c, size_t n);
+typedef int (*mem_cmp_fn)(const void* a, const void* b, size_t n);
+
+// Implementations in lib/mem_x86_64.S
+void* mem_copy_words(void* dst, const void* src, size_t n);
+void* mem_copy_erms(void* dst, const void* src, size_t n);
+void* mem_copy_sse2(void* dst, const void* src, size_t n);
+void* mem_copy_avx(void* dst, const void* src, size_t n);
+void* mem_set_words(void* dst, int c, size_t n);
+void* mem_set_erms(void* dst, int c, size_t n);
+void* mem_set_sse2(void* dst, int c, size_t n);
+void* mem_set_avx(void* dst, int c, size_t n);
+void* mem_move_back(void* dst, const void* src, size_t n);
+int mem_cmp_sse2(const void* a, const void* b, size_t n);
+int mem_cmp_words(const void* a, const void* b, size_t n);   // lib/mem.c
+
+typedef struct {
+    const char* name;
+    mem_copy_fn copy;
+    mem_set_fn set;
+} mem_variant_t;
+
+// Record the variants usable on this CPU. The active one is chosen by the
+// ALTERNATIVE entries on the memcpy/memset/memcmp stubs.
+void mem_init(void);
+// Variants usable on this CPU (for benchmarks); returns count.
+int mem_variants(const mem_variant_t** out);
+// Variant the memcpy stub is currently patched to
+const char* mem_active_name(void);
+// Size-sweep memcpy/memset bandwidth for every usable variant (shell 'membench')
+void mem_bench(void);
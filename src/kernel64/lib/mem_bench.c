@@ -0,0 +1,60 @@
+// Size-sweep bandwidth benchmark for the mem* variants (shell 'membench')
+#include <stdint.h>
+#include <stddef.h>
+#include "mem.h"
+#include "../tsc.h"
+#include "../console.h"
+#include "../../kernel/mm/pmm.h"
+
+#define BENCH_MAX_BYTES   (1024u * 1024u)
+#define BENCH_TOTAL_BYTES (4u * 1024u * 1024u)   // bytes moved per data point
+
+static void print_padded(const char* s, int width) {
+    int n = 0; while (s[n]) ++n;
+    console_write(s);
+    for (; n < width; ++n) console_putc(' ');
+}
+
+// Prints MB/s when the TSC is calibrated, else bytes per 1000 cycles
+static void print_rate(uint64_t bytes, uint64_t cycles, uint64_t khz) {
+    if (cycles == 0) cycles = 1;
+    if (khz) { console_write_dec(bytes * khz / cycles / 1000ULL); console_write(" MB/s"); }
+    else { console_write_dec(bytes * 1000ULL / cycles); console_write(" B/kcyc"); }
+}
+
+void mem_bench(void) {
+    const mem_variant_t* v = NULL;
+    int nv = mem_variants(&v);
+    uint64_t pages = BENCH_MAX_BYTES / PMM_FRAME_SIZE;
+    uint64_t src = pmm_alloc_frames_below((size_t)pages, 1ULL<<32);
+    uint64_t dst = pmm_alloc_frames_below((size_t)pages, 1ULL<<32);
+    if (!src || !dst) {
+        if (src) pmm_free_frames(src, (size_t)pages);
+        console_write("membench: out of memory\n");
+        return;
+    }
+    uint8_t* s = (uint8_t*)(uintptr_t)src;
+    uint8_t* d = (uint8_t*)(uintptr_t)dst;
+    memset(s, 0x5A, BENCH_MAX_BYTES);
+    uint64_t khz = tsc_khz();
+    console_write("membench: active="); console_write(mem_active_name());
+    console_write(" tsc_khz="); console_write_dec(khz); console_putc('\n');
+    for (int op = 0; op < 2; ++op) {
+        for (int i = 0; i < nv; ++i) {
+            for (uint32_t size = 64; size <= BENCH_MAX_BYTES; size <<= 2) {
+                uint32_t reps = BENCH_TOTAL_BYTES / size;
+                uint64_t t0 = rdtsc_ordered();
+                if (op == 0) { for (uint32_t r = 0; r < reps; ++r) v[i].copy(d, s, size); }
+                else { for (uint32_t r = 0; r < reps; ++r) v[i].set(d, r, size); }
+                uint64_t t1 = rdtsc_ordered();
+                console_write(op == 0 ? "  memcpy " : "  memset ");
+                print_padded(v[i].name, 6);
+                console_write_dec(size); console_write("B  ");
+                print_rate((uint64_t)reps * size, t1 - t0, khz);
+                console_putc('\n');
+            }
+        }
+    }
+    pmm_free_frames(src, (size_t)pages);
+    pmm_free_frames(dst, (size_t)pages);
+}
@@ -1,6 +1,7 @@
 // PCI config space access using legacy I/O ports CF8h/CFCh
 #include "pci.h"
 #include "../io.h"
+#include "../../kernel/mm/vmm.h"
 
 static inline uint32_t cfg_addr(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset) {
     return (1u << 31) | ((uint32_t)bus << 16) | ((uint32_t)dev << 11) | ((uint32_t)func << 8) | (offset & 0xFC);
@@ -28,6 +29,53 @@ void pci_cfg_write32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uin
     outl(0xCFC, val);
 }
 
+void pci_cfg_write16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint16_t val) {
+    uint32_t v = pci_cfg_read32(bus, dev, func, offset & 0xFC);
+    uint8_t sh = (offset & 2) ? 16 : 0;
+    v = (v & ~(0xFFFFu << sh)) | ((uint32_t)val << sh);
+    pci_cfg_write32(bus, dev, func, offset & 0xFC, v);
+}
+
+void pci_enable_device(const pci_device_t* d) {
+    uint16_t cmd = pci_cfg_read16(d->bus, d->dev, d->func, 0x04);
+    cmd |= 0x0007;  // I/O space, memory space, bus master
+    pci_cfg_write16(d->bus, d->dev, d->func, 0x04, cmd);
+}
+
+uint64_t pci_bar_base(const pci_device_t* d, int idx, int* is_io) {
+    if (idx < 0 || idx > 5) return 0;
+    uint8_t off = (uint8_t)(0x10 + idx * 4);
+    uint32_t lo = pci_cfg_read32(d->bus, d->dev, d->func, off);
+    if (is_io) *is_io = (int)(lo & 1);
+    if (lo & 1) return lo & ~3u;
+    uint64_t base = lo & ~0xFu;
+    if (((lo >> 1) & 3) == 2 && idx < 5)
+        base |= (uint64_t)pci_cfg_read32(d->bus, d->dev, d->func, (uint8_t)(off + 4)) << 32;
+    return base;
+}
+
+void* pci_map_bar(const pci_device_t* d, int idx, uint64_t bytes) {
+    int io = 0;
+    uint64_t base = pci_bar_base(d, idx, &io);
+    if (io || base == 0) return 0;
+    // The identity map is write-back; device registers must not be cached
+    for (uint64_t a = base & ~(PAGE_SIZE - 1); a < base + bytes; a += PAGE_SIZE)
+        if (vmm_map_page(a, a, VMM_PRESENT | VMM_RW | VMM_PCD | VMM_PWT) != 0) return 0;
+    return (void*)(uintptr_t)base;
+}
+
+uint8_t pci_find_cap(const pci_device_t* d, uint8_t cap_id, uint8_t after) {
+    if (!(pci_cfg_read16(d->bus, d->dev, d->func, 0x06) & 0x10)) return 0;  // no capability list
+    uint8_t off = after ? pci_cfg_read8(d->bus, d->dev, d->func, (uint8_t)(after + 1))
+                        : pci_cfg_read8(d->bus, d->dev, d->func, 0x34);
+    for (int guard = 0; off >= 0x40 && guard < 48; ++guard) {
+        off &= 0xFC;
+        if (pci_cfg_read8(d->bus, d->dev, d->func, off) == cap_id) return off;
+        off = pci_cfg_read8(d->bus, d->dev, d->func, (uint8_t)(off + 1));
+    }
+    return 0;
+}
+
 void pci_enumerate(pci_enum_cb cb, void* user) {
     for (uint8_t bus = 0; bus < 255; ++bus) {
         for (uint8_t dev = 0; dev < 32; ++dev) {
@@ -14,6 +14,20 @@ uint32_t pci_cfg_read32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint16_t pci_cfg_read16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 uint8_t  pci_cfg_read8(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
 void     pci_cfg_write32(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint32_t val);
+void     pci_cfg_write16(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset, uint16_t val);
+
+#define PCI_CAP_MSIX   0x11
+#define PCI_CAP_VENDOR 0x09
+
+// Turn on memory/I/O decoding and bus mastering (DMA) for a function
+void pci_enable_device(const pci_device_t* d);
+// Base of BAR idx (a 64-bit BAR also uses idx+1); *is_io set for port BARs
+uint64_t pci_bar_base(const pci_device_t* d, int idx, int* is_io);
+// Map bytes of a memory BAR uncached at its physical address; NULL if unset
+void* pci_map_bar(const pci_device_t* d, int idx, uint64_t bytes);
+// Config offset of the next capability with cap_id after offset `after`
+// (0 = start of the list); 0 when there is none
+uint8_t pci_find_cap(const pci_device_t* d, uint8_t cap_id, uint8_t after);
 
 typedef void (*pci_enum_cb)(const pci_device_t* dev, void* user);
 void pci_enumerate(pci_enum_cb cb, void* user);
@@ -0,0 +1,265 @@
+// Stackless async task runtime: task pool, ready queue, event sources, executor
+#include <stdint.h>
+#include <stddef.h>
+#include "async.h"
+#include "sched.h"
+#include "../tsc.h"
+#include "../console.h"
+#include "../../kernel/mm/pmm.h"
+
+#define ASYNC_TF_QUEUED 0x1u
+#define ASYNC_TF_LIVE   0x2u
+
+#define TASKS_PER_FRAME (PMM_FRAME_SIZE / sizeof(async_task_t))
+
+static async_task_t* g_free = NULL;
+static async_task_t* g_ready_head = NULL;
+static async_task_t* g_ready_tail = NULL;
+static async_timer_t* g_timers = NULL;     // sorted by deadline
+static async_input_t* g_inputs = NULL;     // FIFO of input waiters
+static async_bio_t* g_bios = NULL;         // submitted, not completed
+static async_stats_t g_stats;
+
+// Grow the pool by one frame; tasks are carved out and pushed on the free list.
+static int pool_grow(void) {
+    uint64_t paddr = pmm_alloc_frames_below(1, 1ULL<<32);
+    if (!paddr) return -1;
+    async_task_t* t = (async_task_t*)(uintptr_t)paddr; // identity-mapped
+    for (uint64_t i = 0; i < TASKS_PER_FRAME; ++i) {
+        t[i].flags = 0;
+        t[i].next = g_free;
+        g_free = &t[i];
+    }
+    g_stats.pool_frames++;
+    return 0;
+}
+
+static void ready_push(async_task_t* t) {
+    t->next = NULL;
+    if (g_ready_tail) g_ready_tail->next = t; else g_ready_head = t;
+    g_ready_tail = t;
+}
+
+async_task_t* async_spawn(async_fn_t fn, void* arg) {
+    if (!fn) return NULL;
+    if (!g_free && pool_grow() != 0) return NULL;
+    async_task_t* t = g_free; g_free = t->next;
+    t->fn = fn; t->arg = arg; t->state = 0;
+    t->local[0] = t->local[1] = 0;
+    t->flags = ASYNC_TF_LIVE | ASYNC_TF_QUEUED;
+    ready_push(t);
+    g_stats.spawned++; g_stats.live++;
+    return t;
+}
+
+void async_wake(async_task_t* t) {
+    if (!t || !(t->flags & ASYNC_TF_LIVE) || (t->flags & ASYNC_TF_QUEUED)) return;
+    t->flags |= ASYNC_TF_QUEUED;
+    ready_push(t);
+}
+
+static void task_free(async_task_t* t) {
+    t->flags = 0;
+    t->next = g_free; g_free = t;
+    g_stats.completed++; g_stats.live--;
+}
+
+void async_future_init(async_future_t* f) {
+    f->waiter = NULL; f->result = 0; f->done = 0;
+}
+
+void async_future_complete(async_future_t* f, int result) {
+    f->result = result; f->done = 1;
+    async_task_t* w = f->waiter; f->waiter = NULL;
+    if (w) async_wake(w);
+}
+
+int async_future_poll(async_future_t* f, async_task_t* t) {
+    if (f->done) return 1;
+    f->waiter = t;
+    return 0;
+}
+
+void async_timer_start(async_timer_t* tm, uint64_t cycles) {
+    async_future_init(&tm->fut);
+    tm->deadline = rdtsc() + cycles;
+    async_timer_t** pp = &g_timers;
+    while (*pp && (*pp)->deadline <= tm->deadline) pp = &(*pp)->next;
+    tm->next = *pp; *pp = tm;
+}
+
+void async_input_start(async_input_t* in) {
+    async_future_init(&in->fut);
+    in->next = NULL;
+    async_input_t** pp = &g_inputs;
+    while (*pp) pp = &(*pp)->next;
+    *pp = in;
+}
+
+// Unlinked here, so the waiter may free 'ab' as soon as it resumes
+static void async_bio_end(bio_t* bio) {
+    async_bio_t* ab = (async_bio_t*)bio->priv;
+    async_bio_t** pp = &g_bios;
+    while (*pp && *pp != ab) pp = &(*pp)->next;
+    if (*pp) *pp = ab->next;
+    async_future_complete(&ab->fut, bio->status);
+}
+
+int async_bio_submit(async_bio_t* ab) {
+    async_future_init(&ab->fut);
+    ab->bio.end_io = async_bio_end;
+    ab->bio.priv = ab;
+    // Linked first: a full queue or a synchronous driver may complete it
+    // inside block_submit()
+    ab->next = g_bios; g_bios = ab;
+    return block_submit(&ab->bio);
+}
+
+// Complete expired timers, hand pending key events to input waiters and
+// push awaited bios through their devices.
+static void poll_sources(void) {
+    if (g_timers) {
+        uint64_t now = rdtsc();
+        while (g_timers && g_timers->deadline <= now) {
+            async_timer_t* tm = g_timers; g_timers = tm->next;
+            async_future_complete(&tm->fut, 0);
+        }
+    }
+    // Only consume input while someone awaits it, so the shell keeps its keys otherwise
+    while (g_inputs) {
+        key_event_t ev;
+        if (!input_try_read_event(&ev)) break;
+        async_input_t* in = g_inputs; g_inputs = in->next;
+        in->ev = ev;
+        async_future_complete(&in->fut, 0);
+    }
+    if (g_bios) {
+        for (block_device_t* d = block_first(); d; d = block_next(d)) {
+            if (d->queue.head) block_unplug(d);
+            if (d->ops && d->ops->poll && d->ops->poll(d) > 0 && d->queue.head) block_unplug(d);
+        }
+    }
+}
+
+int async_run_once(void) {
+    poll_sources();
+    // Detach the current batch; tasks woken while it runs go to the next one
+    async_task_t* t = g_ready_head;
+    g_ready_head = g_ready_tail = NULL;
+    int ran = 0;
+    while (t) {
+        async_task_t* next = t->next;
+        t->flags &= ~ASYNC_TF_QUEUED;
+        g_stats.polls++; ran++;
+        if (t->fn(t) == ASYNC_DONE) task_free(t);
+        t = next;
+    }
+    return ran;
+}
+
+void async_run_until_idle(void) {
+    while (async_run_once() > 0) { }
+}
+
+static void executor_main(void* arg) {
+    (void)arg;
+    for (;;) {
+        async_run_once();
+        sched_yield();
+    }
+}
+
+int async_executor_start(int threads) {
+    int started = 0;
+    for (int i = 0; i < threads; ++i) {
+        if (sched_create(executor_main, NULL) != 0) break;
+        started++;
+    }
+    g_stats.executors += (uint32_t)started;
+    return started;
+}
+
+void async_get_stats(async_stats_t* out) {
+    if (out) *out = g_stats;
+}
+
+// ---- Benchmark: task spawn/switch vs sched_create() threads ----
+
+static async_status_t bench_noop(async_task_t* t) { (void)t; return ASYNC_DONE; }
+
+static async_status_t bench_pingpong(async_task_t* t) {
+    ASYNC_BEGIN(t);
+    while (t->local[0] < t->local[1]) {
+        t->local[0]++;
+        ASYNC_YIELD(t);
+    }
+    ASYNC_END(t);
+}
+
+static volatile uint64_t s_thr_switches;
+static volatile int s_thr_done;
+static uint64_t s_thr_iters;
+
+static void bench_thread_noop(void* arg) { (void)arg; s_thr_done++; }
+
+static void bench_thread_pingpong(void* arg) {
+    (void)arg;
+    for (uint64_t i = 0; i < s_thr_iters; ++i) { s_thr_switches++; sched_yield(); }
+    s_thr_done++;
+}
+
+static void bench_line(const char* label, uint64_t cycles, uint64_t ops) {
+    console_write(label);
+    console_write_dec(ops ? cycles / ops : 0);
+    console_write(" cycles/op (n=");
+    console_write_dec(ops);
+    console_write(")\n");
+}
+
+void async_bench(uint32_t tasks) {
+    if (tasks == 0) tasks = 1000;
+    const uint64_t iters = 1000;
+    console_write("asyncbench: task="); console_write_dec(sizeof(async_task_t));
+    console_write("B thread="); console_write_dec(SCHED_STACK_SIZE); console_write("B+ctx\n");
+
+    // Task spawn: allocation + enqueue, then the first (and only) poll
+    uint64_t t0 = rdtsc_ordered();
+    uint32_t made = 0;
+    for (; made < tasks; ++made) if (!async_spawn(bench_noop, NULL)) break;
+    uint64_t t1 = rdtsc_ordered();
+    async_run_until_idle();
+    uint64_t t2 = rdtsc_ordered();
+    bench_line("  task spawn:    ", t1 - t0, made);
+    bench_line("  task run+free: ", t2 - t1, made);
+
+    // Task switch: two tasks yielding through the ready queue
+    async_task_t* a = async_spawn(bench_pingpong, NULL);
+    async_task_t* b = async_spawn(bench_pingpong, NULL);
+    if (a && b) {
+        a->local[1] = b->local[1] = iters;
+        t0 = rdtsc_ordered();
+        async_run_until_idle();
+        t1 = rdtsc_ordered();
+        bench_line("  task switch:   ", t1 - t0, 2 * iters);
+    }
+
+    // Thread spawn: limited by the fixed thread table, so use what is free
+    s_thr_done = 0;
+    int threads = 0;
+    t0 = rdtsc_ordered();
+    while (threads < (int)tasks && sched_create(bench_thread_noop, NULL) == 0) threads++;
+    t1 = rdtsc_ordered();
+    while (s_thr_done < threads) sched_yield();
+    bench_line("  thread spawn:  ", t1 - t0, (uint64_t)threads);
+
+    // Thread switch: two threads ping-ponging through sched_yield()
+    s_thr_done = 0; s_thr_switches = 0; s_thr_iters = iters;
+    int pp = 0;
+    if (sched_create(bench_thread_pingpong, NULL) == 0) pp++;
+    if (sched_create(bench_thread_pingpong, NULL) == 0) pp++;
+    t0 = rdtsc_ordered();
+    uint64_t own = 0;
+    while (s_thr_done < pp) { own++; sched_yield(); }
+    t1 = rdtsc_ordered();
+    bench_line("  thread switch: ", t1 - t0, s_thr_switches + own);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+#include "../input.h"
+#include "../block/block.h"
+
+// Stackless async task runtime layered on the cooperative scheduler.
+//
+// A task is a small state machine rather than a thread: its poll function is
+// re-entered from the top every time the task is woken, and ASYNC_BEGIN /
+// ASYNC_AWAIT resume it at the last suspension point recorded in 'state'.
+// C locals do not survive an await; keep such state in 'arg' or 'local[]'.
+// Tasks live in a frame-backed pool (48 bytes each) instead of owning a
+// SCHED_STACK_SIZE stack, so thousands can be in flight on a few threads.
+
+typedef struct async_task async_task_t;
+
+typedef enum { ASYNC_PENDING = 0, ASYNC_DONE = 1 } async_status_t;
+typedef async_status_t (*async_fn_t)(async_task_t* t);
+
+struct async_task {
+    async_task_t* next;   // run queue / free list link
+    async_fn_t fn;
+    void* arg;
+    uint64_t local[2];    // per-task scratch preserved across awaits
+    uint32_t state;       // resume point (0 = not started)
+    uint32_t flags;       // ASYNC_TF_*
+};
+
+// One-shot completion with a single waiter. Whoever finishes the operation
+// (timer expiry, input arrival, an I/O completion path) calls
+// async_future_complete(), which acts as the waker for the awaiting task.
+typedef struct {
+    async_task_t* waiter;
+    int result;
+    int done;
+} async_future_t;
+
+typedef struct async_timer {
+    async_future_t fut;
+    uint64_t deadline;          // absolute TSC value
+    struct async_timer* next;
+} async_timer_t;
+
+typedef struct async_input {
+    async_future_t fut;
+    key_event_t ev;             // filled on completion
+    struct async_input* next;
+} async_input_t;
+
+// Block request awaited by a task: set up 'bio' with bio_init() or
+// bio_init_vec(), then async_bio_submit(); 'fut' completes with its status
+typedef struct async_bio {
+    async_future_t fut;
+    bio_t bio;                  // end_io and priv belong to the runtime
+    struct async_bio* next;
+} async_bio_t;
+
+typedef struct {
+    uint64_t spawned;           // tasks created since boot
+    uint64_t completed;         // tasks that returned ASYNC_DONE
+    uint64_t polls;             // poll function invocations
+    uint32_t live;              // tasks currently allocated
+    uint32_t pool_frames;       // 4 KiB frames backing the task pool
+    uint32_t executors;         // scheduler threads running the executor
+} async_stats_t;
+
+// Coroutine helpers. ASYNC_AWAIT must appear on its own line (uses __LINE__).
+#define ASYNC_BEGIN(t)     switch ((t)->state) { case 0:
+#define ASYNC_AWAIT(t, f)  do { (t)->state = __LINE__; case __LINE__: \
+                                if (!async_future_poll((f), (t))) return ASYNC_PENDING; } while (0)
+#define ASYNC_YIELD(t)     do { (t)->state = __LINE__; async_wake(t); return ASYNC_PENDING; case __LINE__:; } while (0)
+#define ASYNC_END(t)       } return ASYNC_DONE
+
+// Create a task and queue it for its first poll. Returns NULL when out of memory.
+async_task_t* async_spawn(async_fn_t fn, void* arg);
+// Waker: queue 't' for another poll (no-op if already queued).
+void async_wake(async_task_t* t);
+
+void async_future_init(async_future_t* f);
+void async_future_complete(async_future_t* f, int result);
+// Returns 1 if 'f' is complete; otherwise registers 't' as its waiter and returns 0.
+int async_future_poll(async_future_t* f, async_task_t* t);
+
+// Arm a timer that completes 'tm->fut' after 'cycles' TSC ticks.
+void async_timer_start(async_timer_t* tm, uint64_t cycles);
+// Queue for the next key event; completes 'in->fut' with 'in->ev' filled.
+void async_input_start(async_input_t* in);
+// Queue ab->bio without waiting. The executor unplugs the block queues once
+// per pass, so bios submitted by the tasks of one pass can merge, and polls
+// drivers with ops->poll for completions. 'ab' must stay valid until 'fut'
+// completes. Returns block_submit()'s result; on -1 'fut' is already done.
+int async_bio_submit(async_bio_t* ab);
+
+// Run every task that is ready right now and poll timer/input sources once.
+// Returns the number of tasks polled. Callable from any scheduler thread.
+int async_run_once(void);
+// Keep running until no task is ready (pending timers/input are not waited on).
+void async_run_until_idle(void);
+
+// Start 'threads' scheduler threads that drive the executor and yield when idle.
+int async_executor_start(int threads);
+
+void async_get_stats(async_stats_t* out);
+
+// Spawn/switch cost comparison against sched_create() threads (shell 'asyncbench').
+void async_bench(uint32_t tasks);
@@ -18,10 +18,11 @@ static thread_t* g_current = NULL;
 
 // Simple static storage for threads and stacks
 #define MAX_THREADS 8
-#define STACK_SIZE  (16*1024)
+#define STACK_SIZE  SCHED_STACK_SIZE
 static thread_t g_threads[MAX_THREADS];
 static uint8_t g_stacks[MAX_THREADS][STACK_SIZE] __attribute__((aligned(16)));
 static int g_thread_count = 0;
+static uint64_t g_switches = 0;
 
 extern void sched_context_switch(uint64_t* old_rsp, uint64_t new_rsp);
 
@@ -53,19 +54,31 @@ static void thread_trampoline(void) {
 }
 
 int sched_create(void (*entry)(void*), void* arg) {
-	if (g_thread_count >= MAX_THREADS) return -1;
-	thread_t* t = &g_threads[g_thread_count];
-	t->entry = entry; t->arg = arg; t->state = 0; t->next = NULL; t->id = g_thread_count;
+	// Reuse the slot of a finished thread before claiming a new one. A done
+	// thread has already switched away for good, so its stack is free.
+	int slot = -1;
+	for (int i = 0; i < g_thread_count; ++i) {
+		if (g_threads[i].state == 2 && &g_threads[i] != g_current) { slot = i; break; }
+	}
+	if (slot < 0) {
+		if (g_thread_count >= MAX_THREADS) return -1;
+		slot = g_thread_count++;
+	}
+	thread_t* t = &g_threads[slot];
+	t->entry = entry; t->arg = arg; t->state = 0; t->next = NULL; t->id = slot;
 	// Set up stack: push return RIP = thread_trampoline end (never returns)
-	uint8_t* stack_top = g_stacks[g_thread_count] + STACK_SIZE;
+	uint8_t* stack_top = g_stacks[slot] + STACK_SIZE;
 	stack_top = (uint8_t*)((uintptr_t)stack_top & ~0xFULL);
-	// Build initial stack frame: return address = thread_trampoline
+	// Build initial stack frame as sched_context_switch leaves it:
+	// [fake caller return][RIP = thread_trampoline][rbp rbx r12 r13 r14 r15]
+	// The fake return slot gives the trampoline the usual entry alignment.
 	uint64_t* sp = (uint64_t*)stack_top;
+	*(--sp) = 0;
 	*(--sp) = (uint64_t)thread_trampoline; // RIP for iret-like simulation
-	// Our context switch will 'ret' into this address
+	for (int i = 0; i < 6; ++i) *(--sp) = 0;
+	// Our context switch will pop the callee-saved registers and 'ret' into the trampoline
 	t->rsp = (uint64_t)sp;
 	enqueue(t);
-	++g_thread_count;
 	return 0;
 }
 
@@ -78,9 +91,12 @@ void sched_yield(void) {
 	if (g_current->state == 1) { g_current->state = 0; enqueue(g_current); }
 	thread_t* prev = g_current;
 	g_current = next; next->state = 1;
+	g_switches++;
 	sched_context_switch(&prev->rsp, next->rsp);
 }
 
+uint64_t sched_switch_count(void) { return g_switches; }
+
 void sched_start(void) {
 	if (g_current) return;
 	thread_t* next = dequeue();
@@ -90,11 +106,24 @@ void sched_start(void) {
 	sched_context_switch(&dummy, next->rsp);
 }
 
-// Assembly context switch: save current RSP into *old, load new_rsp, then 'ret'
+// Assembly context switch: save the callee-saved registers and RSP into *old,
+// load new_rsp, restore that thread's registers, then 'ret'
 __attribute__((naked)) void sched_context_switch(uint64_t* old_rsp, uint64_t new_rsp) {
 	__asm__ volatile (
+		"push %rbp\n\t"
+		"push %rbx\n\t"
+		"push %r12\n\t"
+		"push %r13\n\t"
+		"push %r14\n\t"
+		"push %r15\n\t"
 		"mov %rsp, (%rdi)\n\t"  // *old_rsp = rsp
 		"mov %rsi, %rsp\n\t"    // rsp = new_rsp
+		"pop %r15\n\t"
+		"pop %r14\n\t"
+		"pop %r13\n\t"
+		"pop %r12\n\t"
+		"pop %rbx\n\t"
+		"pop %rbp\n\t"
 		"ret\n\t"
 	);
 }
@@ -1,6 +1,10 @@
 #pragma once
 #include <stdint.h>
 
+// Per-thread stack size; every sched_create() thread owns one
+#define SCHED_STACK_SIZE (16*1024)
+
+// Returns 0 on success, -1 when all thread slots are busy (finished slots are reused)
 int sched_create(void (*entry)(void*), void* arg);
 void sched_yield(void);
 void sched_start(void);
@@ -17,3 +21,5 @@ int sched_enumerate(sched_thread_info_t* out, int max);
 
 // Get currently running thread id, or -1 if scheduler not started.
 int sched_current_id(void);
+// Number of sched_yield() context switches since boot (for benchmarks)
+uint64_t sched_switch_count(void);
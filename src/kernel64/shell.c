@@ -1,11 +1,32 @@
 #include "console.h"
 #include "input.h"
 #include "sched/sched.h"
+#include "sched/async.h"
 #include "../kernel/mm/pmm.h"
 #include "vfs/vfs.h"
 #include "block/block.h"
+#include "block/bcache.h"
+#include "block/virtio_blk.h"
+#include "block/ahci.h"
+#include "block/nvme.h"
+#include "block/iostat.h"
+#include "block/zram.h"
+#include "block/overlay.h"
+#include "block/loop.h"
+#include "block/raid.h"
+#include "block/tier.h"
+#include "block/crypt.h"
+#include "block/integ.h"
+#include "../kernel/mm/kmalloc.h"
 #include "fs/exfat.h"
+#include "static_key.h"
 int ramdisk_create(const char* name, uint64_t bytes);
+int ramdisk_create_sparse(const char* name, uint64_t bytes);
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec);
+int ramdisk_create_sparse_sec(const char* name, uint64_t bytes, uint32_t sec);
+void ramdisk_dump(void);
+void mem_bench(void);
+void bench_run(const char* group);
 #include <stddef.h>
 #include <stdint.h>
 #include "version.h"
@@ -23,7 +44,20 @@ static void cmd_help(void) {
     console_write("  free   - free memory bytes\n");
     console_write("  used   - used memory bytes\n");
     console_write("  lspci  - list PCI devices\n");
-    console_write("  mkram <name> <bytes_hex> - create RAM disk\n");
+    console_write("  mkram [-s] [-4k] <name> <bytes_hex> - create RAM disk (-s: sparse, -4k: 4 KiB sectors); no args lists them\n");
+    console_write("  mkzram <name> <bytes_hex> - create LZ4-compressed RAM disk\n");
+    console_write("  zram                   - compressed RAM disks: ratio, memory saved\n");
+    console_write("  mkcow <name> <base>    - writable copy-on-write overlay over a device\n");
+    console_write("  cow                    - overlays: modified and resident bytes\n");
+    console_write("  losetup [-r] <name> <path> - loop device over a file; no args lists them\n");
+    console_write("  mkraid <name> <0|1> [-c kib] <dev> <dev>... - striped/mirrored array; no args lists them\n");
+    console_write("  mktier <name> <origin> <cache> [wt|wb] - cache a slow device on a fast one\n");
+    console_write("  tier [name wt|wb [seq_kib]] - tier cache stats / set write policy, bypass cutoff\n");
+    console_write("  mkcrypt <name> <base> <hexkey> - XTS-AES device (64/128 hex digits); no args lists them\n");
+    console_write("  mkinteg <name> <base>  - CRC32C-checked device; no args lists them\n");
+    console_write("  integ [name on|off]    - integrity stats / toggle read verification\n");
+    console_write("  scrub <name>           - verify every sector of an integrity device in the background\n");
+    console_write("  parts [-r] <dev>       - partition table of a device (-r: rescan)\n");
     console_write("  mount <fs> <mnt> <dev>   - mount device\n");
     console_write("  mounts                   - list mounts\n");
     console_write("  ls [path]               - list directory (Unix paths: /, /dev, /dev/ram0)\n");
@@ -42,6 +76,19 @@ static void cmd_help(void) {
         console_write("  demo                   - dots/dashes thread demo\n");
         console_write("  smp [N]                - spawn N worker threads\n");
         console_write("  memtest quick|range    - run memory tests\n");
+    console_write("  tasks                  - async task runtime stats\n");
+    console_write("  asyncbench [n]         - task vs thread spawn/switch cost\n");
+    console_write("  membench               - memcpy/memset bandwidth per CPU variant\n");
+    console_write("  bench [group]          - key=value benchmarks (mem alloc sched block fs disk raid tier crypt integ)\n");
+    console_write("  debug [key on|off]     - list or toggle static-key debug logging\n");
+    console_write("  bcache [budget <KiB>]  - buffer cache stats / set memory budget\n");
+    console_write("  sync                   - write back cached blocks, flush disk caches\n");
+    console_write("  fstrim <mnt>           - discard free space of a mounted filesystem\n");
+    console_write("  blkq                   - per-device request queue stats\n");
+    console_write("  iostat [-z|dev]        - per-device I/O counters; dev adds latency histograms\n");
+    console_write("  vblk [poll|irq] [dev]  - virtio-blk devices; set completion mode\n");
+    console_write("  ahci                   - AHCI disks, NCQ depth and counters\n");
+    console_write("  nvme [poll|irq]        - NVMe controllers; set completion mode\n");
     console_write("\nTip: Use PageUp/PageDown to scroll; Ctrl+Home jumps to top, Ctrl+End to live.\n");
 }
 
@@ -393,10 +440,17 @@ static void shell_handle_line(char* buf, uint64_t n) {
         console_write(KERNEL_ARCH);
         console_putc('\n');
     } else if (strcmp(cmd, "mkram") == 0) {
-        // mkram <name> <size_hex>
-        char name[16]={0}; uint64_t sz=0; {
+        // mkram [-s] [-4k] <name> <size_hex>; -s allocates frames on first
+        // write, -4k makes a 4Kn disk (4096-byte sectors)
+        char name[16]={0}; uint64_t sz=0; int sparse=0; uint32_t sec=block_default_sector(); {
+            skip_ws(&args);
+            for (;;) {
+                if (args[0]=='-' && args[1]=='s' && is_ws(args[2])) { sparse=1; args+=2; skip_ws(&args); }
+                else if (args[0]=='-' && args[1]=='4' && args[2]=='k' && is_ws(args[3])) { sec=4096; args+=3; skip_ws(&args); }
+                else break;
+            }
             // parse name
-            int i=0; skip_ws(&args); while(*args && !is_ws(*args) && i<15){ name[i++]=*args++; }
+            int i=0; while(*args && !is_ws(*args) && i<15){ name[i++]=*args++; }
             skip_ws(&args);
             // parse hex size
             while (*args) {
@@ -405,8 +459,166 @@ static void shell_handle_line(char* buf, uint64_t n) {
                 sz = (sz<<4)|v;
             }
         }
-        if (name[0]==0 || sz==0) { console_write("usage: mkram <name> <size_hex>\n"); }
-        else { int rc = ramdisk_create(name, sz); if (rc!=0) console_write("mkram failed\n"); }
+        if (name[0]==0 || sz==0) { console_write("usage: mkram [-s] [-4k] <name> <size_hex>\n"); ramdisk_dump(); }
+        else { int rc = sparse ? ramdisk_create_sparse_sec(name, sz, sec) : ramdisk_create_sec(name, sz, sec); if (rc!=0) console_write("mkram failed\n"); }
+    } else if (strcmp(cmd, "mkzram") == 0) {
+        // mkzram <name> <size_hex>
+        char name[16]={0}; uint64_t sz=0; {
+            int i=0; skip_ws(&args); while(*args && !is_ws(*args) && i<15){ name[i++]=*args++; }
+            skip_ws(&args);
+            while (*args) {
+                char c=*args++; uint8_t v;
+                if (c>='0'&&c<='9') v=c-'0'; else if(c>='a'&&c<='f') v=10+(c-'a'); else if(c>='A'&&c<='F') v=10+(c-'A'); else break;
+                sz = (sz<<4)|v;
+            }
+        }
+        if (name[0]==0 || sz==0) { console_write("usage: mkzram <name> <size_hex>\n"); }
+        else if (zram_create(name, sz)!=0) console_write("mkzram failed\n");
+    } else if (strcmp(cmd, "mkcow") == 0) {
+        // mkcow <name> <base>
+        char name[16]={0}, base[16]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<15) base[i++]=*a++;
+        if (name[0]==0 || base[0]==0) { console_write("usage: mkcow <name> <base>\n"); }
+        else if (overlay_create(name, base)!=0) console_write("mkcow failed\n");
+    } else if (strcmp(cmd, "losetup") == 0) {
+        // losetup [-r] <name> <path>
+        char name[16]={0}, path[128]={0};
+        char* a=args; skip_ws(&a);
+        int ro = 0;
+        if (a[0]=='-' && a[1]=='r' && (a[2]==0 || is_ws(a[2]))) { ro = 1; a += 2; skip_ws(&a); }
+        int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<127) path[i++]=*a++;
+        if (name[0]==0) { loop_dump(); }
+        else if (path[0]==0) { console_write("usage: losetup [-r] <name> <path>\n"); }
+        else {
+            char full[192]; if (translate_unix_path(path, full, sizeof(full)) != 0) resolve_path(path, full, sizeof(full));
+            if (loop_attach(name, full, ro)!=0) console_write("losetup failed\n");
+        }
+    } else if (strcmp(cmd, "mkraid") == 0) {
+        // mkraid <name> <0|1> [-c <chunk_kib>] <dev> <dev> [...]
+        char name[16]={0}, devs[RAID_MAX_MEMBERS][16];
+        const char* members[RAID_MAX_MEMBERS];
+        char* a=args; skip_ws(&a);
+        int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a);
+        int level = (a[0]=='0' || a[0]=='1') && (a[1]==0 || is_ws(a[1])) ? a[0]-'0' : -1;
+        if (level >= 0) { a++; skip_ws(&a); }
+        uint32_t chunk_kib = 0;
+        if (a[0]=='-' && a[1]=='c' && (a[2]==0 || is_ws(a[2]))) {
+            a += 2; skip_ws(&a);
+            while (*a>='0' && *a<='9') chunk_kib = chunk_kib*10 + (uint32_t)(*a++ - '0');
+            skip_ws(&a);
+        }
+        uint32_t n=0;
+        while (*a && n<RAID_MAX_MEMBERS) {
+            i=0; while(*a && !is_ws(*a) && i<15) devs[n][i++]=*a++;
+            devs[n][i]=0; members[n]=devs[n]; n++;
+            skip_ws(&a);
+        }
+        if (name[0]==0) { raid_dump(); }
+        else if (level<0 || n<2) { console_write("usage: mkraid <name> <0|1> [-c chunk_kib] <dev> <dev> [...]\n"); }
+        else {
+            block_device_t* m0 = block_find(members[0]);
+            uint32_t chunk = (chunk_kib && m0) ? chunk_kib * 1024u / m0->sector_size : 0;
+            if (raid_create(name, level, chunk, members, n)!=0) console_write("mkraid failed\n");
+        }
+    } else if (strcmp(cmd, "mktier") == 0) {
+        // mktier <name> <origin> <cache> [wt|wb]
+        char name[16]={0}, origin[16]={0}, cache[16]={0}, mode[4]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<15) origin[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<15) cache[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<3) mode[i++]=*a++;
+        int wb = strcmp(mode, "wb") == 0;
+        if (name[0]==0 || cache[0]==0 || (mode[0] && !wb && strcmp(mode, "wt")!=0)) { console_write("usage: mktier <name> <origin> <cache> [wt|wb]\n"); }
+        else if (tier_create(name, origin, cache, wb ? TIER_WRITEBACK : TIER_WRITETHROUGH)!=0) console_write("mktier failed\n");
+    } else if (strcmp(cmd, "tier") == 0) {
+        // tier [<name> wt|wb [seq_kib]]
+        char name[16]={0}, mode[4]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<3) mode[i++]=*a++;
+        skip_ws(&a);
+        uint32_t seq_kib = TIER_SEQ_CUTOFF >> 10;
+        if (*a>='0' && *a<='9') { seq_kib = 0; while (*a>='0' && *a<='9') seq_kib = seq_kib*10 + (uint32_t)(*a++ - '0'); }
+        int wb = strcmp(mode, "wb") == 0;
+        if (name[0]==0) { tier_dump(); }
+        else if (!wb && strcmp(mode, "wt")!=0) { console_write("usage: tier <name> wt|wb [seq_kib]\n"); }
+        else if (tier_set_policy(name, wb ? TIER_WRITEBACK : TIER_WRITETHROUGH, seq_kib << 10)!=0) console_write("tier: policy change failed\n");
+    } else if (strcmp(cmd, "mkcrypt") == 0) {
+        // mkcrypt <name> <base> <hexkey>
+        char name[16]={0}, base[16]={0};
+        uint8_t key[64];
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<15) base[i++]=*a++;
+        skip_ws(&a);
+        uint32_t nib=0; int bad=0;
+        for (; *a && !is_ws(*a); ++a, ++nib) {
+            char c=*a; int v = (c>='0'&&c<='9') ? c-'0' : (c>='a'&&c<='f') ? c-'a'+10 : (c>='A'&&c<='F') ? c-'A'+10 : -1;
+            if (v<0 || nib>=128) { bad=1; break; }
+            if (nib&1) key[nib/2] = (uint8_t)(key[nib/2] | v); else key[nib/2] = (uint8_t)(v<<4);
+        }
+        if (name[0]==0) { crypt_dump(); }
+        else if (bad || (nib!=64 && nib!=128) || base[0]==0) { console_write("usage: mkcrypt <name> <base> <64|128 hex digits>\n"); }
+        else if (crypt_create(name, base, key, nib/2)!=0) console_write("mkcrypt failed\n");
+        for (i=0; i<64; ++i) ((volatile uint8_t*)key)[i]=0;
+    } else if (strcmp(cmd, "mkinteg") == 0) {
+        // mkinteg <name> <base>
+        char name[16]={0}, base[16]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<15) base[i++]=*a++;
+        if (name[0]==0) { integ_dump(); }
+        else if (base[0]==0) { console_write("usage: mkinteg <name> <base>\n"); }
+        else if (integ_create(name, base)!=0) console_write("mkinteg failed\n");
+    } else if (strcmp(cmd, "integ") == 0) {
+        // integ [<name> on|off]
+        char name[16]={0}, mode[4]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        skip_ws(&a); i=0; while(*a && !is_ws(*a) && i<3) mode[i++]=*a++;
+        int on = strcmp(mode, "on") == 0;
+        if (name[0]==0) { integ_dump(); }
+        else if (!on && strcmp(mode, "off")!=0) { console_write("usage: integ <name> on|off\n"); }
+        else if (integ_set_verify(name, on)!=0) console_write("integ: not an integrity device\n");
+    } else if (strcmp(cmd, "scrub") == 0) {
+        // scrub <name>
+        char name[16]={0};
+        char* a=args; skip_ws(&a); int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        if (name[0]==0) { console_write("usage: scrub <name>\n"); }
+        else if (integ_scrub(name)!=0) console_write("scrub: not an integrity device, already running, or no free thread\n");
+        else console_write("scrub: started\n");
+    } else if (strcmp(cmd, "parts") == 0) {
+        // parts [-r] <dev>
+        char name[16]={0};
+        char* a=args; skip_ws(&a);
+        int rescan = (a[0]=='-' && a[1]=='r' && (a[2]==0 || is_ws(a[2])));
+        if (rescan) { a+=2; skip_ws(&a); }
+        int i=0; while(*a && !is_ws(*a) && i<15) name[i++]=*a++;
+        block_device_t* d = name[0] ? block_find(name) : NULL;
+        if (!d) { console_write("usage: parts [-r] <dev>\n"); }
+        else {
+            if (rescan) block_partitions_invalidate(d);
+            const block_ptable_t* t = block_partitions(d);
+            if (!t) { console_write("parts: cannot scan this device\n"); }
+            else {
+                console_write(d->name);
+                console_write(t->scheme==BLOCK_PT_GPT ? (t->gpt_backup ? ": gpt (backup header)" : ": gpt")
+                              : t->scheme==BLOCK_PT_MBR ? ": mbr" : ": no partition table");
+                console_write(" scans="); console_write_dec(t->scans); console_write("\n");
+                for (i=0; i<t->count; ++i) {
+                    const block_part_t* p = &t->part[i];
+                    console_write("  "); console_write(t->dev[i] ? t->dev[i]->name : "?");
+                    console_write(" start="); console_write_dec(p->start);
+                    console_write(" count="); console_write_dec(p->count);
+                    console_write(" align="); console_write_dec(p->align);
+                    if (p->align < 4096) console_write(" (misaligned)");
+                    console_write("\n");
+                }
+            }
+        }
+    } else if (strcmp(cmd, "cow") == 0) {
+        overlay_dump();
+    } else if (strcmp(cmd, "zram") == 0) {
+        zram_dump();
     } else if (strcmp(cmd, "mount") == 0) {
         // mount <fs> <mnt> <dev>
         char fs[8]={0}, mnt[8]={0}, dev[16]={0};
@@ -573,7 +785,11 @@ static void shell_handle_line(char* buf, uint64_t n) {
             vfs_node_t* n = vfs_open(full);
             if (!n) { console_write("cat: open failed\n"); }
             else {
-                char buf[256]; uint64_t off=0; for(;;){ int r=vfs_read(n, off, buf, sizeof(buf)); if(r<=0) break; for(int i=0;i<r;++i) console_putc(buf[i]); off += (uint64_t)r; } console_putc('\n');
+                // Files on memory-backed volumes print straight from the device
+                uint64_t sz=0; int isd=0;
+                const char* m = (vfs_stat(full, &sz, &isd)==0 && !isd && sz) ? (const char*)vfs_map(n, 0, sz) : NULL;
+                if (m) { for(uint64_t i=0;i<sz;++i) console_putc(m[i]); console_putc('\n'); }
+                else { char buf[256]; uint64_t off=0; for(;;){ int r=vfs_read(n, off, buf, sizeof(buf)); if(r<=0) break; for(int i=0;i<r;++i) console_putc(buf[i]); off += (uint64_t)r; } console_putc('\n'); }
             }
         }
     } else if (strcmp(cmd, "hexdump") == 0) {
@@ -726,6 +942,117 @@ static void shell_handle_line(char* buf, uint64_t n) {
             console_write("   0x"); console_write_hex64(ti[i].rsp);
             console_write((ti[i].id==cur)?"   *\n":"\n");
         }
+    } else if (strcmp(cmd, "tasks") == 0) {
+        async_stats_t st; async_get_stats(&st);
+        console_write("live="); console_write_dec(st.live);
+        console_write(" spawned="); console_write_dec(st.spawned);
+        console_write(" completed="); console_write_dec(st.completed);
+        console_write(" polls="); console_write_dec(st.polls);
+        console_write(" pool_frames="); console_write_dec(st.pool_frames);
+        console_write(" executors="); console_write_dec(st.executors);
+        console_putc('\n');
+    } else if (strcmp(cmd, "asyncbench") == 0) {
+        // asyncbench [n] (decimal task count)
+        uint32_t n = 0; char* a = args;
+        while (*a >= '0' && *a <= '9') { n = n*10 + (uint32_t)(*a - '0'); ++a; }
+        async_bench(n);
+    } else if (strcmp(cmd, "membench") == 0) {
+        mem_bench();
+    } else if (strcmp(cmd, "bench") == 0) {
+        bench_run(args);
+    } else if (strcmp(cmd, "debug") == 0) {
+        // debug [key on|off]
+        char* a = args; char key[16]; int k = 0;
+        while (*a && !is_ws(*a) && k < (int)sizeof(key)-1) key[k++] = *a++;
+        key[k] = 0; skip_ws(&a);
+        if (!key[0]) {
+            static_key_t* keys[16]; int n = static_key_list(keys, 16);
+            for (int i = 0; i < n; ++i) {
+                console_write(keys[i]->name); console_write(keys[i]->enabled ? " on\n" : " off\n");
+            }
+        } else {
+            static_key_t* sk = static_key_find(key);
+            if (!sk) console_write("debug: unknown key\n");
+            else if (strcmp(a, "on") == 0) static_key_enable(sk);
+            else if (strcmp(a, "off") == 0) static_key_disable(sk);
+            else console_write("usage: debug [key on|off]\n");
+        }
+    } else if (strcmp(cmd, "bcache") == 0) {
+        // bcache [budget <KiB>] (decimal)
+        char* a = args;
+        if (a[0]=='b' && a[1]=='u' && a[2]=='d' && a[3]=='g' && a[4]=='e' && a[5]=='t') {
+            a += 6; skip_ws(&a);
+            uint64_t kib = 0; while (*a >= '0' && *a <= '9') { kib = kib*10 + (uint64_t)(*a - '0'); ++a; }
+            bcache_set_budget(kib * 1024u);
+        }
+        bcache_stats_t st; bcache_get_stats(&st);
+        uint64_t lookups = st.hits + st.misses;
+        console_write("hits="); console_write_dec(st.hits);
+        console_write(" misses="); console_write_dec(st.misses);
+        console_write(" hit%="); console_write_dec(lookups ? st.hits * 100 / lookups : 0);
+        console_write(" evictions="); console_write_dec(st.evictions);
+        console_write(" writebacks="); console_write_dec(st.writebacks);
+        console_write(" bypass="); console_write_dec(st.bypass);
+        console_putc('\n');
+        console_write("buffers="); console_write_dec(st.buffers);
+        console_write(" dirty="); console_write_dec(st.dirty);
+        console_write(" used_kib="); console_write_dec((uint64_t)st.buffers * BCACHE_BLOCK_SIZE / 1024);
+        console_write(" budget_kib="); console_write_dec(st.budget / 1024);
+        console_putc('\n');
+    } else if (strcmp(cmd, "blkq") == 0) {
+        for (block_device_t* b = block_first(); b; b = block_next(b)) {
+            const block_queue_stats_t* q = &b->queue.stats;
+            console_write(b->name);
+            console_write(": submitted="); console_write_dec(q->submitted);
+            console_write(" dispatched="); console_write_dec(q->dispatched);
+            console_write(" merged="); console_write_dec(q->merged);
+            console_write(" errors="); console_write_dec(q->errors);
+            console_write(" depth="); console_write_dec(q->depth);
+            console_write(" max_depth="); console_write_dec(q->max_depth);
+            console_write(" inflight="); console_write_dec(q->inflight);
+            if (q->discards) { console_write(" discards="); console_write_dec(q->discards);
+                               console_write(" discard_sectors="); console_write_dec(q->discard_sectors); }
+            if (q->flushes || q->fua) { console_write(" flushes="); console_write_dec(q->flushes);
+                                        console_write(" fua="); console_write_dec(q->fua); }
+            console_putc('\n');
+        }
+    } else if (strcmp(cmd, "iostat") == 0) {
+        char* a = args; skip_ws(&a);
+        if (a[0]=='-' && a[1]=='z') { block_io_reset(NULL); console_write("iostat: counters cleared\n"); }
+        else {
+            block_device_t* d = *a ? block_find(a) : NULL;
+            if (*a && !d) console_write("iostat: no such device\n");
+            else {
+                uint32_t n = iostat_format(d, d != NULL, NULL, 0);
+                char* t = (char*)kmalloc(n + 1);
+                if (t) { iostat_format(d, d != NULL, t, n + 1); console_write(t); kfree(t); }
+            }
+        }
+    } else if (strcmp(cmd, "vblk") == 0) {
+        char* a = args; skip_ws(&a);
+        int mode = -1;
+        if (a[0]=='p' && a[1]=='o' && a[2]=='l' && a[3]=='l') { mode = VBLK_MODE_POLL; a += 4; }
+        else if (a[0]=='i' && a[1]=='r' && a[2]=='q') { mode = VBLK_MODE_IRQ; a += 3; }
+        skip_ws(&a);
+        if (mode >= 0 && virtio_blk_set_mode(*a ? a : NULL, mode) == 0) console_write("vblk: no such device\n");
+        virtio_blk_dump();
+    } else if (strcmp(cmd, "ahci") == 0) {
+        ahci_dump();
+    } else if (strcmp(cmd, "nvme") == 0) {
+        char* a = args; skip_ws(&a);
+        if (a[0]=='p' && a[1]=='o' && a[2]=='l' && a[3]=='l') nvme_set_mode(NVME_MODE_POLL);
+        else if (a[0]=='i' && a[1]=='r' && a[2]=='q') nvme_set_mode(NVME_MODE_IRQ);
+        nvme_dump();
+    } else if (strcmp(cmd, "sync") == 0) {
+        if (bcache_flush(NULL) != 0) console_write("sync: write-back or flush error\n");
+    } else if (strcmp(cmd, "fstrim") == 0) {
+        char* a = args; skip_ws(&a);
+        if (!*a) console_write("usage: fstrim <mnt>\n");
+        else {
+            int64_t n = vfs_trim(a);
+            if (n < 0) console_write("fstrim: not supported\n");
+            else { console_write(a); console_write(": "); console_write_dec((uint64_t)n / 1024); console_write(" KiB trimmed\n"); }
+        }
     } else if (strcmp(cmd, "mem") == 0) {
         uint64_t total = pmm_total_physical_bytes();
         uint64_t freeb = pmm_free_bytes();
@@ -0,0 +1,55 @@
+// Static key sites: 5-byte NOP when disabled, jmp rel32 when enabled
+#include <stdint.h>
+#include "static_key.h"
+#include "alternative.h"
+
+extern const jump_entry_t __jump_table_start[];
+extern const jump_entry_t __jump_table_end[];
+
+static const uint8_t k_nop5[5] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+
+static static_key_t* entry_key(const jump_entry_t* e) {
+    return (static_key_t*)((uint8_t*)&e->key + e->key);
+}
+
+static void static_key_set(static_key_t* key, int enabled) {
+    if (key->enabled == enabled) return;
+    key->enabled = enabled;
+    for (const jump_entry_t* e = __jump_table_start; e < __jump_table_end; ++e) {
+        if (entry_key(e) != key) continue;
+        uint8_t* code = (uint8_t*)&e->code + e->code;
+        uint8_t* target = (uint8_t*)&e->target + e->target;
+        if (!enabled) { text_poke(code, k_nop5, 5); continue; }
+        int32_t rel = (int32_t)(target - (code + 5));
+        uint8_t insn[5] = { 0xE9, (uint8_t)rel, (uint8_t)(rel >> 8),
+                            (uint8_t)(rel >> 16), (uint8_t)(rel >> 24) };
+        text_poke(code, insn, 5);
+    }
+}
+
+void static_key_enable(static_key_t* key) { static_key_set(key, 1); }
+void static_key_disable(static_key_t* key) { static_key_set(key, 0); }
+
+int static_key_list(static_key_t** out, int max) {
+    int n = 0;
+    for (const jump_entry_t* e = __jump_table_start; e < __jump_table_end; ++e) {
+        static_key_t* k = entry_key(e);
+        int seen = 0;
+        for (int i = 0; i < n; ++i) if (out[i] == k) { seen = 1; break; }
+        if (!seen && n < max) out[n++] = k;
+    }
+    return n;
+}
+
+static int name_eq(const char* a, const char* b) {
+    while (*a && *a == *b) { ++a; ++b; }
+    return *a == *b;
+}
+
+static_key_t* static_key_find(const char* name) {
+    for (const jump_entry_t* e = __jump_table_start; e < __jump_table_end; ++e) {
+        static_key_t* k = entry_key(e);
+        if (name_eq(k->name, name)) return k;
+    }
+    return 0;
+}
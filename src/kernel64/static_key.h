@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+
+// Static keys: a guarded branch is compiled as a 5-byte NOP that falls
+// through to the common path; enabling the key patches every site into a
+// jmp to the guarded block. Disabled debug logging costs one NOP.
+// Sites are recorded in the __jump_table section (see linker.ld).
+
+typedef struct {
+    int32_t enabled;
+    char name[12];     // shown and matched by the shell 'debug' command
+} static_key_t;
+
+#define STATIC_KEY_INIT_FALSE(nm) { 0, nm }
+
+typedef struct {
+    int32_t code;      // NOP/jmp site, relative to this field
+    int32_t target;    // guarded block, relative to this field
+    int64_t key;       // static_key_t, relative to this field
+} jump_entry_t;
+
+static inline __attribute__((always_inline)) int static_branch_unlikely(static_key_t* key) {
+    __asm__ goto("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"
+                 ".pushsection __jump_table, \"a\"\n\t"
+                 ".balign 8\n\t"
+                 ".long 1b - ., %l[l_yes] - .\n\t"
+                 ".quad %c0 - .\n\t"
+                 ".popsection"
+                 : : "i"(key) : : l_yes);
+    return 0;
+l_yes:
+    return 1;
+}
+
+void static_key_enable(static_key_t* key);
+void static_key_disable(static_key_t* key);
+// Distinct keys that have at least one site; returns count (<= max)
+int static_key_list(static_key_t** out, int max);
+static_key_t* static_key_find(const char* name);
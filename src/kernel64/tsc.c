@@ -0,0 +1,34 @@
+// TSC frequency calibration against the legacy PIT
+#include <stdint.h>
+#include "tsc.h"
+#include "io.h"
+
+#define PIT_HZ        1193182u
+#define PIT_CAL_MS    10u
+
+static uint64_t g_tsc_khz = 0;
+static int g_tsc_calibrated = 0;
+
+// Run PIT channel 2 in one-shot mode (gate via port 0x61, speaker off) and
+// count TSC ticks until its output goes high.
+static uint64_t calibrate(void) {
+    uint16_t latch = (uint16_t)(PIT_HZ / (1000u / PIT_CAL_MS));
+    uint8_t ctl = inb(0x61);
+    outb(0x61, (uint8_t)((ctl & ~0x02) | 0x01));
+    outb(0x43, 0xB0);                 // channel 2, lobyte/hibyte, mode 0
+    outb(0x42, (uint8_t)(latch & 0xFF));
+    outb(0x42, (uint8_t)(latch >> 8));
+    uint64_t t0 = rdtsc_ordered();
+    uint64_t spins = 0;
+    while ((inb(0x61) & 0x20) == 0) {
+        if (++spins > 100000000ULL) { outb(0x61, ctl); return 0; }
+    }
+    uint64_t t1 = rdtsc_ordered();
+    outb(0x61, ctl);
+    return (t1 - t0) / PIT_CAL_MS;
+}
+
+uint64_t tsc_khz(void) {
+    if (!g_tsc_calibrated) { g_tsc_khz = calibrate(); g_tsc_calibrated = 1; }
+    return g_tsc_khz;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// Time Stamp Counter helpers for cheap cycle-level timing
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Serializing variant: waits for prior instructions to retire before sampling
+static inline uint64_t rdtsc_ordered(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// TSC frequency in kHz, calibrated once against PIT channel 2 (0 if unavailable)
+uint64_t tsc_khz(void);
@@ -1,6 +1,11 @@
 #include "vfs.h"
 #include "../console.h"
 #include "../serial.h"
+#include "../static_key.h"
+
+// Mount tracing on serial; toggled at runtime with the shell "debug vfs on"
+static_key_t g_dbg_vfs = STATIC_KEY_INIT_FALSE("vfs");
+#define VFS_DBG(...) do { if (static_branch_unlikely(&g_dbg_vfs)) { __VA_ARGS__; } } while (0)
 
 static void dbg_puts(const char* s){ while(*s) serial_putc(*s++); serial_putc('\n'); }
 static void dbg_put(const char* s){ while(*s) serial_putc(*s++); }
@@ -33,10 +38,10 @@ int vfs_register_fs(const char* name, const vfs_fs_ops_t* ops){ if(g_fs_count>=M
 __attribute__((constructor)) static void vfs_dbg_init(void){ /* no-op to ensure file is linked */ }
 
 int vfs_mount(const char* fs_name, const char* mount_name, const char* bdev_name){
-    dbg_puts("[vfs] mount enter");
-    dbg_put("[vfs]   fs_name="); dbg_put(fs_name?fs_name:"(null)"); serial_putc('\n');
-    dbg_put("[vfs]   mount_name="); dbg_put(mount_name?mount_name:"(null)"); serial_putc('\n');
-    dbg_put("[vfs]   bdev_name="); dbg_put((bdev_name&&bdev_name[0])?bdev_name:"(none)"); serial_putc('\n');
+    VFS_DBG(dbg_puts("[vfs] mount enter"));
+    VFS_DBG(dbg_put("[vfs]   fs_name="); dbg_put(fs_name?fs_name:"(null)"); serial_putc('\n'));
+    VFS_DBG(dbg_put("[vfs]   mount_name="); dbg_put(mount_name?mount_name:"(null)"); serial_putc('\n'));
+    VFS_DBG(dbg_put("[vfs]   bdev_name="); dbg_put((bdev_name&&bdev_name[0])?bdev_name:"(none)"); serial_putc('\n'));
     if(g_mount_count>=MAX_MOUNTS) return -1;
     // find fs
     const vfs_fs_ops_t* fops=NULL; 
@@ -46,49 +51,65 @@ int vfs_mount(const char* fs_name, const char* mount_name, const char* bdev_name
             break; 
         }
     }
-    dbg_put("[vfs]   fops="); dbg_put_hex64((uint64_t)(uintptr_t)fops); serial_putc('\n');
-    if(!fops){ dbg_puts("[vfs]   fs not found"); return -1; }
+    VFS_DBG(dbg_put("[vfs]   fops="); dbg_put_hex64((uint64_t)(uintptr_t)fops); serial_putc('\n'));
+    if(!fops){ VFS_DBG(dbg_puts("[vfs]   fs not found")); return -1; }
     // find bdev (optional)
     block_device_t* bdev = NULL;
     if (bdev_name && bdev_name[0]) {
         bdev = block_find(bdev_name);
-        dbg_put("[vfs]   bdev="); dbg_put_hex64((uint64_t)(uintptr_t)bdev); serial_putc('\n');
-        if(!bdev) { dbg_puts("[vfs]   bdev not found"); return -1; }
+        VFS_DBG(dbg_put("[vfs]   bdev="); dbg_put_hex64((uint64_t)(uintptr_t)bdev); serial_putc('\n'));
+        if(!bdev) { VFS_DBG(dbg_puts("[vfs]   bdev not found")); return -1; }
     }
     void* priv=NULL; 
     int rc=0;
-    dbg_put("[vfs]   fops->mount="); dbg_put_hex64((uint64_t)(uintptr_t)fops->mount); serial_putc('\n');
-    dbg_puts("[vfs]   calling fops->mount...");
-    if (!fops->mount) { dbg_puts("[vfs]   mount fn NULL, skipping"); priv=(void*)1; rc=0; goto mount_done; }
+    VFS_DBG(dbg_put("[vfs]   fops->mount="); dbg_put_hex64((uint64_t)(uintptr_t)fops->mount); serial_putc('\n'));
+    VFS_DBG(dbg_puts("[vfs]   calling fops->mount..."));
+    if (!fops->mount) { VFS_DBG(dbg_puts("[vfs]   mount fn NULL, skipping")); priv=(void*)1; rc=0; goto mount_done; }
     rc=fops->mount(bdev,mount_name,&priv); 
-    dbg_put("[vfs]   mount rc="); dbg_put_hex((uint32_t)rc); serial_putc('\n');
-    dbg_put("[vfs]   fs_priv="); dbg_put_hex64((uint64_t)(uintptr_t)priv); serial_putc('\n');
+    VFS_DBG(dbg_put("[vfs]   mount rc="); dbg_put_hex((uint32_t)rc); serial_putc('\n'));
+    VFS_DBG(dbg_put("[vfs]   fs_priv="); dbg_put_hex64((uint64_t)(uintptr_t)priv); serial_putc('\n'));
     if(rc!=0) return rc; 
 mount_done:
     // record mount
     str_cpy(g_mounts[g_mount_count].mname,mount_name,8); g_mounts[g_mount_count].ops=fops; g_mounts[g_mount_count].fs_priv=priv; g_mount_count++;
-    dbg_puts("[vfs] mount exit");
+    VFS_DBG(dbg_puts("[vfs] mount exit"));
     return 0;
 }
 
-int vfs_umount(const char* mount_name){ for(int i=0;i<g_mount_count;++i){ if(str_eq(g_mounts[i].mname,mount_name)){ if(g_mounts[i].ops->umount) g_mounts[i].ops->umount(g_mounts[i].fs_priv); // compact
-            for(int j=i+1;j<g_mount_count;++j) g_mounts[j-1]=g_mounts[j]; g_mount_count--; return 0; }} return -1; }
+int vfs_umount(const char* mount_name){ for(int i=0;i<g_mount_count;++i){ if(str_eq(g_mounts[i].mname,mount_name)){
+            if(g_mounts[i].ops->umount) g_mounts[i].ops->umount(g_mounts[i].fs_priv);
+            // compact
+            for(int j=i+1;j<g_mount_count;++j) g_mounts[j-1]=g_mounts[j];
+            g_mount_count--; return 0; }} return -1; }
 
 static mount_t* find_mount(const char* mname){ for(int i=0;i<g_mount_count;++i) if(str_eq(g_mounts[i].mname,mname)) return &g_mounts[i]; return NULL; }
 
 vfs_node_t* vfs_open(const char* path){
     // Expect form mount:/path or mount:path
-    const char* p = path; const char* sep = path; while(*sep && *sep!=':') ++sep; if(*sep!=':') return NULL; char m[8]; int n= (sep-p<7? (int)(sep-p):7); for(int i=0;i<n;++i) m[i]=p[i]; m[n]=0; mount_t* mt=find_mount(m); if(!mt) return NULL; const char* sub = (*sep==':'? sep+1:sep);
-    if(mt->ops->open) return mt->ops->open(mt->fs_priv, sub); return NULL;
+    const char* p = path; const char* sep = path; while(*sep && *sep!=':') ++sep;
+    if(*sep!=':') return NULL;
+    char m[8]; int n= (sep-p<7? (int)(sep-p):7); for(int i=0;i<n;++i) m[i]=p[i];
+    m[n]=0; mount_t* mt=find_mount(m);
+    if(!mt) return NULL;
+    const char* sub = (*sep==':'? sep+1:sep);
+    if(mt->ops->open) return mt->ops->open(mt->fs_priv, sub);
+    return NULL;
 }
 
 int vfs_read(vfs_node_t* n, uint64_t off, void* buf, uint64_t len){ if(!n||!n->fops||!n->fops->read) return -1; return n->fops->read(n,off,buf,len); }
+const void* vfs_map(vfs_node_t* n, uint64_t off, uint64_t len){ if(!n||!n->fops||!n->fops->map) return NULL; return n->fops->map(n,off,len); }
 int vfs_readdir(vfs_node_t* n, uint32_t idx, char* name, uint32_t maxlen){ if(!n||!n->fops||!n->fops->readdir) return -1; return n->fops->readdir(n,idx,name,maxlen); }
 
 int vfs_stat(const char* path, uint64_t* size, int* is_dir){
     // Expect form mount:/path or mount:path
-    const char* p = path; const char* sep = path; while(*sep && *sep!=':') ++sep; if(*sep!=':') return -1; char m[8]; int n= (sep-p<7? (int)(sep-p):7); for(int i=0;i<n;++i) m[i]=p[i]; m[n]=0; mount_t* mt=find_mount(m); if(!mt) return -1; const char* sub = (*sep==':'? sep+1:sep);
-    if(mt->ops->stat) return mt->ops->stat(mt->fs_priv, sub, size, is_dir); return -1;
+    const char* p = path; const char* sep = path; while(*sep && *sep!=':') ++sep;
+    if(*sep!=':') return -1;
+    char m[8]; int n= (sep-p<7? (int)(sep-p):7); for(int i=0;i<n;++i) m[i]=p[i];
+    m[n]=0; mount_t* mt=find_mount(m);
+    if(!mt) return -1;
+    const char* sub = (*sep==':'? sep+1:sep);
+    if(mt->ops->stat) return mt->ops->stat(mt->fs_priv, sub, size, is_dir);
+    return -1;
 }
 
 void vfs_list_mounts(void){ console_write("Mounts:\n"); for(int i=0;i<g_mount_count;++i){ console_write("  "); console_write(g_mounts[i].mname); console_write("\n"); }}
@@ -101,7 +122,10 @@ static int parse_mount_and_sub(const char* path, mount_t** out_mt, const char**
     const char* p = path; const char* sep = path; while(*sep && *sep!=':') ++sep; if(*sep!=':') return -1; char m[8]; int n= (sep-p<7? (int)(sep-p):7); for(int i=0;i<n;++i) m[i]=p[i]; m[n]=0; mount_t* mt=find_mount(m); if(!mt) return -1; const char* sub = (*sep==':'? sep+1:sep); *out_mt=mt; *out_sub=sub; return 0; }
 
 int vfs_write(vfs_node_t* n, uint64_t off, const void* buf, uint64_t len){ if(!n||!n->fops||!n->fops->write) return -1; return n->fops->write(n,off,buf,len); }
+int vfs_fsync(vfs_node_t* n){ if(!n||!n->fops) return -1; if(!n->fops->fsync) return 0; return n->fops->fsync(n); }
 
 int vfs_create(const char* path, uint64_t size_hint){ mount_t* mt; const char* sub; if(parse_mount_and_sub(path,&mt,&sub)!=0) return -1; if(!mt->ops->create) return -1; return mt->ops->create(mt->fs_priv, sub, size_hint); }
 
 int vfs_unlink(const char* path){ mount_t* mt; const char* sub; if(parse_mount_and_sub(path,&mt,&sub)!=0) return -1; if(!mt->ops->unlink) return -1; return mt->ops->unlink(mt->fs_priv, sub); }
+
+int64_t vfs_trim(const char* mount_name){ mount_t* mt=find_mount(mount_name); if(!mt||!mt->ops->trim) return -1; return mt->ops->trim(mt->fs_priv); }
@@ -19,6 +19,13 @@ typedef struct {
     int (*write)(vfs_node_t* node, uint64_t off, const void* buf, uint64_t len);
     int (*create)(void* fs_priv, const char* path, uint64_t size_hint);
     int (*unlink)(void* fs_priv, const char* path);
+    // Optional zero-copy read: pointer to file bytes [off, off+len) in place,
+    // NULL when they are not contiguous in memory (use read instead)
+    const void* (*map)(vfs_node_t* node, uint64_t off, uint64_t len);
+    // Optional: discard all free space on the device; bytes discarded, or -1
+    int64_t (*trim)(void* fs_priv);
+    // Optional: make the file's written data and metadata durable; 0 or -1
+    int (*fsync)(vfs_node_t* node);
 } vfs_fs_ops_t;
 
 struct vfs_node {
@@ -33,11 +40,19 @@ int vfs_umount(const char* mount_name);
 
 vfs_node_t* vfs_open(const char* path);
 int vfs_read(vfs_node_t* n, uint64_t off, void* buf, uint64_t len);
+// Direct pointer to [off, off+len) of a file on a memory-backed device, or
+// NULL; valid until the file or device is written
+const void* vfs_map(vfs_node_t* n, uint64_t off, uint64_t len);
 int vfs_readdir(vfs_node_t* n, uint32_t idx, char* name, uint32_t maxlen);
 int vfs_stat(const char* path, uint64_t* size, int* is_dir);
 int vfs_write(vfs_node_t* n, uint64_t off, const void* buf, uint64_t len);
+// Make earlier writes to n durable; 0 when the filesystem keeps nothing cached
+int vfs_fsync(vfs_node_t* n);
 int vfs_create(const char* path, uint64_t size_hint);
 int vfs_unlink(const char* path);
+// Discard the free space of a mount; bytes discarded, or -1 when the mount,
+// its filesystem or its device can't
+int64_t vfs_trim(const char* mount_name);
 
 // Utility for shell
 void vfs_list_mounts(void);
@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+# Boot headless, run the in-kernel 'bench' suite over serial and compare the
+# key=value results with a stored baseline.
+#
+#   tests/bench.sh                     # compare against tests/bench-baseline.txt
+#   UPDATE_BASELINE=1 tests/bench.sh   # (re)record the baseline from this run
+#
+# A metric regresses when it is worse than the baseline by more than its
+# tolerance: *_mbps / *_bpkc / *_iops must not drop, *_cyc must not grow. The default
+# tolerance is BENCH_TOLERANCE percent (25); a baseline line may override it
+# with a trailing "tol=N". Other keys (tsc_khz, mem_variant) are informational.
+# Timings under TCG are noisy; use KVM=1 where available.
+set -euo pipefail
+cd "$(dirname "$0")/.."
+
+BASELINE=${BASELINE:-tests/bench-baseline.txt}
+TOLERANCE=${BENCH_TOLERANCE:-25}
+QEMU_SCRIPT=${QEMU_SCRIPT:-./scripts/run_qemu.sh}
+BOOT_TIMEOUT_S=${BOOT_TIMEOUT_S:-60}
+BENCH_TIMEOUT_S=${BENCH_TIMEOUT_S:-180}
+BENCH_GROUP=${BENCH_GROUP:-}
+
+./scripts/build.sh >/dev/null
+./scripts/make_iso.sh >/dev/null
+
+mkdir -p build
+LOG=build/bench-serial.log
+RESULTS=build/bench-results.txt
+FIFO=$(mktemp -u)
+mkfifo "${FIFO}"
+rm -f "${LOG}" "${RESULTS}"
+QPID=
+cleanup() {
+  [[ -n "${QPID}" ]] && kill "${QPID}" 2>/dev/null || true
+  exec 3>&- 2>/dev/null || true
+  rm -f "${FIFO}"
+}
+trap cleanup EXIT
+
+# QEMU's serial port is on stdio; the FIFO stays open on fd 3 so commands can be typed later
+env HEADLESS=1 NO_REBOOT=1 SERIAL_LOG="${LOG}" "${QEMU_SCRIPT}" <"${FIFO}" >/dev/null 2>&1 &
+QPID=$!
+exec 3>"${FIFO}"
+
+wait_for() {
+  local pattern=$1 timeout_s=$2
+  for ((i = 0; i < timeout_s; ++i)); do
+    if [[ -f "${LOG}" ]] && grep -Fq "${pattern}" "${LOG}"; then return 0; fi
+    sleep 1
+  done
+  echo "[FAIL] timed out after ${timeout_s}s waiting for '${pattern}' (log: ${LOG})" >&2
+  return 1
+}
+
+echo "[INFO] Booting headless via ${QEMU_SCRIPT}"
+wait_for "Entering shell. Type 'help'." "${BOOT_TIMEOUT_S}"
+echo "[INFO] Running 'bench ${BENCH_GROUP}'"
+printf 'bench %s\n' "${BENCH_GROUP}" >&3
+wait_for "bench-end" "${BENCH_TIMEOUT_S}"
+
+sed -n '/bench-begin/,/bench-end/p' "${LOG}" | tr -d '\r' | grep -E '^[a-z0-9_]+=' > "${RESULTS}"
+echo "[INFO] Results in ${RESULTS}:"
+cat "${RESULTS}"
+
+if [[ "${UPDATE_BASELINE:-0}" == "1" || ! -f "${BASELINE}" ]]; then
+  cp "${RESULTS}" "${BASELINE}"
+  echo "[OK] Baseline recorded in ${BASELINE}"
+  exit 0
+fi
+
+awk -v tol_default="${TOLERANCE}" '
+  FNR == NR {
+    split($1, kv, "="); base[kv[1]] = kv[2]; tol[kv[1]] = tol_default + 0
+    for (i = 2; i <= NF; ++i) if ($i ~ /^tol=/) tol[kv[1]] = substr($i, 5) + 0
+    order[++n] = kv[1]
+    next
+  }
+  { split($1, kv, "="); cur[kv[1]] = kv[2] }
+  END {
+    fail = 0
+    printf "%-24s %12s %12s %8s\n", "metric", "baseline", "current", "delta"
+    for (i = 1; i <= n; ++i) {
+      k = order[i]
+      higher = (k ~ /_(mbps|bpkc|iops)$/); lower = (k ~ /_cyc$/)
+      if (!higher && !lower) continue
+      if (!(k in cur)) { printf "%-24s %12s %12s  MISSING\n", k, base[k], "-"; fail = 1; continue }
+      b = base[k] + 0; c = cur[k] + 0
+      d = (b > 0) ? (c - b) * 100.0 / b : 0
+      bad = (higher && d < -tol[k]) || (lower && d > tol[k])
+      printf "%-24s %12s %12s %+7.1f%%%s\n", k, base[k], cur[k], d, bad ? "  REGRESSION" : ""
+      if (bad) fail = 1
+    }
+    exit fail
+  }' "${BASELINE}" "${RESULTS}" && { echo "[OK] No regressions against ${BASELINE}"; exit 0; }
+
+echo "[FAIL] Benchmark regression against ${BASELINE} (tolerance ${TOLERANCE}%)" >&2
+exit 1
@@ -0,0 +1,56 @@
+// Host benchmark runner: host_bench [--min-time=SECONDS] [--filter=SUBSTRING]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "host_shim.h"
+
+void bench_begin(bench_state_t* st) { st->t0 = host_now_ns(); }
+void bench_end(bench_state_t* st) { st->elapsed_ns = host_now_ns() - st->t0; }
+
+static void run_one(const bench_def_t* b, double min_time) {
+    uint64_t target = (uint64_t)(min_time * 1e9);
+    bench_state_t st;
+    uint64_t iters = 1;
+    for (;;) {
+        memset(&st, 0, sizeof(st));
+        st.iterations = iters; st.arg = b->arg;
+        b->fn(&st);
+        if (st.elapsed_ns >= target || iters >= (1ull << 32)) break;
+        // Same growth rule as Google Benchmark: aim 40% past the target, at most 10x per step
+        double mult = st.elapsed_ns ? (double)target * 1.4 / (double)st.elapsed_ns : 10.0;
+        if (mult > 10.0) mult = 10.0;
+        uint64_t next = (uint64_t)((double)iters * mult);
+        iters = next > iters ? next : iters + 1;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%lld", b->name, (long long)b->arg);
+    double ns = (double)st.elapsed_ns / (double)st.iterations;
+    printf("%-32s %12.1f ns %12llu", name, ns, (unsigned long long)st.iterations);
+    if (st.bytes_per_iter) {
+        double mbs = (double)st.bytes_per_iter * (double)st.iterations / ((double)st.elapsed_ns / 1e9) / (1024.0 * 1024.0);
+        printf(" %10.1f MiB/s", mbs);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    double min_time = 0.2;
+    const char* filter = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--min-time=", 11) == 0) min_time = atof(argv[i] + 11);
+        else if (strncmp(argv[i], "--filter=", 9) == 0) filter = argv[i] + 9;
+        else { fprintf(stderr, "usage: %s [--min-time=SECONDS] [--filter=SUBSTRING]\n", argv[0]); return 2; }
+    }
+    host_kernel_init();
+    printf("%-32s %15s %12s %16s\n", "Benchmark", "Time", "Iterations", "Throughput");
+    printf("------------------------------------------------------------------------------\n");
+    const bench_def_t* tables[] = { g_bench_alloc, g_bench_block, g_bench_fs };
+    for (unsigned t = 0; t < sizeof(tables) / sizeof(tables[0]); ++t) {
+        for (const bench_def_t* b = tables[t]; b->name; ++b) {
+            if (filter && !strstr(b->name, filter)) continue;
+            run_one(b, min_time);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+// Tiny Google-Benchmark-style runner for the host build. A benchmark does
+// its setup, brackets the measured loop with bench_begin()/bench_end() and
+// runs the body st->iterations times; the runner grows the iteration count
+// until the loop takes at least --min-time seconds.
+
+typedef struct {
+    uint64_t iterations;
+    int64_t arg;                // per-registration parameter (size, count...)
+    uint64_t bytes_per_iter;    // set by the benchmark for throughput output
+    uint64_t t0, elapsed_ns;
+} bench_state_t;
+
+typedef void (*bench_fn)(bench_state_t* st);
+
+typedef struct {
+    const char* name;
+    bench_fn fn;
+    int64_t arg;
+} bench_def_t;
+
+void bench_begin(bench_state_t* st);
+void bench_end(bench_state_t* st);
+
+// Benchmark tables, each terminated by an entry with name == NULL
+extern const bench_def_t g_bench_alloc[];
+extern const bench_def_t g_bench_block[];
+extern const bench_def_t g_bench_fs[];
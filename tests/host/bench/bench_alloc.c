@@ -0,0 +1,69 @@
+// Allocator microbenchmarks: PMM frame runs and kmalloc/kfree
+#include <stddef.h>
+#include "bench.h"
+#include "kernel/mm/pmm.h"
+#include "kernel/mm/kmalloc.h"
+
+static void bm_pmm_alloc_free(bench_state_t* st) {
+    size_t n = (size_t)st->arg;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        uint64_t p = pmm_alloc_frames(n);
+        pmm_free_frames(p, n);
+    }
+    bench_end(st);
+}
+
+// Allocate below a limit after fragmenting the low range with single frames
+static void bm_pmm_alloc_fragmented(bench_state_t* st) {
+    enum { HOLES = 512 };
+    static uint64_t frames[HOLES * 2];
+    for (int i = 0; i < HOLES * 2; ++i) frames[i] = pmm_alloc_frames(1);
+    for (int i = 0; i < HOLES * 2; i += 2) pmm_free_frames(frames[i], 1);
+    size_t n = (size_t)st->arg;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        uint64_t p = pmm_alloc_frames(n);
+        pmm_free_frames(p, n);
+    }
+    bench_end(st);
+    for (int i = 1; i < HOLES * 2; i += 2) pmm_free_frames(frames[i], 1);
+}
+
+static void bm_kmalloc_free(bench_state_t* st) {
+    size_t sz = (size_t)st->arg;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        void* p = kmalloc(sz);
+        kfree(p);
+    }
+    bench_end(st);
+}
+
+// First-fit cost with many live blocks ahead of the free space
+static void bm_kmalloc_fragmented(bench_state_t* st) {
+    enum { LIVE = 1024 };
+    static void* live[LIVE];
+    for (int i = 0; i < LIVE; ++i) live[i] = kmalloc(64 + (i % 7) * 16);
+    for (int i = 0; i < LIVE; i += 2) { kfree(live[i]); live[i] = NULL; }
+    size_t sz = (size_t)st->arg;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        void* p = kmalloc(sz);
+        kfree(p);
+    }
+    bench_end(st);
+    for (int i = 0; i < LIVE; ++i) kfree(live[i]);
+}
+
+const bench_def_t g_bench_alloc[] = {
+    { "pmm_alloc_free", bm_pmm_alloc_free, 1 },
+    { "pmm_alloc_free", bm_pmm_alloc_free, 16 },
+    { "pmm_alloc_free", bm_pmm_alloc_free, 256 },
+    { "pmm_alloc_fragmented", bm_pmm_alloc_fragmented, 2 },
+    { "kmalloc_free", bm_kmalloc_free, 32 },
+    { "kmalloc_free", bm_kmalloc_free, 512 },
+    { "kmalloc_free", bm_kmalloc_free, 4096 },
+    { "kmalloc_fragmented", bm_kmalloc_fragmented, 256 },
+    { NULL, NULL, 0 },
+};
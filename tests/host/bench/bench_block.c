@@ -0,0 +1,130 @@
+// Block layer throughput: ramdisk (512-byte and 4 KiB sectors), MBR partition, XTS-AES crypt and CRC32C integrity read/write paths
+#include <stdint.h>
+#include <string.h>
+#include "bench.h"
+#include "kernel64/block/block.h"
+#include "kernel64/block/bcache.h"
+#include "kernel64/block/crypt.h"
+#include "kernel64/block/integ.h"
+#include "kernel64/cpufeature.h"
+#include "kernel64/lib/aes.h"
+#include "kernel64/lib/crc32c.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec);
+
+#define BENCH_DISK_BYTES (8u << 20)
+
+static uint8_t g_buf[1 << 20];
+
+static block_device_t* bench_disk(void) {
+    block_device_t* d = block_find("bram");
+    if (d) return d;
+    if (ramdisk_create("bram", BENCH_DISK_BYTES) != 0) return NULL;
+    d = block_find("bram");
+    // One partition covering the disk after LBA 2048
+    uint8_t mbr[512];
+    memset(mbr, 0, sizeof(mbr));
+    uint32_t start = 2048, count = (uint32_t)d->sector_count - start;
+    mbr[446 + 4] = 0x07;
+    memcpy(&mbr[446 + 8], &start, 4);
+    memcpy(&mbr[446 + 12], &count, 4);
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+    d->ops->write(d, 0, mbr, 1);
+    block_scan_partitions();
+    return d;
+}
+
+enum { RW_READ, RW_WRITE, RW_QUEUED, RW_CACHED };
+
+// Sequential requests of st->arg bytes, wrapping over the device; cached
+// reads wrap over a 256 KiB window that stays resident in the buffer cache
+static void run_rw(bench_state_t* st, block_device_t* d, int mode) {
+    uint32_t secs = (uint32_t)(st->arg / d->sector_size);
+    uint64_t span = mode == RW_CACHED ? (256u << 10) / d->sector_size : d->sector_count;
+    uint64_t lba = 0;
+    st->bytes_per_iter = (uint64_t)st->arg;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        if (lba + secs > span) lba = 0;
+        if (mode == RW_WRITE) d->ops->write(d, lba, g_buf, secs);
+        else if (mode == RW_QUEUED) block_read(d, lba, g_buf, secs);
+        else if (mode == RW_CACHED) bcache_read(d, lba, g_buf, secs);
+        else d->ops->read(d, lba, g_buf, secs);
+        lba += secs;
+    }
+    bench_end(st);
+}
+
+static block_device_t* bench_disk4k(void) {
+    block_device_t* d = block_find("bram4k");
+    if (!d && ramdisk_create_sec("bram4k", BENCH_DISK_BYTES, 4096) == 0) d = block_find("bram4k");
+    return d;
+}
+
+static void bm_ramdisk_read(bench_state_t* st) { run_rw(st, bench_disk(), RW_READ); }
+static void bm_ramdisk4k_read(bench_state_t* st) { run_rw(st, bench_disk4k(), RW_READ); }
+static void bm_queued4k_read(bench_state_t* st) { run_rw(st, bench_disk4k(), RW_QUEUED); }
+static void bm_ramdisk_write(bench_state_t* st) { run_rw(st, bench_disk(), RW_WRITE); }
+static void bm_partition_read(bench_state_t* st) { bench_disk(); run_rw(st, block_find("bramp1"), RW_READ); }
+static void bm_queued_read(bench_state_t* st) { run_rw(st, bench_disk(), RW_QUEUED); }
+static void bm_bcache_read(bench_state_t* st) { run_rw(st, bench_disk(), RW_CACHED); }
+
+// XTS-AES-256 over the ramdisk; hw picks AES-NI (when the host has it) or
+// the portable tables
+static block_device_t* bench_crypt(int hw) {
+    if (__builtin_cpu_supports("aes")) g_cpu_caps |= (1u << X86_FEATURE_AES) | (1u << X86_FEATURE_SSE2);
+    aes_use_hw(hw);
+    block_device_t* d = block_find("bcrypt");
+    if (d || !bench_disk()) return d;
+    uint8_t key[64];
+    for (int i = 0; i < 64; ++i) key[i] = (uint8_t)(i * 37 + 1);
+    if (crypt_create("bcrypt", "bram", key, sizeof(key)) != 0) return NULL;
+    return block_find("bcrypt");
+}
+
+static void bm_crypt_read(bench_state_t* st) { run_rw(st, bench_crypt(1), RW_READ); }
+static void bm_crypt_write(bench_state_t* st) { run_rw(st, bench_crypt(1), RW_WRITE); }
+static void bm_crypt_soft_read(bench_state_t* st) { run_rw(st, bench_crypt(0), RW_READ); }
+static void bm_crypt_soft_write(bench_state_t* st) { run_rw(st, bench_crypt(0), RW_WRITE); }
+
+// Integrity device on its own ramdisk; hw picks SSE4.2 crc32 or the tables
+static block_device_t* bench_integ(int hw) {
+    if (__builtin_cpu_supports("sse4.2")) g_cpu_caps |= 1u << X86_FEATURE_SSE42;
+    crc32c_use_hw(hw);
+    block_device_t* d = block_find("binteg");
+    if (d) return d;
+    if (ramdisk_create("bram2", BENCH_DISK_BYTES) != 0 || integ_create("binteg", "bram2") != 0) return NULL;
+    return block_find("binteg");
+}
+
+static void bm_integ_read(bench_state_t* st) { run_rw(st, bench_integ(1), RW_READ); }
+static void bm_integ_write(bench_state_t* st) { run_rw(st, bench_integ(1), RW_WRITE); }
+static void bm_integ_soft_read(bench_state_t* st) { run_rw(st, bench_integ(0), RW_READ); }
+
+const bench_def_t g_bench_block[] = {
+    { "ramdisk_read", bm_ramdisk_read, 512 },
+    { "ramdisk_read", bm_ramdisk_read, 4096 },
+    { "ramdisk_read", bm_ramdisk_read, 65536 },
+    { "ramdisk_write", bm_ramdisk_write, 512 },
+    { "ramdisk_write", bm_ramdisk_write, 4096 },
+    { "ramdisk_write", bm_ramdisk_write, 65536 },
+    { "ramdisk4k_read", bm_ramdisk4k_read, 4096 },
+    { "ramdisk4k_read", bm_ramdisk4k_read, 65536 },
+    { "partition_read", bm_partition_read, 4096 },
+    { "queued_read", bm_queued_read, 512 },
+    { "queued_read", bm_queued_read, 4096 },
+    { "queued4k_read", bm_queued4k_read, 4096 },
+    { "bcache_read", bm_bcache_read, 512 },
+    { "bcache_read", bm_bcache_read, 4096 },
+    { "crypt_read", bm_crypt_read, 4096 },
+    { "crypt_read", bm_crypt_read, 65536 },
+    { "crypt_write", bm_crypt_write, 65536 },
+    { "crypt_soft_read", bm_crypt_soft_read, 65536 },
+    { "crypt_soft_write", bm_crypt_soft_write, 65536 },
+    { "integ_read", bm_integ_read, 4096 },
+    { "integ_read", bm_integ_read, 65536 },
+    { "integ_write", bm_integ_write, 65536 },
+    { "integ_soft_read", bm_integ_soft_read, 65536 },
+    { NULL, NULL, 0 },
+};
@@ -0,0 +1,71 @@
+// Filesystem throughput: exFAT on a ramdisk through the VFS
+#include <stdint.h>
+#include <string.h>
+#include "bench.h"
+#include "kernel64/block/block.h"
+#include "kernel64/vfs/vfs.h"
+#include "kernel64/fs/exfat.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+void exfat_register(void);
+
+#define BENCH_FILE_BYTES (1u << 20)
+
+static uint8_t g_buf[1 << 16];
+
+static int fs_setup(void) {
+    static int ready = 0;
+    if (ready) return ready > 0;
+    ready = -1;
+    exfat_register();
+    if (ramdisk_create("fram", 16u << 20) != 0) return 0;
+    if (exfat_format_device("fram", "BENCH") != 0) return 0;
+    if (vfs_mount("exfat", "bfs", "fram") != 0) return 0;
+    // Preallocate the file used by the read and overwrite benchmarks
+    if (vfs_create("bfs:/data", 0) != 0) return 0;
+    vfs_node_t* n = vfs_open("bfs:/data");
+    if (!n) return 0;
+    for (uint32_t off = 0; off < BENCH_FILE_BYTES; off += sizeof(g_buf))
+        if (vfs_write(n, off, g_buf, sizeof(g_buf)) != (int)sizeof(g_buf)) return 0;
+    ready = 1;
+    return 1;
+}
+
+static void run_file(bench_state_t* st, int write) {
+    if (!fs_setup()) return;
+    vfs_node_t* n = vfs_open("bfs:/data");
+    uint64_t len = (uint64_t)st->arg, off = 0;
+    st->bytes_per_iter = len;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        if (off + len > BENCH_FILE_BYTES) off = 0;
+        if (write) vfs_write(n, off, g_buf, len); else vfs_read(n, off, g_buf, len);
+        off += len;
+    }
+    bench_end(st);
+}
+
+static void bm_exfat_read(bench_state_t* st) { run_file(st, 0); }
+static void bm_exfat_write(bench_state_t* st) { run_file(st, 1); }
+
+// Metadata path: create a small file, write it and unlink it
+static void bm_exfat_create_unlink(bench_state_t* st) {
+    if (!fs_setup()) return;
+    bench_begin(st);
+    for (uint64_t i = 0; i < st->iterations; ++i) {
+        vfs_create("bfs:/tmp", 0);
+        vfs_node_t* n = vfs_open("bfs:/tmp");
+        if (n) vfs_write(n, 0, g_buf, (uint64_t)st->arg);
+        vfs_unlink("bfs:/tmp");
+    }
+    bench_end(st);
+}
+
+const bench_def_t g_bench_fs[] = {
+    { "exfat_read", bm_exfat_read, 4096 },
+    { "exfat_read", bm_exfat_read, 65536 },
+    { "exfat_write", bm_exfat_write, 4096 },
+    { "exfat_write", bm_exfat_write, 65536 },
+    { "exfat_create_unlink", bm_exfat_create_unlink, 512 },
+    { NULL, NULL, 0 },
+};
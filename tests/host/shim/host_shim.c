@@ -0,0 +1,65 @@
+// Host shim: serial/console output, fake physical memory and heap
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "host_shim.h"
+#include "kernel64/mb2.h"
+#include "kernel/mm/pmm.h"
+#include "kernel/mm/kmalloc.h"
+
+// Kernel log output is dropped unless DEXOS_HOST_VERBOSE is set
+static int g_verbose = -1;
+static int verbose(void) {
+    if (g_verbose < 0) g_verbose = getenv("DEXOS_HOST_VERBOSE") != NULL;
+    return g_verbose;
+}
+
+void serial_putc(char c) { if (verbose()) fputc(c, stderr); }
+void console_putc(char c) { if (verbose()) fputc(c, stderr); }
+void console_write(const char* s) { if (verbose()) fputs(s, stderr); }
+void console_write_hex64(uint64_t v) { if (verbose()) fprintf(stderr, "0x%016llX", (unsigned long long)v); }
+void console_write_dec(uint64_t v) { if (verbose()) fprintf(stderr, "%llu", (unsigned long long)v); }
+
+// Single-threaded host: there is never another thread to yield to
+void sched_yield(void) {}
+// so a spawned thread runs to completion before sched_create returns
+int sched_create(void (*entry)(void*), void* arg) { entry(arg); return 0; }
+
+// cpufeature.c touches CR0/CR4; tests set the feature bits they exercise
+uint32_t g_cpu_caps;
+
+static uint8_t g_heap[8u << 20] __attribute__((aligned(16)));
+
+void host_kernel_init(void) {
+    void* want = (void*)(uintptr_t)HOST_PHYS_BASE;
+    void* p = mmap(want, HOST_PHYS_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != want) {
+        fprintf(stderr, "host_kernel_init: cannot map fake RAM at %p (got %p)\n", want, p);
+        exit(2);
+    }
+    // Multiboot2 info: header, one mmap tag with a single available entry, end tag
+    static uint8_t info[64] __attribute__((aligned(8)));
+    memset(info, 0, sizeof(info));
+    mb2_tag_mmap_hdr* mm = (mb2_tag_mmap_hdr*)(info + 8);
+    mm->tag.type = MB2_TAG_MMAP;
+    mm->tag.size = sizeof(mb2_tag_mmap_hdr) + sizeof(mb2_mmap_entry);
+    mm->entry_size = sizeof(mb2_mmap_entry);
+    mb2_mmap_entry* e = (mb2_mmap_entry*)(mm + 1);
+    e->base_addr = HOST_PHYS_BASE;
+    e->length = HOST_PHYS_BYTES;
+    e->type = 1;
+    mb2_tag* end = (mb2_tag*)(info + 8 + ((mm->tag.size + 7) & ~7u));
+    end->type = MB2_TAG_END;
+    end->size = 8;
+    *(uint32_t*)info = (uint32_t)((uint8_t*)(end + 1) - info);
+    pmm_init(info, 0);
+    kmalloc_init(g_heap, sizeof(g_heap));
+}
+
+uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Userspace stand-ins for the kernel environment used by tests/host.
+// The kernel code treats physical addresses as pointers (identity map), so
+// "physical RAM" is an anonymous mapping placed at a fixed low address.
+
+#define HOST_PHYS_BASE  0x10000000ULL   // 256 MiB: below the ramdisk 1 GiB limit
+#define HOST_PHYS_BYTES (64ULL << 20)
+
+// Map fake physical memory, hand it to pmm_init() through a Multiboot2 mmap
+// tag and initialize the kmalloc heap. Call once at the start of main().
+void host_kernel_init(void);
+// Monotonic clock in nanoseconds
+uint64_t host_now_ns(void);
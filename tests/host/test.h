@@ -0,0 +1,24 @@
+#pragma once
+#include <stdio.h>
+
+// Minimal assertion helpers for host tests: failures are counted, reported
+// with file:line, and turned into a non-zero exit status.
+
+static int g_test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); ++g_test_failures; } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long va_ = (long long)(a), vb_ = (long long)(b); \
+    if (va_ != vb_) { fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (%lld vs %lld)\n", \
+                              __FILE__, __LINE__, #a, #b, va_, vb_); ++g_test_failures; } \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+    int before_ = g_test_failures; fn(); \
+    printf("[%s] %s\n", g_test_failures == before_ ? " OK " : "FAIL", #fn); \
+} while (0)
+
+#define TEST_RESULT() (g_test_failures ? 1 : 0)
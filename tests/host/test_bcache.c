@@ -0,0 +1,213 @@
+// Block buffer cache: hits, write-back, eviction, bypass, discard and partition aliasing
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel64/block/block.h"
+#include "kernel64/block/bcache.h"
+
+// Memory-backed device that counts the requests reaching it
+#define CDEV_SECTORS 1024
+static uint8_t g_img[CDEV_SECTORS * 512];
+static int g_reads, g_writes;
+
+static int cdev_read(block_device_t* d, uint64_t lba, void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    g_reads++;
+    memcpy(buf, g_img + lba * 512, (size_t)n * 512);
+    return (int)n;
+}
+static int cdev_write(block_device_t* d, uint64_t lba, const void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    g_writes++;
+    memcpy(g_img + lba * 512, buf, (size_t)n * 512);
+    return (int)n;
+}
+
+static const void* cdev_map(block_device_t* d, uint64_t lba, uint32_t n) {
+    if (lba + n > d->sector_count) return NULL;
+    return g_img + lba * 512;
+}
+
+static int g_discards;
+static int cdev_discard(block_device_t* d, uint64_t lba, uint64_t n) {
+    if (lba + n > d->sector_count) return -1;
+    g_discards++;
+    memset(g_img + lba * 512, 0, (size_t)n * 512);
+    return 0;
+}
+
+static block_ops_t g_cops;
+static block_device_t g_cdev;
+
+static block_device_t* cdev(void) {
+    if (!g_cdev.ops) {
+        g_cops.read = cdev_read; g_cops.write = cdev_write; g_cops.map = cdev_map;
+        g_cops.discard = cdev_discard;
+        strcpy(g_cdev.name, "cdev");
+        g_cdev.sector_size = 512; g_cdev.sector_count = CDEV_SECTORS; g_cdev.ops = &g_cops;
+        for (int s = 0; s < CDEV_SECTORS; ++s) g_img[s * 512] = (uint8_t)s;
+        block_register(&g_cdev);
+    }
+    return &g_cdev;
+}
+
+static void test_read_hits(void) {
+    block_device_t* d = cdev();
+    bcache_stats_t a, b;
+    bcache_get_stats(&a);
+    uint8_t buf[512];
+    g_reads = 0;
+    CHECK_EQ(bcache_read(d, 9, buf, 1), 1);
+    CHECK_EQ(buf[0], 9);
+    CHECK_EQ(g_reads, 1);
+    // The miss filled the whole 4 KiB block (LBA 8..15)
+    for (int s = 8; s < 16; ++s) { CHECK_EQ(bcache_read(d, s, buf, 1), 1); CHECK_EQ(buf[0], s); }
+    CHECK_EQ(g_reads, 1);
+    bcache_get_stats(&b);
+    CHECK_EQ(b.misses - a.misses, 1);
+    CHECK_EQ(b.hits - a.hits, 8);
+    CHECK_EQ(bcache_read(d, CDEV_SECTORS - 1, buf, 2), -1);
+}
+
+static void test_write_back(void) {
+    block_device_t* d = cdev();
+    uint8_t buf[1024];
+    memset(buf, 0x5A, sizeof(buf));
+    g_writes = 0; g_reads = 0;
+    CHECK_EQ(bcache_write(d, 100, buf, 2), 2);
+    CHECK_EQ(g_writes, 0);
+    CHECK_EQ(g_reads, 0);                  // full-sector writes need no read-fill
+    CHECK(g_img[100 * 512] != 0x5A);
+    memset(buf, 0, sizeof(buf));
+    CHECK_EQ(bcache_read(d, 100, buf, 2), 2);
+    CHECK_EQ(buf[0], 0x5A); CHECK_EQ(buf[1023], 0x5A);
+    bcache_stats_t st; bcache_get_stats(&st);
+    CHECK(st.dirty >= 1);
+    CHECK_EQ(bcache_sync(d), 0);
+    CHECK_EQ(g_writes, 1);                 // one request for the dirty run
+    CHECK_EQ(g_img[100 * 512], 0x5A);
+    CHECK_EQ(g_img[101 * 512 + 511], 0x5A);
+    bcache_get_stats(&st);
+    CHECK_EQ(st.dirty, 0);
+}
+
+static void test_get_put(void) {
+    block_device_t* d = cdev();
+    bcache_buf_t* b = NULL;
+    uint8_t* p = (uint8_t*)bcache_get(d, 200, &b);
+    CHECK(p != NULL && b != NULL);
+    if (!p) return;
+    CHECK_EQ(p[0], 200);
+    p[1] = 0xEE;
+    bcache_put(b, p, 1);
+    CHECK_EQ(bcache_sync(NULL), 0);
+    CHECK_EQ(g_img[200 * 512 + 1], 0xEE);
+    CHECK(bcache_get(d, CDEV_SECTORS, &b) == NULL);
+}
+
+static void test_eviction_and_budget(void) {
+    block_device_t* d = cdev();
+    bcache_set_budget(4 * BCACHE_BLOCK_SIZE);
+    bcache_stats_t a, b;
+    bcache_get_stats(&a);
+    CHECK(a.buffers <= 4);
+    uint8_t buf[512];
+    memset(buf, 0x11, sizeof(buf));
+    CHECK_EQ(bcache_write(d, 300, buf, 1), 1);     // dirty, then pushed out
+    for (int blk = 0; blk < 8; ++blk) CHECK_EQ(bcache_read(d, 512 + blk * 8, buf, 1), 1);
+    bcache_get_stats(&b);
+    CHECK(b.buffers <= 4);
+    CHECK(b.evictions - a.evictions >= 4);
+    CHECK_EQ(g_img[300 * 512], 0x11);              // written back on eviction
+    bcache_set_budget(BCACHE_DEFAULT_BUDGET);
+}
+
+static void test_bypass_coherent(void) {
+    block_device_t* d = cdev();
+    static uint8_t big[BCACHE_BYPASS_SECTORS * 512];
+    uint8_t one[512];
+    memset(one, 0x77, sizeof(one));
+    CHECK_EQ(bcache_write(d, 400, one, 1), 1);     // dirty in cache
+    bcache_stats_t a, b;
+    bcache_get_stats(&a);
+    CHECK_EQ(bcache_read(d, 384, big, BCACHE_BYPASS_SECTORS), (int)BCACHE_BYPASS_SECTORS);
+    CHECK_EQ(big[16 * 512], 0x77);                 // dirty overlap written first
+    memset(big, 0x33, sizeof(big));
+    CHECK_EQ(bcache_write(d, 384, big, BCACHE_BYPASS_SECTORS), (int)BCACHE_BYPASS_SECTORS);
+    bcache_get_stats(&b);
+    CHECK_EQ(b.bypass - a.bypass, 2);
+    CHECK_EQ(bcache_read(d, 400, one, 1), 1);      // cached copy was updated
+    CHECK_EQ(one[0], 0x33);
+}
+
+static void test_map_coherent(void) {
+    block_device_t* d = cdev();
+    uint8_t one[512];
+    memset(one, 0x5A, sizeof(one));
+    CHECK_EQ(bcache_write(d, 500, one, 1), 1);     // dirty in cache
+    g_reads = 0;
+    const uint8_t* m = (const uint8_t*)bcache_map(d, 496, 8);
+    CHECK(m == g_img + 496 * 512);
+    if (m) CHECK_EQ(m[4 * 512], 0x5A);      // dirty overlap written first
+    CHECK_EQ(g_reads, 0);
+    CHECK(bcache_map(d, CDEV_SECTORS - 1, 2) == NULL);
+}
+
+static void test_discard_drops(void) {
+    block_device_t* d = cdev();
+    uint8_t buf[4 * 512];
+    memset(buf, 0x4D, sizeof(buf));
+    CHECK_EQ(bcache_write(d, 600, buf, 4), 4);     // dirty in cache
+    g_writes = 0;
+    CHECK_EQ(bcache_discard(d, 601, 2), 0);
+    CHECK_EQ(g_discards, 1);
+    CHECK_EQ(g_writes, 0);                          // nothing written back
+    CHECK_EQ(bcache_read(d, 600, buf, 4), 4);      // dropped sectors come from the device
+    CHECK_EQ(buf[0], 0x4D);
+    CHECK_EQ(buf[512], 0); CHECK_EQ(buf[2 * 512 + 9], 0);
+    CHECK_EQ(buf[3 * 512], 0x4D);
+    CHECK_EQ(bcache_sync(d), 0);
+    CHECK_EQ(g_img[600 * 512], 0x4D);
+    CHECK_EQ(g_img[601 * 512], 0);
+    CHECK_EQ(g_img[603 * 512], 0x4D);
+    CHECK_EQ(bcache_discard(d, CDEV_SECTORS - 1, 2), -1);
+}
+
+static void put32(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24); }
+
+static void test_partition_alias(void) {
+    block_device_t* d = cdev();
+    uint8_t mbr[512];
+    memset(mbr, 0, sizeof(mbr));
+    mbr[446 + 4] = 0x07; put32(&mbr[446 + 8], 64); put32(&mbr[446 + 12], 256);
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+    CHECK_EQ(bcache_write(d, 0, mbr, 1), 1);
+    CHECK_EQ(bcache_sync(d), 0);
+    block_scan_partitions();
+    block_device_t* p1 = block_find("cdevp1");
+    CHECK(p1 != NULL);
+    if (!p1) return;
+    uint8_t buf[512];
+    memset(buf, 0xC4, sizeof(buf));
+    CHECK_EQ(bcache_write(p1, 3, buf, 1), 1);
+    memset(buf, 0, sizeof(buf));
+    CHECK_EQ(bcache_read(d, 67, buf, 1), 1);       // same buffer via the parent
+    CHECK_EQ(buf[0], 0xC4);
+    CHECK_EQ(bcache_read(p1, 256, buf, 1), -1);
+    CHECK_EQ(bcache_invalidate(p1), 0);
+    CHECK_EQ(g_img[67 * 512], 0xC4);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_read_hits);
+    RUN_TEST(test_write_back);
+    RUN_TEST(test_get_put);
+    RUN_TEST(test_eviction_and_budget);
+    RUN_TEST(test_bypass_coherent);
+    RUN_TEST(test_map_coherent);
+    RUN_TEST(test_discard_drops);
+    RUN_TEST(test_partition_alias);
+    return TEST_RESULT();
+}
@@ -0,0 +1,929 @@
+// Block layer: ramdisk (contiguous and sparse), memdisk, copy-on-write overlay, RAID0/RAID1, tier cache, MBR and GPT partition devices
+// and the request queue (merging, async submit, discard, flush and FUA)
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel64/block/block.h"
+#include "kernel64/block/overlay.h"
+#include "kernel64/block/raid.h"
+#include "kernel64/block/tier.h"
+#include "kernel64/lib/crc32c.h"
+#include "kernel/mm/pmm.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+int ramdisk_create_sparse(const char* name, uint64_t bytes);
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec);
+int ramdisk_create_sparse_sec(const char* name, uint64_t bytes, uint32_t sec);
+uint64_t ramdisk_resident_bytes(const char* name);
+
+static void test_ramdisk_create(void) {
+    uint64_t before = pmm_free_bytes();
+    CHECK_EQ(ramdisk_create("rdA", 1000), 0);
+    block_device_t* d = block_find("rdA");
+    CHECK(d != NULL);
+    if (!d) return;
+    CHECK_EQ(d->sector_size, 512);
+    CHECK_EQ(d->sector_count, 2);           // rounded up to whole sectors
+    CHECK_EQ(pmm_free_bytes(), before - PMM_FRAME_SIZE);
+    CHECK(block_find("rdB") == NULL);
+    CHECK_EQ(ramdisk_create(NULL, 4096), -1);
+    CHECK_EQ(ramdisk_create("rdZ", 0), -1);
+}
+
+static void test_ramdisk_roundtrip(void) {
+    CHECK_EQ(ramdisk_create("rdB", 1 << 20), 0);
+    block_device_t* d = block_find("rdB");
+    if (!d) { CHECK(d != NULL); return; }
+    uint8_t out[4096], in[4096];
+    for (int i = 0; i < 4096; ++i) out[i] = (uint8_t)(i * 7 + 3);
+    CHECK_EQ(d->ops->write(d, 100, out, 8), 8);
+    memset(in, 0, sizeof(in));
+    CHECK_EQ(d->ops->read(d, 100, in, 8), 8);
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    // Fresh sectors read back as zeros
+    CHECK_EQ(d->ops->read(d, 0, in, 1), 1);
+    for (int i = 0; i < 512; ++i) if (in[i]) { CHECK(!"ramdisk not zeroed"); break; }
+    CHECK_EQ(d->ops->read(d, 0, in, 0), 0);
+    // Requests past the end fail without touching the buffer
+    CHECK_EQ(d->ops->read(d, d->sector_count - 1, in, 2), -1);
+    CHECK_EQ(d->ops->write(d, d->sector_count, out, 1), -1);
+}
+
+static void test_ramdisk_sparse(void) {
+    uint64_t before = pmm_free_bytes();
+    // Far larger than the fake RAM: nothing is allocated up front
+    CHECK_EQ(ramdisk_create_sparse("rdS", 4ULL << 30), 0);
+    block_device_t* d = block_find("rdS");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, (4ULL << 30) / 512);
+    CHECK_EQ(ramdisk_resident_bytes("rdS"), 0);
+    CHECK(before - pmm_free_bytes() < 4096);
+    uint8_t buf[3 * 512], in[3 * 512];
+    memset(in, 0xEE, sizeof(in));
+    CHECK_EQ(d->ops->read(d, 12345, in, 3), 3);
+    for (int i = 0; i < (int)sizeof(in); ++i) if (in[i]) { CHECK(!"hole not zero"); break; }
+    // Zeros written to a hole stay a hole
+    memset(buf, 0, sizeof(buf));
+    CHECK_EQ(d->ops->write(d, 777, buf, 3), 3);
+    CHECK_EQ(ramdisk_resident_bytes("rdS"), 0);
+    // A write straddling two pages near the end allocates the path once
+    for (int i = 0; i < (int)sizeof(buf); ++i) buf[i] = (uint8_t)(i * 7);
+    uint64_t lba = d->sector_count - 9;                    // sector 7 of one page, 0-1 of the last
+    CHECK_EQ(d->ops->write(d, lba, buf, 3), 3);
+    uint64_t res = ramdisk_resident_bytes("rdS");
+    CHECK(res >= 2 * 4096 && res <= 8 * 4096);
+    CHECK_EQ(d->ops->read(d, lba, in, 3), 3);
+    CHECK(memcmp(in, buf, sizeof(buf)) == 0);
+    CHECK_EQ(d->ops->read(d, lba - 1, in, 1), 1);
+    CHECK_EQ(in[0], 0);
+    CHECK_EQ(d->ops->write(d, d->sector_count - 1, buf, 2), -1);
+    // Single-page ranges map in place; holes map zeros
+    const uint8_t* m = (const uint8_t*)block_map(d, d->sector_count - 8, 2);
+    CHECK(m != NULL);
+    if (m) CHECK(memcmp(m, buf + 512, 1024) == 0);
+    m = (const uint8_t*)block_map(d, 8, 8);
+    CHECK(m != NULL);
+    if (m) CHECK_EQ(m[100], 0);
+    CHECK(block_map(d, 4, 8) == NULL);                      // crosses a page
+}
+
+static void test_memdisk_readonly(void) {
+    static uint8_t img[8 * 512];
+    for (int i = 0; i < (int)sizeof(img); ++i) img[i] = (uint8_t)i;
+    CHECK_EQ(memdisk_register("mdRO", img, sizeof(img), 512, 0), 0);
+    CHECK_EQ(memdisk_register("mdBad", img, 1000, 512, 0), -1);   // not sector multiple
+    block_device_t* d = block_find("mdRO");
+    if (!d) { CHECK(d != NULL); return; }
+    uint8_t buf[512];
+    CHECK_EQ(d->ops->read(d, 3, buf, 1), 1);
+    CHECK(memcmp(buf, img + 3 * 512, 512) == 0);
+    CHECK_EQ(d->ops->write(d, 3, buf, 1), -1);
+}
+
+static void put32(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24); }
+
+static void test_mbr_partitions(void) {
+    static uint8_t img[256 * 512];
+    memset(img, 0, sizeof(img));
+    uint8_t* e = &img[446];
+    e[4] = 0x07; put32(&e[8], 16); put32(&e[12], 64);          // p1: LBA 16..79
+    e += 16;
+    e[4] = 0x0C; put32(&e[8], 128); put32(&e[12], 100);        // p2: LBA 128..227
+    img[510] = 0x55; img[511] = 0xAA;
+    for (int s = 0; s < 256; ++s) img[s * 512 + 1] = (uint8_t)s;  // tag each sector
+    CHECK_EQ(memdisk_register("mdp", img, sizeof(img), 512, 1), 0);
+    block_scan_partitions();
+    block_device_t* p1 = block_find("mdpp1");
+    block_device_t* p2 = block_find("mdpp2");
+    CHECK(p1 != NULL && p2 != NULL);
+    CHECK(block_find("mdpp3") == NULL);
+    if (!p1 || !p2) return;
+    CHECK_EQ(p1->sector_count, 64);
+    CHECK_EQ(p2->sector_count, 100);
+    uint8_t buf[2 * 512];
+    CHECK_EQ(p1->ops->read(p1, 0, buf, 2), 2);
+    CHECK_EQ(buf[1], 16); CHECK_EQ(buf[512 + 1], 17);
+    CHECK_EQ(p2->ops->read(p2, 99, buf, 1), 1);
+    CHECK_EQ(buf[1], 227);
+    // Writes land at the parent offset and stay inside the partition
+    memset(buf, 0xAB, 512);
+    CHECK_EQ(p2->ops->write(p2, 1, buf, 1), 1);
+    CHECK_EQ(img[129 * 512 + 7], 0xAB);
+    CHECK(p2->ops->read(p2, 99, buf, 2) < 0);
+}
+
+// 4Kn: the MBR sits in the first 512 bytes of a 4 KiB LBA0 and its fields
+// count 4 KiB sectors
+static void test_4kn_partitions(void) {
+    CHECK_EQ(ramdisk_create_sec("k0", 1u << 20, 1000), -1);
+    CHECK_EQ(ramdisk_create_sec("k0", 1u << 20, 8192), -1);
+    CHECK_EQ(ramdisk_create_sec("k0", (1u << 20) + 1, 4096), 0);
+    CHECK_EQ(ramdisk_create_sparse_sec("k1", 1u << 30, 4096), 0);
+    block_device_t* d = block_find("k0");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_size, 4096);
+    CHECK_EQ(d->sector_count, 257);                  // rounded up to whole sectors
+    CHECK_EQ(block_find("k1")->sector_count, 1u << 18);
+    static uint8_t sec[2 * 4096];
+    memset(sec, 0, 4096);
+    uint8_t* e = &sec[446];
+    e[4] = 0x07; put32(&e[8], 8); put32(&e[12], 200);           // LBA 8..207: 32 KiB in
+    sec[510] = 0x55; sec[511] = 0xAA;
+    CHECK_EQ(block_write(d, 0, sec, 1), 1);
+    memset(sec, 0x4C, 4096);
+    CHECK_EQ(block_write(d, 8, sec, 1), 1);
+    block_scan_partitions();
+    block_device_t* p = block_find("k0p1");
+    if (!p) { CHECK(p != NULL); return; }
+    CHECK_EQ(p->sector_size, 4096);
+    CHECK_EQ(p->sector_count, 200);
+    CHECK_EQ(block_read(p, 0, sec + 4096, 1), 1);
+    CHECK(memcmp(sec, sec + 4096, 4096) == 0);
+    CHECK(block_read(p, 199, sec, 2) < 0);
+}
+
+static void put64(uint8_t* p, uint64_t v) { put32(p, (uint32_t)v); put32(p + 4, (uint32_t)(v >> 32)); }
+
+// 128 entries of 128 bytes after each header, as sgdisk lays it out
+#define GPT_ENTRIES_BYTES (128u * 128u)
+
+static void gpt_header(block_device_t* d, uint64_t my, uint64_t alt, uint64_t ent, const uint8_t* entries) {
+    static uint8_t h[4096];
+    uint32_t ssz = d->sector_size, esecs = GPT_ENTRIES_BYTES / ssz;
+    memset(h, 0, ssz);
+    memcpy(h, "EFI PART", 8);
+    put32(h + 8, 0x00010000); put32(h + 12, 92);
+    put64(h + 24, my); put64(h + 32, alt);
+    put64(h + 40, 2 + esecs); put64(h + 48, d->sector_count - 2 - esecs);
+    put64(h + 72, ent); put32(h + 80, 128); put32(h + 84, 128);
+    put32(h + 88, crc32_ieee(0, entries, GPT_ENTRIES_BYTES));
+    put32(h + 16, crc32_ieee(0, h, 92));
+    CHECK_EQ(block_write(d, my, h, 1), 1);
+    CHECK_EQ(block_write(d, ent, entries, esecs), (int)esecs);
+}
+
+// Protective MBR, primary and backup headers; partitions 1 (unless n1 is 0)
+// and 3 in use
+static void gpt_build(block_device_t* d, uint64_t p1, uint64_t n1, uint64_t p3, uint64_t n3) {
+    static uint8_t mbr[4096], ents[GPT_ENTRIES_BYTES];
+    uint64_t last = d->sector_count - 1;
+    memset(mbr, 0, sizeof(mbr));
+    mbr[446 + 4] = 0xEE; put32(&mbr[446 + 8], 1); put32(&mbr[446 + 12], 0xFFFFFFFFu);
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+    CHECK_EQ(block_write(d, 0, mbr, 1), 1);
+    memset(ents, 0, sizeof(ents));
+    if (n1) { memset(ents, 0xA1, 16); put64(ents + 32, p1); put64(ents + 40, p1 + n1 - 1); }
+    memset(ents + 256, 0xA3, 16); put64(ents + 256 + 32, p3); put64(ents + 256 + 40, p3 + n3 - 1);
+    gpt_header(d, 1, last, 2, ents);
+    gpt_header(d, last, 1, last - GPT_ENTRIES_BYTES / d->sector_size, ents);
+}
+
+static void test_gpt_partitions(void) {
+    CHECK_EQ(ramdisk_create("g0", 2u << 20), 0);
+    block_device_t* d = block_find("g0");
+    if (!d) { CHECK(d != NULL); return; }
+    gpt_build(d, 2048, 1024, 100, 100);
+    block_scan_partitions();
+    const block_ptable_t* t = block_partitions(d);
+    block_device_t* p1 = block_find("g0p1");
+    block_device_t* p3 = block_find("g0p3");
+    if (!t || !p1 || !p3) { CHECK(t && p1 && p3); return; }
+    CHECK_EQ(t->scheme, BLOCK_PT_GPT);
+    CHECK_EQ(t->count, 2);
+    CHECK_EQ(t->gpt_backup, 0);
+    CHECK(block_find("g0p2") == NULL);
+    CHECK_EQ(p1->sector_count, 1024);
+    CHECK_EQ(p3->sector_count, 100);
+    CHECK_EQ(t->part[0].align, 1u << 20);
+    CHECK_EQ(t->part[1].align, 2048);                   // 100 * 512: warned about
+    CHECK_EQ(t->part[1].type_guid[0], 0xA3);
+    // Cached: another scan reads nothing
+    uint64_t reads = d->io[BIO_READ].ops;
+    uint32_t scans = t->scans;
+    block_scan_partitions();
+    CHECK(block_partitions(d) == t);
+    CHECK_EQ(t->scans, scans);
+    CHECK_EQ(d->io[BIO_READ].ops, reads);
+    // Wiping the primary header invalidates the cache; the backup takes over
+    static uint8_t zero[512];
+    CHECK_EQ(block_write(d, 1, zero, 1), 1);
+    CHECK_EQ(t->stale, 1);
+    CHECK(block_partitions(d) == t);
+    CHECK_EQ(t->scans, scans + 1);
+    CHECK_EQ(t->gpt_backup, 1);
+    CHECK_EQ(t->count, 2);
+    CHECK(block_find("g0p1") == p1);
+    // A corrupt backup entry array too: no table, the children go dead
+    CHECK_EQ(block_write(d, d->sector_count - 1 - GPT_ENTRIES_BYTES / 512, zero, 1), 1);
+    block_partitions_invalidate(d);
+    block_scan_partitions();
+    CHECK_EQ(t->count, 0);
+    CHECK_EQ(p1->sector_count, 0);
+    CHECK(block_read(p1, 0, zero, 1) < 0);
+    // Rewritten table: the same devices come back with the new geometry
+    gpt_build(d, 2048, 512, 4000 - 64, 32);
+    CHECK(block_partitions(d) == t);
+    CHECK_EQ(t->count, 2);
+    CHECK(block_find("g0p1") == p1);
+    CHECK_EQ(p1->sector_count, 512);
+    CHECK_EQ(p3->sector_count, 32);
+    // Partition 1 removed: p3 keeps its name and extent, only p1 goes dead
+    static uint8_t mark[512], back[512];
+    memset(mark, 0x3C, sizeof(mark));
+    CHECK_EQ(block_write(p3, 0, mark, 1), 1);
+    gpt_build(d, 0, 0, 4000 - 64, 32);
+    CHECK_EQ(block_partitions(d)->count, 1);
+    CHECK(block_find("g0p3") == p3);
+    CHECK(block_find("g0p1") == p1);
+    CHECK(strcmp(p1->name, "g0p1") == 0 && strcmp(p3->name, "g0p3") == 0);
+    CHECK_EQ(p1->sector_count, 0);
+    CHECK_EQ(p3->sector_count, 32);
+    CHECK_EQ(block_read(p3, 0, back, 1), 1);
+    CHECK(memcmp(mark, back, sizeof(back)) == 0);
+    // ...and comes back as the same device
+    gpt_build(d, 2048, 512, 4000 - 64, 32);
+    CHECK_EQ(block_partitions(d)->count, 2);
+    CHECK(block_find("g0p1") == p1);
+    CHECK_EQ(p1->sector_count, 512);
+    // An entry past the usable range is skipped
+    gpt_build(d, 2048, 512, 4090, 6);
+    CHECK_EQ(block_partitions(d)->count, 1);
+    CHECK_EQ(p3->sector_count, 0);
+}
+
+static void test_gpt_4kn(void) {
+    CHECK_EQ(ramdisk_create_sec("g4", 4u << 20, 4096), 0);
+    block_device_t* d = block_find("g4");
+    if (!d) { CHECK(d != NULL); return; }
+    gpt_build(d, 256, 512, 6, 10);
+    const block_ptable_t* t = block_partitions(d);
+    block_device_t* p1 = block_find("g4p1");
+    if (!t || !p1) { CHECK(t && p1); return; }
+    CHECK_EQ(t->scheme, BLOCK_PT_GPT);
+    CHECK_EQ(t->count, 2);
+    CHECK_EQ(p1->sector_size, 4096);
+    CHECK_EQ(p1->sector_count, 512);
+    CHECK_EQ(t->part[1].align, 8192);
+    static uint8_t sec[4096], back[4096];
+    memset(sec, 0x5A, sizeof(sec));
+    CHECK_EQ(block_write(p1, 3, sec, 1), 1);
+    CHECK_EQ(block_read(d, 259, back, 1), 1);
+    CHECK(memcmp(sec, back, sizeof(sec)) == 0);
+}
+
+static void test_block_map(void) {
+    block_device_t* ro = block_find("mdRO");
+    block_device_t* p2 = block_find("mdpp2");
+    CHECK(ro != NULL && p2 != NULL);
+    if (!ro || !p2) return;
+    const uint8_t* m = (const uint8_t*)block_map(ro, 3, 5);
+    CHECK(m != NULL);
+    uint8_t want[5 * 512];
+    CHECK_EQ(ro->ops->read(ro, 3, want, 5), 5);
+    if (m) CHECK(memcmp(m, want, sizeof(want)) == 0);
+    CHECK(block_map(ro, 3, 6) == NULL);
+    CHECK(block_map(ro, 0, 0) == NULL);
+    // Partitions resolve to the parent's memory
+    m = (const uint8_t*)block_map(p2, 99, 1);
+    CHECK(m != NULL);
+    if (m) CHECK_EQ(m[1], 227);
+    CHECK(block_map(p2, 99, 2) == NULL);
+    CHECK_EQ(ramdisk_create("rdM", 4096), 0);
+    block_device_t* rd = block_find("rdM");
+    uint8_t buf[512];
+    memset(buf, 0x5C, sizeof(buf));
+    CHECK_EQ(rd->ops->write(rd, 7, buf, 1), 1);
+    m = (const uint8_t*)block_map(rd, 7, 1);
+    CHECK(m != NULL);
+    if (m) CHECK_EQ(m[511], 0x5C);
+}
+
+static int g_completions;
+static void count_end_io(bio_t* bio) { g_completions++; *(int*)bio->priv = bio->status; }
+
+static void test_queue_merge(void) {
+    static uint8_t img[64 * 512];
+    CHECK_EQ(memdisk_register("mdq", img, sizeof(img), 512, 1), 0);
+    block_device_t* d = block_find("mdq");
+    if (!d) { CHECK(d != NULL); return; }
+    static uint8_t buf[8 * 512];
+    for (int i = 0; i < (int)sizeof(buf); ++i) buf[i] = (uint8_t)(i / 512 + 1);
+    bio_t bios[4]; int st[4];
+    block_queue_stats_t a = d->queue.stats;
+    g_completions = 0;
+    // Submitted out of order; the queue sorts them into one request
+    int order[4] = { 2, 0, 3, 1 };
+    for (int k = 0; k < 4; ++k) {
+        int i = order[k];
+        bio_init(&bios[i], d, BIO_WRITE, 8 + i * 2, buf + i * 1024, 2);
+        bios[i].end_io = count_end_io; bios[i].priv = &st[i]; st[i] = 99;
+        CHECK_EQ(block_submit(&bios[i]), 0);
+    }
+    CHECK_EQ(d->queue.stats.depth, 4);
+    CHECK_EQ(g_completions, 0);
+    block_unplug(d);
+    CHECK_EQ(g_completions, 4);
+    for (int i = 0; i < 4; ++i) { CHECK(bios[i].done); CHECK_EQ(st[i], 0); }
+    CHECK_EQ(d->queue.stats.dispatched - a.dispatched, 1);
+    CHECK_EQ(d->queue.stats.merged - a.merged, 3);
+    CHECK_EQ(d->queue.stats.max_depth >= 4, 1);
+    CHECK_EQ(img[8 * 512], 1); CHECK_EQ(img[15 * 512 + 511], 8);
+    // Out of range: completes at once with an error
+    bio_t bad; bio_init(&bad, d, BIO_READ, 63, buf, 2);
+    CHECK_EQ(block_submit(&bad), -1);
+    CHECK(bad.done); CHECK_EQ(bad.status, -1);
+}
+
+static void test_queue_ordering(void) {
+    block_device_t* d = block_find("mdq");
+    if (!d) { CHECK(d != NULL); return; }
+    uint8_t w[512], r[4 * 512];
+    memset(w, 0xE1, sizeof(w));
+    bio_t wb, rb;
+    bio_init(&wb, d, BIO_WRITE, 30, w, 1);
+    bio_init(&rb, d, BIO_READ, 28, r, 4);     // lower LBA, but overlaps the write
+    CHECK_EQ(block_submit(&wb), 0);
+    CHECK_EQ(block_submit(&rb), 0);
+    CHECK_EQ(block_wait(&rb), 0);
+    CHECK(wb.done);
+    CHECK_EQ(r[2 * 512], 0xE1);
+    // Sync wrappers go through the same queue
+    CHECK_EQ(block_read(d, 30, r, 1), 1);
+    CHECK_EQ(r[0], 0xE1);
+    CHECK_EQ(block_write(d, 64, w, 1), -1);
+}
+
+static uint64_t hist_sum(const block_io_stats_t* s) {
+    uint64_t n = 0;
+    for (int b = 0; b < BLOCK_LAT_BUCKETS; ++b) n += s->hist[b];
+    return n;
+}
+
+static void test_io_stats(void) {
+    block_device_t* d = block_find("mdp");
+    block_device_t* p1 = block_find("mdpp1");
+    if (!d || !p1) { CHECK(d && p1); return; }
+    block_io_reset(NULL);
+    uint8_t buf[4 * 512];
+    CHECK_EQ(block_read(p1, 0, buf, 4), 4);          // counted on the parent disk
+    CHECK_EQ(block_read(d, 2, buf, 1), 1);
+    CHECK_EQ(block_write(d, 200, buf, 2), 2);
+    const block_io_stats_t* r = &d->io[BIO_READ];
+    const block_io_stats_t* w = &d->io[BIO_WRITE];
+    CHECK_EQ(r->ops, 2); CHECK_EQ(r->sectors, 5); CHECK_EQ(r->errors, 0);
+    CHECK_EQ(w->ops, 1); CHECK_EQ(w->sectors, 2);
+    CHECK_EQ(p1->io[BIO_READ].ops, 0);
+    CHECK_EQ(hist_sum(r), r->ops); CHECK_EQ(hist_sum(w), w->ops);
+    CHECK(r->lat_max <= r->lat_sum);
+    CHECK_EQ(d->queue.stats.inflight, 0);
+    CHECK(d->queue.stats.max_inflight >= 1);
+    // Bios merged into one request count as one op
+    bio_t b[2];
+    bio_init(&b[0], d, BIO_READ, 40, buf, 2);
+    bio_init(&b[1], d, BIO_READ, 42, buf + 1024, 2);
+    CHECK_EQ(block_submit(&b[0]), 0); CHECK_EQ(block_submit(&b[1]), 0);
+    CHECK_EQ(block_wait(&b[1]), 0);
+    CHECK_EQ(r->ops, 3); CHECK_EQ(r->sectors, 9);
+    block_io_reset(d);
+    CHECK_EQ(r->ops, 0); CHECK_EQ(hist_sum(w), 0);
+}
+
+// Device with plain read/write only, to exercise the per-segment fallback
+static uint8_t g_plain_img[32 * 512];
+static int plain_read(block_device_t* d, uint64_t lba, void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    memcpy(buf, g_plain_img + lba * 512, (size_t)n * 512); return (int)n;
+}
+static int plain_write(block_device_t* d, uint64_t lba, const void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    memcpy(g_plain_img + lba * 512, buf, (size_t)n * 512); return (int)n;
+}
+
+static void test_vectored_io(void) {
+    block_device_t* d = block_find("mdq");
+    if (!d) { CHECK(d != NULL); return; }
+    uint8_t a[700], b[324], c[2048];
+    memset(a, 0xA1, sizeof(a)); memset(b, 0xB2, sizeof(b)); memset(c, 0xC3, sizeof(c));
+    block_iovec_t w[3] = { { a, sizeof(a) }, { b, sizeof(b) }, { c, sizeof(c) } };   // 3072 bytes = 6 sectors
+    CHECK_EQ(block_writev(d, 40, w, 3), 6);
+    uint8_t flat[6 * 512];
+    CHECK_EQ(block_read(d, 40, flat, 6), 6);
+    CHECK_EQ(flat[699], 0xA1); CHECK_EQ(flat[700], 0xB2); CHECK_EQ(flat[1023], 0xB2); CHECK_EQ(flat[1024], 0xC3);
+    // Scatter read that drops a partial head and tail
+    uint8_t sink[1024], mid[600];
+    block_iovec_t r[3] = { { sink, 690 - 512 }, { mid, 20 }, { sink, 1024 - 178 - 20 } };
+    CHECK_EQ(block_readv(d, 41, r, 3), 2);
+    CHECK_EQ(mid[0], 0xA1); CHECK_EQ(mid[9], 0xA1); CHECK_EQ(mid[10], 0xB2);
+    block_iovec_t odd = { mid, 100 };
+    CHECK_EQ(block_readv(d, 40, &odd, 1), -1);                      // not whole sectors
+    // Adjacent bios in separate buffers merge into one vectored request
+    static uint8_t s1[512], s2[512];
+    bio_t b1, b2;
+    block_queue_stats_t before = d->queue.stats;
+    bio_init(&b1, d, BIO_READ, 40, s1, 1);
+    bio_init(&b2, d, BIO_READ, 41, s2, 1);
+    block_submit(&b2); block_submit(&b1);
+    CHECK_EQ(block_wait(&b2), 0); CHECK_EQ(block_wait(&b1), 0);
+    CHECK_EQ(d->queue.stats.dispatched - before.dispatched, 1);
+    CHECK_EQ(s1[0], 0xA1); CHECK_EQ(s2[187], 0xA1); CHECK_EQ(s2[188], 0xB2);
+}
+
+static void test_vectored_fallback(void) {
+    static block_ops_t ops;
+    static block_device_t dev;
+    ops.read = plain_read; ops.write = plain_write;
+    strcpy(dev.name, "plain"); dev.sector_size = 512; dev.sector_count = 32; dev.ops = &ops;
+    block_register(&dev);
+    uint8_t a[300], b[724];
+    memset(a, 0x5A, sizeof(a)); memset(b, 0x6B, sizeof(b));
+    block_iovec_t w[2] = { { a, sizeof(a) }, { b, sizeof(b) } };    // sector 0 straddles both
+    CHECK_EQ(block_writev(&dev, 4, w, 2), 2);
+    CHECK_EQ(g_plain_img[4 * 512 + 299], 0x5A); CHECK_EQ(g_plain_img[4 * 512 + 300], 0x6B);
+    CHECK_EQ(g_plain_img[5 * 512 + 511], 0x6B);
+    memset(a, 0, sizeof(a)); memset(b, 0, sizeof(b));
+    CHECK_EQ(block_readv(&dev, 4, w, 2), 2);
+    CHECK_EQ(a[0], 0x5A); CHECK_EQ(b[0], 0x6B); CHECK_EQ(b[723], 0x6B);
+}
+
+// Asynchronous device: two hardware slots, completes one request per poll
+#define ADEV_SLOTS 2
+static uint8_t g_async_img[64 * 512];
+static bio_t* g_slot_rq[ADEV_SLOTS];
+static block_iovec_t g_slot_segs[ADEV_SLOTS][BLOCK_MAX_SEGS];
+static uint32_t g_slot_nseg[ADEV_SLOTS];
+static int g_async_submits;
+
+static int async_rd(block_device_t* d, uint64_t lba, void* buf, uint32_t n) { (void)d; (void)lba; (void)buf; (void)n; return -1; }
+static int async_wr(block_device_t* d, uint64_t lba, const void* buf, uint32_t n) { (void)d; (void)lba; (void)buf; (void)n; return -1; }
+static int async_submit(block_device_t* d, bio_t* rq, const block_iovec_t* segs, uint32_t nseg) {
+    (void)d;
+    for (int i = 0; i < ADEV_SLOTS; ++i) {
+        if (g_slot_rq[i]) continue;
+        g_slot_rq[i] = rq; g_slot_nseg[i] = nseg;
+        memcpy(g_slot_segs[i], segs, nseg * sizeof(*segs));
+        g_async_submits++;
+        return 0;
+    }
+    return BLOCK_BUSY;
+}
+static int async_poll(block_device_t* d) {
+    (void)d;
+    for (int i = 0; i < ADEV_SLOTS; ++i) {
+        bio_t* rq = g_slot_rq[i];
+        if (!rq) continue;
+        g_slot_rq[i] = NULL;
+        uint8_t* p = g_async_img + rq->lba * 512;
+        uint64_t len = (uint64_t)rq->rq_count * 512;
+        if (rq->op == BIO_WRITE) block_iov_to_buf(g_slot_segs[i], g_slot_nseg[i], 0, p, len);
+        else block_iov_from_buf(g_slot_segs[i], g_slot_nseg[i], 0, p, len);
+        block_complete(rq, 0);
+        return 1;
+    }
+    return 0;
+}
+
+static void test_async_submit(void) {
+    static block_ops_t ops;
+    static block_device_t dev;
+    ops.read = async_rd; ops.write = async_wr; ops.submit = async_submit; ops.poll = async_poll;
+    strcpy(dev.name, "async"); dev.sector_size = 512; dev.sector_count = 64; dev.ops = &ops;
+    block_register(&dev);
+    for (int s = 0; s < 64; ++s) g_async_img[s * 512] = (uint8_t)s;
+    // Three separate regions: two fill the slots, the third waits for a completion
+    static uint8_t buf[3][1024];
+    bio_t b[4];
+    bio_init(&b[0], &dev, BIO_READ, 2, buf[0], 1);
+    bio_init(&b[1], &dev, BIO_READ, 3, buf[0] + 512, 1);     // merges with b[0]
+    bio_init(&b[2], &dev, BIO_READ, 20, buf[1], 2);
+    bio_init(&b[3], &dev, BIO_READ, 40, buf[2], 2);
+    for (int i = 0; i < 4; ++i) CHECK_EQ(block_submit(&b[i]), 0);
+    block_unplug(&dev);
+    CHECK_EQ(g_async_submits, 2);
+    CHECK_EQ(dev.queue.stats.inflight, 2);
+    CHECK_EQ(dev.queue.stats.depth, 1);                      // refused with BLOCK_BUSY
+    CHECK(!b[0].done && !b[3].done);
+    CHECK_EQ(block_wait(&b[3]), 0);
+    for (int i = 0; i < 3; ++i) CHECK_EQ(block_wait(&b[i]), 0);
+    CHECK_EQ(buf[0][0], 2); CHECK_EQ(buf[0][512], 3);
+    CHECK_EQ(buf[1][512], 21); CHECK_EQ(buf[2][0], 40);
+    CHECK_EQ(dev.queue.stats.inflight, 0);
+    CHECK_EQ(dev.queue.stats.merged, 1);
+    uint8_t w[512];
+    memset(w, 0xE7, sizeof(w));
+    CHECK_EQ(block_write(&dev, 9, w, 1), 1);                 // synchronous wrappers poll too
+    CHECK_EQ(g_async_img[9 * 512 + 100], 0xE7);
+}
+
+static void test_overlay(void) {
+    static uint8_t img[64 * 512];
+    for (int s = 0; s < 64; ++s) memset(img + s * 512, s + 1, 512);
+    CHECK_EQ(memdisk_register("mdB", img, sizeof(img), 512, 0), 0);
+    CHECK_EQ(overlay_create("cowA", "nodev"), -1);
+    CHECK_EQ(overlay_create("cowA", "mdB"), 0);
+    CHECK_EQ(overlay_create("cowA", "mdB"), -1);           // name taken
+    block_device_t* d = block_find("cowA");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, 64);
+    uint64_t before = pmm_free_bytes();
+    uint8_t buf[8 * 512], in[8 * 512];
+    CHECK_EQ(block_read(d, 0, in, 8), 8);
+    CHECK(memcmp(in, img, sizeof(in)) == 0);
+    // A partial-page write allocates one frame; the rest of the page and
+    // the base stay as they were
+    memset(buf, 0xC3, 512);
+    CHECK_EQ(block_write(d, 9, buf, 1), 1);
+    CHECK_EQ(img[9 * 512], 10);
+    CHECK_EQ(block_read(d, 8, in, 8), 8);
+    CHECK_EQ(in[0], 9); CHECK_EQ(in[512], 0xC3); CHECK_EQ(in[2 * 512], 11);
+    overlay_stats_t st;
+    CHECK_EQ(overlay_get_stats("cowA", &st), 0);
+    CHECK_EQ(st.sectors, 1); CHECK_EQ(st.pages, 1);
+    CHECK_EQ(overlay_get_stats("mdB", &st), -1);
+    // Untouched ranges map the base in place, held ones the overlay frame
+    CHECK(block_map(d, 0, 8) == (const void*)img);
+    CHECK(block_map(d, 8, 2) == NULL);
+    const uint8_t* m = (const uint8_t*)block_map(d, 9, 1);
+    CHECK(m != NULL);
+    if (m) CHECK_EQ(m[100], 0xC3);
+    // Fully held ranges are served without the base
+    memset(buf, 0x3C, sizeof(buf));
+    CHECK_EQ(block_write(d, 16, buf, 8), 8);
+    overlay_stats_t a;
+    CHECK_EQ(overlay_get_stats("cowA", &a), 0);
+    CHECK_EQ(block_read(d, 16, in, 8), 8);
+    CHECK(memcmp(in, buf, sizeof(in)) == 0);
+    CHECK_EQ(overlay_get_stats("cowA", &st), 0);
+    CHECK_EQ(st.base_reads, a.base_reads);
+    CHECK_EQ(st.sectors, 9);
+    // Discarded sectors read the base again; emptied pages are freed
+    CHECK_EQ(block_discard(d, 9, 1), 0);
+    CHECK_EQ(block_read(d, 9, in, 1), 1);
+    CHECK_EQ(in[0], 10);
+    CHECK_EQ(block_discard(d, 16, 8), 0);
+    CHECK_EQ(overlay_get_stats("cowA", &st), 0);
+    CHECK_EQ(st.sectors, 0); CHECK_EQ(st.frames, 0);
+    CHECK_EQ(pmm_free_bytes(), before);
+    CHECK_EQ(block_write(d, 63, buf, 2), -1);
+}
+
+static int all_zero(const uint8_t* p, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) if (p[i]) return 0;
+    return 1;
+}
+
+static void test_discard(void) {
+    // Contiguous: the range reads back as zeros, neighbours are untouched
+    block_device_t* d = block_find("rdB");
+    if (!d) { CHECK(d != NULL); return; }
+    uint8_t buf[8 * 512], in[8 * 512];
+    memset(buf, 0x6D, sizeof(buf));
+    CHECK_EQ(block_write(d, 200, buf, 8), 8);
+    CHECK_EQ(block_discard(d, 201, 2), 0);
+    CHECK_EQ(block_read(d, 200, in, 8), 8);
+    CHECK_EQ(in[0], 0x6D);
+    CHECK(all_zero(in + 512, 2 * 512));
+    CHECK_EQ(in[3 * 512], 0x6D);
+    CHECK_EQ(d->queue.stats.discards, 1);
+    CHECK_EQ(d->queue.stats.discard_sectors, 2);
+    CHECK_EQ(block_discard(d, d->sector_count - 1, 2), -1);
+    CHECK_EQ(block_discard(d, 0, 0), 0);
+    CHECK_EQ(block_discard(block_find("mdRO"), 0, 1), -1);   // no discard op
+
+    // Sparse: whole pages go back to the PMM, partial ones are zeroed and
+    // freed once empty, taking the emptied tree nodes with them
+    CHECK_EQ(ramdisk_create_sparse("rdT", 64ULL << 20), 0);
+    d = block_find("rdT");
+    if (!d) { CHECK(d != NULL); return; }
+    uint64_t before = pmm_free_bytes();
+    for (int k = 0; k < 3; ++k) CHECK_EQ(block_write(d, k * 8, buf, 8), 8);
+    uint64_t res = ramdisk_resident_bytes("rdT");
+    CHECK(res > 3 * 4096);
+    CHECK_EQ(block_discard(d, 0, 16), 0);
+    CHECK_EQ(ramdisk_resident_bytes("rdT"), res - 2 * 4096);
+    CHECK_EQ(block_discard(d, 17, 7), 0);
+    CHECK_EQ(ramdisk_resident_bytes("rdT"), res - 2 * 4096);
+    CHECK_EQ(block_read(d, 16, in, 2), 2);
+    CHECK_EQ(in[0], 0x6D);
+    CHECK(all_zero(in + 512, 512));
+    CHECK_EQ(block_discard(d, 16, 1), 0);
+    CHECK_EQ(ramdisk_resident_bytes("rdT"), 0);
+    CHECK_EQ(pmm_free_bytes(), before);
+    CHECK_EQ(block_discard(d, 1000, d->sector_count - 1000), 0);   // all holes
+
+    // Partitions pass the range through at their offset
+    CHECK_EQ(ramdisk_create("rdP", 128 * 512), 0);
+    block_device_t* pd = block_find("rdP");
+    if (!pd) { CHECK(pd != NULL); return; }
+    uint8_t mbr[512];
+    memset(mbr, 0, sizeof(mbr));
+    mbr[446 + 4] = 0x07; put32(&mbr[446 + 8], 32); put32(&mbr[446 + 12], 64);
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+    CHECK_EQ(block_write(pd, 0, mbr, 1), 1);
+    CHECK_EQ(block_write(pd, 32, buf, 8), 8);
+    block_scan_partitions();
+    block_device_t* p1 = block_find("rdPp1");
+    if (!p1) { CHECK(p1 != NULL); return; }
+    CHECK_EQ(p1->ops->discard(p1, 0, 2), 0);
+    CHECK_EQ(block_discard(p1, 4, 2), 0);
+    CHECK_EQ(block_read(pd, 32, in, 8), 8);
+    CHECK(all_zero(in, 2 * 512));
+    CHECK_EQ(in[2 * 512], 0x6D);
+    CHECK(all_zero(in + 4 * 512, 2 * 512));
+    CHECK_EQ(in[6 * 512], 0x6D);
+    CHECK_EQ(pd->queue.stats.discards, 1);                   // counted on the disk
+    CHECK_EQ(p1->ops->discard(p1, 63, 2), -1);
+    CHECK_EQ(block_discard(p1, 63, 2), -1);
+}
+
+// Device with a volatile write cache: counts writes and flushes, and the
+// writes a flush covered
+static uint8_t g_wc_img[128 * 512];
+static int g_wc_writes, g_wc_flushes, g_wc_flushed_writes;
+static int wc_read(block_device_t* d, uint64_t lba, void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    memcpy(buf, g_wc_img + lba * 512, (size_t)n * 512); return (int)n;
+}
+static int wc_write(block_device_t* d, uint64_t lba, const void* buf, uint32_t n) {
+    if (lba + n > d->sector_count) return -1;
+    memcpy(g_wc_img + lba * 512, buf, (size_t)n * 512); g_wc_writes++; return (int)n;
+}
+static int wc_flush(block_device_t* d) { (void)d; g_wc_flushes++; g_wc_flushed_writes = g_wc_writes; return 0; }
+
+static void test_flush_fua(void) {
+    static block_ops_t ops;
+    static block_device_t dev;
+    ops.read = wc_read; ops.write = wc_write; ops.flush = wc_flush;
+    strcpy(dev.name, "wc"); dev.sector_size = 512; dev.sector_count = 128; dev.ops = &ops;
+    block_register(&dev);
+    uint8_t buf[512];
+    memset(buf, 0x3C, sizeof(buf));
+    // FUA without driver support: the write, then a flush covering it
+    CHECK_EQ(block_write_fua(&dev, 5, buf, 1), 1);
+    CHECK_EQ(g_wc_flushes, 1); CHECK_EQ(g_wc_flushed_writes, g_wc_writes);
+    CHECK_EQ(dev.queue.stats.fua, 1); CHECK_EQ(dev.queue.stats.flushes, 1);
+    CHECK_EQ(g_wc_img[5 * 512], 0x3C);
+    // A FUA bio does not merge with a plain neighbour
+    bio_t b1, b2;
+    bio_init(&b1, &dev, BIO_WRITE, 10, buf, 1);
+    bio_init(&b2, &dev, BIO_WRITE, 11, buf, 1);
+    b2.flags = BIO_FUA;
+    uint64_t disp = dev.queue.stats.dispatched;
+    block_submit(&b1); block_submit(&b2);
+    CHECK_EQ(block_wait(&b1), 0); CHECK_EQ(block_wait(&b2), 0);
+    CHECK_EQ(dev.queue.stats.dispatched - disp, 2);
+    CHECK_EQ(g_wc_flushes, 2);
+    // block_flush dispatches queued writes before flushing
+    bio_init(&b1, &dev, BIO_WRITE, 20, buf, 1);
+    block_submit(&b1);
+    CHECK(!b1.done);
+    CHECK_EQ(block_flush(&dev), 0);
+    CHECK(b1.done);
+    CHECK_EQ(g_wc_flushes, 3); CHECK_EQ(g_wc_flushed_writes, g_wc_writes);
+    // Partitions flush their disk
+    uint8_t mbr[512];
+    memset(mbr, 0, sizeof(mbr));
+    mbr[446 + 4] = 0x07; put32(&mbr[446 + 8], 64); put32(&mbr[446 + 12], 64);
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+    CHECK_EQ(block_write(&dev, 0, mbr, 1), 1);
+    block_scan_partitions();
+    block_device_t* p1 = block_find("wcp1");
+    if (!p1) { CHECK(p1 != NULL); return; }
+    CHECK_EQ(p1->ops->flush(p1), 0);
+    CHECK_EQ(block_flush(p1), 0);
+    CHECK_EQ(block_write_fua(p1, 0, buf, 1), 1);
+    CHECK_EQ(g_wc_flushes, 6);
+    CHECK_EQ(dev.queue.stats.fua, 3);
+    CHECK_EQ(g_wc_img[64 * 512], 0x3C);
+    // Every device, once each; devices without a cache have nothing to do
+    CHECK_EQ(block_flush(NULL), 0);
+    CHECK_EQ(g_wc_flushes, 7);
+    block_device_t* rd = block_find("rdB");
+    CHECK_EQ(block_flush(rd), 0);
+    CHECK_EQ(block_write_fua(rd, 0, buf, 1), 1);
+    CHECK_EQ(rd->queue.stats.flushes, 0);
+}
+
+static void test_raid(void) {
+    static uint8_t out[256 * 512], in[256 * 512];
+    for (uint32_t i = 0; i < sizeof(out); ++i) out[i] = (uint8_t)(i / 512 * 7 + i);
+    const char* m[3];
+    m[0] = "rA"; m[1] = "rB"; m[2] = "rA";
+    CHECK_EQ(ramdisk_create("rA", 128 * 512), 0);
+    CHECK_EQ(ramdisk_create("rB", 136 * 512), 0);
+    CHECK_EQ(raid_create("md0", 0, 8, m, 1), -1);           // too few members
+    CHECK_EQ(raid_create("md0", 0, 8, m, 3), -1);           // member twice
+    CHECK_EQ(raid_create("md0", 2, 8, m, 2), -1);
+    CHECK_EQ(raid_create("md0", 0, 8, m, 2), 0);
+    block_device_t* d = block_find("md0");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, 256);                          // smallest member, times two
+    // Chunks alternate between members: md0 16..23 is rA 8..15
+    CHECK_EQ(block_write(d, 0, out, 256), 256);
+    CHECK_EQ(block_read(block_find("rA"), 8, in, 8), 8);
+    CHECK(memcmp(in, out + 16 * 512, 8 * 512) == 0);
+    CHECK_EQ(block_read(block_find("rB"), 0, in, 8), 8);
+    CHECK(memcmp(in, out + 8 * 512, 8 * 512) == 0);
+    memset(in, 0, sizeof(in));
+    CHECK_EQ(block_read(d, 0, in, 256), 256);
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    // Unaligned vectored read across a chunk boundary
+    static uint8_t a[700], b[324];
+    block_iovec_t v[2] = { { a, sizeof(a) }, { b, sizeof(b) } };
+    CHECK_EQ(block_readv(d, 7, v, 2), 2);
+    CHECK(memcmp(a, out + 7 * 512, sizeof(a)) == 0);
+    CHECK(memcmp(b, out + 7 * 512 + sizeof(a), sizeof(b)) == 0);
+    raid_stats_t st;
+    CHECK_EQ(raid_get_stats("md0", &st), 0);
+    CHECK_EQ(st.member_sectors[0], st.member_sectors[1]);
+    CHECK_EQ(raid_get_stats("rA", &st), -1);
+    // Discard reaches each member as one run
+    CHECK_EQ(block_discard(d, 4, 16), 0);
+    CHECK_EQ(block_read(d, 0, in, 24), 24);
+    CHECK(memcmp(in, out, 4 * 512) == 0);
+    CHECK(all_zero(in + 4 * 512, 16 * 512));
+    CHECK(memcmp(in + 20 * 512, out + 20 * 512, 4 * 512) == 0);
+    CHECK_EQ(block_find("rA")->queue.stats.discards, 1);
+
+    // RAID1: both mirrors hold the data; a large read uses both
+    CHECK_EQ(ramdisk_create("rC", 128 * 512), 0);
+    CHECK_EQ(ramdisk_create("rD", 128 * 512), 0);
+    m[0] = "rC"; m[1] = "rD";
+    CHECK_EQ(raid_create("md1", 1, 16, m, 2), 0);
+    d = block_find("md1");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, 128);
+    CHECK_EQ(block_write(d, 0, out, 128), 128);
+    CHECK_EQ(block_read(block_find("rD"), 0, in, 128), 128);
+    CHECK(memcmp(in, out, 128 * 512) == 0);
+    CHECK_EQ(raid_get_stats("md1", &st), 0);
+    uint64_t c0 = st.member_sectors[0], c1 = st.member_sectors[1];
+    memset(in, 0, sizeof(in));
+    CHECK_EQ(block_read(d, 0, in, 128), 128);
+    CHECK(memcmp(in, out, 128 * 512) == 0);
+    CHECK_EQ(raid_get_stats("md1", &st), 0);
+    CHECK_EQ(st.member_sectors[0] - c0, 64);
+    CHECK_EQ(st.member_sectors[1] - c1, 64);
+    // Small reads rotate between mirrors
+    CHECK_EQ(block_read(d, 0, in, 1), 1);
+    CHECK_EQ(block_read(d, 1, in, 1), 1);
+    CHECK_EQ(raid_get_stats("md1", &st), 0);
+    CHECK_EQ(st.member_sectors[0] - c0, 65);
+    CHECK_EQ(st.member_sectors[1] - c1, 65);
+
+    // A mirror that fails writes is dropped; the array keeps working
+    m[0] = "rC"; m[1] = "mdRO";
+    CHECK_EQ(raid_create("md2", 1, 0, m, 2), 0);
+    d = block_find("md2");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, 8);
+    CHECK_EQ(block_write(d, 2, out, 2), 2);
+    CHECK_EQ(raid_get_stats("md2", &st), 0);
+    CHECK_EQ(st.failed, 2u);
+    for (int k = 0; k < 4; ++k) { CHECK_EQ(block_read(d, 2, in, 2), 2); CHECK(memcmp(in, out, 2 * 512) == 0); }
+}
+
+static void test_tier(void) {
+    static uint8_t img[512 * 512], in[64 * 512], blk[4096];
+    for (uint32_t i = 0; i < sizeof(img); ++i) img[i] = (uint8_t)(i / 512 * 13 + i);
+    CHECK_EQ(ramdisk_create("to0", sizeof(img)), 0);
+    CHECK_EQ(ramdisk_create("tc0", 128 * 512), 0);     // superblock, table, 8 slots
+    block_device_t* o = block_find("to0");
+    CHECK_EQ(block_write(o, 0, img, 512), 512);
+    CHECK_EQ(tier_create("tr0", "to0", "to0", TIER_WRITETHROUGH), -1);
+    CHECK_EQ(tier_create("tr0", "to0", "tc0", 2), -1);
+    CHECK_EQ(tier_create("tr0", "to0", "tc0", TIER_WRITETHROUGH), 0);
+    block_device_t* d = block_find("tr0");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, 512);
+    tier_stats_t st;
+    CHECK_EQ(tier_get_stats("tr0", &st), 0);
+    CHECK_EQ(st.slots, 8);
+    // Misses promote whole blocks; the second pass hits
+    CHECK_EQ(block_read(d, 3, in, 26), 26);
+    CHECK(memcmp(in, img + 3 * 512, 26 * 512) == 0);
+    CHECK_EQ(block_read(d, 0, in, 32), 32);
+    CHECK(memcmp(in, img, 32 * 512) == 0);
+    CHECK_EQ(tier_get_stats("tr0", &st), 0);
+    CHECK_EQ(st.read_misses, 4);
+    CHECK_EQ(st.promotions, 4);
+    CHECK_EQ(st.read_hits, 4);
+    CHECK_EQ(st.cached, 4);
+    // Write-through updates the origin and the cached copy
+    memset(blk, 0x5A, 512);
+    CHECK_EQ(block_write(d, 11, blk, 1), 1);
+    memcpy(img + 11 * 512, blk, 512);
+    CHECK_EQ(block_read(o, 11, in, 1), 1);
+    CHECK(memcmp(in, blk, 512) == 0);
+    CHECK_EQ(block_read(d, 8, in, 8), 8);
+    CHECK(memcmp(in, img + 8 * 512, 8 * 512) == 0);
+
+    // Write-back: a partial miss is merged from the origin and stays dirty
+    CHECK_EQ(tier_set_policy("tr0", TIER_WRITEBACK, TIER_SEQ_CUTOFF), 0);
+    memset(blk, 0xC3, sizeof(blk));
+    CHECK_EQ(block_write(d, 82, blk, 2), 2);
+    CHECK_EQ(block_read(o, 82, in, 1), 1);
+    CHECK(memcmp(in, img + 82 * 512, 512) == 0);        // origin untouched
+    memcpy(img + 82 * 512, blk, 2 * 512);
+    CHECK_EQ(block_read(d, 80, in, 8), 8);
+    CHECK(memcmp(in, img + 80 * 512, 8 * 512) == 0);
+    CHECK_EQ(tier_get_stats("tr0", &st), 0);
+    CHECK_EQ(st.dirty, 1);
+    CHECK_EQ(block_flush(d), 0);
+
+    // The table on the cache device survives: a new tier over the same pair
+    // finds every block, dirty state included
+    CHECK_EQ(tier_create("tr1", "to0", "tc0", TIER_WRITEBACK), 0);
+    d = block_find("tr1");
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.loaded, 5);
+    CHECK_EQ(st.dirty, 1);
+    CHECK_EQ(block_read(d, 80, in, 8), 8);
+    CHECK(memcmp(in, img + 80 * 512, 8 * 512) == 0);
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.read_hits, 1);
+    // Filling the set evicts; the dirty block reaches the origin first
+    for (uint32_t b = 20; b < 28; ++b) CHECK_EQ(block_read(d, b * 8, in, 8), 8);
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.evictions, 5);
+    CHECK_EQ(st.writebacks, 1);
+    CHECK_EQ(st.dirty, 0);
+    CHECK_EQ(block_read(o, 80, in, 8), 8);
+    CHECK(memcmp(in, img + 80 * 512, 8 * 512) == 0);
+
+    // Sequential streams past the cutoff go straight to the origin
+    CHECK_EQ(tier_set_policy("tr1", TIER_WRITEBACK, 8192), 0);
+    CHECK_EQ(block_read(d, 320, in, 16), 16);
+    CHECK_EQ(block_read(d, 336, in, 16), 16);
+    CHECK(memcmp(in, img + 336 * 512, 16 * 512) == 0);
+    memset(blk, 0x77, sizeof(blk));
+    CHECK_EQ(block_write(d, 352, blk, 8), 8);           // bypassed: origin at once
+    CHECK_EQ(block_read(o, 352, in, 8), 8);
+    CHECK(memcmp(in, blk, sizeof(blk)) == 0);
+    memcpy(img + 352 * 512, blk, sizeof(blk));
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.bypassed, 2);
+    CHECK_EQ(st.dirty, 0);
+
+    // Back to write-through: dirty blocks are written back
+    CHECK_EQ(tier_set_policy("tr1", TIER_WRITEBACK, 0), 0);
+    memset(blk, 0x19, sizeof(blk));
+    CHECK_EQ(block_write(d, 400, blk, 8), 8);
+    memcpy(img + 400 * 512, blk, sizeof(blk));
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.dirty, 1);
+    CHECK_EQ(tier_set_policy("tr1", TIER_WRITETHROUGH, 0), 0);
+    CHECK_EQ(tier_get_stats("tr1", &st), 0);
+    CHECK_EQ(st.dirty, 0);
+    CHECK_EQ(block_read(o, 0, in, 64), 64);
+    CHECK(memcmp(in, img, 64 * 512) == 0);
+    static uint8_t all[512 * 512];
+    CHECK_EQ(block_read(o, 0, all, 512), 512);
+    CHECK(memcmp(all, img, sizeof(img)) == 0);
+    CHECK_EQ(tier_get_stats("to0", &st), -1);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_ramdisk_create);
+    RUN_TEST(test_ramdisk_roundtrip);
+    RUN_TEST(test_ramdisk_sparse);
+    RUN_TEST(test_memdisk_readonly);
+    RUN_TEST(test_mbr_partitions);
+    RUN_TEST(test_4kn_partitions);
+    RUN_TEST(test_gpt_partitions);
+    RUN_TEST(test_gpt_4kn);
+    RUN_TEST(test_block_map);
+    RUN_TEST(test_queue_merge);
+    RUN_TEST(test_queue_ordering);
+    RUN_TEST(test_io_stats);
+    RUN_TEST(test_vectored_io);
+    RUN_TEST(test_vectored_fallback);
+    RUN_TEST(test_async_submit);
+    RUN_TEST(test_discard);
+    RUN_TEST(test_overlay);
+    RUN_TEST(test_flush_fua);
+    RUN_TEST(test_raid);
+    RUN_TEST(test_tier);
+    return TEST_RESULT();
+}
@@ -0,0 +1,392 @@
+// VFS + exFAT on a ramdisk: mkfs, mount, create/write/read/stat/unlink, discard, and exFAT
+// mounted from a copy-on-write overlay, a loop device, a RAID0 array and a 4Kn disk; allocation
+// bitmap and NoFatChain files as mkfs.exfat/Linux write them
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel64/block/block.h"
+#include "kernel64/vfs/vfs.h"
+#include "kernel64/fs/exfat.h"
+#include "kernel64/block/bcache.h"
+#include "kernel64/block/overlay.h"
+#include "kernel64/block/loop.h"
+#include "kernel64/block/raid.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+int ramdisk_create_sparse(const char* name, uint64_t bytes);
+int ramdisk_create_sec(const char* name, uint64_t bytes, uint32_t sec);
+uint64_t ramdisk_resident_bytes(const char* name);
+void exfat_register(void);
+
+static uint32_t rd32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+static void test_mkfs_layout(void) {
+    CHECK_EQ(exfat_format_device("nodev", NULL), -1);
+    CHECK_EQ(ramdisk_create("ram0", 8u << 20), 0);
+    CHECK_EQ(exfat_format_device("ram0", "TESTVOL"), 0);
+    block_device_t* d = block_find("ram0");
+    uint8_t vbr[512];
+    CHECK_EQ(d->ops->read(d, 0, vbr, 1), 1);
+    CHECK(memcmp(&vbr[3], "EXFAT   ", 8) == 0);
+    CHECK_EQ(vbr[510], 0x55); CHECK_EQ(vbr[511], 0xAA);
+    CHECK_EQ(vbr[0x6C], 9);
+    uint32_t fat_off = rd32(&vbr[0x50]), fat_len = rd32(&vbr[0x54]);
+    uint32_t heap = rd32(&vbr[0x58]), clusters = rd32(&vbr[0x5C]);
+    uint32_t spc = 1u << vbr[0x6D];
+    CHECK(heap >= fat_off + fat_len);
+    CHECK_EQ(heap % spc, 0);
+    CHECK((uint64_t)heap + (uint64_t)clusters * spc <= d->sector_count);
+    CHECK((clusters + 2u) * 4u <= fat_len * 512u);
+    // FAT entry for the root directory is end-of-chain
+    uint8_t fat[512];
+    CHECK_EQ(d->ops->read(d, fat_off, fat, 1), 1);
+    CHECK_EQ(rd32(&fat[2 * 4]), 0xFFFFFFFFu);
+}
+
+static void test_mount(void) {
+    exfat_register();
+    CHECK_EQ(vfs_mount("exfat", "root", "ram0"), 0);
+    CHECK_EQ(vfs_has_mount("root"), 1);
+    CHECK(vfs_mount("nofs", "x", "ram0") != 0);
+    CHECK(vfs_mount("exfat", "x", "nodev") != 0);
+    uint64_t sz = 1; int dir = 0;
+    CHECK_EQ(vfs_stat("root:/", &sz, &dir), 0);
+    CHECK_EQ(dir, 1);
+    CHECK(vfs_stat("root:/missing", &sz, &dir) != 0);
+}
+
+static void fill(uint8_t* b, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; ++i) { seed = seed * 1664525u + 1013904223u; b[i] = (uint8_t)(seed >> 24); }
+}
+
+static void test_write_read_multicluster(void) {
+    static uint8_t out[50000], in[50000];
+    fill(out, sizeof(out), 1);
+    CHECK_EQ(vfs_create("root:/big.bin", 0), 0);
+    vfs_node_t* n = vfs_open("root:/big.bin");
+    CHECK(n != NULL);
+    if (!n) return;
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    uint64_t sz = 0; int dir = 1;
+    CHECK_EQ(vfs_stat("root:/big.bin", &sz, &dir), 0);
+    CHECK_EQ(sz, sizeof(out)); CHECK_EQ(dir, 0);
+    // Reopen so the size comes from the directory entry
+    vfs_node_t* r = vfs_open("root:/big.bin");
+    memset(in, 0, sizeof(in));
+    CHECK_EQ(vfs_read(r, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    // Unaligned read crossing a cluster boundary, and reads clipped at EOF
+    CHECK_EQ(vfs_read(r, 4000, in, 300), 300);
+    CHECK(memcmp(in, out + 4000, 300) == 0);
+    CHECK_EQ(vfs_read(r, 1234, in, 20000), 20000);   // sector-unaligned, multi-cluster run
+    CHECK(memcmp(in, out + 1234, 20000) == 0);
+    CHECK_EQ(vfs_read(r, sizeof(out) - 10, in, 100), 10);
+    CHECK_EQ(vfs_read(r, sizeof(out), in, 100), 0);
+    // Freshly allocated clusters are contiguous, so the ramdisk maps in place
+    const uint8_t* m = (const uint8_t*)vfs_map(r, 1234, 20000);
+    CHECK(m != NULL);
+    if (m) CHECK(memcmp(m, out + 1234, 20000) == 0);
+    CHECK(vfs_map(r, sizeof(out) - 10, 100) == NULL);
+}
+
+static void test_overwrite_and_append(void) {
+    uint8_t a[6000], b[3000], in[9000];
+    fill(a, sizeof(a), 2); fill(b, sizeof(b), 3);
+    CHECK_EQ(vfs_create("root:/log.txt", 0), 0);
+    vfs_node_t* n = vfs_open("root:/log.txt");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, a, sizeof(a)), sizeof(a));
+    CHECK_EQ(vfs_write(n, sizeof(a), b, sizeof(b)), sizeof(b));
+    CHECK_EQ(vfs_write(n, 10, "hello", 5), 5);
+    memcpy(a + 10, "hello", 5);
+    vfs_node_t* r = vfs_open("root:/log.txt");
+    CHECK_EQ(vfs_read(r, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, a, sizeof(a)) == 0);
+    CHECK(memcmp(in + sizeof(a), b, sizeof(b)) == 0);
+    // The earlier file is untouched
+    static uint8_t big[50000], chk[50000];
+    fill(big, sizeof(big), 1);
+    vfs_node_t* o = vfs_open("root:/big.bin");
+    CHECK_EQ(vfs_read(o, 0, chk, sizeof(chk)), sizeof(chk));
+    CHECK(memcmp(big, chk, sizeof(chk)) == 0);
+}
+
+static void test_unlink_reuses_clusters(void) {
+    uint8_t buf[4096];
+    fill(buf, sizeof(buf), 4);
+    CHECK_EQ(vfs_create("root:/tmp", 0), 0);
+    vfs_node_t* n = vfs_open("root:/tmp");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, buf, sizeof(buf)), sizeof(buf));
+    CHECK_EQ(vfs_unlink("root:/tmp"), 0);
+    uint64_t sz; int dir;
+    CHECK(vfs_stat("root:/tmp", &sz, &dir) != 0);
+    CHECK(vfs_unlink("root:/tmp") != 0);
+    // Remaining files are still visible
+    CHECK_EQ(vfs_stat("root:/log.txt", &sz, &dir), 0);
+    CHECK_EQ(sz, 9000);
+}
+
+static void test_unlink_discards(void) {
+    CHECK_EQ(ramdisk_create_sparse("sp0", 16u << 20), 0);
+    CHECK_EQ(exfat_format_device("sp0", NULL), 0);
+    CHECK_EQ(vfs_mount("exfat", "sp", "sp0"), 0);
+    static uint8_t data[100000];
+    fill(data, sizeof(data), 5);
+    CHECK_EQ(vfs_create("sp:/f", 0), 0);
+    vfs_node_t* n = vfs_open("sp:/f");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, data, sizeof(data)), sizeof(data));
+    CHECK_EQ(bcache_sync(NULL), 0);
+    uint64_t full = ramdisk_resident_bytes("sp0");
+    CHECK(full >= sizeof(data));
+    CHECK_EQ(vfs_unlink("sp:/f"), 0);
+    CHECK(full - ramdisk_resident_bytes("sp0") >= sizeof(data) - 4096);
+}
+
+static void test_fstrim(void) {
+    block_device_t* d = block_find("ram0");
+    uint8_t vbr[512], junk[512], in[512];
+    CHECK_EQ(d->ops->read(d, 0, vbr, 1), 1);
+    uint32_t heap = rd32(&vbr[0x58]), clusters = rd32(&vbr[0x5C]);
+    uint32_t spc = 1u << vbr[0x6D];
+    // Stale bytes in the last (free) cluster are discarded
+    uint64_t lba = heap + (uint64_t)(clusters - 1) * spc;
+    memset(junk, 0xA5, sizeof(junk));
+    CHECK_EQ(d->ops->write(d, lba, junk, 1), 1);
+    int64_t n = vfs_trim("root");
+    CHECK(n > 0 && n < (int64_t)clusters * spc * 512);
+    CHECK_EQ(n % (spc * 512), 0);
+    CHECK_EQ(d->ops->read(d, lba, in, 1), 1);
+    CHECK_EQ(in[0], 0); CHECK_EQ(in[511], 0);
+    uint64_t sz; int dir;
+    CHECK_EQ(vfs_stat("root:/log.txt", &sz, &dir), 0);    // live files untouched
+    vfs_node_t* f = vfs_open("root:/log.txt");
+    CHECK(f != NULL);
+    if (f) { CHECK_EQ(vfs_read(f, 0, in, 16), 16); CHECK(in[0] != 0 || in[1] != 0); }
+    CHECK_EQ(vfs_trim("nomnt"), -1);
+}
+
+// A read-only image mounts writable through an overlay and stays unchanged
+static void test_overlay_root(void) {
+    static uint8_t img[2u << 20], snap[2u << 20];
+    CHECK_EQ(ramdisk_create("mk0", sizeof(img)), 0);
+    CHECK_EQ(exfat_format_device("mk0", "IMG"), 0);
+    block_device_t* mk = block_find("mk0");
+    CHECK_EQ(bcache_sync(NULL), 0);
+    CHECK_EQ(mk->ops->read(mk, 0, img, sizeof(img) / 512), (int)(sizeof(img) / 512));
+    memcpy(snap, img, sizeof(img));
+    CHECK_EQ(memdisk_register("ro0", img, sizeof(img), 512, 0), 0);
+    CHECK_EQ(overlay_create("cw0", "ro0"), 0);
+    CHECK_EQ(vfs_mount("exfat", "cw", "cw0"), 0);
+    uint8_t out[10000], in[10000];
+    fill(out, sizeof(out), 6);
+    CHECK_EQ(vfs_create("cw:/new.bin", 0), 0);
+    vfs_node_t* n = vfs_open("cw:/new.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    CHECK_EQ(bcache_sync(NULL), 0);
+    vfs_node_t* r = vfs_open("cw:/new.bin");
+    CHECK_EQ(vfs_read(r, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    CHECK(memcmp(img, snap, sizeof(img)) == 0);
+    overlay_stats_t st;
+    CHECK_EQ(overlay_get_stats("cw0", &st), 0);
+    CHECK(st.sectors >= sizeof(out) / 512 && st.pages * 4096 < sizeof(img) / 8);
+}
+
+// An exFAT image stored as a file on root mounts through a loop device
+static void test_loop_image(void) {
+    static uint8_t img[1u << 20];
+    CHECK_EQ(ramdisk_create("mk1", sizeof(img)), 0);
+    CHECK_EQ(exfat_format_device("mk1", "LOOP"), 0);
+    block_device_t* mk = block_find("mk1");
+    CHECK_EQ(bcache_sync(NULL), 0);
+    CHECK_EQ(mk->ops->read(mk, 0, img, sizeof(img) / 512), (int)(sizeof(img) / 512));
+    CHECK_EQ(vfs_create("root:/disk.img", 0), 0);
+    vfs_node_t* f = vfs_open("root:/disk.img");
+    if (!f) { CHECK(f != NULL); return; }
+    CHECK_EQ(vfs_write(f, 0, img, sizeof(img)), sizeof(img));
+    CHECK_EQ(loop_attach("loop0", "root:/missing", 0), -1);
+    CHECK_EQ(loop_attach("loop0", "root:/disk.img", 0), 0);
+    CHECK_EQ(loop_attach("loop0", "root:/disk.img", 0), -1);   // name taken
+    block_device_t* d = block_find("loop0");
+    if (!d) { CHECK(d != NULL); return; }
+    CHECK_EQ(d->sector_count, sizeof(img) / 512);
+    CHECK_EQ(vfs_mount("exfat", "lp", "loop0"), 0);
+    uint8_t out[6000], in[6000];
+    fill(out, sizeof(out), 7);
+    CHECK_EQ(vfs_create("lp:/inner.bin", 0), 0);
+    vfs_node_t* n = vfs_open("lp:/inner.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    CHECK_EQ(bcache_sync(NULL), 0);
+    vfs_node_t* r = vfs_open("lp:/inner.bin");
+    CHECK_EQ(vfs_read(r, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    loop_stats_t st;
+    CHECK_EQ(loop_get_stats("loop0", &st), 0);
+    CHECK(st.reads > 0 && st.writes > 0);
+    CHECK(st.mapped > 0);                               // file sits on a ramdisk
+    CHECK(st.flushes > 0);                              // size update waited on a barrier
+    // The image file holds the inner filesystem's bytes
+    uint8_t vbr[512];
+    CHECK_EQ(vfs_read(f, 0, vbr, sizeof(vbr)), sizeof(vbr));
+    CHECK(memcmp(&vbr[3], "EXFAT   ", 8) == 0);
+    // Read-only attachment refuses writes
+    CHECK_EQ(loop_attach("loop1", "root:/disk.img", 1), 0);
+    block_device_t* ro = block_find("loop1");
+    CHECK_EQ(block_write(ro, 0, vbr, 1), -1);
+    CHECK_EQ(block_read(ro, 0, vbr, 1), 1);
+}
+
+static void test_raid_volume(void) {
+    CHECK_EQ(ramdisk_create("st0", 1u << 20), 0);
+    CHECK_EQ(ramdisk_create("st1", 1u << 20), 0);
+    const char* m[2];
+    m[0] = "st0"; m[1] = "st1";
+    CHECK_EQ(raid_create("md9", 0, 8, m, 2), 0);
+    CHECK_EQ(exfat_format_device("md9", "STRIPE"), 0);
+    CHECK_EQ(vfs_umount("lp"), 0);                  // the mount table holds four
+    CHECK_EQ(vfs_mount("exfat", "md", "md9"), 0);
+    static uint8_t out[40000], in[40000];
+    fill(out, sizeof(out), 11);
+    CHECK_EQ(vfs_create("md:/big.bin", 0), 0);
+    vfs_node_t* n = vfs_open("md:/big.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    CHECK_EQ(bcache_invalidate(block_find("md9")), 0);
+    CHECK_EQ(vfs_read(n, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    raid_stats_t st;
+    CHECK_EQ(raid_get_stats("md9", &st), 0);
+    CHECK(st.member_sectors[0] > 40 && st.member_sectors[1] > 40);   // the file spans both
+    CHECK_EQ(vfs_umount("md"), 0);
+}
+
+// 4 KiB sectors: bps_shift 12, one sector per cluster, FAT 64 KiB in
+static void test_4kn_volume(void) {
+    CHECK_EQ(ramdisk_create_sec("k4", 8u << 20, 4096), 0);
+    CHECK_EQ(exfat_format_device("k4", "NATIVE4K"), 0);
+    block_device_t* d = block_find("k4");
+    static uint8_t vbr[4096];
+    CHECK_EQ(block_read(d, 0, vbr, 1), 1);
+    CHECK(memcmp(&vbr[3], "EXFAT   ", 8) == 0);
+    CHECK_EQ(vbr[0x6C], 12);
+    CHECK_EQ(vbr[0x6D], 0);
+    CHECK_EQ(rd32(&vbr[0x50]), 16);
+    CHECK((rd32(&vbr[0x5C]) + 2u) * 4u <= rd32(&vbr[0x54]) * 4096u);
+    CHECK_EQ(vfs_mount("exfat", "k", "k4"), 0);
+    static uint8_t out[70000], in[70000];
+    fill(out, sizeof(out), 41);
+    CHECK_EQ(vfs_create("k:/native.bin", 0), 0);
+    vfs_node_t* n = vfs_open("k:/native.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    CHECK_EQ(bcache_invalidate(d), 0);
+    CHECK_EQ(vfs_read(n, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    CHECK_EQ(vfs_read(n, 5000, in, 3000), 3000);     // unaligned inside a 4 KiB sector
+    CHECK(memcmp(in, out + 5000, 3000) == 0);
+    CHECK_EQ(vfs_umount("k"), 0);
+    // A VBR that claims 512-byte sectors does not mount on a 4Kn device
+    vbr[0x6C] = 9;
+    CHECK_EQ(block_write(d, 0, vbr, 1), 1);
+    CHECK_EQ(bcache_invalidate(d), 0);
+    CHECK(vfs_mount("exfat", "k", "k4") != 0);
+}
+
+// A volume laid out the way mkfs.exfat and Linux leave it: an allocation
+// bitmap, and a contiguous file with NoFatChain whose FAT entries stay 0
+static void put32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static void put64(uint8_t* p, uint64_t v) { memcpy(p, &v, 8); }
+
+static int bit_of(block_device_t* d, uint32_t bm_lba, uint32_t cl) {
+    uint8_t sec[512];
+    if (block_read(d, bm_lba + (cl - 2) / 8 / 512, sec, 1) != 1) return -1;
+    return (sec[(cl - 2) / 8 % 512] >> ((cl - 2) % 8)) & 1;
+}
+
+static void test_bitmap_volume(void) {
+    CHECK_EQ(ramdisk_create("xb", 4u << 20), 0);
+    CHECK_EQ(exfat_format_device("xb", NULL), 0);
+    block_device_t* d = block_find("xb");
+    uint8_t vbr[512];
+    CHECK_EQ(block_read(d, 0, vbr, 1), 1);
+    uint32_t heap = rd32(&vbr[0x58]), clusters = rd32(&vbr[0x5C]), spc = 1u << vbr[0x6D], fat = rd32(&vbr[0x50]);
+    uint32_t bm_lba = heap + (3 - 2) * spc;
+    static uint8_t cl[4096], back[4096];
+    // FAT: the bitmap in cluster 3 is chained like mkfs.exfat does it
+    CHECK_EQ(block_read(d, fat, cl, 1), 1);
+    put32(cl + 3 * 4, 0xFFFFFFFFu);
+    CHECK_EQ(block_write(d, fat, cl, 1), 1);
+    // Bitmap: root, the bitmap itself and the file in clusters 10..12
+    memset(cl, 0, sizeof(cl));
+    cl[0] = 0x03; cl[1] = 0x07;
+    CHECK_EQ(block_write(d, bm_lba, cl, spc), (int)spc);
+    // Root: bitmap entry, then a 3-cluster NoFatChain file "nofat"
+    memset(cl, 0, sizeof(cl));
+    cl[0] = 0x81; put32(cl + 20, 3); put64(cl + 24, (clusters + 7) / 8);
+    uint8_t* e = cl + 32;
+    e[0] = 0x85; e[1] = 2;
+    e[32] = 0xC0; e[33] = 0x03; e[35] = 5; put32(e + 52, 10); put64(e + 40, 3 * 4096 - 100); put64(e + 56, 3 * 4096 - 100);
+    e[64] = 0xC1;
+    for (int i = 0; i < 5; ++i) e[66 + 2 * i] = (uint8_t)"nofat"[i];
+    CHECK_EQ(block_write(d, heap, cl, spc), (int)spc);
+    fill(cl, sizeof(cl), 77);
+    for (uint32_t c = 10; c <= 12; ++c) CHECK_EQ(block_write(d, heap + (c - 2) * spc, cl, spc), (int)spc);
+    CHECK_EQ(block_write(d, heap + (20 - 2) * spc, cl, spc), (int)spc);      // stale data in a free cluster
+    CHECK_EQ(bcache_invalidate(d), 0);
+    CHECK_EQ(vfs_mount("exfat", "xb", "xb"), 0);
+    // fstrim discards cluster 20 but not the file
+    CHECK(vfs_trim("xb") > 0);
+    CHECK_EQ(block_read(d, heap + (11 - 2) * spc, back, spc), (int)spc);
+    CHECK(memcmp(back, cl, sizeof(back)) == 0);
+    CHECK_EQ(block_read(d, heap + (20 - 2) * spc, back, spc), (int)spc);
+    CHECK_EQ(back[0], 0);
+    // New clusters skip the file and are marked in the bitmap
+    CHECK_EQ(vfs_create("xb:/new.bin", 0), 0);
+    vfs_node_t* n = vfs_open("xb:/new.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    static uint8_t big[8 * 4096];
+    fill(big, sizeof(big), 5);
+    CHECK_EQ(vfs_write(n, 0, big, sizeof(big)), sizeof(big));
+    CHECK_EQ(bcache_sync(d), 0);
+    CHECK_EQ(block_read(d, heap + (10 - 2) * spc, back, spc), (int)spc);
+    CHECK(memcmp(back, cl, sizeof(back)) == 0);
+    CHECK_EQ(bit_of(d, bm_lba, 4), 1);
+    // Unlink frees the file by DataLength: bits clear, data discarded
+    CHECK_EQ(vfs_unlink("xb:/nofat"), 0);
+    CHECK_EQ(bcache_sync(d), 0);
+    for (uint32_t c = 10; c <= 12; ++c) CHECK_EQ(bit_of(d, bm_lba, c), 0);
+    CHECK_EQ(bit_of(d, bm_lba, 13), 1);             // new.bin runs past the hole
+    CHECK_EQ(block_read(d, heap + (12 - 2) * spc, back, spc), (int)spc);
+    CHECK_EQ(back[0], 0);
+    CHECK_EQ(vfs_umount("xb"), 0);
+    // A bitmap too short for the heap: fstrim refuses
+    CHECK_EQ(block_read(d, heap, back, spc), (int)spc);
+    put64(back + 24, 1);
+    CHECK_EQ(block_write(d, heap, back, spc), (int)spc);
+    CHECK_EQ(bcache_invalidate(d), 0);
+    CHECK_EQ(vfs_mount("exfat", "xb", "xb"), 0);
+    CHECK_EQ(vfs_trim("xb"), -1);
+    CHECK_EQ(vfs_umount("xb"), 0);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_mkfs_layout);
+    RUN_TEST(test_mount);
+    RUN_TEST(test_write_read_multicluster);
+    RUN_TEST(test_overwrite_and_append);
+    RUN_TEST(test_unlink_reuses_clusters);
+    RUN_TEST(test_unlink_discards);
+    RUN_TEST(test_fstrim);
+    RUN_TEST(test_overlay_root);
+    RUN_TEST(test_loop_image);
+    RUN_TEST(test_raid_volume);
+    RUN_TEST(test_4kn_volume);
+    RUN_TEST(test_bitmap_volume);
+    return TEST_RESULT();
+}
@@ -0,0 +1,138 @@
+// CRC32C (SSE4.2 and tables) and the integrity block device
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel64/cpufeature.h"
+#include "kernel64/block/block.h"
+#include "kernel64/block/integ.h"
+#include "kernel64/lib/crc32c.h"
+#include "kernel64/vfs/vfs.h"
+#include "kernel64/fs/exfat.h"
+
+int ramdisk_create(const char* name, uint64_t bytes);
+void exfat_register(void);
+
+static void pattern(uint8_t* b, uint32_t n, uint32_t seed) { for (uint32_t i = 0; i < n; ++i) b[i] = (uint8_t)(i * 7 + seed); }
+
+// RFC 3720 B.4 vectors, and a split run continuing the CRC
+static void check_vectors(void) {
+    static uint8_t b[4099];
+    CHECK_EQ(crc32c(0, "123456789", 9), 0xE3069283u);
+    memset(b, 0, 32);
+    CHECK_EQ(crc32c(0, b, 32), 0x8A9136AAu);
+    memset(b, 0xFF, 32);
+    CHECK_EQ(crc32c(0, b, 32), 0x62A8AB43u);
+    for (uint32_t i = 0; i < 32; ++i) b[i] = (uint8_t)i;
+    CHECK_EQ(crc32c(0, b, 32), 0x46DD794Eu);
+    CHECK_EQ(crc32c(0, b, 0), 0u);
+    pattern(b, sizeof(b), 1);
+    uint32_t whole = crc32c(0, b + 3, 4096);
+    CHECK_EQ(crc32c(crc32c(0, b + 3, 1001), b + 1004, 3095), whole);
+}
+
+static void test_crc32c_soft(void) {
+    crc32c_use_hw(0);
+    CHECK_EQ(crc32c_hw(), 0);
+    check_vectors();
+}
+
+static void test_crc32c_sse42(void) {
+    if (!__builtin_cpu_supports("sse4.2")) { printf("  (no SSE4.2 on this host)\n"); return; }
+    g_cpu_caps |= 1u << X86_FEATURE_SSE42;
+    crc32c_use_hw(1);
+    CHECK_EQ(crc32c_hw(), 1);
+    check_vectors();
+    // Every alignment and tail length against the tables
+    static uint8_t b[64];
+    pattern(b, sizeof(b), 9);
+    for (uint32_t off = 0; off < 8; ++off)
+        for (uint32_t len = 0; len + off <= sizeof(b); ++len) {
+            crc32c_use_hw(1); uint32_t h = crc32c(0x1234, b + off, len);
+            crc32c_use_hw(0); uint32_t s = crc32c(0x1234, b + off, len);
+            CHECK_EQ(h, s);
+        }
+    crc32c_use_hw(1);
+}
+
+static void test_integ_dev(void) {
+    static uint8_t out[16 * 512], in[16 * 512], bad[512];
+    CHECK_EQ(ramdisk_create("ib0", 1u << 20), 0);
+    CHECK_EQ(integ_create("in0", "nodev"), -1);
+    CHECK_EQ(integ_create("in0", "ib0"), 0);
+    CHECK_EQ(integ_create("in0", "ib0"), -1);           // name taken
+    block_device_t* d = block_find("in0");
+    if (!d) { CHECK(d != NULL); return; }
+    // 2048 sectors: 2031 data, 16 table sectors of 128 entries, superblock
+    CHECK_EQ(d->sector_count, 2031);
+    integ_stats_t st;
+    CHECK_EQ(integ_get_stats("in0", &st), 0);
+    CHECK_EQ(st.built, 2031);
+    CHECK_EQ(st.verify, 1);
+    CHECK_EQ(integ_get_stats("ib0", &st), -1);
+    pattern(out, sizeof(out), 3);
+    CHECK_EQ(block_write(d, 40, out, 16), 16);
+    CHECK_EQ(block_read(d, 40, in, 16), 16);
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    CHECK_EQ(block_read(d, 2030, in, 1), 1);            // last data sector, never written
+    // Corrupt sector 50 behind the device's back
+    memset(bad, 0xEE, sizeof(bad));
+    CHECK_EQ(block_write(block_find("ib0"), 50, bad, 1), 1);
+    CHECK_EQ(block_read(d, 48, in, 4), -1);
+    CHECK_EQ(integ_get_stats("in0", &st), 0);
+    CHECK_EQ(st.mismatches, 1);
+    CHECK_EQ(st.last_bad, 50);
+    CHECK_EQ(block_read(d, 40, in, 10), 10);            // neighbours are fine
+    CHECK_EQ(integ_set_verify("in0", 0), 0);
+    CHECK_EQ(block_read(d, 48, in, 4), 4);
+    CHECK(memcmp(in + 2 * 512, bad, 512) == 0);
+    CHECK_EQ(integ_set_verify("in0", 1), 0);
+    CHECK_EQ(integ_set_verify("ib0", 1), -1);
+    // The host shim runs the scrub thread to completion
+    CHECK_EQ(integ_scrub("in0"), 0);
+    CHECK_EQ(integ_get_stats("in0", &st), 0);
+    CHECK_EQ(st.scrubs, 1);
+    CHECK_EQ(st.scrub_pos, 2031);
+    CHECK_EQ(st.scrub_errors, 1);
+    CHECK_EQ(st.scrubbing, 0);
+    CHECK_EQ(block_write(d, 50, out + 10 * 512, 1), 1);  // rewrite repairs it
+    CHECK_EQ(integ_scrub("in0"), 0);
+    CHECK_EQ(integ_get_stats("in0", &st), 0);
+    CHECK_EQ(st.scrub_errors, 0);
+    // A second instance finds the superblock and loads the table
+    CHECK_EQ(integ_create("in1", "ib0"), 0);
+    CHECK_EQ(integ_get_stats("in1", &st), 0);
+    CHECK_EQ(st.built, 0);
+    CHECK_EQ(block_read(block_find("in1"), 40, in, 16), 16);
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+}
+
+static void test_integ_exfat(void) {
+    CHECK_EQ(ramdisk_create("ib2", 4u << 20), 0);
+    CHECK_EQ(integ_create("in2", "ib2"), 0);
+    CHECK_EQ(exfat_format_device("in2", "CHECKED"), 0);
+    exfat_register();
+    CHECK_EQ(vfs_mount("exfat", "i", "in2"), 0);
+    static uint8_t out[20000], in[20000];
+    pattern(out, sizeof(out), 5);
+    CHECK_EQ(vfs_create("i:/data.bin", 0), 0);
+    vfs_node_t* n = vfs_open("i:/data.bin");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    CHECK_EQ(vfs_read(n, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    CHECK_EQ(integ_scrub("in2"), 0);
+    integ_stats_t st;
+    CHECK_EQ(integ_get_stats("in2", &st), 0);
+    CHECK_EQ(st.scrub_errors, 0);
+    CHECK_EQ(st.mismatches, 0);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_crc32c_soft);
+    RUN_TEST(test_crc32c_sse42);
+    RUN_TEST(test_integ_dev);
+    RUN_TEST(test_integ_exfat);
+    return TEST_RESULT();
+}
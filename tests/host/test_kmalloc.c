@@ -0,0 +1,83 @@
+// kmalloc: first-fit heap with 16-byte alignment and neighbour coalescing
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel/mm/kmalloc.h"
+
+static uint8_t g_arena[64 * 1024] __attribute__((aligned(16)));
+
+static void test_alignment_and_size(void) {
+    kmalloc_init(g_arena, sizeof(g_arena));
+    CHECK(kmalloc(0) == NULL);
+    for (size_t sz = 1; sz < 200; sz += 7) {
+        void* p = kmalloc(sz);
+        CHECK(p != NULL);
+        CHECK_EQ((uintptr_t)p % 16, 0);
+        CHECK(kmalloc_usable_size(p) >= sz);
+        CHECK_EQ(kmalloc_usable_size(p) % 16, 0);
+        kfree(p);
+    }
+    kfree(NULL);
+}
+
+static void test_no_overlap(void) {
+    kmalloc_init(g_arena, sizeof(g_arena));
+    uint8_t* p[32];
+    for (int i = 0; i < 32; ++i) { p[i] = kmalloc(100 + i * 10); CHECK(p[i] != NULL); memset(p[i], i, 100 + i * 10); }
+    for (int i = 0; i < 32; ++i) {
+        for (int k = 0; k < 100 + i * 10; ++k) if (p[i][k] != (uint8_t)i) { CHECK(!"block clobbered"); break; }
+    }
+    for (int i = 0; i < 32; ++i) kfree(p[i]);
+}
+
+static void test_coalesce(void) {
+    kmalloc_init(g_arena, sizeof(g_arena));
+    void* a = kmalloc(1000); void* b = kmalloc(1000); void* c = kmalloc(1000);
+    CHECK(a && b && c);
+    kfree(b); kfree(a); kfree(c);
+    // After coalescing the whole arena is one free block again
+    void* big = kmalloc(sizeof(g_arena) - 64);
+    CHECK(big != NULL);
+    CHECK(big == a);
+    kfree(big);
+}
+
+static void test_exhaustion(void) {
+    kmalloc_init(g_arena, sizeof(g_arena));
+    CHECK(kmalloc(sizeof(g_arena)) == NULL);
+    int n = 0;
+    while (kmalloc(1024)) ++n;
+    CHECK(n > 0 && n < (int)(sizeof(g_arena) / 1024));
+}
+
+static void test_random_churn(void) {
+    kmalloc_init(g_arena, sizeof(g_arena));
+    enum { SLOTS = 64 };
+    uint8_t* p[SLOTS] = { 0 }; size_t len[SLOTS] = { 0 };
+    uint32_t seed = 12345;
+    for (int it = 0; it < 20000; ++it) {
+        seed = seed * 1103515245u + 12345u;
+        int s = (int)((seed >> 16) % SLOTS);
+        if (p[s]) {
+            for (size_t k = 0; k < len[s]; ++k) if (p[s][k] != (uint8_t)s) { CHECK(!"churn corruption"); return; }
+            kfree(p[s]); p[s] = NULL;
+        } else {
+            len[s] = 1 + (seed >> 8) % 700;
+            p[s] = kmalloc(len[s]);
+            if (p[s]) memset(p[s], s, len[s]);
+        }
+    }
+    for (int s = 0; s < SLOTS; ++s) kfree(p[s]);
+    CHECK(kmalloc(sizeof(g_arena) - 64) != NULL);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_alignment_and_size);
+    RUN_TEST(test_no_overlap);
+    RUN_TEST(test_coalesce);
+    RUN_TEST(test_exhaustion);
+    RUN_TEST(test_random_churn);
+    return TEST_RESULT();
+}
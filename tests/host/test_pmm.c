@@ -0,0 +1,91 @@
+// PMM: bitmap frame allocator over the fake physical range
+#include <stdint.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel/mm/pmm.h"
+
+#define FRAMES (HOST_PHYS_BYTES / PMM_FRAME_SIZE)
+
+static void test_init_accounting(void) {
+    CHECK_EQ(pmm_total_bytes(), HOST_PHYS_BYTES);
+    // The first frame is reserved so no allocation returns the region base
+    CHECK_EQ(pmm_free_bytes(), HOST_PHYS_BYTES - PMM_FRAME_SIZE);
+}
+
+static void test_alloc_free_single(void) {
+    uint64_t before = pmm_free_bytes();
+    uint64_t a = pmm_alloc_frames(1);
+    CHECK(a >= HOST_PHYS_BASE + PMM_FRAME_SIZE && a < HOST_PHYS_BASE + HOST_PHYS_BYTES);
+    CHECK_EQ(a % PMM_FRAME_SIZE, 0);
+    CHECK_EQ(pmm_free_bytes(), before - PMM_FRAME_SIZE);
+    *(volatile uint64_t*)(uintptr_t)a = 0x1122334455667788ull;
+    pmm_free_frames(a, 1);
+    CHECK_EQ(pmm_free_bytes(), before);
+    // First fit: the same frame comes back
+    uint64_t b = pmm_alloc_frames(1);
+    CHECK_EQ(b, a);
+    pmm_free_frames(b, 1);
+}
+
+static void test_contiguous_runs(void) {
+    uint64_t a = pmm_alloc_frames(16);
+    uint64_t b = pmm_alloc_frames(16);
+    CHECK(a && b);
+    CHECK(b >= a + 16 * PMM_FRAME_SIZE || a >= b + 16 * PMM_FRAME_SIZE);
+    // A hole of 16 frames is reused by a 16-frame request but skipped by 17
+    pmm_free_frames(a, 16);
+    uint64_t c = pmm_alloc_frames(17);
+    CHECK(c != a);
+    uint64_t d = pmm_alloc_frames(16);
+    CHECK_EQ(d, a);
+    pmm_free_frames(b, 16); pmm_free_frames(c, 17); pmm_free_frames(d, 16);
+}
+
+static void test_alloc_below(void) {
+    uint64_t limit = HOST_PHYS_BASE + 8 * PMM_FRAME_SIZE;
+    uint64_t a = pmm_alloc_frames_below(4, limit);
+    CHECK(a != 0);
+    CHECK(a + 4 * PMM_FRAME_SIZE <= limit);
+    // Only 3 frames remain below the limit (frame 0 is reserved)
+    CHECK_EQ(pmm_alloc_frames_below(4, limit), 0);
+    CHECK_EQ(pmm_alloc_frames_below(1, HOST_PHYS_BASE), 0);
+    pmm_free_frames(a, 4);
+}
+
+static void test_double_free_and_reserve(void) {
+    uint64_t before = pmm_free_bytes();
+    uint64_t a = pmm_alloc_frames(2);
+    pmm_free_frames(a, 2);
+    pmm_free_frames(a, 2);
+    CHECK_EQ(pmm_free_bytes(), before);
+    // Freeing outside the managed range is ignored
+    pmm_free_frames(HOST_PHYS_BASE + HOST_PHYS_BYTES, 1);
+    CHECK_EQ(pmm_free_bytes(), before);
+    pmm_reserve(a, 2 * PMM_FRAME_SIZE);
+    CHECK_EQ(pmm_free_bytes(), before - 2 * PMM_FRAME_SIZE);
+    pmm_free_frames(a, 2);
+    CHECK_EQ(pmm_free_bytes(), before);
+}
+
+static void test_exhaustion(void) {
+    uint64_t before = pmm_free_bytes();
+    uint64_t n = 0;
+    while (pmm_alloc_frames(1)) ++n;
+    CHECK_EQ(n, before / PMM_FRAME_SIZE);
+    CHECK_EQ(pmm_free_bytes(), 0);
+    CHECK_EQ(pmm_alloc_frames(1), 0);
+    pmm_free_frames(HOST_PHYS_BASE + PMM_FRAME_SIZE, FRAMES - 1);
+    CHECK_EQ(pmm_free_bytes(), before);
+    CHECK(pmm_alloc_frames(FRAMES) == 0);
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_init_accounting);
+    RUN_TEST(test_alloc_free_single);
+    RUN_TEST(test_contiguous_runs);
+    RUN_TEST(test_alloc_below);
+    RUN_TEST(test_double_free_and_reserve);
+    RUN_TEST(test_exhaustion);
+    return TEST_RESULT();
+}
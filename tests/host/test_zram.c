@@ -0,0 +1,161 @@
+// LZ4 block codec and the compressed RAM disk (zram), including exFAT on it
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "host_shim.h"
+#include "kernel64/block/block.h"
+#include "kernel64/block/zram.h"
+#include "kernel64/lib/lz4.h"
+#include "kernel64/vfs/vfs.h"
+#include "kernel64/fs/exfat.h"
+#include "kernel/mm/pmm.h"
+
+void exfat_register(void);
+
+static void fill_random(uint8_t* b, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; ++i) { seed = seed * 1664525u + 1013904223u; b[i] = (uint8_t)(seed >> 24); }
+}
+// Text-like data: words from a small vocabulary
+static void fill_text(uint8_t* b, size_t n, uint32_t seed) {
+    static const char* words[] = { "block ", "device ", "sector ", "cache ", "exfat ", "queue ", "\n" };
+    size_t i = 0;
+    while (i < n) {
+        seed = seed * 1664525u + 1013904223u;
+        const char* w = words[(seed >> 24) % 7];
+        while (*w && i < n) b[i++] = (uint8_t)*w++;
+    }
+}
+
+static void roundtrip(const uint8_t* in, uint32_t n, int expect_smaller) {
+    static uint8_t c[LZ4_BOUND(65536)], out[65536];
+    uint32_t cl = lz4_compress(in, n, c, sizeof(c));
+    CHECK(cl > 0);
+    if (expect_smaller) CHECK(cl < n / 2);
+    CHECK_EQ(lz4_decompress(c, cl, out, n), (int)n);
+    CHECK(memcmp(in, out, n) == 0);
+}
+
+static void test_lz4_roundtrip(void) {
+    static uint8_t buf[65536];
+    memset(buf, 0, sizeof(buf));
+    roundtrip(buf, 4096, 1);
+    roundtrip(buf, 65536, 1);
+    fill_text(buf, 4096, 7);
+    roundtrip(buf, 4096, 1);
+    fill_random(buf, 4096, 3);
+    roundtrip(buf, 4096, 0);
+    for (uint32_t n = 1; n < 40; ++n) { fill_text(buf, n, n); roundtrip(buf, n, 0); }
+    // Long overlapping match: one byte repeated after a literal run
+    for (int i = 0; i < 1000; ++i) buf[i] = (uint8_t)(i < 3 ? 'a' + i : 'z');
+    roundtrip(buf, 1000, 1);
+}
+
+static void test_lz4_limits(void) {
+    static uint8_t in[4096], c[LZ4_BOUND(4096)], out[4096];
+    fill_random(in, sizeof(in), 9);
+    CHECK_EQ(lz4_compress(in, sizeof(in), c, 3072), 0);     // does not fit
+    CHECK_EQ(lz4_compress(in, 0, c, sizeof(c)), 0);
+    fill_text(in, sizeof(in), 5);
+    uint32_t cl = lz4_compress(in, sizeof(in), c, sizeof(c));
+    CHECK(cl > 0);
+    CHECK_EQ(lz4_decompress(c, cl, out, 100), -1);          // output too small
+    CHECK(lz4_decompress(c, cl - 3, out, sizeof(out)) != (int)sizeof(in));
+    uint8_t bad[] = { 0x04, 'a', 0x05, 0x00 };              // offset past the start
+    CHECK_EQ(lz4_decompress(bad, sizeof(bad), out, sizeof(out)), -1);
+}
+
+static void test_zram_io(void) {
+    CHECK_EQ(zram_create("zr0", 1u << 20), 0);
+    block_device_t* d = block_find("zr0");
+    if (!d) { CHECK(d != NULL); return; }
+    zram_stats_t st;
+    CHECK_EQ(zram_get_stats("zr0", &st), 0);
+    CHECK_EQ(st.disk_bytes, 1u << 20);
+    CHECK_EQ(st.pool_bytes, 0);                 // nothing allocated until written
+    CHECK_EQ(zram_get_stats("nope", &st), -1);
+    static uint8_t w[16 * 512], r[16 * 512];
+    memset(r, 0xFF, sizeof(r));
+    CHECK_EQ(d->ops->read(d, 0, r, 16), 16);    // unwritten pages read as zeros
+    for (size_t i = 0; i < sizeof(r); ++i) if (r[i]) { CHECK(!"not zero"); break; }
+    // Aligned text pages, an incompressible page and a zero page
+    fill_text(w, 8 * 512, 1);
+    fill_random(w + 8 * 512, 8 * 512, 2);
+    CHECK_EQ(d->ops->write(d, 8, w, 16), 16);
+    memset(w, 0, 8 * 512);
+    CHECK_EQ(d->ops->write(d, 24, w, 8), 8);
+    CHECK_EQ(zram_get_stats("zr0", &st), 0);
+    CHECK_EQ(st.stored_pages, 2); CHECK_EQ(st.huge_pages, 1); CHECK_EQ(st.zero_pages, 1);
+    CHECK(st.compr_bytes < 4096 + 2048);
+    // Unaligned partial-page write straddling two pages
+    fill_text(w, 16 * 512, 1);
+    fill_random(w + 8 * 512, 8 * 512, 2);
+    uint8_t p[3 * 512];
+    memset(p, 0xAB, sizeof(p));
+    CHECK_EQ(d->ops->write(d, 14, p, 3), 3);
+    memcpy(w + 6 * 512, p, sizeof(p));
+    CHECK_EQ(d->ops->read(d, 8, r, 16), 16);
+    CHECK(memcmp(r, w, sizeof(w)) == 0);
+    CHECK_EQ(d->ops->read(d, d->sector_count - 1, r, 2), -1);
+    // Overwriting with zeros releases the stored page
+    memset(w, 0, sizeof(w));
+    CHECK_EQ(d->ops->write(d, 8, w, 16), 16);
+    CHECK_EQ(zram_get_stats("zr0", &st), 0);
+    CHECK_EQ(st.stored_pages, 0); CHECK_EQ(st.compr_bytes, 0); CHECK_EQ(st.zero_pages, 3);
+    CHECK_EQ(st.pool_bytes, 0);                 // empty slabs went back to the PMM
+}
+
+static void test_zram_discard_reclaims(void) {
+    uint64_t before = pmm_free_bytes();
+    CHECK_EQ(zram_create("zr2", 1u << 20), 0);
+    block_device_t* d = block_find("zr2");
+    if (!d) { CHECK(d != NULL); return; }
+    uint64_t after_create = pmm_free_bytes();
+    static uint8_t w[64 * 4096];
+    for (uint32_t i = 0; i < 64; ++i) fill_text(w + i * 4096, 4096, i + 1);
+    fill_random(w + 60 * 4096, 4 * 4096, 5);    // a few raw pages too
+    CHECK_EQ(d->ops->write(d, 0, w, 64 * 8), 64 * 8);
+    zram_stats_t st;
+    CHECK_EQ(zram_get_stats("zr2", &st), 0);
+    CHECK(st.pool_bytes > 0);
+    CHECK_EQ(pmm_free_bytes(), after_create - st.pool_bytes);
+    // Discarding half keeps the other half readable; discarding all frees the pool
+    CHECK_EQ(d->ops->discard(d, 0, 32 * 8), 0);
+    static uint8_t r[32 * 4096];
+    CHECK_EQ(d->ops->read(d, 32 * 8, r, 32 * 8), 32 * 8);
+    CHECK(memcmp(r, w + 32 * 4096, sizeof(r)) == 0);
+    CHECK_EQ(d->ops->discard(d, 32 * 8, 32 * 8), 0);
+    CHECK_EQ(zram_get_stats("zr2", &st), 0);
+    CHECK_EQ(st.stored_pages, 0);
+    CHECK_EQ(st.pool_bytes, 0);
+    CHECK_EQ(pmm_free_bytes(), after_create);
+    CHECK(before - after_create < (64u << 10));  // only the page table and slab index remain
+}
+
+static void test_zram_exfat(void) {
+    CHECK_EQ(zram_create("zr1", 8u << 20), 0);
+    CHECK_EQ(exfat_format_device("zr1", "ZRAM"), 0);
+    exfat_register();
+    CHECK_EQ(vfs_mount("exfat", "z", "zr1"), 0);
+    static uint8_t out[40000], in[40000];
+    fill_text(out, sizeof(out), 11);
+    CHECK_EQ(vfs_create("z:/notes.txt", 0), 0);
+    vfs_node_t* n = vfs_open("z:/notes.txt");
+    if (!n) { CHECK(n != NULL); return; }
+    CHECK_EQ(vfs_write(n, 0, out, sizeof(out)), sizeof(out));
+    vfs_node_t* r = vfs_open("z:/notes.txt");
+    CHECK_EQ(vfs_read(r, 0, in, sizeof(in)), sizeof(in));
+    CHECK(memcmp(in, out, sizeof(in)) == 0);
+    zram_stats_t st;
+    CHECK_EQ(zram_get_stats("zr1", &st), 0);
+    CHECK(st.pool_bytes + st.meta_bytes < (1u << 20));   // far below the 8 MiB disk
+}
+
+int main(void) {
+    host_kernel_init();
+    RUN_TEST(test_lz4_roundtrip);
+    RUN_TEST(test_lz4_limits);
+    RUN_TEST(test_zram_io);
+    RUN_TEST(test_zram_discard_reclaims);
+    RUN_TEST(test_zram_exfat);
+    return TEST_RESULT();
+}